@@ -134,6 +134,16 @@ struct block_t
  *      with preheader and or body (increase
  *      and decrease are supported). Use it as it is optimised.
  * - block_Duplicate : create a copy of a block.
+ * - block_Share : turn a block into one whose payload can be shared without
+ *      copying. The payload of a shared block is read-only, even when it has
+ *      a single reference left: block_Realloc makes a private copy before any
+ *      modification, and code writing to a payload in place must call
+ *      block_Writable first.
+ * - block_Clone : create a new reference to the payload of a shared block
+ *      (falls back to block_Duplicate for other blocks).
+ * - block_IsShareable : whether block_Clone can avoid copying the payload.
+ * - block_Writable : get a block whose payload can be modified in place
+ *      (copies the payload if it is shared).
  ****************************************************************************/
 VLC_API void block_Init( block_t *, void *, size_t );
 VLC_API block_t *block_Alloc( size_t ) VLC_USED VLC_MALLOC;
@@ -166,6 +176,11 @@ static inline void block_Release( block_t *p_block )
     p_block->pf_release( p_block );
 }
 
+VLC_API block_t *block_Share( block_t * ) VLC_USED;
+VLC_API block_t *block_Clone( block_t * ) VLC_USED;
+VLC_API bool block_IsShareable( const block_t * ) VLC_USED;
+VLC_API block_t *block_Writable( block_t * ) VLC_USED;
+
 VLC_API block_t *block_heap_Alloc(void *, size_t) VLC_USED VLC_MALLOC;
 VLC_API block_t *block_mmap_Alloc(void *addr, size_t length) VLC_USED VLC_MALLOC;
 VLC_API block_t * block_shm_Alloc(void *addr, size_t length) VLC_USED VLC_MALLOC;
@@ -325,6 +340,7 @@ VLC_API void vlc_fifo_Signal(vlc_fifo_t *);
 VLC_API void vlc_fifo_Wait(vlc_fifo_t *);
 VLC_API void vlc_fifo_WaitCond(vlc_fifo_t *, vlc_cond_t *);
 VLC_API void vlc_fifo_QueueUnlocked(vlc_fifo_t *, block_t *);
+VLC_API void vlc_fifo_Push(vlc_fifo_t *, block_t *);
 VLC_API block_t *vlc_fifo_DequeueUnlocked(vlc_fifo_t *) VLC_USED;
 VLC_API block_t *vlc_fifo_DequeueAllUnlocked(vlc_fifo_t *) VLC_USED;
 VLC_API size_t vlc_fifo_GetCount(const vlc_fifo_t *) VLC_USED;
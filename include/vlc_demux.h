@@ -152,6 +152,10 @@ enum demux_query_e
     DEMUX_GET_SIGNAL, /* arg1=double *pf_quality, arg2=double *pf_strength
                          res=can fail */
 
+    /* Duration of media read ahead and not demuxed yet, e.g. downloaded
+     * segments of adaptive streams */
+    DEMUX_GET_BUFFER_LEVEL,     /* arg1= int64_t *      res=can fail */
+
     /* II. Specific access_demux queries */
     /* PAUSE you are ensured that it is never called twice with the same state */
     DEMUX_CAN_PAUSE = 0x1000,   /* arg1= bool*    can fail (assume false)*/
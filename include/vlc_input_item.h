@@ -337,6 +337,7 @@ struct input_stats_t
     float f_average_demux_bitrate;
     int64_t i_demux_corrupted;
     int64_t i_demux_discontinuity;
+    float f_demux_buffer_level; /* seconds read ahead, if known */
 
     /* Decoders */
     int64_t i_decoded_audio;
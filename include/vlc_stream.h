@@ -69,6 +69,9 @@ struct stream_t
     int         (*pf_peek)   ( stream_t *, const uint8_t **pp_peek, unsigned int i_peek );
     int         (*pf_readdir)( stream_t *, input_item_node_t * );
     int         (*pf_control)( stream_t *, int i_query, va_list );
+    /* Optional, see stream_BlockShared(). The block may reference read-only data
+     * (see block_Share()). */
+    block_t    *(*pf_block)  ( stream_t *, unsigned int i_read );
 
     /* */
     void     (*pf_destroy)( stream_t *);
@@ -120,6 +123,8 @@ enum stream_query_e
 
     /* XXX only data read through stream_Read/Block will be recorded */
     STREAM_SET_RECORD_STATE,     /**< arg1=bool, arg2=const char *psz_ext (if arg1 is true)  res=can fail */
+    /* Records data the caller had read ahead before recording started */
+    STREAM_RECORD_DATA,          /**< arg1=const void *p_data, arg2=size_t i_data  res=can fail */
 
     STREAM_SET_PRIVATE_ID_STATE = 0x1000, /* arg1= int i_private_data, bool b_selected    res=can fail */
     STREAM_SET_PRIVATE_ID_CA,             /* arg1= int i_program_number, uint16_t i_vpid, uint16_t i_apid1, uint16_t i_apid2, uint16_t i_apid3, uint8_t i_length, uint8_t *p_data */
@@ -132,6 +137,7 @@ VLC_API int stream_vaControl( stream_t *s, int i_query, va_list args );
 VLC_API void stream_Delete( stream_t *s );
 VLC_API int stream_Control( stream_t *s, int i_query, ... );
 VLC_API block_t * stream_Block( stream_t *s, int i_size );
+VLC_API block_t * stream_BlockShared( stream_t *s, int i_size );
 VLC_API block_t * stream_BlockRemaining( stream_t *s, int i_max_size );
 VLC_API char * stream_ReadLine( stream_t * );
 VLC_API int stream_ReadDir( stream_t *, input_item_node_t * );
@@ -57,6 +57,7 @@ static int Control(stream_t *p_stream, int i_query, va_list args)
         case STREAM_SET_POSITION:
         case STREAM_UPDATE_SIZE:
         case STREAM_SET_RECORD_STATE:
+        case STREAM_RECORD_DATA:
         case STREAM_GET_CONTENT_TYPE:
             return VLC_EGENERIC;
 
@@ -52,6 +52,9 @@
 #   include <unistd.h>
 #endif
 #include <dirent.h>
+#ifdef HAVE_MMAP
+#   include <sys/mman.h>
+#endif
 
 #include <vlc_common.h>
 #include "fs.h"
@@ -63,6 +66,7 @@
 #endif
 #include <vlc_fs.h>
 #include <vlc_url.h>
+#include <vlc_block.h>
 
 struct access_sys_t
 {
@@ -70,6 +74,11 @@ struct access_sys_t
 
     bool b_pace_control;
     uint64_t size;
+
+#ifdef HAVE_MMAP
+    block_t *map; /* shareable block over the mapped window */
+    uint64_t map_offset; /* file offset of the mapped window */
+#endif
 };
 
 #if !defined (_WIN32) && !defined (__OS2__)
@@ -129,6 +138,9 @@ static bool IsRemote (const char *path)
 #endif
 
 static ssize_t FileRead (access_t *, uint8_t *, size_t);
+#ifdef HAVE_MMAP
+static block_t *FileBlock (access_t *);
+#endif
 static int FileSeek (access_t *, uint64_t);
 static ssize_t StreamRead (access_t *, uint8_t *, size_t);
 static int NoSeek (access_t *, uint64_t);
@@ -223,6 +235,9 @@ int FileOpen( vlc_object_t *p_this )
     p_access->pf_control = FileControl;
     p_access->p_sys = p_sys;
     p_sys->fd = fd;
+#ifdef HAVE_MMAP
+    p_sys->map = NULL;
+#endif
 
     if (S_ISREG (st.st_mode) || S_ISBLK (st.st_mode))
     {
@@ -243,6 +258,18 @@ int FileOpen( vlc_object_t *p_this )
             fcntl (fd, F_RDAHEAD, 0);
         else
             fcntl (fd, F_RDAHEAD, 1);
+#endif
+#ifdef HAVE_MMAP
+        /* Hand out blocks from a mapping of the file, rather than copies.
+         * Only for local regular files: if the file is truncated while it is
+         * mapped, reading beyond its new end raises SIGBUS. */
+        if (S_ISREG (st.st_mode) && !IsRemote(fd, p_access->psz_filepath)
+         && var_InheritBool (p_access, "file-mmap"))
+        {
+            msg_Dbg (p_access, "using memory mapping");
+            p_access->pf_read = NULL;
+            p_access->pf_block = FileBlock;
+        }
 #endif
     }
     else
@@ -267,7 +294,7 @@ void FileClose (vlc_object_t * p_this)
 {
     access_t     *p_access = (access_t*)p_this;
 
-    if (p_access->pf_read == NULL)
+    if (p_access->pf_read == NULL && p_access->pf_block == NULL)
     {
         DirClose (p_this);
         return;
@@ -275,6 +302,10 @@ void FileClose (vlc_object_t * p_this)
 
     access_sys_t *p_sys = p_access->p_sys;
 
+#ifdef HAVE_MMAP
+    if (p_sys->map != NULL)
+        block_Release (p_sys->map);
+#endif
     close (p_sys->fd);
     free (p_sys);
 }
@@ -319,6 +350,119 @@ static ssize_t FileRead (access_t *p_access, uint8_t *p_buffer, size_t i_len)
     return val;
 }
 
+#ifdef HAVE_MMAP
+/* Largest mapping: the whole file on 64-bits systems, but only a window of it
+ * where address space is scarce. */
+#define MMAP_WINDOW_SIZE (sizeof (void *) >= 8 ? UINT64_C(1) << 40 \
+                                               : UINT64_C(32) << 20)
+/* Size of the blocks handed out */
+#define MMAP_BLOCK_SIZE  (1 << 20)
+
+/**
+ * Maps the window of the file starting at or just before the given offset.
+ */
+static int FileMap (access_t *p_access, uint64_t offset)
+{
+    access_sys_t *p_sys = p_access->p_sys;
+    const uint64_t page = sysconf (_SC_PAGESIZE);
+
+    if (p_sys->map != NULL)
+    {
+        block_Release (p_sys->map);
+        p_sys->map = NULL;
+    }
+
+    offset -= offset % page;
+
+    uint64_t length = p_sys->size - offset;
+    if (length > MMAP_WINDOW_SIZE)
+        length = MMAP_WINDOW_SIZE;
+    if (length > SIZE_MAX)
+        length = SIZE_MAX - (SIZE_MAX % page);
+
+    /* Read-only mapping: the blocks are shared (see block_Share()), so they
+     * are copied before being modified, and data read again after seeking
+     * back are never those modified by a previous reader. */
+    void *addr = mmap (NULL, length, PROT_READ, MAP_SHARED,
+                       p_sys->fd, offset);
+    if (addr == MAP_FAILED)
+    {
+        msg_Err (p_access, "memory mapping error: %s", vlc_strerror_c(errno));
+        return VLC_EGENERIC;
+    }
+    posix_madvise (addr, length, POSIX_MADV_SEQUENTIAL);
+
+    block_t *block = block_mmap_Alloc (addr, length);
+    if (unlikely(block == NULL))
+        return VLC_ENOMEM;
+
+    p_sys->map = block_Share (block);
+    p_sys->map_offset = offset;
+    return VLC_SUCCESS;
+}
+
+/**
+ * Reads from a regular file without copying, through a memory mapping.
+ */
+static block_t *FileBlock (access_t *p_access)
+{
+    access_sys_t *p_sys = p_access->p_sys;
+    uint64_t pos = p_access->info.i_pos;
+
+    if (pos >= p_sys->size)
+    {   /* The file may have grown */
+        struct stat st;
+
+        if (fstat (p_sys->fd, &st) == 0)
+            p_sys->size = st.st_size;
+        if (pos >= p_sys->size)
+        {
+            p_access->info.b_eof = true;
+            return NULL;
+        }
+    }
+
+    if (p_sys->map == NULL || pos < p_sys->map_offset
+     || pos >= p_sys->map_offset + p_sys->map->i_buffer)
+    {
+        if (FileMap (p_access, pos))
+        {
+            dialog_Fatal (p_access, _("File reading failed"),
+                          _("VLC could not read the file (%s)."),
+                          vlc_strerror(errno));
+            p_access->info.b_eof = true;
+            return NULL;
+        }
+    }
+
+    size_t offset = pos - p_sys->map_offset;
+    size_t length = p_sys->map->i_buffer - offset;
+    if (length > MMAP_BLOCK_SIZE)
+        length = MMAP_BLOCK_SIZE;
+
+    block_t *block = block_Clone (p_sys->map);
+    if (unlikely(block == NULL))
+        return NULL;
+    block->p_buffer += offset;
+    block->i_buffer = length;
+
+    /* Have the next block paged in while this one is being demuxed */
+    size_t next = offset + length;
+    if (next < p_sys->map->i_buffer)
+    {
+        size_t page = sysconf (_SC_PAGESIZE);
+        size_t ahead = p_sys->map->i_buffer - next;
+
+        if (ahead > MMAP_BLOCK_SIZE)
+            ahead = MMAP_BLOCK_SIZE;
+        posix_madvise (p_sys->map->p_buffer + next - (next % page),
+                       ahead + (next % page), POSIX_MADV_WILLNEED);
+    }
+
+    p_access->info.i_pos += length;
+    return block;
+}
+#endif
 
 /*****************************************************************************
  * Seek: seek to a specific location in a file
@@ -43,6 +43,12 @@ static const char *const psz_sort_list_text[] = {
     N_("Sort items in a natural order (for example: 1.ogg 2.ogg 10.ogg). This method does not take the current language's collation rules into account."),
     N_("Do not sort the items.") };
 
+#define MMAP_TEXT N_("Memory mapping")
+#define MMAP_LONGTEXT N_( \
+    "Read local files through a memory mapping instead of copying their " \
+    "data. This avoids a copy of all the data read, but VLC may crash if " \
+    "the file is truncated while it is played." )
+
 #define SORT_TEXT N_("Directory sort order")
 #define SORT_LONGTEXT N_( \
     "Define the sort algorithm used when adding items from a directory." )
@@ -56,6 +62,7 @@ vlc_module_begin ()
     set_capability( "access", 50 )
     add_shortcut( "file", "fd", "stream" )
     set_callbacks( FileOpen, FileClose )
+    add_bool( "file-mmap", false, MMAP_TEXT, MMAP_LONGTEXT, true )
 
     add_submodule()
     set_section( N_("Directory" ), NULL )
@@ -50,6 +50,9 @@
 
 #include <assert.h>
 #include <limits.h>
+#ifdef HAVE_POLL
+# include <poll.h>
+#endif
 
 /*****************************************************************************
  * Module descriptor
@@ -78,6 +81,12 @@ static void Close( vlc_object_t * );
     "You should not globally enable this option as it will break all other " \
     "types of HTTP streams." )
 
+#define KEEP_ALIVE_TEXT N_("Persistent connections")
+#define KEEP_ALIVE_LONGTEXT N_( \
+    "Keep the connection to the server open when seeking, and reuse idle " \
+    "connections to the same server, rather than connecting anew for " \
+    "every request." )
+
 #define FORWARD_COOKIES_TEXT N_("Forward Cookies")
 #define FORWARD_COOKIES_LONGTEXT N_("Forward Cookies across http redirections.")
 
@@ -112,6 +121,8 @@ vlc_module_begin ()
     add_bool( "http-continuous", false, CONTINUOUS_TEXT,
               CONTINUOUS_LONGTEXT, true )
         change_safe()
+    add_bool( "http-keep-alive", true, KEEP_ALIVE_TEXT,
+              KEEP_ALIVE_LONGTEXT, true )
     add_bool( "http-forward-cookies", true, FORWARD_COOKIES_TEXT,
               FORWARD_COOKIES_LONGTEXT, true )
     /* 'itpc' = iTunes Podcast */
@@ -182,8 +193,22 @@ struct access_sys_t
     bool b_pace_control;
     bool b_persist;
     bool b_has_size;
+
+    /* Persistent connections */
+    bool b_keep_alive;
+    mtime_t i_idle_timeout;
+    unsigned i_conn_new;
+    unsigned i_conn_reused;
 };
 
+/* Largest amount of data read and discarded to keep a connection instead of
+ * closing it, either to skip forward or to finish the current response */
+#define HTTP_DRAIN_MAX (64 * 1024)
+/* Idle connections kept for later accesses to the same server */
+#define HTTP_POOL_SIZE 8
+/* How long an idle connection is kept, unless the server says otherwise */
+#define HTTP_IDLE_TIMEOUT (10 * CLOCK_FREQ)
+
 /* */
 static int OpenRedirected( vlc_object_t *p_this, const char *psz_access,
                            unsigned i_redirect );
@@ -198,7 +223,12 @@ static int Control( access_t *, int, va_list );
 static int Connect( access_t *, uint64_t );
 static int Request( access_t *p_access, uint64_t i_tell );
 static void Disconnect( access_t * );
+static bool Reusable( access_t * );
 
+static void PoolHold( void );
+static void PoolRelease( void );
+static int  PoolTake( const vlc_url_t * );
+static void PoolPut( const vlc_url_t *, int, mtime_t );
 
 static void AuthReply( access_t *p_acces, const char *psz_prefix,
                        vlc_url_t *p_url, http_auth_t *p_auth );
@@ -212,7 +242,12 @@ static vlc_http_cookie_jar_t *GetCookieJar( vlc_object_t *p_this );
 static int Open( vlc_object_t *p_this )
 {
     access_t *p_access = (access_t*)p_this;
-    return OpenRedirected( p_this, p_access->psz_access, 5 );
+
+    PoolHold();
+    int i_ret = OpenRedirected( p_this, p_access->psz_access, 5 );
+    if( i_ret != VLC_SUCCESS )
+        PoolRelease();
+    return i_ret;
 }
 
 /**
@@ -268,6 +303,9 @@ static int OpenRedirected( vlc_object_t *p_this, const char *psz_access,
     p_sys->b_persist = false;
     p_sys->b_has_size = false;
     p_sys->size = 0;
+    p_sys->i_idle_timeout = HTTP_IDLE_TIMEOUT;
+    p_sys->i_conn_new = 0;
+    p_sys->i_conn_reused = 0;
     p_access->info.i_pos  = 0;
     p_access->info.b_eof  = false;
 
@@ -402,6 +440,7 @@ static int OpenRedirected( vlc_object_t *p_this, const char *psz_access,
 
     p_sys->b_reconnect = var_InheritBool( p_access, "http-reconnect" );
     p_sys->b_continuous = var_InheritBool( p_access, "http-continuous" );
+    p_sys->b_keep_alive = var_InheritBool( p_access, "http-keep-alive" );
 
 connect:
     /* Connect */
@@ -604,9 +643,7 @@ static void Close( vlc_object_t *p_this )
     access_t     *p_access = (access_t*)p_this;
     access_sys_t *p_sys = p_access->p_sys;
 
-    vlc_UrlClean( &p_sys->url );
     http_auth_Reset( &p_sys->auth );
-    vlc_UrlClean( &p_sys->proxy );
     http_auth_Reset( &p_sys->proxy_auth );
 
     free( p_sys->psz_mime );
@@ -620,8 +657,23 @@ static void Close( vlc_object_t *p_this )
     free( p_sys->psz_user_agent );
     free( p_sys->psz_referrer );
 
+    msg_Dbg( p_access, "%u new connection(s), %u reused connection(s)",
+             p_sys->i_conn_new, p_sys->i_conn_reused );
+
+    /* TLS sessions belong to our credentials, only plain connections can
+     * outlive the access */
+    if( p_sys->p_tls == NULL && Reusable( p_access ) )
+    {
+        PoolPut( p_sys->b_proxy ? &p_sys->proxy : &p_sys->url, p_sys->fd,
+                 p_sys->i_idle_timeout );
+        p_sys->fd = -1;
+    }
     Disconnect( p_access );
     vlc_tls_Delete( p_sys->p_creds );
+    PoolRelease();
+
+    vlc_UrlClean( &p_sys->url );
+    vlc_UrlClean( &p_sys->proxy );
 
 #ifdef HAVE_ZLIB_H
     inflateEnd( &p_sys->inflate.stream );
@@ -905,15 +957,41 @@ static ssize_t ReadCompressed( access_t *p_access, uint8_t *p_buffer,
 }
 #endif
 
+/* Reads and discards data from the current response */
+static bool Skip( access_t *p_access, uint64_t i_skip )
+{
+    uint8_t p_buffer[4096];
+
+    while( i_skip > 0 )
+    {
+        ssize_t i_read = Read( p_access, p_buffer,
+                               __MIN( i_skip, sizeof( p_buffer ) ) );
+        if( i_read <= 0 )
+            return false;
+        i_skip -= i_read;
+    }
+    return true;
+}
+
 /*****************************************************************************
- * Seek: close and re-open a connection at the right place
+ * Seek: skip forward, or request the new position from the server
  *****************************************************************************/
 static int Seek( access_t *p_access, uint64_t i_pos )
 {
     access_sys_t *p_sys = p_access->p_sys;
+    const uint64_t i_cur = p_access->info.i_pos;
 
     msg_Dbg( p_access, "trying to seek to %"PRId64, i_pos );
-    Disconnect( p_access );
+
+    /* A short jump forward within the current response is cheaper to read
+     * through than to request */
+    if( p_sys->fd != -1 && p_sys->b_has_size && !p_access->info.b_eof
+     && i_pos >= i_cur && i_pos - i_cur <= HTTP_DRAIN_MAX
+     && i_pos - i_cur < p_sys->i_remaining && Skip( p_access, i_pos - i_cur ) )
+        return VLC_SUCCESS;
+
+    if( !Reusable( p_access ) )
+        Disconnect( p_access );
 
     if( p_sys->size && i_pos >= p_sys->size )
     {
@@ -1048,9 +1126,30 @@ static int Connect( access_t *p_access, uint64_t i_tell )
     p_sys->b_persist = false;
     p_sys->b_has_size = false;
     p_sys->size = 0;
+    p_sys->i_idle_timeout = HTTP_IDLE_TIMEOUT;
     p_access->info.i_pos  = i_tell;
     p_access->info.b_eof  = false;
 
+    /* Reuse the connection kept from the previous request, or an idle one
+     * left by an earlier access to the same server */
+    if( p_sys->fd == -1 && p_sys->p_creds == NULL && p_sys->b_keep_alive )
+        p_sys->fd = PoolTake( &srv );
+    if( p_sys->fd != -1 )
+    {
+        msg_Dbg( p_access, "reusing connection to %s:%d", srv.psz_host,
+                 srv.i_port );
+        if( Request( p_access, i_tell ) == VLC_SUCCESS )
+        {
+            p_sys->i_conn_reused++;
+            return 0;
+        }
+        /* The server may have closed the connection in the mean time, in
+         * which case no status was received. Anything else is final. */
+        if( p_sys->i_code != 0 )
+            return -2;
+        msg_Dbg( p_access, "persistent connection lost, reconnecting" );
+    }
+
     /* Open connection */
     assert( p_sys->fd == -1 ); /* No open sockets (leaking fds is BAD) */
     p_sys->fd = net_ConnectTCP( p_access, srv.psz_host, srv.i_port );
@@ -1059,6 +1158,7 @@ static int Connect( access_t *p_access, uint64_t i_tell )
         msg_Err( p_access, "cannot connect to %s:%d", srv.psz_host, srv.i_port );
         return -1;
     }
+    p_sys->i_conn_new++;
     setsockopt (p_sys->fd, SOL_SOCKET, SO_KEEPALIVE, &(int){ 1 }, sizeof (int));
 
     /* Initialize TLS/SSL session */
@@ -1148,6 +1248,7 @@ static int Request( access_t *p_access, uint64_t i_tell )
     access_sys_t   *p_sys = p_access->p_sys;
     char           *psz ;
     p_sys->b_persist = false;
+    p_sys->i_code = 0;
 
     p_sys->i_remaining = 0;
 
@@ -1176,7 +1277,9 @@ static int Request( access_t *p_access, uint64_t i_tell )
     {
         p_sys->b_persist = true;
         WriteHeaders( p_access, "Range: bytes=%"PRIu64"-\r\n", i_tell );
-        WriteHeaders( p_access, "Connection: close\r\n" );
+        /* HTTP/1.1 connections are persistent unless told otherwise */
+        if( !p_sys->b_keep_alive )
+            WriteHeaders( p_access, "Connection: close\r\n" );
     }
 
     /* Cookies */
@@ -1223,12 +1326,16 @@ static int Request( access_t *p_access, uint64_t i_tell )
     {
         p_sys->psz_protocol = "HTTP";
         p_sys->i_code = atoi( &psz[9] );
+        /* HTTP/1.0 servers close the connection after the response */
+        if( psz[7] == '0' )
+            p_sys->b_persist = false;
     }
     else if( !strncmp( psz, "ICY", 3 ) )
     {
         p_sys->psz_protocol = "ICY";
         p_sys->i_code = atoi( &psz[4] );
         p_sys->b_reconnect = true;
+        p_sys->b_persist = false;
     }
     else
     {
@@ -1343,6 +1450,16 @@ static int Request( access_t *p_access, uint64_t i_tell )
                 p_sys->b_persist = false;
             }
         }
+        else if( !strcasecmp( psz, "Keep-Alive" ) )
+        {
+            const char *psz_timeout = strcasestr( p, "timeout=" );
+            if( psz_timeout != NULL )
+            {
+                mtime_t i_timeout = atoi( psz_timeout + 8 ) * CLOCK_FREQ;
+                if( i_timeout >= 0 && i_timeout < p_sys->i_idle_timeout )
+                    p_sys->i_idle_timeout = i_timeout;
+            }
+        }
         else if( !strcasecmp( psz, "Location" ) )
         {
             char * psz_new_loc;
@@ -1566,6 +1683,138 @@ static void Disconnect( access_t *p_access )
 
 }
 
+/**
+ * Checks whether the connection can carry another request, reading the end
+ * of the current response if needed.
+ */
+static bool Reusable( access_t *p_access )
+{
+    access_sys_t *p_sys = p_access->p_sys;
+
+    /* The end of the response is only known from its length, and ICY
+     * metadata is interleaved with the data */
+    if( p_sys->fd == -1 || !p_sys->b_keep_alive || !p_sys->b_persist
+     || !p_sys->b_has_size || p_sys->b_chunked || p_sys->i_icy_meta > 0
+     || p_sys->b_error || p_sys->i_remaining > HTTP_DRAIN_MAX )
+        return false;
+
+    bool b_reconnect = p_sys->b_reconnect;
+    p_sys->b_reconnect = false;
+    bool b_ret = Skip( p_access, p_sys->i_remaining );
+    p_sys->b_reconnect = b_reconnect;
+    return b_ret && p_sys->fd != -1;
+}
+
+/*****************************************************************************
+ * Idle connections pool
+ *****************************************************************************/
+static vlc_mutex_t pool_lock = VLC_STATIC_MUTEX;
+static struct
+{
+    unsigned    users; /* open accesses, the pool is emptied without any */
+    unsigned    count;
+    struct
+    {
+        char     *host;
+        unsigned  port;
+        int       fd;
+        mtime_t   deadline;
+    } conns[HTTP_POOL_SIZE]; /* oldest first */
+} pool;
+
+static void PoolRemove( unsigned i )
+{
+    free( pool.conns[i].host );
+    pool.count--;
+    memmove( &pool.conns[i], &pool.conns[i + 1],
+             ( pool.count - i ) * sizeof( pool.conns[0] ) );
+}
+
+/* Closes the connections that expired or that the server shut down */
+static void PoolPurge( void )
+{
+    mtime_t now = mdate();
+
+    for( unsigned i = 0; i < pool.count; )
+    {
+        /* Idle connections have nothing to read but the end of stream */
+        struct pollfd ufd = { .fd = pool.conns[i].fd, .events = POLLIN };
+
+        if( pool.conns[i].deadline <= now || poll( &ufd, 1, 0 ) != 0 )
+        {
+            net_Close( pool.conns[i].fd );
+            PoolRemove( i );
+        }
+        else
+            i++;
+    }
+}
+
+static int PoolTake( const vlc_url_t *srv )
+{
+    int fd = -1;
+
+    vlc_mutex_lock( &pool_lock );
+    PoolPurge();
+    for( unsigned i = pool.count; i-- > 0; )
+        if( pool.conns[i].port == srv->i_port
+         && !strcasecmp( pool.conns[i].host, srv->psz_host ) )
+        {
+            fd = pool.conns[i].fd;
+            PoolRemove( i );
+            break;
+        }
+    vlc_mutex_unlock( &pool_lock );
+    return fd;
+}
+
+static void PoolPut( const vlc_url_t *srv, int fd, mtime_t timeout )
+{
+    char *host = strdup( srv->psz_host );
+    if( unlikely(host == NULL) || timeout <= 0 )
+    {
+        free( host );
+        net_Close( fd );
+        return;
+    }
+
+    vlc_mutex_lock( &pool_lock );
+    PoolPurge();
+    if( pool.count == HTTP_POOL_SIZE )
+    {
+        net_Close( pool.conns[0].fd );
+        PoolRemove( 0 );
+    }
+    pool.conns[pool.count].host = host;
+    pool.conns[pool.count].port = srv->i_port;
+    pool.conns[pool.count].fd = fd;
+    pool.conns[pool.count].deadline = mdate() + timeout;
+    pool.count++;
+    vlc_mutex_unlock( &pool_lock );
+}
+
+static void PoolHold( void )
+{
+    vlc_mutex_lock( &pool_lock );
+    pool.users++;
+    vlc_mutex_unlock( &pool_lock );
+}
+
+/* Closes the idle connections once the last access is closed, so that none
+ * outlives the instance nor the plugin */
+static void PoolRelease( void )
+{
+    vlc_mutex_lock( &pool_lock );
+    assert( pool.users > 0 );
+    if( --pool.users == 0 )
+        while( pool.count > 0 )
+        {
+            net_Close( pool.conns[0].fd );
+            PoolRemove( 0 );
+        }
+    vlc_mutex_unlock( &pool_lock );
+}
+
 /*****************************************************************************
  * HTTP authentication
  *****************************************************************************/
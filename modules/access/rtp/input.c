@@ -80,6 +80,160 @@ drop:
     block_Release (block);
 }
 
+/* Maximum number of datagrams received per system call */
+#ifdef HAVE_RECVMMSG
+# define RTP_BATCH 32
+#else
+# define RTP_BATCH 1
+#endif
+#define RTP_MTU 0xffff
+/* Number of receive calls between updates of the statistics variables */
+#define RTP_STATS_PERIOD 64
+
+/**
+ * Publishes the receive statistics as variables of the demux.
+ */
+static void rtp_stats_Publish (demux_t *demux)
+{
+    demux_sys_t *sys = demux->p_sys;
+
+    var_SetInteger (demux, "rtp-packets", sys->packets);
+    var_SetInteger (demux, "rtp-recv-calls", sys->syscalls);
+    var_SetInteger (demux, "rtp-truncated", sys->truncated);
+    var_SetInteger (demux, "rtp-wasted-bytes", sys->wasted);
+}
+
+/**
+ * (Re)allocates the datagram receive slab. Slots are sized after the largest
+ * datagram seen so far, with some headroom. In batch mode, a datagram that
+ * does not fit in its slot is received partly into the spill area, which
+ * covers the rest of the MTU and is only touched by such datagrams. Slots
+ * remain as large as the MTU otherwise.
+ */
+static int rtp_slab_setup (demux_sys_t *sys)
+{
+    size_t size = RTP_MTU;
+
+    if (RTP_BATCH > 1 && sys->spill == NULL)
+    {
+        sys->spill = malloc (RTP_BATCH * RTP_MTU);
+        if (unlikely(sys->spill == NULL))
+            return -1;
+    }
+
+    if (RTP_BATCH > 1 && sys->mru > 0)
+    {
+        size = (2 * sys->mru + 2047) & ~(size_t)2047;
+        if (size > RTP_MTU)
+            size = RTP_MTU;
+    }
+
+    if (size == sys->slot_size)
+        return 0;
+
+    uint8_t *slab = realloc (sys->slab, RTP_BATCH * size);
+    if (unlikely(slab == NULL))
+        return -1;
+
+    sys->slab = slab;
+    sys->slot_size = size;
+    return 0;
+}
+
+/**
+ * Receives pending datagrams from the RTP socket and processes them.
+ * @return 0 on success (including no pending datagrams), -1 on fatal error.
+ */
+static int rtp_recv (demux_t *demux, int fd)
+{
+    demux_sys_t *sys = demux->p_sys;
+    size_t lenv[RTP_BATCH];
+    bool truncv[RTP_BATCH];
+    int n;
+
+    if (rtp_slab_setup (sys))
+        return -1;
+
+#ifdef HAVE_RECVMMSG
+    struct mmsghdr msgv[RTP_BATCH];
+    struct iovec iov[RTP_BATCH][2];
+
+    for (unsigned i = 0; i < RTP_BATCH; i++)
+    {
+        iov[i][0].iov_base = sys->slab + i * sys->slot_size;
+        iov[i][0].iov_len = sys->slot_size;
+        iov[i][1].iov_base = sys->spill + i * RTP_MTU;
+        iov[i][1].iov_len = RTP_MTU - sys->slot_size;
+        memset (&msgv[i].msg_hdr, 0, sizeof (msgv[i].msg_hdr));
+        msgv[i].msg_hdr.msg_iov = iov[i];
+        msgv[i].msg_hdr.msg_iovlen = 2;
+    }
+
+    n = recvmmsg (fd, msgv, RTP_BATCH, MSG_DONTWAIT, NULL);
+    for (int i = 0; i < n; i++)
+    {
+        lenv[i] = msgv[i].msg_len;
+        truncv[i] = (msgv[i].msg_hdr.msg_flags & MSG_TRUNC) != 0;
+    }
+#else
+    ssize_t len = recv (fd, sys->slab, sys->slot_size, 0);
+
+    n = (len >= 0) ? 1 : -1;
+    if (n > 0)
+    {
+        lenv[0] = len;
+        truncv[0] = false;
+    }
+#endif
+    if (n == -1)
+    {
+        switch (errno)
+        {
+            case EAGAIN:
+#if (EAGAIN != EWOULDBLOCK)
+            case EWOULDBLOCK:
+#endif
+            case EINTR:
+                break;
+            default:
+                msg_Warn (demux, "RTP network error: %s",
+                          vlc_strerror_c(errno));
+        }
+        return 0;
+    }
+    sys->syscalls++;
+
+    if ((sys->syscalls % RTP_STATS_PERIOD) == 0)
+        rtp_stats_Publish (demux);
+
+    for (int i = 0; i < n; i++)
+    {
+        if (truncv[i])
+        {   /* Larger than the MTU: cannot be a valid datagram */
+            msg_Warn (demux, "RTP datagram truncated to %zu bytes, dropped",
+                      lenv[i]);
+            sys->truncated++;
+            continue;
+        }
+        if (lenv[i] > sys->mru)
+            sys->mru = lenv[i]; /* grow the slots for the next batch */
+
+        block_t *block = block_Alloc (lenv[i]);
+        if (unlikely(block == NULL))
+            return -1; /* we are totallly screwed */
+
+        size_t head = (lenv[i] < sys->slot_size) ? lenv[i] : sys->slot_size;
+        memcpy (block->p_buffer, sys->slab + i * sys->slot_size, head);
+        if (head < lenv[i])
+            memcpy (block->p_buffer + head, sys->spill + i * RTP_MTU,
+                    lenv[i] - head);
+        sys->packets++;
+        sys->wasted += block->i_size - block->i_buffer;
+        rtp_process (demux, block);
+    }
+    return 0;
+}
+
 static int rtp_timeout (mtime_t deadline)
 {
     if (deadline == VLC_TS_INVALID)
@@ -125,22 +279,8 @@ void *rtp_dgram_thread (void *opaque)
             if (unlikely(ufd[0].revents & POLLHUP))
                 break; /* RTP socket dead (DCCP only) */
 
-            block_t *block = block_Alloc (0xffff); /* TODO: p_sys->mru */
-            if (unlikely(block == NULL))
-                break; /* we are totallly screwed */
-
-            ssize_t len = recv (rtp_fd, block->p_buffer, block->i_buffer, 0);
-            if (len != -1)
-            {
-                block->i_buffer = len;
-                rtp_process (demux, block);
-            }
-            else
-            {
-                msg_Warn (demux, "RTP network error: %s",
-                          vlc_strerror_c(errno));
-                block_Release (block);
-            }
+            if (rtp_recv (demux, rtp_fd))
+                break;
         }
 
     dequeue:
@@ -266,6 +266,20 @@ static int Open (vlc_object_t *obj)
     p_sys->max_misorder = var_CreateGetInteger (obj, "rtp-max-misorder");
     p_sys->thread_ready = false;
     p_sys->autodetect   = true;
+    p_sys->slab         = NULL;
+    p_sys->spill        = NULL;
+    p_sys->slot_size    = 0;
+    p_sys->mru          = 0;
+    p_sys->packets      = 0;
+    p_sys->syscalls     = 0;
+    p_sys->truncated    = 0;
+    p_sys->wasted       = 0;
+
+    /* Receive statistics, see rtp_stats_Publish() */
+    var_Create (obj, "rtp-packets", VLC_VAR_INTEGER);
+    var_Create (obj, "rtp-recv-calls", VLC_VAR_INTEGER);
+    var_Create (obj, "rtp-truncated", VLC_VAR_INTEGER);
+    var_Create (obj, "rtp-wasted-bytes", VLC_VAR_INTEGER);
 
     demux->pf_demux   = NULL;
     demux->pf_control = Control;
@@ -328,6 +342,15 @@ static void Close (vlc_object_t *obj)
         vlc_join (p_sys->thread, NULL);
     }
 
+    if (p_sys->syscalls > 0)
+        msg_Dbg (demux, "received %"PRIu64" packets in %"PRIu64" calls "
+                 "(%.2f packets/call), %"PRIu64" truncated, "
+                 "%"PRIu64" bytes wasted (%.2f/packet)",
+                 p_sys->packets, p_sys->syscalls,
+                 (double)p_sys->packets / p_sys->syscalls, p_sys->truncated,
+                 p_sys->wasted,
+                 p_sys->packets ? (double)p_sys->wasted / p_sys->packets : 0.);
+
 #ifdef HAVE_SRTP
     if (p_sys->srtp)
         srtp_destroy (p_sys->srtp);
@@ -337,6 +360,8 @@ static void Close (vlc_object_t *obj)
     if (p_sys->rtcp_fd != -1)
         net_Close (p_sys->rtcp_fd);
     net_Close (p_sys->fd);
+    free (p_sys->spill);
+    free (p_sys->slab);
     free (p_sys);
 }
 
@@ -76,5 +76,17 @@ struct demux_sys_t
     uint8_t       max_src; /**< Max simultaneous RTP sources */
     bool          thread_ready;
     bool          autodetect; /**< Payload type autodetection pending */
+
+    /* Datagram receive slab */
+    uint8_t      *slab;
+    uint8_t      *spill; /**< Tails of datagrams larger than a slot */
+    size_t        slot_size;
+    size_t        mru; /**< Largest datagram seen so far */
+
+    /* Receive statistics */
+    uint64_t      packets;
+    uint64_t      syscalls;
+    uint64_t      truncated; /**< Dropped datagrams larger than the MTU */
+    uint64_t      wasted; /**< Bytes allocated but not used in blocks */
 };
 
@@ -45,6 +45,13 @@
 
 #define MTU 65535
 
+/* Maximum number of datagrams received per system call */
+#ifdef HAVE_RECVMMSG
+# define BATCH 32
+#else
+# define BATCH 1
+#endif
+
 /*****************************************************************************
  * Module descriptor
  *****************************************************************************/
@@ -76,6 +83,18 @@ struct access_sys_t
     size_t fifo_size;
     block_fifo_t *fifo;
     vlc_thread_t thread;
+
+    /* Receive slab (datagrams are copied out to right-sized blocks) */
+    uint8_t *slab;
+    uint8_t *spill; /**< Tails of datagrams larger than a slot */
+    size_t slot_size;
+    size_t mru; /**< Largest datagram seen so far */
+
+    /* Statistics */
+    uint64_t packets;
+    uint64_t syscalls;
+    uint64_t truncated; /**< Dropped datagrams larger than the MTU */
+    uint64_t wasted; /**< Bytes allocated but not used in queued blocks */
 };
 
 /*****************************************************************************
@@ -169,6 +188,17 @@ static int Open( vlc_object_t *p_this )
 
     sys->running = true;
     sys->fifo_size = var_InheritInteger( p_access, "udp-buffer");
+    sys->slab = NULL;
+    sys->spill = NULL;
+    sys->slot_size = 0;
+    sys->mru = 0;
+    sys->packets = sys->syscalls = sys->truncated = sys->wasted = 0;
+
+    /* Receive statistics, see StatsPublish() */
+    var_Create( p_access, "udp-packets", VLC_VAR_INTEGER );
+    var_Create( p_access, "udp-recv-calls", VLC_VAR_INTEGER );
+    var_Create( p_access, "udp-truncated", VLC_VAR_INTEGER );
+    var_Create( p_access, "udp-wasted-bytes", VLC_VAR_INTEGER );
 
     if( vlc_clone( &sys->thread, ThreadRead, p_access,
                    VLC_THREAD_PRIORITY_INPUT ) )
@@ -193,8 +223,20 @@ static void Close( vlc_object_t *p_this )
 
     vlc_cancel( sys->thread );
     vlc_join( sys->thread, NULL );
+
+    if( sys->syscalls > 0 )
+        msg_Dbg( p_access, "received %"PRIu64" packets in %"PRIu64" calls "
+                 "(%.2f packets/call), %"PRIu64" truncated, "
+                 "%"PRIu64" bytes wasted (%.2f/packet)",
+                 sys->packets, sys->syscalls,
+                 (double)sys->packets / sys->syscalls, sys->truncated,
+                 sys->wasted,
+                 sys->packets ? (double)sys->wasted / sys->packets : 0. );
+
     block_FifoRelease( sys->fifo );
     net_Close( sys->fd );
+    free( sys->spill );
+    free( sys->slab );
     free( sys );
 }
 
@@ -250,47 +292,187 @@ static block_t *BlockUDP( access_t *p_access )
     return block;
 }
 
+/*****************************************************************************
+ * SlabSetup: (re)allocate the receive slab for the current MRU
+ *****************************************************************************
+ * The first slot is always as large as the MTU. The other slots, which are
+ * only filled in batch mode, are sized after the largest datagram seen so
+ * far, with some headroom. Until a datagram has been seen, they are as large
+ * as the MTU too. A datagram that does not fit in its slot is received
+ * partly into the spill area, which covers the rest of the MTU for every
+ * slot; it is allocated once, and its pages are only touched by such
+ * datagrams.
+ *****************************************************************************/
+static int SlabSetup( access_sys_t *sys )
+{
+    size_t size = MTU;
+
+#if BATCH > 1
+    if( sys->spill == NULL )
+    {
+        sys->spill = malloc( (BATCH - 1) * MTU );
+        if( unlikely(sys->spill == NULL) )
+            return -1;
+    }
+#endif
+
+    if( sys->mru > 0 )
+    {
+        size = (2 * sys->mru + 2047) & ~(size_t)2047;
+        if( size > MTU )
+            size = MTU;
+    }
+
+    if( size == sys->slot_size )
+        return 0;
+
+    uint8_t *slab = realloc( sys->slab, MTU + (BATCH - 1) * size );
+    if( unlikely(slab == NULL) )
+        return -1;
+
+    sys->slab = slab;
+    sys->slot_size = size;
+    return 0;
+}
+
+static uint8_t *SlabSlot( access_sys_t *sys, unsigned i )
+{
+    return (i == 0) ? sys->slab : sys->slab + MTU + (i - 1) * sys->slot_size;
+}
+
+static uint8_t *SlabSpill( access_sys_t *sys, unsigned i )
+{
+    return sys->spill + (i - 1) * MTU;
+}
+
+/*****************************************************************************
+ * StatsPublish: update the receive statistics variables
+ *****************************************************************************
+ * This is done every STATS_PERIOD receive calls, not for every datagram.
+ *****************************************************************************/
+#define STATS_PERIOD 64
+
+static void StatsPublish( access_t *p_access )
+{
+    access_sys_t *sys = p_access->p_sys;
+
+    var_SetInteger( p_access, "udp-packets", sys->packets );
+    var_SetInteger( p_access, "udp-recv-calls", sys->syscalls );
+    var_SetInteger( p_access, "udp-truncated", sys->truncated );
+    var_SetInteger( p_access, "udp-wasted-bytes", sys->wasted );
+}
+
 /*****************************************************************************
  * ThreadRead: Pull packets from socket as soon as possible.
+ *****************************************************************************
+ * The first datagram is waited for with net_Read(). Then, in batch mode,
+ * whatever else is already pending is fetched with a single recvmmsg().
+ * Datagrams are copied out of the slab (and spill area) into blocks of the
+ * exact size; the slots grow before the next batch if one did not fit.
  *****************************************************************************/
 static void* ThreadRead( void *data )
 {
     access_t *access = data;
     access_sys_t *sys = access->p_sys;
+    unsigned rounds = 0;
 
     for(;;)
     {
-        block_t *pkt = block_Alloc(MTU);
-        if (unlikely(pkt == NULL))
+        if (SlabSetup(sys))
             break;
 
+        size_t lenv[BATCH];
+        bool truncv[BATCH];
         ssize_t len;
+        int n = 1;
 
-        block_cleanup_push(pkt);
         do
-            len = net_Read(access, sys->fd, pkt->p_buffer, MTU, false);
+            len = net_Read(access, sys->fd, sys->slab, MTU, false);
         while (len == -1 && errno != EINTR);
-        vlc_cleanup_pop();
 
         if (len == -1)
-        {
-            block_Release(pkt);
             break;
+
+        int canc = vlc_savecancel();
+
+        sys->syscalls++;
+        lenv[0] = len;
+        truncv[0] = false;
+
+#ifdef HAVE_RECVMMSG
+        struct mmsghdr msgv[BATCH - 1];
+        struct iovec iov[BATCH - 1][2];
+
+        for (unsigned i = 0; i < BATCH - 1; i++)
+        {
+            iov[i][0].iov_base = SlabSlot(sys, i + 1);
+            iov[i][0].iov_len = sys->slot_size;
+            iov[i][1].iov_base = SlabSpill(sys, i + 1);
+            iov[i][1].iov_len = MTU - sys->slot_size;
+            memset(&msgv[i].msg_hdr, 0, sizeof (msgv[i].msg_hdr));
+            msgv[i].msg_hdr.msg_iov = iov[i];
+            msgv[i].msg_hdr.msg_iovlen = 2;
         }
 
-        pkt->i_buffer = len;
+        int val = recvmmsg(sys->fd, msgv, BATCH - 1, MSG_DONTWAIT, NULL);
+        if (val > 0)
+        {
+            sys->syscalls++;
+            for (int i = 0; i < val; i++)
+            {
+                lenv[n] = msgv[i].msg_len;
+                truncv[n] = (msgv[i].msg_hdr.msg_flags & MSG_TRUNC) != 0;
+                n++;
+            }
+        }
+#endif
+
+        if ((++rounds % STATS_PERIOD) == 0)
+            StatsPublish(access);
+
+        block_t *first = NULL, **pp = &first;
+        size_t bytes = 0;
+
+        for (int i = 0; i < n; i++)
+        {
+            if (truncv[i])
+            {   /* Larger than the MTU: cannot be a valid datagram */
+                msg_Warn(access, "datagram truncated to %zu bytes, dropped",
+                         lenv[i]);
+                sys->truncated++;
+                continue;
+            }
+            if (lenv[i] > sys->mru)
+                sys->mru = lenv[i]; /* grow the slots for the next batch */
+
+            block_t *pkt = block_Alloc(lenv[i]);
+            if (unlikely(pkt == NULL))
+                break;
+
+            size_t head = lenv[i];
+            if (i > 0 && head > sys->slot_size)
+                head = sys->slot_size;
+            memcpy(pkt->p_buffer, SlabSlot(sys, i), head);
+            if (head < lenv[i])
+                memcpy(pkt->p_buffer + head, SlabSpill(sys, i),
+                       lenv[i] - head);
+            sys->packets++;
+            sys->wasted += pkt->i_size - pkt->i_buffer;
+            bytes += pkt->i_buffer;
+            *pp = pkt;
+            pp = &pkt->p_next;
+        }
 
         vlc_fifo_Lock(sys->fifo);
         /* Discard old buffers on overflow */
-        while (vlc_fifo_GetBytes(sys->fifo) + len > sys->fifo_size)
-        {
-            int canc = vlc_savecancel();
+        while (vlc_fifo_GetBytes(sys->fifo) + bytes > sys->fifo_size
+            && !vlc_fifo_IsEmpty(sys->fifo))
             block_Release(vlc_fifo_DequeueUnlocked(sys->fifo));
-            vlc_restorecancel(canc);
-        }
 
-        vlc_fifo_QueueUnlocked(sys->fifo, pkt);
+        if (first != NULL)
+            vlc_fifo_QueueUnlocked(sys->fifo, first);
         vlc_fifo_Unlock(sys->fifo);
+        vlc_restorecancel(canc);
     }
 
     vlc_fifo_Lock(sys->fifo);
@@ -326,6 +326,7 @@ static int Control( stream_t *s, int i_query, va_list args )
         case STREAM_CAN_SEEK:
         case STREAM_CAN_FASTSEEK:
         case STREAM_SET_RECORD_STATE:
+        case STREAM_RECORD_DATA:
             return stream_vaControl( s->p_source, i_query, args );
 
         default:
@@ -76,6 +76,23 @@ static void Close( vlc_object_t * );
     "on the file path")
 #define SYNC_TEXT N_("Synchronous writing")
 #define SYNC_LONGTEXT N_( "Open the file with synchronous writing.")
+#define BUFFER_TEXT N_("Write-behind buffer (KiB)")
+#define BUFFER_LONGTEXT N_( \
+    "If not 0, data is written to the file from a separate thread, so that " \
+    "a slow disk does not stall the stream. This is the maximum amount of " \
+    "data waiting to be written. By default, the stream thread writes.")
+#define WRITE_SIZE_TEXT N_("Write size (KiB)")
+#define WRITE_SIZE_LONGTEXT N_( \
+    "When the disk falls behind, small blocks are gathered into writes of " \
+    "this size, which end at multiples of it in the file.")
+#define SYNC_PERIOD_TEXT N_("Flush period (ms)")
+#define SYNC_PERIOD_LONGTEXT N_( \
+    "Written data is flushed to the disk at most once per period. " \
+    "0 leaves it to the operating system.")
+#define DROP_TEXT N_("Drop data when the buffer is full")
+#define DROP_LONGTEXT N_( \
+    "When the write-behind buffer is full, drop the data instead of " \
+    "waiting for the disk.")
 
 vlc_module_begin ()
     set_description( N_("File stream output") )
@@ -94,6 +111,17 @@ vlc_module_begin ()
     add_bool( SOUT_CFG_PREFIX "sync", false, SYNC_TEXT,SYNC_LONGTEXT,
               false )
 #endif
+    add_integer( SOUT_CFG_PREFIX "buffer", 0, BUFFER_TEXT,
+                 BUFFER_LONGTEXT, true )
+        change_integer_range( 0, 1024 * 1024 )
+    add_integer( SOUT_CFG_PREFIX "write-size", 256, WRITE_SIZE_TEXT,
+                 WRITE_SIZE_LONGTEXT, true )
+        change_integer_range( 4, 16 * 1024 )
+    add_integer( SOUT_CFG_PREFIX "sync-period", 0, SYNC_PERIOD_TEXT,
+                 SYNC_PERIOD_LONGTEXT, true )
+        change_integer_range( 0, 3600 * 1000 )
+    add_bool( SOUT_CFG_PREFIX "drop", false, DROP_TEXT, DROP_LONGTEXT,
+              true )
     set_callbacks( Open, Close )
 vlc_module_end ()
 
@@ -108,6 +136,10 @@ static const char *const ppsz_sout_options[] = {
 #ifdef O_SYNC
     "sync",
 #endif
+    "buffer",
+    "write-size",
+    "sync-period",
+    "drop",
     NULL
 };
 
@@ -116,6 +148,43 @@ static int Seek ( sout_access_out_t *, off_t  );
 static ssize_t Read ( sout_access_out_t *, block_t * );
 static int Control( sout_access_out_t *, int, va_list );
 
+static void *Thread( void * );
+
+struct sout_access_out_sys_t
+{
+    int           fd;
+
+    /* Write-behind, when b_thread */
+    bool          b_thread;
+    vlc_thread_t  thread;
+    vlc_mutex_t   lock;
+    vlc_cond_t    wait_data;    /* Signaled to the writer thread */
+    vlc_cond_t    wait_space;   /* Signaled to the stream thread */
+    block_t       *p_first;
+    block_t       **pp_last;
+    size_t        i_queued;     /* Bytes waiting to be written */
+    size_t        i_queue_max;
+    bool          b_busy;       /* The writer thread holds unwritten data */
+    bool          b_drop;
+    bool          b_closing;
+    int           i_error;      /* errno of the first failed write, or 0 */
+
+    uint8_t       *p_chunk;     /* Gathers small blocks */
+    size_t        i_chunk;
+    size_t        i_chunk_max;
+    off_t         i_offset;     /* File offset of the next write, or -1 */
+    mtime_t       i_sync_period;
+    mtime_t       i_sync_last;
+
+    /* Statistics, also exported as variables */
+    size_t        i_queued_max;
+    mtime_t       i_write_max;  /* Longest write() or fdatasync() */
+    mtime_t       i_stall;      /* Time the stream thread waited */
+    uint64_t      i_dropped;
+    uint64_t      i_writes;
+    uint64_t      i_syncs;
+};
+
 /*****************************************************************************
  * Open: open the file
  *****************************************************************************/
@@ -213,15 +282,84 @@ static int Open( vlc_object_t *p_this )
             return VLC_EGENERIC;
     }
 
+    sout_access_out_sys_t *p_sys = malloc( sizeof( *p_sys ) );
+    if( unlikely(p_sys == NULL) )
+    {
+        close( fd );
+        return VLC_ENOMEM;
+    }
+    p_sys->fd = fd;
+
+    if (append)
+        lseek (fd, 0, SEEK_END);
+
+    p_sys->i_queue_max = var_GetInteger( p_access, SOUT_CFG_PREFIX "buffer" ) * 1024;
+    p_sys->b_thread = p_sys->i_queue_max > 0;
+    if( p_sys->b_thread )
+    {
+        p_sys->i_chunk_max =
+            var_GetInteger( p_access, SOUT_CFG_PREFIX "write-size" ) * 1024;
+        p_sys->p_chunk = malloc( p_sys->i_chunk_max );
+        if( unlikely(p_sys->p_chunk == NULL) )
+        {
+            close( fd );
+            free( p_sys );
+            return VLC_ENOMEM;
+        }
+        p_sys->i_chunk = 0;
+        p_sys->i_offset = lseek( fd, 0, SEEK_CUR ); /* -1 if not a file */
+        p_sys->i_sync_period =
+            var_GetInteger( p_access, SOUT_CFG_PREFIX "sync-period" ) * 1000;
+        p_sys->i_sync_last = mdate();
+        p_sys->b_drop = var_GetBool( p_access, SOUT_CFG_PREFIX "drop" );
+
+        p_sys->p_first = NULL;
+        p_sys->pp_last = &p_sys->p_first;
+        p_sys->i_queued = 0;
+        p_sys->b_busy = false;
+        p_sys->b_closing = false;
+        p_sys->i_error = 0;
+
+        p_sys->i_queued_max = 0;
+        p_sys->i_write_max = 0;
+        p_sys->i_stall = 0;
+        p_sys->i_dropped = 0;
+        p_sys->i_writes = 0;
+        p_sys->i_syncs = 0;
+
+        var_Create( p_access, "write-queue", VLC_VAR_INTEGER );
+        var_Create( p_access, "write-queue-max", VLC_VAR_INTEGER );
+        var_Create( p_access, "write-latency-max", VLC_VAR_INTEGER );
+        var_Create( p_access, "write-stall", VLC_VAR_INTEGER );
+        var_Create( p_access, "write-dropped", VLC_VAR_INTEGER );
+
+        vlc_mutex_init( &p_sys->lock );
+        vlc_cond_init( &p_sys->wait_data );
+        vlc_cond_init( &p_sys->wait_space );
+
+        /* The thread gets its state from the access output */
+        p_access->p_sys = p_sys;
+        if( vlc_clone( &p_sys->thread, Thread, p_access,
+                       VLC_THREAD_PRIORITY_LOW ) )
+        {
+            vlc_cond_destroy( &p_sys->wait_space );
+            vlc_cond_destroy( &p_sys->wait_data );
+            vlc_mutex_destroy( &p_sys->lock );
+            free( p_sys->p_chunk );
+            close( fd );
+            free( p_sys );
+            p_access->p_sys = NULL;
+            return VLC_EGENERIC;
+        }
+    }
+
     p_access->pf_write = Write;
     p_access->pf_read  = Read;
     p_access->pf_seek  = Seek;
     p_access->pf_control = Control;
-    p_access->p_sys    = (void *)(intptr_t)fd;
+    p_access->p_sys    = p_sys;
 
     msg_Dbg( p_access, "file access output opened (%s)", p_access->psz_path );
-    if (append)
-        lseek (fd, 0, SEEK_END);
 
     return VLC_SUCCESS;
 }
@@ -232,8 +370,36 @@ static int Open( vlc_object_t *p_this )
 static void Close( vlc_object_t * p_this )
 {
     sout_access_out_t *p_access = (sout_access_out_t*)p_this;
+    sout_access_out_sys_t *p_sys = p_access->p_sys;
+
+    if( p_sys->b_thread )
+    {
+        /* The writer thread writes out everything still queued */
+        vlc_mutex_lock( &p_sys->lock );
+        p_sys->b_closing = true;
+        vlc_cond_signal( &p_sys->wait_data );
+        vlc_mutex_unlock( &p_sys->lock );
+        vlc_join( p_sys->thread, NULL );
+
+        if( p_sys->i_sync_period > 0 && p_sys->i_error == 0 )
+            fdatasync( p_sys->fd );
+
+        msg_Dbg( p_access, "%"PRIu64" writes, %"PRIu64" flushes, "
+                 "at most %zu KiB queued, longest write %"PRId64" ms, "
+                 "stalled %"PRId64" ms, dropped %"PRIu64" bytes",
+                 p_sys->i_writes, p_sys->i_syncs, p_sys->i_queued_max / 1024,
+                 p_sys->i_write_max / 1000, p_sys->i_stall / 1000,
+                 p_sys->i_dropped );
+
+        block_ChainRelease( p_sys->p_first );
+        vlc_cond_destroy( &p_sys->wait_space );
+        vlc_cond_destroy( &p_sys->wait_data );
+        vlc_mutex_destroy( &p_sys->lock );
+        free( p_sys->p_chunk );
+    }
 
-    close( (intptr_t)p_access->p_sys );
+    close( p_sys->fd );
+    free( p_sys );
 
     msg_Dbg( p_access, "file access output closed" );
 }
@@ -253,7 +419,7 @@ static int Control( sout_access_out_t *p_access, int i_query, va_list args )
         {
             bool *pb = va_arg( args, bool * );
             struct stat st;
-            if( fstat( (intptr_t)p_access->p_sys, &st ) == -1 )
+            if( fstat( p_access->p_sys->fd, &st ) == -1 )
                 *pb = false;
             else
                 *pb = S_ISREG( st.st_mode ) || S_ISBLK( st.st_mode );
@@ -266,6 +432,30 @@ static int Control( sout_access_out_t *p_access, int i_query, va_list args )
     return VLC_SUCCESS;
 }
 
+/*****************************************************************************
+ * Drain: wait for the writer thread to write out everything queued
+ *****************************************************************************/
+static int Drain( sout_access_out_t *p_access )
+{
+    sout_access_out_sys_t *p_sys = p_access->p_sys;
+
+    if( !p_sys->b_thread )
+        return 0;
+
+    vlc_mutex_lock( &p_sys->lock );
+    while( ( p_sys->p_first != NULL || p_sys->b_busy ) && p_sys->i_error == 0 )
+        vlc_cond_wait( &p_sys->wait_space, &p_sys->lock );
+    int i_error = p_sys->i_error;
+    vlc_mutex_unlock( &p_sys->lock );
+
+    if( i_error )
+    {
+        errno = i_error;
+        return -1;
+    }
+    return 0;
+}
+
 /*****************************************************************************
  * Read: standard read on a file descriptor.
  *****************************************************************************/
@@ -273,23 +463,95 @@ static ssize_t Read( sout_access_out_t *p_access, block_t *p_buffer )
 {
     ssize_t val;
 
+    if( Drain( p_access ) )
+        return -1;
+
     do
-        val = read( (intptr_t)p_access->p_sys, p_buffer->p_buffer,
+        val = read( p_access->p_sys->fd, p_buffer->p_buffer,
                     p_buffer->i_buffer );
     while (val == -1 && errno == EINTR);
     return val;
 }
 
 /*****************************************************************************
- * Write: standard write on a file descriptor.
+ * WriteFd: write a buffer completely
+ *****************************************************************************/
+static ssize_t WriteFd( int fd, const uint8_t *p_data, size_t i_data )
+{
+    size_t i_write = 0;
+
+    while( i_write < i_data )
+    {
+        ssize_t val = write( fd, p_data + i_write, i_data - i_write );
+        if( val <= 0 )
+        {
+            if( errno == EINTR )
+                continue;
+            return -1;
+        }
+        i_write += val;
+    }
+    return i_write;
+}
+
+/*****************************************************************************
+ * Write: standard write on a file descriptor, or queue for the writer thread
  *****************************************************************************/
 static ssize_t Write( sout_access_out_t *p_access, block_t *p_buffer )
 {
+    sout_access_out_sys_t *p_sys = p_access->p_sys;
     size_t i_write = 0;
 
+    if( p_sys->b_thread )
+    {
+        block_ChainProperties( p_buffer, NULL, &i_write, NULL );
+
+        vlc_mutex_lock( &p_sys->lock );
+        if( p_sys->i_queued + i_write > p_sys->i_queue_max &&
+            p_sys->i_queued > 0 && p_sys->i_error == 0 )
+        {
+            if( p_sys->b_drop )
+            {
+                if( p_sys->i_dropped == 0 )
+                    msg_Warn( p_access, "disk too slow, dropping data" );
+                p_sys->i_dropped += i_write;
+                vlc_mutex_unlock( &p_sys->lock );
+                var_SetInteger( p_access, "write-dropped", p_sys->i_dropped );
+                block_ChainRelease( p_buffer );
+                return i_write;
+            }
+
+            /* Back-pressure: wait for the disk to catch up */
+            const mtime_t i_start = mdate();
+            do
+                vlc_cond_wait( &p_sys->wait_space, &p_sys->lock );
+            while( p_sys->i_queued + i_write > p_sys->i_queue_max &&
+                   p_sys->i_queued > 0 && p_sys->i_error == 0 );
+            p_sys->i_stall += mdate() - i_start;
+        }
+
+        if( p_sys->i_error )
+        {
+            vlc_mutex_unlock( &p_sys->lock );
+            block_ChainRelease( p_buffer );
+            return -1;
+        }
+
+        *p_sys->pp_last = p_buffer;
+        while( p_buffer->p_next != NULL )
+            p_buffer = p_buffer->p_next;
+        p_sys->pp_last = &p_buffer->p_next;
+        p_sys->i_queued += i_write;
+        if( p_sys->i_queued > p_sys->i_queued_max )
+            p_sys->i_queued_max = p_sys->i_queued;
+        vlc_cond_signal( &p_sys->wait_data );
+        vlc_mutex_unlock( &p_sys->lock );
+        return i_write;
+    }
+
     while( p_buffer )
     {
-        ssize_t val = write ((intptr_t)p_access->p_sys,
+        ssize_t val = write (p_sys->fd,
                              p_buffer->p_buffer, p_buffer->i_buffer);
         if (val <= 0)
         {
@@ -321,5 +583,166 @@ static ssize_t Write( sout_access_out_t *p_access, block_t *p_buffer )
  *****************************************************************************/
 static int Seek( sout_access_out_t *p_access, off_t i_pos )
 {
-    return lseek( (intptr_t)p_access->p_sys, i_pos, SEEK_SET );
+    sout_access_out_sys_t *p_sys = p_access->p_sys;
+
+    if( Drain( p_access ) )
+        return -1;
+
+    off_t i_ret = lseek( p_sys->fd, i_pos, SEEK_SET );
+    if( p_sys->b_thread )
+    {   /* the writer thread is idle until the next Write() */
+        vlc_mutex_lock( &p_sys->lock );
+        p_sys->i_offset = i_ret;
+        vlc_mutex_unlock( &p_sys->lock );
+    }
+    return i_ret;
+}
+
+/*****************************************************************************
+ * Thread: write the queued data
+ *****************************************************************************/
+static bool ThreadWrite( sout_access_out_t *p_access,
+                         const uint8_t *p_data, size_t i_data )
+{
+    sout_access_out_sys_t *p_sys = p_access->p_sys;
+    const mtime_t i_start = mdate();
+
+    if( WriteFd( p_sys->fd, p_data, i_data ) < 0 )
+    {
+        int i_error = errno;
+
+        msg_Err( p_access, "cannot write: %s", vlc_strerror_c(i_error) );
+        vlc_mutex_lock( &p_sys->lock );
+        p_sys->i_error = i_error;
+        vlc_cond_broadcast( &p_sys->wait_space );
+        vlc_mutex_unlock( &p_sys->lock );
+        return false;
+    }
+
+    const mtime_t i_time = mdate() - i_start;
+    if( i_time > p_sys->i_write_max )
+        p_sys->i_write_max = i_time;
+    p_sys->i_writes++;
+    if( p_sys->i_offset >= 0 )
+        p_sys->i_offset += i_data;
+    return true;
+}
+
+static bool ThreadFlush( sout_access_out_t *p_access )
+{
+    sout_access_out_sys_t *p_sys = p_access->p_sys;
+    size_t i_chunk = p_sys->i_chunk;
+
+    p_sys->i_chunk = 0;
+    return i_chunk == 0 || ThreadWrite( p_access, p_sys->p_chunk, i_chunk );
+}
+
+static void ThreadSync( sout_access_out_t *p_access )
+{
+    sout_access_out_sys_t *p_sys = p_access->p_sys;
+    const mtime_t i_start = mdate();
+
+    if( p_sys->i_sync_period <= 0 ||
+        i_start - p_sys->i_sync_last < p_sys->i_sync_period )
+        return;
+
+    /* One flush for all the writes of the period */
+    if( fdatasync( p_sys->fd ) == 0 )
+        p_sys->i_syncs++;
+    p_sys->i_sync_last = mdate();
+    if( p_sys->i_sync_last - i_start > p_sys->i_write_max )
+        p_sys->i_write_max = p_sys->i_sync_last - i_start;
+}
+
+static void *Thread( void *data )
+{
+    sout_access_out_t *p_access = data;
+    sout_access_out_sys_t *p_sys = p_access->p_sys;
+    int canc = vlc_savecancel();
+
+    vlc_mutex_lock( &p_sys->lock );
+    for( ;; )
+    {
+        while( p_sys->p_first == NULL && !p_sys->b_closing )
+            vlc_cond_wait( &p_sys->wait_data, &p_sys->lock );
+        if( p_sys->p_first == NULL )
+            break;
+
+        /* Take everything queued so far */
+        block_t *p_chain = p_sys->p_first;
+        const size_t i_taken = p_sys->i_queued;
+        const bool b_failed = p_sys->i_error != 0;
+
+        p_sys->p_first = NULL;
+        p_sys->pp_last = &p_sys->p_first;
+        p_sys->b_busy = true;
+        vlc_mutex_unlock( &p_sys->lock );
+
+        bool b_ok = !b_failed;
+        while( p_chain != NULL )
+        {
+            block_t *p_block = p_chain;
+
+            p_chain = p_block->p_next;
+            if( b_ok && p_sys->i_chunk == 0 &&
+                ( p_block->i_buffer >= p_sys->i_chunk_max || p_chain == NULL ) )
+            {
+                /* Large enough, or alone as the disk keeps up: no need to
+                 * gather it with other blocks */
+                b_ok = ThreadWrite( p_access, p_block->p_buffer,
+                                    p_block->i_buffer );
+            }
+            else if( b_ok )
+            {
+                const uint8_t *p_data = p_block->p_buffer;
+                size_t i_data = p_block->i_buffer;
+
+                /* Gather small blocks into writes of i_chunk_max bytes,
+                 * ending at multiples of i_chunk_max in the file */
+                while( b_ok && i_data > 0 )
+                {
+                    size_t i_max = p_sys->i_chunk_max;
+                    if( p_sys->i_offset >= 0 )
+                        i_max -= p_sys->i_offset % p_sys->i_chunk_max;
+
+                    size_t i_copy = __MIN( i_data, i_max - p_sys->i_chunk );
+
+                    memcpy( &p_sys->p_chunk[p_sys->i_chunk], p_data, i_copy );
+                    p_sys->i_chunk += i_copy;
+                    p_data += i_copy;
+                    i_data -= i_copy;
+                    if( p_sys->i_chunk == i_max )
+                        b_ok = ThreadFlush( p_access );
+                }
+            }
+            block_Release( p_block );
+        }
+
+        vlc_mutex_lock( &p_sys->lock );
+        p_sys->i_queued -= i_taken;
+        const bool b_idle = p_sys->p_first == NULL;
+        const size_t i_queued = p_sys->i_queued;
+        const size_t i_queued_max = p_sys->i_queued_max;
+        const mtime_t i_stall = p_sys->i_stall;
+        vlc_mutex_unlock( &p_sys->lock );
+
+        /* Do not keep a partial chunk back when the disk keeps up */
+        if( b_ok && b_idle )
+            b_ok = ThreadFlush( p_access );
+        if( b_ok )
+            ThreadSync( p_access );
+
+        var_SetInteger( p_access, "write-queue", i_queued );
+        var_SetInteger( p_access, "write-queue-max", i_queued_max );
+        var_SetInteger( p_access, "write-latency-max", p_sys->i_write_max );
+        var_SetInteger( p_access, "write-stall", i_stall );
+
+        vlc_mutex_lock( &p_sys->lock );
+        p_sys->b_busy = false;
+        vlc_cond_broadcast( &p_sys->wait_space );
+    }
+    vlc_mutex_unlock( &p_sys->lock );
+
+    vlc_restorecancel( canc );
+    return NULL;
 }
@@ -51,6 +51,13 @@
 
 #define MAX_EMPTY_BLOCKS 200
 
+/* Maximum number of packets sent per system call */
+#ifdef HAVE_SENDMMSG
+# define BATCH 32
+#else
+# define BATCH 8
+#endif
+
 /*****************************************************************************
  * Module descriptor
  *****************************************************************************/
@@ -122,6 +129,10 @@ struct sout_access_out_sys_t
     block_t      *p_buffer;
 
     vlc_thread_t  thread;
+
+    /* Statistics */
+    uint64_t      i_packets;
+    uint64_t      i_syscalls;
 };
 
 #define DEFAULT_PORT 1234
@@ -213,6 +224,8 @@ static int Open( vlc_object_t *p_this )
     p_sys->p_fifo = block_FifoNew();
     p_sys->p_empty_blocks = block_FifoNew();
     p_sys->p_buffer = NULL;
+    p_sys->i_packets = 0;
+    p_sys->i_syscalls = 0;
 
     if( vlc_clone( &p_sys->thread, ThreadWrite, p_access,
                            VLC_THREAD_PRIORITY_HIGHEST ) )
@@ -242,6 +255,12 @@ static void Close( vlc_object_t * p_this )
 
     vlc_cancel( p_sys->thread );
     vlc_join( p_sys->thread, NULL );
+
+    if( p_sys->i_syscalls > 0 )
+        msg_Dbg( p_access, "sent %"PRIu64" packets in %"PRIu64" calls "
+                 "(%.2f packets/call)", p_sys->i_packets, p_sys->i_syscalls,
+                 (double)p_sys->i_packets / p_sys->i_syscalls );
+
     block_FifoRelease( p_sys->p_fifo );
     block_FifoRelease( p_sys->p_empty_blocks );
 
@@ -404,12 +423,17 @@ static void* ThreadWrite( void *data )
                                              SOUT_CFG_PREFIX "group" );
     mtime_t i_to_send = i_group;
     unsigned i_dropped_packets = 0;
+    block_t *p_pending = NULL;
 
     for (;;)
     {
-        block_t *p_pk = block_FifoGet( p_sys->p_fifo );
+        block_t *p_pk = p_pending;
         mtime_t       i_date, i_sent;
 
+        if( p_pk == NULL )
+            p_pk = block_FifoGet( p_sys->p_fifo );
+        p_pending = NULL;
+
         i_date = p_sys->i_caching + p_pk->i_dts;
         if( i_date_last > 0 )
         {
@@ -440,10 +464,88 @@ static void* ThreadWrite( void *data )
             mwait( i_date );
             i_to_send = i_group;
         }
-        if ( send( p_sys->i_handle, p_pk->p_buffer, p_pk->i_buffer, 0 ) == -1 )
-            msg_Warn( p_access, "send error: %s", vlc_strerror_c(errno) );
         vlc_cleanup_pop();
 
+        /* Gather the queued packets that are due in the same pacing slot,
+         * i.e. that would be sent right away without waiting. */
+        block_t *batch[BATCH];
+        unsigned n = 0;
+        mtime_t now = mdate();
+
+        batch[n++] = p_pk;
+        i_date_last = i_date;
+
+        mtime_t i_past = 0;
+
+        vlc_fifo_Lock( p_sys->p_fifo );
+        while( n < BATCH )
+        {
+            block_t *p_next = vlc_fifo_DequeueUnlocked( p_sys->p_fifo );
+            if( p_next == NULL )
+                break;
+
+            mtime_t i_next_date = p_sys->i_caching + p_next->i_dts;
+            bool b_wait = i_to_send == 1
+                       || (p_next->i_flags & BLOCK_FLAG_CLOCK);
+
+            if( (b_wait && i_next_date > now)
+             || i_next_date - i_date_last > 2000000 )
+            {
+                p_pending = p_next;
+                break;
+            }
+
+            if( i_date_last - i_next_date > i_past )
+                i_past = i_date_last - i_next_date;
+            /* Waiting for a date in the past would not block */
+            i_to_send = b_wait ? i_group : (i_to_send - 1);
+            i_date_last = i_next_date;
+            batch[n++] = p_next;
+        }
+        vlc_fifo_Unlock( p_sys->p_fifo );
+
+        if( i_past > 1000 && !i_dropped_packets )
+            msg_Dbg( p_access, "mmh, packets in the past (%"PRId64")",
+                     i_past );
+
+        int canc = vlc_savecancel();
+#ifdef HAVE_SENDMMSG
+        struct mmsghdr msgv[BATCH];
+        struct iovec iov[BATCH];
+
+        for( unsigned i = 0; i < n; i++ )
+        {
+            iov[i].iov_base = batch[i]->p_buffer;
+            iov[i].iov_len = batch[i]->i_buffer;
+            memset( &msgv[i].msg_hdr, 0, sizeof( msgv[i].msg_hdr ) );
+            msgv[i].msg_hdr.msg_iov = &iov[i];
+            msgv[i].msg_hdr.msg_iovlen = 1;
+        }
+
+        for( unsigned i = 0; i < n; )
+        {
+            int val = sendmmsg( p_sys->i_handle, msgv + i, n - i, 0 );
+            p_sys->i_syscalls++;
+            if( val <= 0 )
+            {
+                msg_Warn( p_access, "send error: %s", vlc_strerror_c(errno) );
+                i++; /* skip the failing packet */
+                continue;
+            }
+            i += val;
+        }
+#else
+        for( unsigned i = 0; i < n; i++ )
+        {
+            if( send( p_sys->i_handle, batch[i]->p_buffer,
+                      batch[i]->i_buffer, 0 ) == -1 )
+                msg_Warn( p_access, "send error: %s", vlc_strerror_c(errno) );
+            p_sys->i_syscalls++;
+        }
+#endif
+        p_sys->i_packets += n;
+        vlc_restorecancel( canc );
+
         if( i_dropped_packets )
         {
             msg_Dbg( p_access, "dropped %i packets", i_dropped_packets );
@@ -459,9 +561,8 @@ static void* ThreadWrite( void *data )
         }
 #endif
 
-        block_FifoPut( p_sys->p_empty_blocks, p_pk );
-
-        i_date_last = i_date;
+        for( unsigned i = 0; i < n; i++ )
+            block_FifoPut( p_sys->p_empty_blocks, batch[i] );
     }
     return NULL;
 }
@@ -1453,6 +1453,18 @@ static picture_t *DecodeVideo(decoder_t *p_dec, block_t **pp_block)
         bool b_csd_changed = false, b_size_changed = false;
 
         p_sys->b_new_block = false;
+        /* The NAL units are converted in place, but demuxers may share the
+         * payload (see stream_BlockShared()) */
+        if (p_sys->nal_size)
+        {
+            p_block = *pp_block = block_Writable(p_block);
+            if (!p_block)
+            {
+                p_sys->b_new_block = true;
+                b_error = true;
+                goto endclean;
+            }
+        }
         if (p_dec->fmt_in.i_codec == VLC_CODEC_H264)
             H264ProcessBlock(p_dec, p_block, &b_csd_changed, &b_size_changed);
         else if (p_dec->fmt_in.i_codec == VLC_CODEC_HEVC)
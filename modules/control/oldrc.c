@@ -109,7 +109,7 @@ static int  AudioChannel ( vlc_object_t *, char const *,
 static int  Statistics   ( vlc_object_t *, char const *,
                            vlc_value_t, vlc_value_t, void * );
 
-static int updateStatistics( intf_thread_t *, input_item_t *);
+static int updateStatistics( intf_thread_t *, input_thread_t * );
 
 /* Status Callbacks */
 static int VolumeChanged( vlc_object_t *, char const *,
@@ -1731,13 +1731,14 @@ static int Statistics ( vlc_object_t *p_this, char const *psz_cmd,
     if( !p_input )
         return VLC_ENOOBJ;
 
-    updateStatistics( p_intf, input_GetItem(p_input) );
+    updateStatistics( p_intf, p_input );
     vlc_object_release( p_input );
     return VLC_SUCCESS;
 }
 
-static int updateStatistics( intf_thread_t *p_intf, input_item_t *p_item )
+static int updateStatistics( intf_thread_t *p_intf, input_thread_t *p_input )
 {
+    input_item_t *p_item = input_GetItem( p_input );
     if( !p_item ) return VLC_EGENERIC;
 
     vlc_mutex_lock( &p_item->lock );
@@ -1786,6 +1787,24 @@ static int updateStatistics( intf_thread_t *p_intf, input_item_t *p_item )
     msg_rc(_("| sending bitrate  :   %6.0f kb/s"),
             (float)(p_item->p_stats->f_send_bitrate*8)*1000 );
     msg_rc("|");
+    /* Read-ahead */
+    msg_rc("%s", _("+-[Read-ahead]"));
+    msg_rc(_("| hits             :    %5"PRIi64),
+           var_GetInteger( p_input, "prefetch-hits" ) );
+    msg_rc(_("| stalls           :    %5"PRIi64),
+           var_GetInteger( p_input, "prefetch-stalls" ) );
+    msg_rc(_("| time stalled     :    %5"PRIi64" ms"),
+           var_GetInteger( p_input, "prefetch-stall-time" ) / 1000 );
+    msg_rc("|");
+    /* Block allocator */
+    msg_rc("%s", _("+-[Block allocator]"));
+    msg_rc(_("| pool hits        :    %5"PRIi64),
+           var_GetInteger( p_intf->p_libvlc, "block-pool-hits" ) );
+    msg_rc(_("| pool misses      :    %5"PRIi64),
+           var_GetInteger( p_intf->p_libvlc, "block-pool-misses" ) );
+    msg_rc(_("| bytes retained   : %8.0f KiB"),
+            var_GetInteger( p_intf->p_libvlc, "block-pool-retained" )/1024.f );
+    msg_rc("|");
     msg_rc( "+----[ end of statistical info ]" );
     vlc_mutex_unlock( &p_item->p_stats->lock );
     vlc_mutex_unlock( &p_item->lock );
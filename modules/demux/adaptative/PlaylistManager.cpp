@@ -38,6 +38,7 @@
 #include "logic/AlwaysBestAdaptationLogic.h"
 #include "logic/RateBasedAdaptationLogic.h"
 #include "logic/AlwaysLowestAdaptationLogic.hpp"
+#include "logic/BufferBasedAdaptationLogic.h"
 #include <vlc_stream.h>
 
 using namespace adaptative::http;
@@ -51,7 +52,8 @@ PlaylistManager::PlaylistManager( AbstractPlaylist *pl,
              logicType      ( type ),
              playlist       ( pl ),
              stream         ( stream ),
-             nextPlaylistupdate  ( 0 )
+             nextPlaylistupdate  ( 0 ),
+             prefetch       ( 3 )
 {
     for(int i=0; i<StreamTypeCount; i++)
         streams[i] = NULL;
@@ -59,9 +61,10 @@ PlaylistManager::PlaylistManager( AbstractPlaylist *pl,
 
 PlaylistManager::~PlaylistManager   ()
 {
-    delete conManager;
+    /* stops the download threads first */
     for(int i=0; i<StreamTypeCount; i++)
         delete streams[i];
+    delete conManager;
 }
 
 bool PlaylistManager::start(demux_t *demux)
@@ -70,6 +73,10 @@ bool PlaylistManager::start(demux_t *demux)
     if(!period)
         return false;
 
+    conManager = new (std::nothrow) HTTPConnectionManager(VLC_OBJECT(stream));
+    if(!conManager)
+        return false;
+
     for(int i=0; i<StreamTypeCount; i++)
     {
         StreamType type = static_cast<StreamType>(i);
@@ -92,7 +99,7 @@ bool PlaylistManager::start(demux_t *demux)
             {
                 if(!tracker)
                     throw VLC_ENOMEM;
-                streams[type]->create(demux, logic, tracker);
+                streams[type]->create(demux, logic, tracker, conManager, prefetch);
             } catch (int) {
                 delete streams[type];
                 delete logic;
@@ -102,10 +109,6 @@ bool PlaylistManager::start(demux_t *demux)
         }
     }
 
-    conManager = new (std::nothrow) HTTPConnectionManager(VLC_OBJECT(stream));
-    if(!conManager)
-        return false;
-
     playlist->playbackStart.Set(time(NULL));
     nextPlaylistupdate = playlist->playbackStart.Get();
 
@@ -122,7 +125,7 @@ Stream::status PlaylistManager::demux(mtime_t nzdeadline)
             continue;
 
         Stream::status i_ret =
-                streams[type]->demux(conManager, nzdeadline);
+                streams[type]->demux(nzdeadline);
 
         if(i_ret < Stream::status_eof)
             return i_ret;
@@ -133,6 +136,21 @@ Stream::status PlaylistManager::demux(mtime_t nzdeadline)
     return i_return;
 }
 
+/* shortest duration downloaded ahead among the streams, or -1 */
+mtime_t PlaylistManager::getBufferLevel() const
+{
+    mtime_t level = -1;
+    for(int type=0; type<StreamTypeCount; type++)
+    {
+        if(!streams[type])
+            continue;
+        mtime_t streamLevel = streams[type]->getBufferLevel();
+        if(level == -1 || streamLevel < level)
+            level = streamLevel;
+    }
+    return level;
+}
+
 mtime_t PlaylistManager::getPCR() const
 {
     mtime_t pcr = VLC_TS_INVALID;
@@ -227,6 +245,8 @@ AbstractAdaptationLogic *PlaylistManager::createLogic(AbstractAdaptationLogic::L
         case AbstractAdaptationLogic::Default:
         case AbstractAdaptationLogic::RateBased:
             return new (std::nothrow) RateBasedAdaptationLogic(0, 0);
+        case AbstractAdaptationLogic::BufferBased:
+            return new (std::nothrow) BufferBasedAdaptationLogic(0, 0);
         default:
             return NULL;
     }
@@ -53,6 +53,7 @@ namespace adaptative
             Stream::status demux(mtime_t);
             mtime_t getDuration() const;
             mtime_t getPCR() const;
+            mtime_t getBufferLevel() const;
             int     getGroup() const;
             int     esCount() const;
             bool    setPosition(mtime_t);
@@ -68,6 +69,7 @@ namespace adaptative
             stream_t                            *stream;
             Stream                              *streams[StreamTypeCount];
             mtime_t                              nextPlaylistupdate;
+            unsigned                             prefetch; /* segments downloaded ahead */
     };
 
 }
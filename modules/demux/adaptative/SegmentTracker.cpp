@@ -55,6 +55,14 @@ void SegmentTracker::resetCounter()
 }
 
 Chunk * SegmentTracker::getNextChunk(StreamType type)
+{
+    playlist->lock();
+    Chunk *chunk = getNextChunkUnlocked(type);
+    playlist->unlock();
+    return chunk;
+}
+
+Chunk * SegmentTracker::getNextChunkUnlocked(StreamType type)
 {
     BaseRepresentation *rep;
     ISegment *segment;
@@ -97,12 +105,16 @@ Chunk * SegmentTracker::getNextChunk(StreamType type)
     {
         currentPeriod = playlist->getNextPeriod(currentPeriod);
         resetCounter();
-        return getNextChunk(type);
+        return getNextChunkUnlocked(type);
     }
 
     Chunk *chunk = segment->toChunk(count, rep);
     if(chunk)
+    {
+        chunk->setDuration(rep->getPlaybackTimeBySegmentNumber(count + 1) -
+                           rep->getPlaybackTimeBySegmentNumber(count));
         count++;
+    }
 
     return chunk;
 }
@@ -110,20 +122,27 @@ Chunk * SegmentTracker::getNextChunk(StreamType type)
 bool SegmentTracker::setPosition(mtime_t time, bool tryonly)
 {
     uint64_t segcount;
+    bool ret = false;
+
+    playlist->lock();
     if(prevRepresentation &&
        prevRepresentation->getSegmentNumberByTime(time, &segcount))
     {
         if(!tryonly)
             count = segcount;
-        return true;
+        ret = true;
     }
-    return false;
+    playlist->unlock();
+    return ret;
 }
 
 mtime_t SegmentTracker::getSegmentStart() const
 {
+    mtime_t start = 0;
+
+    playlist->lock();
     if(prevRepresentation)
-        return prevRepresentation->getPlaybackTimeBySegmentNumber(count);
-    else
-        return 0;
+        start = prevRepresentation->getPlaybackTimeBySegmentNumber(count);
+    playlist->unlock();
+    return start;
 }
@@ -63,6 +63,7 @@ namespace adaptative
             mtime_t getSegmentStart() const;
 
         private:
+            Chunk* getNextChunkUnlocked(StreamType);
             bool initializing;
             bool indexed;
             uint64_t count;
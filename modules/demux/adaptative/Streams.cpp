@@ -18,6 +18,7 @@
  * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
  *****************************************************************************/
 #define __STDC_CONSTANT_MACROS
+#define __STDC_FORMAT_MACROS
 #include "Streams.hpp"
 #include "StreamsType.hpp"
 #include "http/HTTPConnection.hpp"
@@ -32,6 +33,12 @@ using namespace adaptative;
 using namespace adaptative::http;
 using namespace adaptative::logic;
 
+/* marks the last block of a downloaded chunk */
+#define BLOCK_FLAG_CHUNK_END (1 << BLOCK_FLAG_PRIVATE_SHIFT)
+
+/* longest wait for downloaded data in the demux thread */
+#define READ_TIMEOUT (CLOCK_FREQ / 10)
+
 Stream::Stream(const std::string &mime)
 {
     init(mimeToType(mime), mimeToFormat(mime));
@@ -48,14 +55,41 @@ void Stream::init(const StreamType type_, const StreamFormat format_)
     format = format_;
     output = NULL;
     adaptationLogic = NULL;
-    currentChunk = NULL;
     eof = false;
     segmentTracker = NULL;
+    connManager = NULL;
+    demuxer = NULL;
+    buffer = NULL;
+    pp_buffer_last = &buffer;
+    bufferedChunks = 0;
+    prefetch = 1;
+    bufferLevel = 0;
+    generation = 0;
+    running = false;
+    dead = false;
+    currentChunk = NULL;
+    vlc_mutex_init(&lock);
+    vlc_cond_init(&waitData);
+    vlc_cond_init(&waitSpace);
 }
 
 Stream::~Stream()
 {
-    delete currentChunk;
+    if(running)
+    {
+        vlc_mutex_lock(&lock);
+        dead = true;
+        vlc_cond_signal(&waitSpace);
+        /* the thread may be blocked reading from the network */
+        if(currentChunk)
+            connManager->interruptChunk(currentChunk);
+        vlc_mutex_unlock(&lock);
+        vlc_join(thread, NULL);
+    }
+    block_ChainRelease(buffer);
+    vlc_cond_destroy(&waitSpace);
+    vlc_cond_destroy(&waitData);
+    vlc_mutex_destroy(&lock);
     delete adaptationLogic;
     delete output;
     delete segmentTracker;
@@ -90,7 +124,8 @@ StreamFormat Stream::mimeToFormat(const std::string &mime)
     return format;
 }
 
-void Stream::create(demux_t *demux, AbstractAdaptationLogic *logic, SegmentTracker *tracker)
+void Stream::create(demux_t *demux, AbstractAdaptationLogic *logic, SegmentTracker *tracker,
+                    HTTPConnectionManager *conn, unsigned prefetch_)
 {
     switch(format)
     {
@@ -106,6 +141,18 @@ void Stream::create(demux_t *demux, AbstractAdaptationLogic *logic, SegmentTrack
     }
     adaptationLogic = logic;
     segmentTracker = tracker;
+    connManager = conn;
+    demuxer = VLC_OBJECT(demux);
+    prefetch = prefetch_ ? prefetch_ : 1;
+
+    if(vlc_clone(&thread, downloadThread, this, VLC_THREAD_PRIORITY_INPUT))
+    {
+        /* still owned by the caller on failure */
+        adaptationLogic = NULL;
+        segmentTracker = NULL;
+        throw VLC_EGENERIC;
+    }
+    running = true;
 }
 
 bool Stream::isEOF() const
@@ -133,29 +180,21 @@ bool Stream::operator ==(const Stream &stream) const
     return stream.type == type;
 }
 
-Chunk * Stream::getChunk()
-{
-    if (currentChunk == NULL)
-    {
-        currentChunk = segmentTracker->getNextChunk(type);
-        if (currentChunk == NULL)
-            eof = true;
-    }
-    return currentChunk;
-}
-
 bool Stream::seekAble() const
 {
     return (output && output->seekAble());
 }
 
-Stream::status Stream::demux(HTTPConnectionManager *connManager, mtime_t nz_deadline)
+Stream::status Stream::demux(mtime_t nz_deadline)
 {
     if(nz_deadline + VLC_TS_0 > output->getPCR()) /* not already demuxed */
     {
         /* need to read, demuxer still buffering, ... */
-        if(read(connManager) <= 0)
+        ssize_t readsize = read();
+        if(readsize == 0)
             return Stream::status_eof;
+        if(readsize < 0) /* nothing downloaded yet */
+            return Stream::status_buffering;
 
         if(nz_deadline + VLC_TS_0 > output->getPCR()) /* need to read more */
             return Stream::status_buffering;
@@ -165,79 +204,207 @@ Stream::status Stream::demux(HTTPConnectionManager *connManager, mtime_t nz_dead
     return Stream::status_demuxed;
 }
 
-size_t Stream::read(HTTPConnectionManager *connManager)
+/* Returns -1 if no data arrived in time, so that the demux thread gets
+ * back to the input loop and can be stopped */
+ssize_t Stream::read()
 {
-    Chunk *chunk = getChunk();
-    if(!chunk)
-        return 0;
+    const mtime_t deadline = mdate() + READ_TIMEOUT;
 
-    if(!chunk->getConnection())
+    vlc_mutex_lock(&lock);
+    while(buffer == NULL && !eof)
     {
-       if(!connManager->connectChunk(chunk))
-        return 0;
+        if(vlc_cond_timedwait(&waitData, &lock, deadline) &&
+           buffer == NULL && !eof)
+        {
+            vlc_mutex_unlock(&lock);
+            return -1;
+        }
     }
 
-    size_t readsize = 0;
-
-    /* New chunk, do query */
-    if(chunk->getBytesRead() == 0)
+    block_t *block = buffer;
+    if(block)
     {
-        if(chunk->getConnection()->query(chunk->getPath()) != VLC_SUCCESS)
+        buffer = block->p_next;
+        if(buffer == NULL)
+            pp_buffer_last = &buffer;
+        block->p_next = NULL;
+
+        bufferLevel -= block->i_length;
+        if(block->i_flags & BLOCK_FLAG_CHUNK_END)
         {
-            chunk->getConnection()->releaseChunk();
-            currentChunk = NULL;
-            delete chunk;
-            return 0;
+            bufferedChunks--;
+            vlc_cond_signal(&waitSpace);
         }
     }
+    vlc_mutex_unlock(&lock);
 
-    /* Because we don't know Chunk size at start, we need to get size
-       from content length */
-    readsize = chunk->getBytesToRead();
-    if (readsize > 32768)
-        readsize = 32768;
-
-    block_t *block = block_Alloc(readsize);
     if(!block)
         return 0;
 
-    mtime_t time = mdate();
-    ssize_t ret = chunk->getConnection()->read(block->p_buffer, readsize);
-    time = mdate() - time;
+    block->i_flags &= ~BLOCK_FLAG_CHUNK_END;
+    block->i_length = 0;
+
+    size_t readsize = block->i_buffer;
+    output->pushBlock(block);
+    return readsize;
+}
+
+mtime_t Stream::getBufferLevel() const
+{
+    vlc_mutex_lock(&lock);
+    mtime_t level = bufferLevel;
+    vlc_mutex_unlock(&lock);
+    return level;
+}
+
+void *Stream::downloadThread(void *data)
+{
+    Stream *me = static_cast<Stream *>(data);
+    int canc = vlc_savecancel();
 
-    if(ret < 0)
+    vlc_mutex_lock(&me->lock);
+    while(!me->dead)
     {
-        block_Release(block);
-        chunk->getConnection()->releaseChunk();
-        currentChunk = NULL;
+        if(me->eof || me->bufferedChunks >= me->prefetch)
+        {
+            vlc_cond_wait(&me->waitSpace, &me->lock);
+            continue;
+        }
+
+        /* The next chunk is picked under the lock, so that it always
+         * matches the current position */
+        const unsigned generation = me->generation;
+        me->adaptationLogic->updateBufferLevel(me->bufferLevel);
+        Chunk *chunk = me->segmentTracker->getNextChunk(me->type);
+        me->currentChunk = chunk;
+        vlc_mutex_unlock(&me->lock);
+
+        bool b_ok = chunk && me->download(chunk, generation);
+
+        vlc_mutex_lock(&me->lock);
+        me->currentChunk = NULL;
         delete chunk;
-        return 0;
+        if(!b_ok && generation == me->generation)
+        {
+            me->eof = true;
+            vlc_cond_signal(&me->waitData);
+        }
     }
-    else
+    vlc_mutex_unlock(&me->lock);
+
+    vlc_restorecancel(canc);
+    return NULL;
+}
+
+bool Stream::download(Chunk *chunk, unsigned generation)
+{
+    if(!connManager->connectChunk(chunk))
+        return false;
+
+    /* interrupted before the chunk got its connection */
+    vlc_mutex_lock(&lock);
+    bool b_dead = dead;
+    vlc_mutex_unlock(&lock);
+    if(b_dead)
     {
-        block->i_buffer = (size_t)ret;
+        connManager->releaseChunk(chunk);
+        return false;
+    }
+
+    if(chunk->getConnection()->query(chunk->getPath()) != VLC_SUCCESS)
+    {
+        connManager->releaseChunk(chunk);
+        return false;
+    }
+
+    bool b_ok = true;
+
+    /* Because we don't know Chunk size at start, we need to get size
+       from content length */
+    while(chunk->getBytesToRead() > 0)
+    {
+        size_t readsize = chunk->getBytesToRead();
+        if (readsize > 32768)
+            readsize = 32768;
+
+        block_t *block = block_Alloc(readsize);
+        if(!block)
+        {
+            b_ok = false;
+            break;
+        }
 
+        mtime_t time = mdate();
+        ssize_t ret = chunk->getConnection()->read(block->p_buffer, readsize);
+        time = mdate() - time;
+
+        if(ret < 0)
+        {
+            block_Release(block);
+            b_ok = false;
+            break;
+        }
+
+        block->i_buffer = (size_t)ret;
         adaptationLogic->updateDownloadRate(block->i_buffer, time);
 
         if (chunk->getBytesToRead() == 0)
         {
             chunk->onDownload(block->p_buffer, block->i_buffer);
-            chunk->getConnection()->releaseChunk();
-            currentChunk = NULL;
-            delete chunk;
+            block->i_flags |= BLOCK_FLAG_CHUNK_END;
+            /* the segment only counts once complete, for its duration */
+            block->i_length = chunk->getDuration();
         }
-    }
 
-    readsize = block->i_buffer;
+        vlc_mutex_lock(&lock);
+        if(generation != this->generation || dead)
+        {
+            /* seeked meanwhile: this chunk is not wanted anymore */
+            vlc_mutex_unlock(&lock);
+            block_Release(block);
+            break;
+        }
 
-    output->pushBlock(block);
+        *pp_buffer_last = block;
+        pp_buffer_last = &block->p_next;
+        bufferLevel += block->i_length;
+        if(block->i_flags & BLOCK_FLAG_CHUNK_END)
+        {
+            bufferedChunks++;
+            msg_Dbg(demuxer, "%u segment(s) downloaded ahead, %" PRId64 " ms "
+                    "buffered", bufferedChunks, bufferLevel / 1000);
+        }
+        vlc_cond_signal(&waitData);
+        vlc_mutex_unlock(&lock);
+    }
 
-    return readsize;
+    connManager->releaseChunk(chunk);
+    return b_ok;
+}
+
+void Stream::flush()
+{
+    block_ChainRelease(buffer);
+    buffer = NULL;
+    pp_buffer_last = &buffer;
+    bufferedChunks = 0;
+    bufferLevel = 0;
 }
 
 bool Stream::setPosition(mtime_t time, bool tryonly)
 {
+    vlc_mutex_lock(&lock);
     bool ret = segmentTracker->setPosition(time, tryonly);
+    if(!tryonly && ret)
+    {
+        /* drop whatever was downloaded ahead of the former position */
+        flush();
+        generation++;
+        eof = false;
+        vlc_cond_signal(&waitSpace);
+    }
+    vlc_mutex_unlock(&lock);
+
     if(!tryonly && ret)
         output->setPosition(time);
     return ret;
@@ -59,27 +59,47 @@ namespace adaptative
         bool operator==(const Stream &) const;
         static StreamType mimeToType(const std::string &mime);
         static StreamFormat mimeToFormat(const std::string &mime);
-        void create(demux_t *, AbstractAdaptationLogic *, SegmentTracker *);
+        void create(demux_t *, AbstractAdaptationLogic *, SegmentTracker *,
+                    HTTPConnectionManager *, unsigned);
         bool isEOF() const;
         mtime_t getPCR() const;
         int getGroup() const;
         int esCount() const;
         bool seekAble() const;
         typedef enum {status_eof, status_buffering, status_demuxed} status;
-        status demux(HTTPConnectionManager *, mtime_t);
+        status demux(mtime_t);
         bool setPosition(mtime_t, bool);
         mtime_t getPosition() const;
+        mtime_t getBufferLevel() const;
 
     private:
-        Chunk *getChunk();
         void init(const StreamType, const StreamFormat);
-        size_t read(HTTPConnectionManager *);
+        ssize_t read();
+        static void *downloadThread(void *);
+        bool download(Chunk *, unsigned);
+        void flush();
         StreamType type;
         StreamFormat format;
         AbstractStreamOutput *output;
         AbstractAdaptationLogic *adaptationLogic;
         SegmentTracker *segmentTracker;
-        http::Chunk *currentChunk;
+        HTTPConnectionManager *connManager;
+        vlc_object_t *demuxer;
+
+        /* Segments are downloaded ahead by a thread of their own */
+        vlc_thread_t thread;
+        mutable vlc_mutex_t lock;
+        vlc_cond_t waitData;
+        vlc_cond_t waitSpace;
+        block_t *buffer;
+        block_t **pp_buffer_last;
+        unsigned bufferedChunks; /* fully downloaded segments */
+        unsigned prefetch;
+        mtime_t bufferLevel; /* duration of the segments downloaded ahead */
+        unsigned generation; /* bumped on seek */
+        Chunk *currentChunk; /* being downloaded, interrupted when dead */
+        bool running;
+        bool dead;
         bool eof;
     };
 
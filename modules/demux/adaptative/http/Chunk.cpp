@@ -36,6 +36,7 @@ Chunk::Chunk        (const std::string& url) :
        startByte    (0),
        endByte      (0),
        bitrate      (1),
+       duration     (0),
        port         (0),
        length       (0),
        bytesRead    (0),
@@ -111,6 +112,15 @@ int                 Chunk::getBitrate           ()
     return this->bitrate;
 }
 
+void                Chunk::setDuration          (int64_t duration)
+{
+    this->duration = duration;
+}
+int64_t             Chunk::getDuration          () const
+{
+    return this->duration;
+}
+
 const std::string&  Chunk::getScheme            () const
 {
     return scheme;
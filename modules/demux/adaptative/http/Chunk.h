@@ -64,6 +64,9 @@ namespace adaptative
                 bool                usesByteRange   () const;
                 void                setBitrate      (uint64_t bitrate);
                 int                 getBitrate      ();
+                /* playback duration in microseconds, 0 if unknown */
+                void                setDuration     (int64_t duration);
+                int64_t             getDuration     () const;
 
                 virtual void        onDownload      (void *, size_t) {}
 
@@ -76,6 +79,7 @@ namespace adaptative
                 size_t                      startByte;
                 size_t                      endByte;
                 int                         bitrate;
+                int64_t                     duration;
                 int                         port;
                 uint64_t                    length;
                 uint64_t                    bytesRead;
@@ -69,6 +69,12 @@ void HTTPConnection::disconnect()
     socket->disconnect();
 }
 
+/* Can be called from another thread than the one using the connection */
+void HTTPConnection::interrupt()
+{
+    socket->interrupt();
+}
+
 int HTTPConnection::query(const std::string &path)
 {
     if(!chunk)
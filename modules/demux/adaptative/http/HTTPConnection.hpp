@@ -52,6 +52,7 @@ namespace adaptative
                 virtual ssize_t read        (void *p_buffer, size_t len);
                 virtual void    disconnect  ();
                 virtual bool    send        (const std::string &data);
+                void            interrupt   ();
 
                 const std::string&  getHostname () const;
                 virtual void    bindChunk   (Chunk *chunk);
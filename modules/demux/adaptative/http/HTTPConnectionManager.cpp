@@ -37,10 +37,12 @@ const uint64_t  HTTPConnectionManager::CHUNKDEFAULTBITRATE    = 1;
 HTTPConnectionManager::HTTPConnectionManager    (vlc_object_t *stream) :
                        stream                   (stream)
 {
+    vlc_mutex_init(&lock);
 }
 HTTPConnectionManager::~HTTPConnectionManager   ()
 {
     this->closeAllConnections();
+    vlc_mutex_destroy(&lock);
 }
 
 void HTTPConnectionManager::closeAllConnections      ()
@@ -51,9 +53,11 @@ void HTTPConnectionManager::closeAllConnections      ()
 
 void HTTPConnectionManager::releaseAllConnections()
 {
+    vlc_mutex_lock(&lock);
     std::vector<HTTPConnection *>::iterator it;
     for(it = connectionPool.begin(); it != connectionPool.end(); ++it)
         (*it)->releaseChunk();
+    vlc_mutex_unlock(&lock);
 }
 
 HTTPConnection * HTTPConnectionManager::getConnectionForHost(const std::string &hostname)
@@ -77,29 +81,61 @@ bool HTTPConnectionManager::connectChunk(Chunk *chunk)
     msg_Dbg(stream, "Retrieving %s @%zu", chunk->getUrl().c_str(),
             chunk->getStartByte());
 
+    /* Streams download from their own threads: the pool is locked, but
+     * connecting is done outside of the lock, once the chunk is bound */
+    vlc_mutex_lock(&lock);
     HTTPConnection *conn = getConnectionForHost(chunk->getHostname());
     if(!conn)
     {
         const bool tls = (chunk->getScheme() == "https");
         Socket *socket = tls ? new (std::nothrow) TLSSocket(): new (std::nothrow) Socket();
         if(!socket)
+        {
+            vlc_mutex_unlock(&lock);
             return false;
+        }
         /* disable pipelined tls until we have ticket/resume session support */
         conn = new (std::nothrow) HTTPConnection(stream, socket, chunk, !tls);
         if(!conn)
         {
+            vlc_mutex_unlock(&lock);
             delete socket;
             return false;
         }
         connectionPool.push_back(conn);
+        vlc_mutex_unlock(&lock);
         if (!chunk->getConnection()->connect(chunk->getHostname(), chunk->getPort()))
+        {
+            releaseChunk(chunk);
             return false;
+        }
+    }
+    else
+    {
+        conn->bindChunk(chunk);
+        vlc_mutex_unlock(&lock);
     }
-
-    conn->bindChunk(chunk);
 
     if(chunk->getBitrate() <= 0)
         chunk->setBitrate(HTTPConnectionManager::CHUNKDEFAULTBITRATE);
 
     return true;
 }
+
+void HTTPConnectionManager::releaseChunk(Chunk *chunk)
+{
+    vlc_mutex_lock(&lock);
+    if(chunk->getConnection())
+        chunk->getConnection()->releaseChunk();
+    vlc_mutex_unlock(&lock);
+}
+
+/* Wakes up the thread downloading the chunk, if it is blocked on its
+ * connection. The connection cannot be used anymore afterwards. */
+void HTTPConnectionManager::interruptChunk(Chunk *chunk)
+{
+    vlc_mutex_lock(&lock);
+    if(chunk->getConnection())
+        chunk->getConnection()->interrupt();
+    vlc_mutex_unlock(&lock);
+}
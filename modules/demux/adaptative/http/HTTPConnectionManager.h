@@ -49,9 +49,12 @@ namespace adaptative
                 void    closeAllConnections ();
                 void    releaseAllConnections ();
                 bool    connectChunk        (Chunk *chunk);
+                void    releaseChunk        (Chunk *chunk);
+                void    interruptChunk      (Chunk *chunk);
 
             private:
                 std::vector<HTTPConnection *>                       connectionPool;
+                vlc_mutex_t                                         lock;
                 vlc_object_t                                       *stream;
 
                 static const uint64_t   CHUNKDEFAULTBITRATE;
@@ -27,20 +27,33 @@ using namespace adaptative::http;
 Socket::Socket()
 {
     netfd = -1;
+    interrupted = false;
+    vlc_mutex_init(&lock);
 }
 
 Socket::~Socket()
 {
     disconnect();
+    vlc_mutex_destroy(&lock);
 }
 
 bool Socket::connect(vlc_object_t *stream, const std::string &hostname, int port)
 {
-    netfd = net_ConnectTCP(stream, hostname.c_str(), port);
+    int fd = net_ConnectTCP(stream, hostname.c_str(), port);
 
-    if(netfd == -1)
+    if(fd == -1)
         return false;
 
+    vlc_mutex_lock(&lock);
+    if(interrupted)
+    {
+        vlc_mutex_unlock(&lock);
+        net_Close(fd);
+        return false;
+    }
+    netfd = fd;
+    vlc_mutex_unlock(&lock);
+
     return true;
 }
 
@@ -51,11 +64,24 @@ bool Socket::connected() const
 
 void Socket::disconnect()
 {
+    vlc_mutex_lock(&lock);
+    int fd = netfd;
+    netfd = -1;
+    vlc_mutex_unlock(&lock);
+
+    if (fd >= 0)
+        net_Close(fd);
+}
+
+/* Wakes up a read or write blocked on the socket, from another thread.
+ * The socket cannot be connected anymore afterwards. */
+void Socket::interrupt()
+{
+    vlc_mutex_lock(&lock);
+    interrupted = true;
     if (netfd >= 0)
-    {
-        net_Close(netfd);
-        netfd = -1;
-    }
+        shutdown(netfd, SHUT_RDWR);
+    vlc_mutex_unlock(&lock);
 }
 
 ssize_t Socket::read(vlc_object_t *stream, void *p_buffer, size_t len)
@@ -98,6 +124,8 @@ TLSSocket::TLSSocket() : Socket()
 TLSSocket::~TLSSocket()
 {
     disconnect();
+    if(creds)
+        vlc_tls_Delete(creds);
 }
 
 bool TLSSocket::connect(vlc_object_t *stream, const std::string &hostname, int port)
@@ -106,7 +134,9 @@ bool TLSSocket::connect(vlc_object_t *stream, const std::string &hostname, int p
     if(!Socket::connect(stream, hostname, port))
         return false;
 
-    creds = vlc_tls_ClientCreate(stream);
+    /* credentials are kept across connections, so that sessions resume */
+    if(!creds)
+        creds = vlc_tls_ClientCreate(stream);
     if(!creds)
     {
         disconnect();
@@ -159,9 +189,6 @@ void TLSSocket::disconnect()
 {
     if(tls)
         vlc_tls_SessionDelete(tls);
-    if(creds)
-        vlc_tls_Delete(creds);
     tls = NULL;
-    creds = NULL;
     Socket::disconnect();
 }
@@ -43,9 +43,14 @@ namespace adaptative
                 virtual ssize_t read        (vlc_object_t *, void *p_buffer, size_t len);
                 virtual std::string readline(vlc_object_t *);
                 virtual void    disconnect  ();
+                void            interrupt   ();
 
             protected:
                 int netfd;
+
+            private:
+                vlc_mutex_t lock; /* netfd against interrupt() */
+                bool interrupted;
         };
 
         class TLSSocket : public Socket
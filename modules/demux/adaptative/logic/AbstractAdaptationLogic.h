@@ -48,6 +48,8 @@ namespace adaptative
 
                 virtual BaseRepresentation* getCurrentRepresentation(StreamType, BasePeriod *) const = 0;
                 virtual void                updateDownloadRate     (size_t, mtime_t);
+                /* duration of media downloaded ahead of the demuxer */
+                virtual void                updateBufferLevel      (mtime_t);
 
                 enum LogicType
                 {
@@ -55,7 +57,8 @@ namespace adaptative
                     AlwaysBest,
                     AlwaysLowest,
                     RateBased,
-                    FixedRate
+                    FixedRate,
+                    BufferBased
                 };
         };
     }
@@ -0,0 +1,160 @@
+/*
+ * BufferBasedAdaptationLogic.cpp
+ *****************************************************************************
+ * Copyright (C) 2015 - VideoLAN authors
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "BufferBasedAdaptationLogic.h"
+#include "Representationselectors.hpp"
+
+#include "../playlist/BaseRepresentation.h"
+#include "../playlist/BasePeriod.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace adaptative::logic;
+
+/* Reads are gathered into samples of at least that much time or data */
+#define SAMPLE_TIME     (CLOCK_FREQ / 8)
+#define SAMPLE_SIZE     (512 * 1024)
+/* Half-lives of the averages, in seconds of download time */
+#define FAST_HALFLIFE   2.
+#define SLOW_HALFLIFE   8.
+/* Below the reservoir, half of the estimate is used; the margin then shrinks
+ * linearly until the buffer reaches the cushion */
+#define RESERVOIR       (2 * CLOCK_FREQ)
+#define CUSHION         (4 * CLOCK_FREQ)
+#define MARGIN_LOW      .5
+#define MARGIN_HIGH     .9
+
+BufferBasedAdaptationLogic::MovingAverage::MovingAverage(double halfLife_) :
+    halfLife(halfLife_), average(0.), totalWeight(0.)
+{
+}
+
+void BufferBasedAdaptationLogic::MovingAverage::push(double weight, double value)
+{
+    double alpha = pow(.5, weight / halfLife);
+    average = value * (1. - alpha) + average * alpha;
+    totalWeight += weight;
+}
+
+double BufferBasedAdaptationLogic::MovingAverage::get() const
+{
+    if(totalWeight <= 0.)
+        return 0.;
+    /* the average started from zero: unbias it */
+    return average / (1. - pow(.5, totalWeight / halfLife));
+}
+
+BufferBasedAdaptationLogic::BufferBasedAdaptationLogic  (int w, int h) :
+                            AbstractAdaptationLogic     (),
+                            sampleBytes(0), sampleTime(0),
+                            fastAvg(FAST_HALFLIFE), slowAvg(SLOW_HALFLIFE),
+                            historyCount(0), bufferLevel(0),
+                            currentBps(0)
+{
+    width  = w;
+    height = h;
+}
+
+BaseRepresentation *BufferBasedAdaptationLogic::getCurrentRepresentation(StreamType type, BasePeriod *period) const
+{
+    if(period == NULL)
+        return NULL;
+
+    RepresentationSelector selector;
+    BaseRepresentation *rep = selector.select(period, type, currentBps, width, height);
+    if ( rep == NULL )
+    {
+        rep = selector.select(period, type);
+        if ( rep == NULL )
+            return NULL;
+    }
+    return rep;
+}
+
+void BufferBasedAdaptationLogic::updateDownloadRate(size_t size, mtime_t time)
+{
+    sampleBytes += size;
+    sampleTime += time;
+    if(sampleTime < SAMPLE_TIME && sampleBytes < SAMPLE_SIZE)
+        return;
+
+    if(likely(sampleTime > 0))
+    {
+        double bps = 8. * CLOCK_FREQ * sampleBytes / sampleTime;
+        double weight = (double) sampleTime / CLOCK_FREQ;
+
+        fastAvg.push(weight, bps);
+        slowAvg.push(weight, bps);
+        history[historyCount++ % HISTORY] = bps;
+    }
+    sampleBytes = 0;
+    sampleTime = 0;
+
+    updateTarget();
+}
+
+void BufferBasedAdaptationLogic::updateBufferLevel(mtime_t level)
+{
+    bufferLevel = level;
+    updateTarget();
+}
+
+uint64_t BufferBasedAdaptationLogic::getEstimate() const
+{
+    if(historyCount == 0)
+        return 0;
+
+    /* The lowest of the fast and slow averages reacts quickly to drops but
+     * slowly to increases; the harmonic mean of the last samples damps the
+     * outliers both ways */
+    double estimate = std::min(fastAvg.get(), slowAvg.get());
+    unsigned count = historyCount < HISTORY ? historyCount : HISTORY;
+    double sum = 0.;
+    for(unsigned i = 0; i < count; i++)
+        sum += 1. / history[i];
+    estimate = std::min(estimate, count / sum);
+
+    return estimate;
+}
+
+void BufferBasedAdaptationLogic::updateTarget()
+{
+    double margin;
+    if(bufferLevel <= RESERVOIR)
+        margin = MARGIN_LOW;
+    else if(bufferLevel >= CUSHION)
+        margin = MARGIN_HIGH;
+    else
+        margin = MARGIN_LOW + (MARGIN_HIGH - MARGIN_LOW) *
+                 (bufferLevel - RESERVOIR) / (CUSHION - RESERVOIR);
+
+    uint64_t target = getEstimate() * margin;
+
+    /* Switch down at once, but up only once the buffer is out of the
+     * reservoir, and not for small gains */
+    if(target > currentBps &&
+       (bufferLevel < RESERVOIR || target < currentBps + currentBps / 8))
+        return;
+    currentBps = target;
+}
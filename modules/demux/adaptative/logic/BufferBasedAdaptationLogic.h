@@ -0,0 +1,73 @@
+/*
+ * BufferBasedAdaptationLogic.h
+ *****************************************************************************
+ * Copyright (C) 2015 - VideoLAN authors
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+#ifndef BUFFERBASEDADAPTATIONLOGIC_H_
+#define BUFFERBASEDADAPTATIONLOGIC_H_
+
+#include "AbstractAdaptationLogic.h"
+
+namespace adaptative
+{
+    namespace logic
+    {
+        /* Picks the representation from a smoothed bandwidth estimate, with
+         * a safety margin that shrinks as the buffer fills up. */
+        class BufferBasedAdaptationLogic : public AbstractAdaptationLogic
+        {
+            public:
+                BufferBasedAdaptationLogic          (int, int);
+
+                BaseRepresentation *getCurrentRepresentation(StreamType, BasePeriod *) const;
+                virtual void updateDownloadRate(size_t, mtime_t);
+                virtual void updateBufferLevel(mtime_t);
+                uint64_t     getEstimate() const;
+
+            private:
+                class MovingAverage
+                {
+                    public:
+                        MovingAverage(double);
+                        void push(double, double);
+                        double get() const;
+
+                    private:
+                        double halfLife;
+                        double average;
+                        double totalWeight;
+                };
+
+                void updateTarget();
+
+                static const unsigned HISTORY = 5;
+
+                int                     width;
+                int                     height;
+                size_t                  sampleBytes;
+                mtime_t                 sampleTime;
+                MovingAverage           fastAvg;
+                MovingAverage           slowAvg;
+                double                  history[HISTORY];
+                unsigned                historyCount;
+                mtime_t                 bufferLevel;
+                uint64_t                currentBps;
+        };
+    }
+}
+
+#endif /* BUFFERBASEDADAPTATIONLOGIC_H_ */
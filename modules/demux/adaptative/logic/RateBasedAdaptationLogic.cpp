@@ -63,7 +63,7 @@ void RateBasedAdaptationLogic::updateDownloadRate(size_t size, mtime_t time)
     if(unlikely(time == 0))
         return;
 
-    size_t current = size * 8000 / time;
+    size_t current = (uint64_t) size * 8 * CLOCK_FREQ / time;
 
     if (current >= bpsAvg)
         bpsAvg = bpsAvg + (current - bpsAvg) / (bpsSamplecount + 1);
@@ -44,12 +44,24 @@ AbstractPlaylist::AbstractPlaylist (stream_t *stream_) :
     maxSegmentDuration.Set( 0 );
     minBufferTime.Set( 0 );
     timeShiftBufferDepth.Set( 0 );
+    vlc_mutex_init(&playlistLock);
 }
 
 AbstractPlaylist::~AbstractPlaylist()
 {
     for(size_t i = 0; i < this->periods.size(); i++)
         delete(this->periods.at(i));
+    vlc_mutex_destroy(&playlistLock);
+}
+
+void AbstractPlaylist::lock()
+{
+    vlc_mutex_lock(&playlistLock);
+}
+
+void AbstractPlaylist::unlock()
+{
+    vlc_mutex_unlock(&playlistLock);
 }
 
 const std::vector<BasePeriod *>& AbstractPlaylist::getPeriods()
@@ -27,6 +27,7 @@
 
 #include "Helper.h"
 #include <algorithm>
+#include <cctype>
 using namespace adaptative;
 
 std::string Helper::combinePaths        (const std::string &path1, const std::string &path2)
@@ -56,7 +57,7 @@ std::string Helper::getDirectoryPath    (const std::string &path)
 
 bool Helper::ifind(std::string haystack, std::string needle)
 {
-    transform(haystack.begin(), haystack.end(), haystack.begin(), toupper);
-    transform(needle.begin(), needle.end(), needle.begin(), toupper);
+    transform(haystack.begin(), haystack.end(), haystack.begin(), ::toupper);
+    transform(needle.begin(), needle.end(), needle.begin(), ::toupper);
     return haystack.find(needle) != std::string::npos;
 }
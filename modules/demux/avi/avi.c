@@ -42,6 +42,13 @@
 #include <vlc_codecs.h>
 #include <vlc_charset.h>
 #include <vlc_memory.h>
+#include <vlc_fs.h>
+#include <vlc_md5.h>
+#include <vlc_configuration.h>
+
+#include <errno.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "libavi.h"
 #include "../rawdv.h"
@@ -57,6 +64,12 @@
     "Recreate a index for the AVI file. Use this if your AVI file is damaged "\
     "or incomplete (not seekable)." )
 
+#define INDEX_FILE_TEXT N_("Store the created index")
+#define INDEX_FILE_LONGTEXT N_( \
+    "Store the index created for a damaged or incomplete AVI file in the " \
+    "cache directory, and use it instead of creating it again when the file " \
+    "is reopened." )
+
 #define BI_RAWRGB 0x00
 #define BI_RGBBITFIELDS 0x03
 
@@ -82,6 +95,8 @@ vlc_module_begin ()
     add_integer( "avi-index", 0,
               INDEX_TEXT, INDEX_LONGTEXT, false )
         change_integer_list( pi_index, ppsz_indexes )
+    add_bool( "avi-index-file", false,
+              INDEX_FILE_TEXT, INDEX_FILE_LONGTEXT, true )
 
     set_callbacks( Open, Close )
 vlc_module_end ()
@@ -137,6 +152,22 @@ static void avi_index_Init( avi_index_t * );
 static void avi_index_Clean( avi_index_t * );
 static void avi_index_Append( avi_index_t *, off_t *, avi_entry_t * );
 
+typedef struct
+{
+    vlc_thread_t    thread;
+    stream_t        *s;
+
+    vlc_mutex_t     lock;
+    bool            b_abort;
+    bool            b_done;
+    bool            b_store;
+
+    /* one per track, only appended to by the thread */
+    avi_index_t     *p_index;
+    off_t           i_last_pos;
+
+} avi_indexer_t;
+
 typedef struct
 {
     bool            b_activated;
@@ -186,6 +217,9 @@ struct demux_sys_t
     off_t   i_movi_begin;
     off_t   i_movi_lastchunk_pos;   /* XXX position of last valid chunk */
 
+    /* index creation in the background */
+    avi_indexer_t *p_indexer;
+
     /* number of streams and information */
     unsigned int i_track;
     avi_track_t  **track;
@@ -217,14 +251,23 @@ static int AVI_StreamBytesSet ( demux_t *,
 vlc_fourcc_t AVI_FourccGetCodec( unsigned int i_cat, vlc_fourcc_t );
 static int   AVI_GetKeyFlag    ( vlc_fourcc_t , uint8_t * );
 
-static int AVI_PacketGetHeader( demux_t *, avi_packet_t *p_pk );
-static int AVI_PacketNext     ( demux_t * );
+static int AVI_PacketGetHeader( stream_t *, avi_packet_t *p_pk );
+static int AVI_PacketNext     ( stream_t * );
 static int AVI_PacketRead     ( demux_t *, avi_packet_t *, block_t **);
-static int AVI_PacketSearch   ( demux_t * );
+static int AVI_PacketSearch   ( demux_t *, stream_t * );
 
 static void AVI_IndexLoad    ( demux_t * );
 static void AVI_IndexCreate  ( demux_t * );
 
+static int  AVI_IndexerStart ( demux_t * );
+static void AVI_IndexerMerge ( demux_t * );
+static void AVI_IndexerPoll  ( demux_t * );
+static void AVI_IndexerStop  ( demux_t *, bool );
+
+static int  AVI_IndexFileLoad ( demux_t * );
+static void AVI_IndexFileStore( demux_t *, uint64_t i_size,
+                                const avi_index_t *, off_t i_last_pos );
+
 static void AVI_ExtractSubtitle( demux_t *, unsigned int i_stream, avi_chunk_list_t *, avi_chunk_STRING_t * );
 
 static void AVI_DvHandleAudio( demux_t *, avi_track_t *, block_t * );
@@ -692,12 +735,21 @@ static int Open( vlc_object_t * p_this )
     }
 
     i_do_index = var_InheritInteger( p_demux, "avi-index" );
-    if( i_do_index == 1 ) /* Always fix */
+    if( i_do_index != 2 && p_sys->b_fastseekable &&
+        var_InheritBool( p_demux, "avi-index-file" ) &&
+        !AVI_IndexFileLoad( p_demux ) )
+    {
+        /* already fixed */
+        b_index = true;
+    }
+    else if( i_do_index == 1 ) /* Always fix */
     {
 aviindex:
         if( p_sys->b_fastseekable )
         {
-            AVI_IndexCreate( p_demux );
+            /* play while the index is being created */
+            if( AVI_IndexerStart( p_demux ) )
+                AVI_IndexCreate( p_demux );
         }
         else
         {
@@ -712,6 +764,12 @@ aviindex:
 
     /* *** movie length in sec *** */
     p_sys->i_length = AVI_MovieGetLength( p_demux );
+    if( p_sys->p_indexer )
+    {
+        /* trust the header until the index is complete */
+        p_sys->i_length = (mtime_t)p_avih->i_totalframes *
+                          (mtime_t)p_avih->i_microsecperframe / CLOCK_FREQ;
+    }
 
     /* Check the index completeness */
     unsigned int i_idx_totalframes = 0;
@@ -815,6 +873,8 @@ aviindex:
     return VLC_SUCCESS;
 
 error:
+    AVI_IndexerStop( p_demux, false );
+
     for( unsigned i = 0; i < p_sys->i_attachment; i++)
         vlc_input_attachment_Delete(p_sys->attachment[i]);
     free(p_sys->attachment);
@@ -835,6 +895,8 @@ static void Close ( vlc_object_t * p_this )
     demux_t *    p_demux = (demux_t *)p_this;
     demux_sys_t *p_sys = p_demux->p_sys  ;
 
+    AVI_IndexerStop( p_demux, false );
+
     for( unsigned int i = 0; i < p_sys->i_track; i++ )
     {
         if( p_sys->track[i] )
@@ -961,6 +1023,7 @@ static int Demux_Seekable( demux_t *p_demux )
     /* cannot be more than 100 stream (dcXX or wbXX) */
     avi_track_toread_t toread[100];
 
+    AVI_IndexerPoll( p_demux );
 
     /* detect new selected/unselected streams */
     for( i_track = 0; i_track < p_sys->i_track; i_track++ )
@@ -1098,7 +1161,7 @@ static int Demux_Seekable( demux_t *p_demux )
             if( p_sys->b_seekable && p_sys->i_movi_lastchunk_pos >= p_sys->i_movi_begin + 12 )
             {
                 stream_Seek( p_demux->s, p_sys->i_movi_lastchunk_pos );
-                if( AVI_PacketNext( p_demux ) )
+                if( AVI_PacketNext( p_demux->s ) )
                 {
                     return( AVI_TrackStopFinishedStreams( p_demux ) ? 0 : 1 );
                 }
@@ -1112,7 +1175,7 @@ static int Demux_Seekable( demux_t *p_demux )
             {
                 avi_packet_t avi_pk;
 
-                if( AVI_PacketGetHeader( p_demux, &avi_pk ) )
+                if( AVI_PacketGetHeader( p_demux->s, &avi_pk ) )
                 {
                     msg_Warn( p_demux,
                              "cannot get packet header, track disabled" );
@@ -1121,7 +1184,7 @@ static int Demux_Seekable( demux_t *p_demux )
                 if( avi_pk.i_stream >= p_sys->i_track ||
                     ( avi_pk.i_cat != AUDIO_ES && avi_pk.i_cat != VIDEO_ES ) )
                 {
-                    if( AVI_PacketNext( p_demux ) )
+                    if( AVI_PacketNext( p_demux->s ) )
                     {
                         msg_Warn( p_demux,
                                   "cannot skip packet, track disabled" );
@@ -1162,7 +1225,7 @@ static int Demux_Seekable( demux_t *p_demux )
                     }
                     else
                     {
-                        if( AVI_PacketNext( p_demux ) )
+                        if( AVI_PacketNext( p_demux->s ) )
                         {
                             msg_Warn( p_demux,
                                       "cannot skip packet, track disabled" );
@@ -1342,7 +1405,7 @@ static int Demux_UnSeekable( demux_t *p_demux )
 
         avi_packet_t    avi_pk;
 
-        if( AVI_PacketGetHeader( p_demux, &avi_pk ) )
+        if( AVI_PacketGetHeader( p_demux->s, &avi_pk ) )
         {
             return( 0 );
         }
@@ -1359,17 +1422,17 @@ static int Demux_UnSeekable( demux_t *p_demux )
                 case AVIFOURCC_JUNK:
                 case AVIFOURCC_LIST:
                 case AVIFOURCC_RIFF:
-                    return( !AVI_PacketNext( p_demux ) ? 1 : 0 );
+                    return( !AVI_PacketNext( p_demux->s ) ? 1 : 0 );
                 case AVIFOURCC_idx1:
                     if( p_sys->b_odml )
                     {
-                        return( !AVI_PacketNext( p_demux ) ? 1 : 0 );
+                        return( !AVI_PacketNext( p_demux->s ) ? 1 : 0 );
                     }
                     return( 0 );    /* eof */
                 default:
                     msg_Warn( p_demux,
                               "seems to have lost position, resync" );
-                    if( AVI_PacketSearch( p_demux ) )
+                    if( AVI_PacketSearch( p_demux, p_demux->s ) )
                     {
                         msg_Err( p_demux, "resync failed" );
                         return( -1 );
@@ -1404,7 +1467,7 @@ static int Demux_UnSeekable( demux_t *p_demux )
             }
             else
             {
-                if( AVI_PacketNext( p_demux ) )
+                if( AVI_PacketNext( p_demux->s ) )
                 {
                     return( 0 );
                 }
@@ -1444,6 +1507,8 @@ static int Seek( demux_t *p_demux, mtime_t i_date, int i_percent )
     {
         int64_t i_pos_backup = stream_Tell( p_demux->s );
 
+        AVI_IndexerPoll( p_demux );
+
         /* Check and lazy load indexes if it was not done (not fastseekable) */
         if ( !p_sys->b_indexloaded && ( p_sys->i_avih_flags & AVIF_HASINDEX ) )
         {
@@ -1466,7 +1531,8 @@ static int Seek( demux_t *p_demux, mtime_t i_date, int i_percent )
             p_sys->b_indexloaded = true; /* we don't want to try each time */
         }
 
-        if( !p_sys->i_length )
+        /* the index being created is good enough to seek by date */
+        if( !p_sys->i_length && !p_sys->p_indexer )
         {
             avi_track_t *p_stream = NULL;
             unsigned i_stream = 0;
@@ -1762,12 +1828,18 @@ static int AVI_StreamChunkFind( demux_t *p_demux, unsigned int i_stream )
     avi_packet_t avi_pk;
     int i_loop_count = 0;
 
+    /* the background index might already have it */
+    const unsigned int i_size = p_sys->track[i_stream]->idx.i_size;
+    AVI_IndexerPoll( p_demux );
+    if( p_sys->track[i_stream]->idx.i_size > i_size )
+        return VLC_SUCCESS;
+
     /* find first chunk of i_stream that isn't in index */
 
     if( p_sys->i_movi_lastchunk_pos >= p_sys->i_movi_begin + 12 )
     {
         stream_Seek( p_demux->s, p_sys->i_movi_lastchunk_pos );
-        if( AVI_PacketNext( p_demux ) )
+        if( AVI_PacketNext( p_demux->s ) )
         {
             return VLC_EGENERIC;
         }
@@ -1779,7 +1851,7 @@ static int AVI_StreamChunkFind( demux_t *p_demux, unsigned int i_stream )
 
     for( ;; )
     {
-        if( AVI_PacketGetHeader( p_demux, &avi_pk ) )
+        if( AVI_PacketGetHeader( p_demux->s, &avi_pk ) )
         {
             msg_Warn( p_demux, "cannot get packet header" );
             return VLC_EGENERIC;
@@ -1787,7 +1859,7 @@ static int AVI_StreamChunkFind( demux_t *p_demux, unsigned int i_stream )
         if( avi_pk.i_stream >= p_sys->i_track ||
             ( avi_pk.i_cat != AUDIO_ES && avi_pk.i_cat != VIDEO_ES ) )
         {
-            if( AVI_PacketNext( p_demux ) )
+            if( AVI_PacketNext( p_demux->s ) )
             {
                 return VLC_EGENERIC;
             }
@@ -1821,7 +1893,7 @@ static int AVI_StreamChunkFind( demux_t *p_demux, unsigned int i_stream )
                 return VLC_SUCCESS;
             }
 
-            if( AVI_PacketNext( p_demux ) )
+            if( AVI_PacketNext( p_demux->s ) )
             {
                 return VLC_EGENERIC;
             }
@@ -1839,18 +1911,14 @@ static int AVI_StreamChunkSet( demux_t *p_demux, unsigned int i_stream,
     p_stream->i_idxposc = i_ck;
     p_stream->i_idxposb = 0;
 
-    if(  i_ck >= p_stream->idx.i_size )
+    /* each find adds at least one chunk of i_stream */
+    while( i_ck >= p_stream->idx.i_size )
     {
-        p_stream->i_idxposc = p_stream->idx.i_size - 1;
-        do
+        if( AVI_StreamChunkFind( p_demux, i_stream ) )
         {
-            p_stream->i_idxposc++;
-            if( AVI_StreamChunkFind( p_demux, i_stream ) )
-            {
-                return VLC_EGENERIC;
-            }
-
-        } while( p_stream->i_idxposc < i_ck );
+            p_stream->i_idxposc = p_stream->idx.i_size;
+            return VLC_EGENERIC;
+        }
     }
 
     return VLC_SUCCESS;
@@ -1864,59 +1932,47 @@ static int AVI_StreamBytesSet( demux_t    *p_demux,
     demux_sys_t *p_sys = p_demux->p_sys;
     avi_track_t *p_stream = p_sys->track[i_stream];
 
-    if( ( p_stream->idx.i_size > 0 )
-        &&( i_byte < p_stream->idx.p_entry[p_stream->idx.i_size - 1].i_lengthtotal +
-                p_stream->idx.p_entry[p_stream->idx.i_size - 1].i_length ) )
+    /* each find adds at least one chunk of i_stream */
+    while( p_stream->idx.i_size <= 0
+        || i_byte >= p_stream->idx.p_entry[p_stream->idx.i_size - 1].i_lengthtotal +
+                     p_stream->idx.p_entry[p_stream->idx.i_size - 1].i_length )
     {
-        /* index is valid to find the ck */
-        /* uses dichototmie to be fast enougth */
-        int i_idxposc = __MIN( p_stream->i_idxposc, p_stream->idx.i_size - 1 );
-        int i_idxmax  = p_stream->idx.i_size;
-        int i_idxmin  = 0;
-        for( ;; )
+        if( AVI_StreamChunkFind( p_demux, i_stream ) )
         {
-            if( p_stream->idx.p_entry[i_idxposc].i_lengthtotal > i_byte )
-            {
-                i_idxmax  = i_idxposc ;
-                i_idxposc = ( i_idxmin + i_idxposc ) / 2 ;
-            }
-            else
-            {
-                if( p_stream->idx.p_entry[i_idxposc].i_lengthtotal +
-                        p_stream->idx.p_entry[i_idxposc].i_length <= i_byte)
-                {
-                    i_idxmin  = i_idxposc ;
-                    i_idxposc = (i_idxmax + i_idxposc ) / 2 ;
-                }
-                else
-                {
-                    p_stream->i_idxposc = i_idxposc;
-                    p_stream->i_idxposb = i_byte -
-                            p_stream->idx.p_entry[i_idxposc].i_lengthtotal;
-                    return VLC_SUCCESS;
-                }
-            }
+            p_stream->i_idxposc = p_stream->idx.i_size;
+            p_stream->i_idxposb = 0;
+            return VLC_EGENERIC;
         }
-
     }
-    else
+
+    /* index is valid to find the ck */
+    /* uses dichototmie to be fast enougth */
+    int i_idxposc = __MIN( p_stream->i_idxposc, p_stream->idx.i_size - 1 );
+    int i_idxmax  = p_stream->idx.i_size;
+    int i_idxmin  = 0;
+    for( ;; )
     {
-        p_stream->i_idxposc = p_stream->idx.i_size - 1;
-        p_stream->i_idxposb = 0;
-        do
+        if( p_stream->idx.p_entry[i_idxposc].i_lengthtotal > i_byte )
         {
-            p_stream->i_idxposc++;
-            if( AVI_StreamChunkFind( p_demux, i_stream ) )
+            i_idxmax  = i_idxposc ;
+            i_idxposc = ( i_idxmin + i_idxposc ) / 2 ;
+        }
+        else
+        {
+            if( p_stream->idx.p_entry[i_idxposc].i_lengthtotal +
+                    p_stream->idx.p_entry[i_idxposc].i_length <= i_byte)
             {
-                return VLC_EGENERIC;
+                i_idxmin  = i_idxposc ;
+                i_idxposc = (i_idxmax + i_idxposc ) / 2 ;
             }
-
-        } while( p_stream->idx.p_entry[p_stream->i_idxposc].i_lengthtotal +
-                    p_stream->idx.p_entry[p_stream->i_idxposc].i_length <= i_byte );
-
-        p_stream->i_idxposb = i_byte -
-                       p_stream->idx.p_entry[p_stream->i_idxposc].i_lengthtotal;
-        return VLC_SUCCESS;
+            else
+            {
+                p_stream->i_idxposc = i_idxposc;
+                p_stream->i_idxposb = i_byte -
+                        p_stream->idx.p_entry[i_idxposc].i_lengthtotal;
+                return VLC_SUCCESS;
+            }
+        }
     }
 }
 
@@ -2119,17 +2175,17 @@ static void AVI_ParseStreamHeader( vlc_fourcc_t i_id,
 /****************************************************************************
  *
  ****************************************************************************/
-static int AVI_PacketGetHeader( demux_t *p_demux, avi_packet_t *p_pk )
+static int AVI_PacketGetHeader( stream_t *s, avi_packet_t *p_pk )
 {
     const uint8_t *p_peek;
 
-    if( stream_Peek( p_demux->s, &p_peek, 16 ) < 16 )
+    if( stream_Peek( s, &p_peek, 16 ) < 16 )
     {
         return VLC_EGENERIC;
     }
     p_pk->i_fourcc  = VLC_FOURCC( p_peek[0], p_peek[1], p_peek[2], p_peek[3] );
     p_pk->i_size    = GetDWLE( p_peek + 4 );
-    p_pk->i_pos     = stream_Tell( p_demux->s );
+    p_pk->i_pos     = stream_Tell( s );
     if( p_pk->i_fourcc == AVIFOURCC_LIST || p_pk->i_fourcc == AVIFOURCC_RIFF )
     {
         p_pk->i_type = VLC_FOURCC( p_peek[8],  p_peek[9],
@@ -2146,12 +2202,12 @@ static int AVI_PacketGetHeader( demux_t *p_demux, avi_packet_t *p_pk )
     return VLC_SUCCESS;
 }
 
-static int AVI_PacketNext( demux_t *p_demux )
+static int AVI_PacketNext( stream_t *s )
 {
     avi_packet_t    avi_ck;
     int             i_skip = 0;
 
-    if( AVI_PacketGetHeader( p_demux, &avi_ck ) )
+    if( AVI_PacketGetHeader( s, &avi_ck ) )
     {
         return VLC_EGENERIC;
     }
@@ -2171,7 +2227,7 @@ static int AVI_PacketNext( demux_t *p_demux )
         i_skip = __EVEN( avi_ck.i_size ) + 8;
     }
 
-    if( stream_Read( p_demux->s, NULL, i_skip ) != i_skip )
+    if( stream_Read( s, NULL, i_skip ) != i_skip )
     {
         return VLC_EGENERIC;
     }
@@ -2201,7 +2257,7 @@ static int AVI_PacketRead( demux_t   *p_demux,
     return VLC_SUCCESS;
 }
 
-static int AVI_PacketSearch( demux_t *p_demux )
+static int AVI_PacketSearch( demux_t *p_demux, stream_t *s )
 {
     demux_sys_t     *p_sys = p_demux->p_sys;
     avi_packet_t    avi_pk;
@@ -2209,11 +2265,11 @@ static int AVI_PacketSearch( demux_t *p_demux )
 
     for( ;; )
     {
-        if( stream_Read( p_demux->s, NULL, 1 ) != 1 )
+        if( stream_Read( s, NULL, 1 ) != 1 )
         {
             return VLC_EGENERIC;
         }
-        AVI_PacketGetHeader( p_demux, &avi_pk );
+        AVI_PacketGetHeader( s, &avi_pk );
         if( avi_pk.i_stream < p_sys->i_track &&
             ( avi_pk.i_cat == AUDIO_ES || avi_pk.i_cat == VIDEO_ES ) )
         {
@@ -2540,18 +2596,22 @@ static void AVI_IndexLoad( demux_t *p_demux )
     }
 }
 
-static void AVI_IndexCreate( demux_t *p_demux )
+/* Walks the chunks of the movi list from the stream s, and appends them to
+ * the per track indexes p_index, holding p_lock (if any) while doing so.
+ * pf_update is regularly called with the progress and stops the walk by
+ * returning true. Returns false if it was stopped before the end. */
+static bool AVI_IndexWalk( demux_t *p_demux, stream_t *s,
+                           avi_index_t *p_index, off_t *pi_last_pos,
+                           vlc_mutex_t *p_lock,
+                           bool (*pf_update)( void *, double ), void *p_data )
 {
     demux_sys_t *p_sys = p_demux->p_sys;
 
     avi_chunk_list_t *p_riff;
     avi_chunk_list_t *p_movi;
 
-    unsigned int i_stream;
     off_t i_movi_end;
-
-    mtime_t i_dialog_update;
-    dialog_progress_bar_t *p_dialog = NULL;
+    mtime_t i_update;
 
     p_riff = AVI_ChunkFind( &p_sys->ck_root, AVIFOURCC_RIFF, 0);
     p_movi = AVI_ChunkFind( p_riff, AVIFOURCC_movi, 0);
@@ -2559,44 +2619,32 @@ static void AVI_IndexCreate( demux_t *p_demux )
     if( !p_movi )
     {
         msg_Err( p_demux, "cannot find p_movi" );
-        return;
+        return true;
     }
 
-    for( i_stream = 0; i_stream < p_sys->i_track; i_stream++ )
-        avi_index_Init( &p_sys->track[i_stream]->idx );
-
     i_movi_end = __MIN( (off_t)(p_movi->i_chunk_pos + p_movi->i_chunk_size),
-                        stream_Size( p_demux->s ) );
-
-    stream_Seek( p_demux->s, p_movi->i_chunk_pos + 12 );
-    msg_Warn( p_demux, "creating index from LIST-movi, will take time !" );
+                        stream_Size( s ) );
 
+    stream_Seek( s, p_movi->i_chunk_pos + 12 );
 
-    /* Only show dialog if AVI is > 10MB */
-    i_dialog_update = mdate();
-    if( stream_Size( p_demux->s ) > 10000000 )
-        p_dialog = dialog_ProgressCreate( p_demux, _("Fixing AVI Index..."),
-                                       NULL, _("Cancel") );
-
+    i_update = mdate();
     for( ;; )
     {
         avi_packet_t pk;
 
-        /* Don't update/check dialog too often */
-        if( p_dialog && mdate() - i_dialog_update > 100000 )
+        /* Don't update/check too often */
+        if( mdate() - i_update > 100000 )
         {
-            if( dialog_ProgressCancelled( p_dialog ) )
-                break;
+            double f_current = stream_Tell( s );
+            double f_size    = stream_Size( s );
 
-            double f_current = stream_Tell( p_demux->s );
-            double f_size    = stream_Size( p_demux->s );
-            double f_pos     = f_current / f_size;
-            dialog_ProgressSet( p_dialog, NULL, f_pos );
+            if( pf_update( p_data, f_current / f_size ) )
+                return false;
 
-            i_dialog_update = mdate();
+            i_update = mdate();
         }
 
-        if( AVI_PacketGetHeader( p_demux, &pk ) )
+        if( AVI_PacketGetHeader( s, &pk ) )
             break;
 
         if( pk.i_stream < p_sys->i_track &&
@@ -2610,7 +2658,12 @@ static void AVI_IndexCreate( demux_t *p_demux )
             index.i_pos     = pk.i_pos;
             index.i_length  = pk.i_size;
             index.i_lengthtotal = pk.i_size;
-            avi_index_Append( &tk->idx, &p_sys->i_movi_lastchunk_pos, &index );
+
+            if( p_lock )
+                vlc_mutex_lock( p_lock );
+            avi_index_Append( &p_index[pk.i_stream], pi_last_pos, &index );
+            if( p_lock )
+                vlc_mutex_unlock( p_lock );
         }
         else
         {
@@ -2624,11 +2677,11 @@ static void AVI_IndexCreate( demux_t *p_demux )
                                             AVIFOURCC_RIFF, 1 );
 
                     msg_Dbg( p_demux, "looking for new RIFF chunk" );
-                    if( stream_Seek( p_demux->s, p_sysx->i_chunk_pos + 24 ) )
-                        goto print_stat;
+                    if( stream_Seek( s, p_sysx->i_chunk_pos + 24 ) )
+                        return true;
                     break;
                 }
-                goto print_stat;
+                return true;
 
             case AVIFOURCC_RIFF:
                     msg_Dbg( p_demux, "new RIFF chunk found" );
@@ -2640,30 +2693,512 @@ static void AVI_IndexCreate( demux_t *p_demux )
 
             default:
                 msg_Warn( p_demux, "need resync, probably broken avi" );
-                if( AVI_PacketSearch( p_demux ) )
+                if( AVI_PacketSearch( p_demux, s ) )
                 {
                     msg_Warn( p_demux, "lost sync, abord index creation" );
-                    goto print_stat;
+                    return true;
                 }
             }
         }
 
         if( ( !p_sys->b_odml && pk.i_pos + pk.i_size >= i_movi_end ) ||
-            AVI_PacketNext( p_demux ) )
+            AVI_PacketNext( s ) )
         {
             break;
         }
     }
+    return true;
+}
+
+static bool AVI_IndexCreateUpdate( void *p_data, double f_pos )
+{
+    dialog_progress_bar_t *p_dialog = p_data;
+
+    if( !p_dialog )
+        return false;
+    if( dialog_ProgressCancelled( p_dialog ) )
+        return true;
+
+    dialog_ProgressSet( p_dialog, NULL, f_pos );
+    return false;
+}
+
+static void AVI_IndexCreate( demux_t *p_demux )
+{
+    demux_sys_t *p_sys = p_demux->p_sys;
+
+    dialog_progress_bar_t *p_dialog = NULL;
+
+    avi_index_t *p_index = calloc( p_sys->i_track, sizeof( avi_index_t ) );
+    if( !p_index )
+        return;
+    for( unsigned i = 0; i < p_sys->i_track; i++ )
+        avi_index_Init( &p_index[i] );
+
+    msg_Warn( p_demux, "creating index from LIST-movi, will take time !" );
+
+    /* Only show dialog if AVI is > 10MB */
+    if( stream_Size( p_demux->s ) > 10000000 )
+        p_dialog = dialog_ProgressCreate( p_demux, _("Fixing AVI Index..."),
+                                       NULL, _("Cancel") );
+
+    AVI_IndexWalk( p_demux, p_demux->s, p_index, &p_sys->i_movi_lastchunk_pos,
+                   NULL, AVI_IndexCreateUpdate, p_dialog );
 
-print_stat:
     if( p_dialog != NULL )
         dialog_ProgressDestroy( p_dialog );
 
-    for( i_stream = 0; i_stream < p_sys->i_track; i_stream++ )
+    for( unsigned i = 0; i < p_sys->i_track; i++ )
     {
+        avi_index_Clean( &p_sys->track[i]->idx );
+        p_sys->track[i]->idx = p_index[i];
+
         msg_Dbg( p_demux, "stream[%d] creating %d index entries",
-                i_stream, p_sys->track[i_stream]->idx.i_size );
+                i, p_index[i].i_size );
+    }
+    free( p_index );
+}
+
+/*****************************************************************************
+ * Background index creation
+ *****************************************************************************
+ * The movi list is walked from a thread, on a stream of its own, into
+ * indexes of its own. The demuxer merges what was found so far into the
+ * tracks indexes, before scanning the file by itself past their end.
+ *****************************************************************************/
+static bool AVI_IndexerUpdate( void *p_data, double f_pos )
+{
+    avi_indexer_t *p_indexer = p_data;
+    bool b_abort;
+
+    VLC_UNUSED( f_pos );
+
+    vlc_mutex_lock( &p_indexer->lock );
+    b_abort = p_indexer->b_abort;
+    vlc_mutex_unlock( &p_indexer->lock );
+
+    return b_abort;
+}
+
+static void *AVI_IndexerThread( void *p_data )
+{
+    demux_t *p_demux = p_data;
+    avi_indexer_t *p_indexer = p_demux->p_sys->p_indexer;
+    mtime_t i_start = mdate();
+
+    if( !AVI_IndexWalk( p_demux, p_indexer->s, p_indexer->p_index,
+                        &p_indexer->i_last_pos, &p_indexer->lock,
+                        AVI_IndexerUpdate, p_indexer ) )
+        return NULL;
+
+    msg_Dbg( p_demux, "index created in %"PRId64" ms",
+             ( mdate() - i_start ) / 1000 );
+
+    /* the indexes are only modified by this thread */
+    if( p_indexer->b_store )
+        AVI_IndexFileStore( p_demux, stream_Size( p_indexer->s ),
+                            p_indexer->p_index, p_indexer->i_last_pos );
+
+    vlc_mutex_lock( &p_indexer->lock );
+    p_indexer->b_done = true;
+    vlc_mutex_unlock( &p_indexer->lock );
+
+    return NULL;
+}
+
+static int AVI_IndexerStart( demux_t *p_demux )
+{
+    demux_sys_t *p_sys = p_demux->p_sys;
+    avi_indexer_t *p_indexer;
+    char *psz_url;
+    stream_t *s;
+
+    if( p_demux->psz_access == NULL || p_demux->psz_location == NULL ||
+        asprintf( &psz_url, "%s://%s", p_demux->psz_access,
+                  p_demux->psz_location ) == -1 )
+        return VLC_EGENERIC;
+
+    /* the demux stream is not ours to move around */
+    s = stream_UrlNew( p_demux, psz_url );
+    free( psz_url );
+    if( !s )
+    {
+        msg_Warn( p_demux, "cannot open a stream to create the index" );
+        return VLC_EGENERIC;
+    }
+
+    p_indexer = malloc( sizeof( *p_indexer ) );
+    if( p_indexer )
+        p_indexer->p_index = malloc( p_sys->i_track * sizeof( avi_index_t ) );
+    if( !p_indexer || !p_indexer->p_index )
+    {
+        free( p_indexer );
+        stream_Delete( s );
+        return VLC_ENOMEM;
+    }
+
+    for( unsigned i = 0; i < p_sys->i_track; i++ )
+        avi_index_Init( &p_indexer->p_index[i] );
+    p_indexer->s          = s;
+    p_indexer->b_abort    = false;
+    p_indexer->b_done     = false;
+    p_indexer->b_store    = var_InheritBool( p_demux, "avi-index-file" );
+    p_indexer->i_last_pos = 0;
+    vlc_mutex_init( &p_indexer->lock );
+
+    /* the broken index is dropped, the chunks are taken from the new one
+     * or found by the demuxer itself, in file order */
+    for( unsigned i = 0; i < p_sys->i_track; i++ )
+    {
+        avi_index_Clean( &p_sys->track[i]->idx );
+        avi_index_Init( &p_sys->track[i]->idx );
     }
+    p_sys->i_movi_lastchunk_pos = 0;
+    p_sys->b_indexloaded = true;
+
+    p_sys->p_indexer = p_indexer;
+    if( vlc_clone( &p_indexer->thread, AVI_IndexerThread, p_demux,
+                   VLC_THREAD_PRIORITY_LOW ) )
+    {
+        p_sys->p_indexer = NULL;
+        vlc_mutex_destroy( &p_indexer->lock );
+        free( p_indexer->p_index );
+        free( p_indexer );
+        stream_Delete( s );
+        return VLC_EGENERIC;
+    }
+
+    msg_Dbg( p_demux, "creating index from LIST-movi in the background" );
+    return VLC_SUCCESS;
+}
+
+/* Joins the indexer thread, then takes the chunks it found if b_merge */
+static void AVI_IndexerStop( demux_t *p_demux, bool b_merge )
+{
+    demux_sys_t *p_sys = p_demux->p_sys;
+    avi_indexer_t *p_indexer = p_sys->p_indexer;
+
+    if( !p_indexer )
+        return;
+
+    vlc_mutex_lock( &p_indexer->lock );
+    p_indexer->b_abort = true;
+    vlc_mutex_unlock( &p_indexer->lock );
+
+    vlc_join( p_indexer->thread, NULL );
+
+    if( b_merge )
+        AVI_IndexerMerge( p_demux );
+
+    for( unsigned i = 0; i < p_sys->i_track; i++ )
+        avi_index_Clean( &p_indexer->p_index[i] );
+    free( p_indexer->p_index );
+    stream_Delete( p_indexer->s );
+    vlc_mutex_destroy( &p_indexer->lock );
+    free( p_indexer );
+
+    p_sys->p_indexer = NULL;
+}
+
+/* Appends to the tracks indexes the chunks found by the indexer past the
+ * last one known by the demuxer */
+static void AVI_IndexerMerge( demux_t *p_demux )
+{
+    demux_sys_t *p_sys = p_demux->p_sys;
+    avi_indexer_t *p_indexer = p_sys->p_indexer;
+
+    const off_t i_last_pos = p_sys->i_movi_lastchunk_pos;
+
+    vlc_mutex_lock( &p_indexer->lock );
+    for( unsigned i = 0; i < p_sys->i_track; i++ )
+    {
+        const avi_index_t *p_index = &p_indexer->p_index[i];
+
+        /* the chunks are found in order, look for the first unknown one */
+        unsigned i_low = 0, i_high = p_index->i_size;
+        while( i_low < i_high )
+        {
+            unsigned i_mid = ( i_low + i_high ) / 2;
+            if( p_index->p_entry[i_mid].i_pos <= i_last_pos )
+                i_low = i_mid + 1;
+            else
+                i_high = i_mid;
+        }
+
+        for( unsigned j = i_low; j < p_index->i_size; j++ )
+        {
+            avi_entry_t index = p_index->p_entry[j];
+            avi_index_Append( &p_sys->track[i]->idx,
+                              &p_sys->i_movi_lastchunk_pos, &index );
+        }
+    }
+    vlc_mutex_unlock( &p_indexer->lock );
+}
+
+/* Takes the chunks found so far, and releases the indexer once it is done.
+ * Called from the demux thread only. */
+static void AVI_IndexerPoll( demux_t *p_demux )
+{
+    demux_sys_t *p_sys = p_demux->p_sys;
+    avi_indexer_t *p_indexer = p_sys->p_indexer;
+
+    if( !p_indexer )
+        return;
+
+    vlc_mutex_lock( &p_indexer->lock );
+    const bool b_done = p_indexer->b_done;
+    vlc_mutex_unlock( &p_indexer->lock );
+
+    if( !b_done )
+    {
+        AVI_IndexerMerge( p_demux );
+
+        /* the header until the index goes past it */
+        p_sys->i_length = __MAX( p_sys->i_length,
+                                 AVI_MovieGetLength( p_demux ) );
+        return;
+    }
+
+    /* nothing is added to its index once the thread is joined */
+    AVI_IndexerStop( p_demux, true );
+
+    p_sys->i_length = AVI_MovieGetLength( p_demux );
+    for( unsigned i = 0; i < p_sys->i_track; i++ )
+        msg_Dbg( p_demux, "stream[%d] created %d index entries",
+                 i, p_sys->track[i]->idx.i_size );
+}
+
+/*****************************************************************************
+ * Index file
+ *****************************************************************************
+ * The index rebuilt for a file can be stored in the user cache directory,
+ * under the md5 of the file path, with the size and modification time of
+ * the file when it was indexed, so that it is only used as long as it still
+ * matches the file. All values are little endian:
+ *
+ *   u32 magic, u32 version, u64 size, i64 mtime, u64 last chunk position,
+ *   u32 tracks, tracks * { u32 entries,
+ *                          entries * { u32 id, u32 flags, u64 pos, u32 length } }
+ *****************************************************************************/
+#define INDEX_FILE_MAGIC   VLC_FOURCC('v','a','i','x')
+#define INDEX_FILE_VERSION 1
+#define INDEX_FILE_HEADER  (4 + 4 + 8 + 8 + 8 + 4)
+#define INDEX_FILE_ENTRY   (4 + 4 + 8 + 4)
+
+static char *AVI_IndexFileDir( void )
+{
+    char *psz_cachedir = config_GetUserDir( VLC_CACHE_DIR );
+    char *psz_dir;
+
+    if( psz_cachedir == NULL )
+        return NULL;
+
+    if( asprintf( &psz_dir, "%s" DIR_SEP "aviindex", psz_cachedir ) == -1 )
+        psz_dir = NULL;
+    free( psz_cachedir );
+    return psz_dir;
+}
+
+static char *AVI_IndexFilePath( demux_t *p_demux )
+{
+    char *psz_path;
+
+    if( p_demux->psz_file == NULL || !*p_demux->psz_file ||
+        p_demux->psz_access == NULL || strcmp( p_demux->psz_access, "file" ) )
+        return NULL;
+
+    char *psz_dir = AVI_IndexFileDir();
+    if( psz_dir == NULL )
+        return NULL;
+
+    struct md5_s md5;
+    InitMD5( &md5 );
+    AddMD5( &md5, p_demux->psz_file, strlen( p_demux->psz_file ) );
+    EndMD5( &md5 );
+    char *psz_hash = psz_md5_hash( &md5 );
+
+    if( psz_hash == NULL ||
+        asprintf( &psz_path, "%s" DIR_SEP "%s", psz_dir, psz_hash ) == -1 )
+        psz_path = NULL;
+    free( psz_hash );
+    free( psz_dir );
+    return psz_path;
+}
+
+static int AVI_IndexFileLoad( demux_t *p_demux )
+{
+    demux_sys_t *p_sys = p_demux->p_sys;
+    struct stat st;
+
+    char *psz_path = AVI_IndexFilePath( p_demux );
+    if( !psz_path )
+        return VLC_EGENERIC;
+
+    FILE *p_file = vlc_fopen( psz_path, "rb" );
+    free( psz_path );
+    if( !p_file )
+        return VLC_EGENERIC;
+
+    avi_index_t *p_index = calloc( p_sys->i_track, sizeof( avi_index_t ) );
+    if( !p_index )
+    {
+        fclose( p_file );
+        return VLC_ENOMEM;
+    }
+    for( unsigned i = 0; i < p_sys->i_track; i++ )
+        avi_index_Init( &p_index[i] );
+    off_t i_last_pos = 0;
+
+    uint8_t header[INDEX_FILE_HEADER];
+    if( fread( header, sizeof(header), 1, p_file ) != 1 ||
+        GetDWLE( &header[0] ) != INDEX_FILE_MAGIC ||
+        GetDWLE( &header[4] ) != INDEX_FILE_VERSION ||
+        GetQWLE( &header[8] ) != (uint64_t)stream_Size( p_demux->s ) ||
+        vlc_stat( p_demux->psz_file, &st ) ||
+        (int64_t)GetQWLE( &header[16] ) != (int64_t)st.st_mtime ||
+        GetDWLE( &header[32] ) != p_sys->i_track )
+        goto error;
+
+    for( unsigned i = 0; i < p_sys->i_track; i++ )
+    {
+        uint8_t count[4];
+        if( fread( count, sizeof(count), 1, p_file ) != 1 )
+            goto error;
+
+        const uint32_t i_entries = GetDWLE( count );
+        for( uint32_t j = 0; j < i_entries; j++ )
+        {
+            uint8_t entry[INDEX_FILE_ENTRY];
+            if( fread( entry, sizeof(entry), 1, p_file ) != 1 )
+                goto error;
+
+            avi_entry_t index;
+            index.i_id     = GetDWLE( &entry[0] );
+            index.i_flags  = GetDWLE( &entry[4] );
+            index.i_pos    = GetQWLE( &entry[8] );
+            index.i_length = GetDWLE( &entry[16] );
+            index.i_lengthtotal = index.i_length;
+            if( j > 0 && index.i_pos <= p_index[i].p_entry[j - 1].i_pos )
+                goto error;
+
+            avi_index_Append( &p_index[i], &i_last_pos, &index );
+            if( !p_index[i].p_entry )
+                goto error;
+        }
+    }
+    fclose( p_file );
+
+    for( unsigned i = 0; i < p_sys->i_track; i++ )
+    {
+        avi_index_Clean( &p_sys->track[i]->idx );
+        p_sys->track[i]->idx = p_index[i];
+    }
+    free( p_index );
+    p_sys->i_movi_lastchunk_pos = GetQWLE( &header[24] );
+    p_sys->b_indexloaded = true;
+
+    msg_Dbg( p_demux, "loaded the index created before" );
+    return VLC_SUCCESS;
+
+error:
+    msg_Warn( p_demux, "ignoring invalid or outdated index file" );
+    fclose( p_file );
+    for( unsigned i = 0; i < p_sys->i_track; i++ )
+        avi_index_Clean( &p_index[i] );
+    free( p_index );
+    return VLC_EGENERIC;
+}
+
+static void AVI_IndexFileStore( demux_t *p_demux, uint64_t i_size,
+                                const avi_index_t *p_index, off_t i_last_pos )
+{
+    demux_sys_t *p_sys = p_demux->p_sys;
+    struct stat st;
+
+    /* the cache directory itself might not exist yet */
+    char *psz_dir = AVI_IndexFileDir();
+    if( !psz_dir )
+        return;
+    char *psz_parent = strrchr( psz_dir, DIR_SEP_CHAR );
+    if( psz_parent )
+    {
+        *psz_parent = '\0';
+        vlc_mkdir( psz_dir, 0700 );
+        *psz_parent = DIR_SEP_CHAR;
+    }
+    vlc_mkdir( psz_dir, 0700 );
+    free( psz_dir );
+
+    char *psz_path = AVI_IndexFilePath( p_demux );
+    char *psz_tmp;
+    if( !psz_path || vlc_stat( p_demux->psz_file, &st ) ||
+        asprintf( &psz_tmp, "%s.XXXXXX", psz_path ) == -1 )
+    {
+        free( psz_path );
+        return;
+    }
+
+    /* written aside then renamed, so that a concurrent reader never gets a
+     * truncated index, and concurrent writers do not mix their data */
+    FILE *p_file = NULL;
+    int fd = vlc_mkstemp( psz_tmp );
+    if( fd != -1 && !(p_file = fdopen( fd, "wb" )) )
+    {
+        close( fd );
+        vlc_unlink( psz_tmp );
+    }
+    if( !p_file )
+    {
+        msg_Warn( p_demux, "cannot create index file %s: %s", psz_tmp,
+                  vlc_strerror_c( errno ) );
+        free( psz_tmp );
+        free( psz_path );
+        return;
+    }
+
+    uint8_t header[INDEX_FILE_HEADER];
+    bool b_error;
+
+    SetDWLE( &header[0], INDEX_FILE_MAGIC );
+    SetDWLE( &header[4], INDEX_FILE_VERSION );
+    SetQWLE( &header[8], i_size );
+    SetQWLE( &header[16], st.st_mtime );
+    SetQWLE( &header[24], i_last_pos );
+    SetDWLE( &header[32], p_sys->i_track );
+    b_error = fwrite( header, sizeof(header), 1, p_file ) != 1;
+
+    for( unsigned i = 0; i < p_sys->i_track && !b_error; i++ )
+    {
+        uint8_t count[4];
+        SetDWLE( count, p_index[i].i_size );
+        b_error = fwrite( count, sizeof(count), 1, p_file ) != 1;
+
+        for( unsigned j = 0; j < p_index[i].i_size && !b_error; j++ )
+        {
+            const avi_entry_t *p_entry = &p_index[i].p_entry[j];
+            uint8_t entry[INDEX_FILE_ENTRY];
+
+            SetDWLE( &entry[0], p_entry->i_id );
+            SetDWLE( &entry[4], p_entry->i_flags );
+            SetQWLE( &entry[8], p_entry->i_pos );
+            SetDWLE( &entry[16], p_entry->i_length );
+            b_error = fwrite( entry, sizeof(entry), 1, p_file ) != 1;
+        }
+    }
+
+    if( fclose( p_file ) )
+        b_error = true;
+
+    if( b_error || vlc_rename( psz_tmp, psz_path ) )
+    {
+        msg_Warn( p_demux, "cannot write index file %s", psz_path );
+        vlc_unlink( psz_tmp );
+    }
+    else
+        msg_Dbg( p_demux, "stored the index in %s", psz_path );
+
+    free( psz_tmp );
+    free( psz_path );
 }
 
 /* */
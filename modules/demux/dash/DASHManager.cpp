@@ -38,6 +38,7 @@
 #include "mpd/MPDFactory.h"
 #include "xml/DOMParser.h"
 #include "../adaptative/logic/RateBasedAdaptationLogic.h"
+#include "../adaptative/logic/BufferBasedAdaptationLogic.h"
 #include <vlc_stream.h>
 
 #include <algorithm>
@@ -50,6 +51,7 @@ DASHManager::DASHManager(MPD *mpd,
                          AbstractAdaptationLogic::LogicType type, stream_t *stream) :
              PlaylistManager(mpd, type, stream)
 {
+    prefetch = var_InheritInteger(stream, "dash-prefetch");
 }
 
 DASHManager::~DASHManager   ()
@@ -96,7 +98,9 @@ bool DASHManager::updatePlaylist()
         MPD *newmpd = MPDFactory::create(parser.getRootNode(), mpdstream, parser.getProfile());
         if(newmpd)
         {
+            playlist->lock();
             playlist->mergeWith(newmpd, minsegmentTime);
+            playlist->unlock();
             delete newmpd;
         }
         stream_Delete(mpdstream);
@@ -139,6 +143,12 @@ AbstractAdaptationLogic *DASHManager::createLogic(AbstractAdaptationLogic::Logic
             int height = var_InheritInteger(stream, "dash-prefheight");
             return new (std::nothrow) RateBasedAdaptationLogic(width, height);
         }
+        case AbstractAdaptationLogic::BufferBased:
+        {
+            int width = var_InheritInteger(stream, "dash-prefwidth");
+            int height = var_InheritInteger(stream, "dash-prefheight");
+            return new (std::nothrow) BufferBasedAdaptationLogic(width, height);
+        }
         default:
             return PlaylistManager::createLogic(type);
     }
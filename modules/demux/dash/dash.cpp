@@ -69,12 +69,18 @@ static void Close   (vlc_object_t *);
 
 #define DASH_LOGIC_TEXT N_("Adaptation Logic")
 
+#define DASH_PREFETCH_TEXT N_("Segments to download ahead")
+#define DASH_PREFETCH_LONGTEXT N_("Number of segments downloaded in advance " \
+    "of playback, for each stream.")
+
 static const int pi_logics[] = {AbstractAdaptationLogic::RateBased,
+                                AbstractAdaptationLogic::BufferBased,
                                 AbstractAdaptationLogic::FixedRate,
                                 AbstractAdaptationLogic::AlwaysLowest,
                                 AbstractAdaptationLogic::AlwaysBest};
 
 static const char *const ppsz_logics[] = { N_("Bandwidth Adaptive"),
+                                           N_("Buffer and Bandwidth Adaptive"),
                                            N_("Fixed Bandwidth"),
                                            N_("Lowest Bandwidth/Quality"),
                                            N_("Highest Bandwith/Quality")};
@@ -91,6 +97,8 @@ vlc_module_begin ()
         add_integer( "dash-prefwidth",  480, DASH_WIDTH_TEXT,  DASH_WIDTH_LONGTEXT,  true )
         add_integer( "dash-prefheight", 360, DASH_HEIGHT_TEXT, DASH_HEIGHT_LONGTEXT, true )
         add_integer( "dash-prefbw",     250, DASH_BW_TEXT,     DASH_BW_LONGTEXT,     false )
+        add_integer_with_range( "dash-prefetch", 3, 1, 30, DASH_PREFETCH_TEXT,
+                                DASH_PREFETCH_LONGTEXT, true )
         set_callbacks( Open, Close )
 vlc_module_end ()
 
@@ -259,6 +267,15 @@ static int  Control         (demux_t *p_demux, int i_query, va_list args)
             break;
         }
 
+        case DEMUX_GET_BUFFER_LEVEL:
+        {
+            mtime_t level = p_sys->p_dashManager->getBufferLevel();
+            if(level < 0)
+                return VLC_EGENERIC;
+            *(va_arg (args, int64_t *)) = level;
+            break;
+        }
+
         case DEMUX_GET_PTS_DELAY:
             *va_arg (args, int64_t *) = INT64_C(1000) *
                 var_InheritInteger(p_demux, "network-caching");
@@ -54,6 +54,10 @@ void DashIndexSegment::onChunkDownload(void *data, size_t size, Chunk *, BaseRep
     if(!rep)
         return;
 
-    AtomsReader br(rep->getPlaylist()->getVLCObject());
+    /* the index adds subsegments to the representation */
+    AbstractPlaylist *playlist = rep->getPlaylist();
+    AtomsReader br(playlist->getVLCObject());
+    playlist->lock();
     br.parseBlock(data, size, rep);
+    playlist->unlock();
 }
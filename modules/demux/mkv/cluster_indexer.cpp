@@ -0,0 +1,298 @@
+/*****************************************************************************
+ * cluster_indexer.cpp : matroska demuxer
+ *****************************************************************************
+ * Copyright (C) 2015 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "cluster_indexer.hpp"
+
+#include <vlc_stream.h>
+
+/* EBML IDs, with their length marker */
+#define MKV_ID_SEGMENT          UINT32_C(0x18538067)
+#define MKV_ID_CLUSTER          UINT32_C(0x1F43B675)
+#define MKV_ID_CLUSTER_TIMECODE UINT32_C(0xE7)
+#define MKV_ID_SIMPLEBLOCK      UINT32_C(0xA3)
+#define MKV_ID_BLOCKGROUP       UINT32_C(0xA0)
+#define MKV_ID_EBML             UINT32_C(0x1A45DFA3)
+
+/* Only the elements at the segment level have 4 bytes IDs */
+#define MKV_ID_IS_LEVEL1( id )  ( (id) > UINT32_C(0xFFFFFF) )
+
+cluster_indexer_c::cluster_indexer_c( demux_t *p_demux_, uint64_t i_timescale_,
+                                      int64_t i_end_ )
+    :p_demux(p_demux_)
+    ,i_timescale(i_timescale_)
+    ,i_end(i_end_)
+    ,s(NULL)
+    ,i_start(0)
+    ,i_size(0)
+    ,is_running(false)
+    ,b_abort(false)
+    ,b_done(false)
+    ,i_percent(-1)
+{
+    vlc_mutex_init( &lock );
+}
+
+cluster_indexer_c::~cluster_indexer_c()
+{
+    if( is_running )
+    {
+        vlc_mutex_lock( &lock );
+        b_abort = true;
+        vlc_mutex_unlock( &lock );
+
+        vlc_join( thread, NULL );
+    }
+
+    if( s != NULL )
+        stream_Delete( s );
+    vlc_mutex_destroy( &lock );
+}
+
+bool cluster_indexer_c::Start( int64_t i_position )
+{
+    char *psz_url;
+
+    if( p_demux->psz_access == NULL || p_demux->psz_location == NULL ||
+        asprintf( &psz_url, "%s://%s", p_demux->psz_access,
+                  p_demux->psz_location ) == -1 )
+        return false;
+
+    /* the demux stream is not ours to move around */
+    s = stream_UrlNew( p_demux, psz_url );
+    free( psz_url );
+    if( s == NULL )
+    {
+        msg_Warn( p_demux, "cannot open a stream to index the clusters" );
+        return false;
+    }
+
+    i_start = i_position;
+    i_size = stream_Size( s );
+
+    is_running = !vlc_clone( &thread, IndexThread, this, VLC_THREAD_PRIORITY_LOW );
+    return is_running;
+}
+
+bool cluster_indexer_c::Fetch( int64_t i_position, std::vector<cluster_point_t> & out )
+{
+    vlc_mutex_locker l( &lock );
+
+    /* the clusters are found in order, look for the first one after */
+    size_t i_low = 0, i_high = points.size();
+    while( i_low < i_high )
+    {
+        size_t i_mid = ( i_low + i_high ) / 2;
+        if( points[i_mid].i_position <= i_position )
+            i_low = i_mid + 1;
+        else
+            i_high = i_mid;
+    }
+    out.insert( out.end(), points.begin() + i_low, points.end() );
+
+    return b_done;
+}
+
+void cluster_indexer_c::Publish( const cluster_point_t & point )
+{
+    uint64_t i_scanned = stream_Tell( s );
+    int i_new_percent = i_size > 0 ? __MIN( 100, i_scanned * 100 / i_size ) : 0;
+
+    vlc_mutex_lock( &lock );
+    points.push_back( point );
+    vlc_mutex_unlock( &lock );
+
+    if( i_new_percent != i_percent )
+    {
+        i_percent = i_new_percent;
+        var_SetFloat( p_demux, "mkv-index-progress", i_percent / 100.f );
+    }
+}
+
+/* Reads an element ID and size, the size is -1 when it is unknown */
+bool cluster_indexer_c::ReadHeader( uint32_t *pi_id, int64_t *pi_size )
+{
+    const uint8_t *p_peek;
+    int i_peek = stream_Peek( s, &p_peek, 12 );
+    if( i_peek < 2 )
+        return false;
+
+    int i_id_len = 1;
+    while( i_id_len <= 4 && !( p_peek[0] & ( 0x100 >> i_id_len ) ) )
+        i_id_len++;
+    if( i_id_len > 4 || i_id_len >= i_peek )
+        return false;
+
+    uint32_t i_id = 0;
+    for( int i = 0; i < i_id_len; i++ )
+        i_id = ( i_id << 8 ) | p_peek[i];
+
+    const uint8_t *p_size = &p_peek[i_id_len];
+    int i_size_len = 1;
+    while( i_size_len <= 8 && !( p_size[0] & ( 0x100 >> i_size_len ) ) )
+        i_size_len++;
+    if( i_size_len > 8 || i_id_len + i_size_len > i_peek )
+        return false;
+
+    uint64_t i_value = p_size[0] & ( 0xff >> i_size_len );
+    bool b_unknown = i_value == ( 0xffu >> i_size_len );
+    for( int i = 1; i < i_size_len; i++ )
+    {
+        i_value = ( i_value << 8 ) | p_size[i];
+        b_unknown = b_unknown && p_size[i] == 0xff;
+    }
+    if( !b_unknown && i_value > INT64_MAX )
+        return false;
+
+    uint8_t header[12];
+    if( stream_Read( s, header, i_id_len + i_size_len ) != i_id_len + i_size_len )
+        return false;
+
+    *pi_id = i_id;
+    *pi_size = b_unknown ? -1 : (int64_t)i_value;
+    return true;
+}
+
+/* Publishes the timecode of the cluster whose header was just read, and
+ * leaves the stream at its end. Returns false if the end cannot be found. */
+bool cluster_indexer_c::ReadCluster( int64_t i_position, int64_t i_cluster_size )
+{
+    const int64_t i_cluster_end = i_cluster_size >= 0 ?
+                                  stream_Tell( s ) + i_cluster_size : -1;
+    bool b_timecode = false;
+
+    for( ;; )
+    {
+        const int64_t i_child = stream_Tell( s );
+        uint32_t i_id;
+        int64_t i_child_size;
+
+        if( i_cluster_end >= 0 && i_child >= i_cluster_end )
+            break;
+        if( !ReadHeader( &i_id, &i_child_size ) )
+            return false;
+
+        if( MKV_ID_IS_LEVEL1( i_id ) )
+        {
+            /* the end of a cluster of unknown size */
+            if( i_cluster_end >= 0 )
+                return false;
+            return stream_Seek( s, i_child ) == VLC_SUCCESS;
+        }
+
+        /* the timecode comes before the blocks */
+        if( i_id == MKV_ID_CLUSTER_TIMECODE && !b_timecode &&
+            i_child_size >= 1 && i_child_size <= 8 )
+        {
+            uint8_t buf[8];
+            if( stream_Read( s, buf, i_child_size ) != i_child_size )
+                return false;
+
+            uint64_t i_timecode = 0;
+            for( int64_t i = 0; i < i_child_size; i++ )
+                i_timecode = ( i_timecode << 8 ) | buf[i];
+
+            cluster_point_t point;
+            point.i_position = i_position;
+            point.i_mk_time  = i_timecode * i_timescale / INT64_C(1000);
+            Publish( point );
+            b_timecode = true;
+
+            /* skip the blocks altogether */
+            if( i_cluster_end >= 0 )
+                break;
+        }
+        else if( i_cluster_end >= 0 &&
+                 ( i_id == MKV_ID_SIMPLEBLOCK || i_id == MKV_ID_BLOCKGROUP ) )
+        {
+            /* no timecode before the blocks */
+            break;
+        }
+        else if( i_child_size < 0 ||
+                 stream_Seek( s, stream_Tell( s ) + i_child_size ) )
+            return false;
+    }
+
+    return stream_Seek( s, i_cluster_end ) == VLC_SUCCESS;
+}
+
+void cluster_indexer_c::IndexThread()
+{
+    mtime_t     i_begin = mdate();
+    bool        b_eos = false;
+
+    if( stream_Seek( s, i_start ) )
+        b_eos = true;
+
+    while( !b_eos )
+    {
+        vlc_mutex_lock( &lock );
+        bool b_stop = b_abort;
+        vlc_mutex_unlock( &lock );
+        if( b_stop )
+            break;
+
+        const int64_t i_position = stream_Tell( s );
+        uint32_t i_id;
+        int64_t i_element_size;
+
+        if( ( i_end >= 0 && i_position >= i_end ) ||
+            !ReadHeader( &i_id, &i_element_size ) ||
+            i_id == MKV_ID_EBML || i_id == MKV_ID_SEGMENT )
+        {
+            b_eos = true;
+        }
+        else if( i_id == MKV_ID_CLUSTER )
+        {
+            if( !ReadCluster( i_position, i_element_size ) )
+                b_eos = true;
+        }
+        else if( i_element_size < 0 ||
+                 stream_Seek( s, stream_Tell( s ) + i_element_size ) )
+        {
+            /* the cues, tags... cannot be skipped */
+            b_eos = true;
+        }
+    }
+
+    vlc_mutex_lock( &lock );
+    b_done = b_eos;
+    const size_t i_points = points.size();
+    vlc_mutex_unlock( &lock );
+
+    if( b_eos )
+    {
+        var_SetFloat( p_demux, "mkv-index-progress", 1.f );
+        msg_Dbg( p_demux, "indexed %zu clusters in %" PRId64 " ms",
+                 i_points, ( mdate() - i_begin ) / 1000 );
+    }
+    else
+        msg_Dbg( p_demux, "cluster indexing stopped after %zu clusters",
+                 i_points );
+}
+
+void *cluster_indexer_c::IndexThread( void *data )
+{
+    static_cast<cluster_indexer_c*>( data )->IndexThread();
+    return NULL;
+}
@@ -0,0 +1,84 @@
+/*****************************************************************************
+ * cluster_indexer.hpp : matroska demuxer
+ *****************************************************************************
+ * Copyright (C) 2015 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifndef _CLUSTER_INDEXER_HPP_
+#define _CLUSTER_INDEXER_HPP_
+
+#include <vlc_common.h>
+#include <vlc_demux.h>
+
+#include <vector>
+
+/*****************************************************************************
+ * Background cluster indexer
+ *****************************************************************************
+ * Walks the clusters headers of a segment without cues from a thread, on its
+ * own stream, so that seeks can start from the closest cluster found so far
+ * instead of parsing all the blocks up to the target on the demux thread.
+ * Only the element headers and the cluster timecodes are read, so it does
+ * not go through libebml.
+ *****************************************************************************/
+struct cluster_point_t
+{
+    int64_t i_position;
+    mtime_t i_mk_time;
+};
+
+class cluster_indexer_c
+{
+public:
+    /* i_end is the end of the segment, or -1 when its size is unknown */
+    cluster_indexer_c( demux_t *p_demux, uint64_t i_timescale, int64_t i_end );
+    ~cluster_indexer_c();
+
+    /* Starts indexing from the cluster at i_position */
+    bool Start( int64_t i_position );
+
+    /* Appends the clusters found after i_position,
+     * returns true once the whole segment was indexed */
+    bool Fetch( int64_t i_position, std::vector<cluster_point_t> & points );
+
+private:
+    void IndexThread();
+    static void *IndexThread( void * );
+
+    bool ReadHeader( uint32_t *pi_id, int64_t *pi_size );
+    bool ReadCluster( int64_t i_position, int64_t i_size );
+    void Publish( const cluster_point_t & point );
+
+    demux_t                *p_demux;
+    uint64_t               i_timescale;
+    int64_t                i_end;
+
+    stream_t               *s;
+    int64_t                i_start;
+    uint64_t               i_size;
+
+    bool                   is_running;
+    vlc_thread_t           thread;
+
+    vlc_mutex_t            lock;
+    bool                   b_abort;
+    bool                   b_done;
+    std::vector<cluster_point_t> points;
+    int                    i_percent;
+};
+
+#endif
@@ -780,7 +780,10 @@ bool demux_sys_t::PreparePlayback( virtual_segment_c *p_new_segment )
     if( !p_current_segment->CurrentSegment() )
         return false;
     if( !p_current_segment->CurrentSegment()->b_cues )
+    {
         msg_Warn( &p_current_segment->CurrentSegment()->sys.demuxer, "no cues/empty cues found->seek won't be precise" );
+        p_current_segment->CurrentSegment()->StartClusterIndexer();
+    }
 
     f_duration = p_current_segment->Duration();
 
@@ -27,6 +27,7 @@
 #include "demux.hpp"
 #include "util.hpp"
 #include "Ebml_parser.hpp"
+#include "cluster_indexer.hpp"
 
 matroska_segment_c::matroska_segment_c( demux_sys_t & demuxer, EbmlStream & estream )
     :segment(NULL)
@@ -52,6 +53,8 @@ matroska_segment_c::matroska_segment_c( demux_sys_t & demuxer, EbmlStream & estr
     ,b_cues(false)
     ,i_index(0)
     ,i_index_max(1024)
+    ,p_indexer(NULL)
+    ,i_seek_scan_bytes(0)
     ,psz_muxing_application(NULL)
     ,psz_writing_application(NULL)
     ,psz_segment_filename(NULL)
@@ -68,6 +71,9 @@ matroska_segment_c::matroska_segment_c( demux_sys_t & demuxer, EbmlStream & estr
 
 matroska_segment_c::~matroska_segment_c()
 {
+    /* before the segment it walks */
+    delete p_indexer;
+
     for( size_t i_track = 0; i_track < tracks.size(); i_track++ )
     {
         delete tracks[i_track]->p_compression_data;
@@ -593,12 +599,18 @@ void matroska_segment_c::InformationCreate( )
  *****************************************************************************/
 
 void matroska_segment_c::IndexAppendCluster( KaxCluster *cluster )
+{
+    IndexAppend( cluster->GetElementPosition(),
+                 cluster->GlobalTimecode() / INT64_C(1000) );
+}
+
+void matroska_segment_c::IndexAppend( int64_t i_position, mtime_t i_mk_time )
 {
 #define idx p_indexes[i_index]
     idx.i_track       = -1;
     idx.i_block_number= -1;
-    idx.i_position    = cluster->GetElementPosition();
-    idx.i_mk_time     = cluster->GlobalTimecode() / INT64_C(1000);
+    idx.i_position    = i_position;
+    idx.i_mk_time     = i_mk_time;
     idx.b_key         = true;
 
     i_index++;
@@ -611,6 +623,57 @@ void matroska_segment_c::IndexAppendCluster( KaxCluster *cluster )
 #undef idx
 }
 
+/* Without cues, look for the clusters from a thread, ahead of the playback */
+void matroska_segment_c::StartClusterIndexer()
+{
+    if( b_cues || p_indexer != NULL ||
+        !var_InheritBool( &sys.demuxer, "mkv-index-clusters" ) )
+        return;
+
+    /* only the segments of the demuxed stream */
+    if( sys.streams.empty() || sys.streams[0]->p_estream != &es )
+        return;
+
+    bool b_fastseekable;
+    stream_Control( sys.demuxer.s, STREAM_CAN_FASTSEEK, &b_fastseekable );
+    if( !b_fastseekable )
+        return;
+
+    int64_t i_pos = i_index > 0 ? p_indexes[i_index - 1].i_position : i_start_pos;
+
+    p_indexer = new cluster_indexer_c( &sys.demuxer, i_timescale,
+                                       segment->IsFiniteSize() ?
+                                       (int64_t)segment->GetEndPosition() : -1 );
+    if( !p_indexer->Start( i_pos ) )
+    {
+        delete p_indexer;
+        p_indexer = NULL;
+        return;
+    }
+    msg_Dbg( &sys.demuxer, "indexing the clusters from %" PRId64, i_pos );
+}
+
+/* Takes the clusters found by the indexer past the ones already known */
+void matroska_segment_c::MergeClusterIndex()
+{
+    if( p_indexer == NULL )
+        return;
+
+    std::vector<cluster_point_t> points;
+    bool b_done = p_indexer->Fetch( i_index > 0 ? p_indexes[i_index - 1].i_position : -1,
+                                    points );
+
+    for( size_t i = 0; i < points.size(); i++ )
+        IndexAppend( points[i].i_position, points[i].i_mk_time );
+
+    if( b_done )
+    {
+        /* nothing left to find, release its stream */
+        delete p_indexer;
+        p_indexer = NULL;
+    }
+}
+
 bool matroska_segment_c::PreloadFamily( const matroska_segment_c & of_segment )
 {
     if ( b_preloaded )
@@ -892,9 +955,13 @@ void matroska_segment_c::Seek( mtime_t i_mk_date, mtime_t i_mk_time_offset, int6
     int i_cat;
     bool b_has_key = false;
 
+    uint64      i_scanned = 0;
+
     for( size_t i = 0; i < tracks.size(); i++)
         tracks[i]->i_last_dts = VLC_TS_INVALID;
 
+    MergeClusterIndex();
+
     if( i_global_position >= 0 )
     {
         /* Special case for seeking in files with no cues */
@@ -906,6 +973,7 @@ void matroska_segment_c::Seek( mtime_t i_mk_date, mtime_t i_mk_time_offset, int6
         else
             es.I_O().setFilePointer( p_indexes[ i_index - 1 ].i_position,
                                      seek_beginning );
+        const uint64 i_scan_start = es.I_O().getFilePointer();
         delete ep;
         ep = new EbmlParser( &es, segment, &sys.demuxer,
                              var_InheritBool( &sys.demuxer, "mkv-use-dummy" ) );
@@ -928,6 +996,7 @@ void matroska_segment_c::Seek( mtime_t i_mk_date, mtime_t i_mk_time_offset, int6
                     break;
             }
         }
+        i_scanned += es.I_O().getFilePointer() - i_scan_start;
     }
 
     /* Don't try complex seek if we seek to 0 */
@@ -1085,9 +1154,11 @@ void matroska_segment_c::Seek( mtime_t i_mk_date, mtime_t i_mk_time_offset, int6
             break;
 
         /* No key picture was found in the cluster seek to previous seekpoint */
+        i_scanned += es.I_O().getFilePointer() - i_seek_position;
         i_mk_date = i_mk_time_offset + p_indexes[i_idx].i_mk_time;
         i_idx--;
         i_mk_pts = 0;
+        i_seek_position = p_indexes[i_idx].i_position;
         es.I_O().setFilePointer( p_indexes[i_idx].i_position );
         delete ep;
         ep = new EbmlParser( &es, segment, &sys.demuxer,
@@ -1095,6 +1166,11 @@ void matroska_segment_c::Seek( mtime_t i_mk_date, mtime_t i_mk_time_offset, int6
         cluster = NULL;
     }
 
+    i_scanned += es.I_O().getFilePointer() - i_seek_position;
+    i_seek_scan_bytes += i_scanned;
+    var_SetInteger( &sys.demuxer, "mkv-seek-scan-bytes", i_seek_scan_bytes );
+    msg_Dbg( &sys.demuxer, "seek scanned %" PRIu64 " bytes", (uint64_t)i_scanned );
+
     /* rewind to the last I img */
     spoint * p_min;
     for( p_min  = p_first, p_last = p_first; p_last; p_last = p_last->p_next )
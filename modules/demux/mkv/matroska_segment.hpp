@@ -28,6 +28,7 @@
 #include "mkv.hpp"
 
 class EbmlParser;
+class cluster_indexer_c;
 
 class chapter_edition_c;
 class chapter_translation_c;
@@ -110,6 +111,8 @@ public:
     int                     i_index;
     int                     i_index_max;
     mkv_index_t             *p_indexes;
+    cluster_indexer_c       *p_indexer;
+    uint64_t                i_seek_scan_bytes;
 
     /* info */
     char                    *psz_muxing_application;
@@ -137,6 +140,8 @@ public:
     bool PreloadFamily( const matroska_segment_c & segment );
     void InformationCreate();
     void Seek( mtime_t i_mk_date, mtime_t i_mk_time_offset, int64_t i_global_position );
+    void StartClusterIndexer();
+    void MergeClusterIndex();
     int BlockGet( KaxBlock * &, KaxSimpleBlock * &, bool *, bool *, int64_t *);
 
     int BlockFindTrackIndex( size_t *pi_track,
@@ -161,6 +166,7 @@ private:
     void ParseCluster( KaxCluster *cluster, bool b_update_start_time = true, ScopeMode read_fully = SCOPE_ALL_DATA );
     SimpleTag * ParseSimpleTags( KaxTagSimple *tag, int level = 50 );
     void IndexAppendCluster( KaxCluster *cluster );
+    void IndexAppend( int64_t i_position, mtime_t i_mk_time );
     int32_t TrackInit( mkv_track_t * p_tk );
     void ComputeTrackPriority();
     void EnsureDuration();
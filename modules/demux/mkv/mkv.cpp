@@ -74,6 +74,10 @@ vlc_module_begin ()
             N_("Dummy Elements"),
             N_("Read and discard unknown EBML elements (not good for broken files)."), true );
 
+    add_bool( "mkv-index-clusters", true,
+            N_("Index clusters without cues"),
+            N_("Look for the clusters in the background when the segment has no cues, so that seeking is faster."), true );
+
     add_shortcut( "mka", "mkv" )
 vlc_module_end ()
 
@@ -110,6 +114,10 @@ static int Open( vlc_object_t * p_this )
     p_demux->pf_control = Control;
     p_demux->p_sys      = p_sys = new demux_sys_t( *p_demux );
 
+    /* progress of the clusters indexing and bytes parsed to seek, without cues */
+    var_Create( p_demux, "mkv-index-progress", VLC_VAR_FLOAT );
+    var_Create( p_demux, "mkv-seek-scan-bytes", VLC_VAR_INTEGER );
+
     p_io_callback = new vlc_stream_io_callback( p_demux->s, false );
     p_io_stream = new EbmlStream( *p_io_callback );
 
@@ -463,6 +471,9 @@ static void Seek( demux_t *p_demux, mtime_t i_mk_date, double f_percent, virtual
         {
             int64_t i_pos = int64_t( f_percent * stream_Size( p_demux->s ) );
 
+            /* use the clusters indexed in the background so far */
+            p_segment->MergeClusterIndex();
+
             msg_Dbg( p_demux, "lengthy way of seeking for pos:%" PRId64, i_pos );
             for( i_index = 0; i_index < p_segment->i_index; i_index++ )
             {
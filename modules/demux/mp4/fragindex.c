@@ -0,0 +1,250 @@
+/*****************************************************************************
+ * fragindex.c: persistent fragments index for fragmented mp4
+ *****************************************************************************
+ * Copyright (C) 2015 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#include "mp4.h"
+
+#include <vlc_fs.h>
+#include <vlc_md5.h>
+#include <vlc_configuration.h>
+
+#include <errno.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* The index of a file is stored in the user cache directory, under the md5
+ * of its URI. It starts with the URI and the size and modification time of
+ * the file when it was indexed, so that the caller can check the index
+ * still matches the file. All values are big endian:
+ *
+ *   u32 magic, u32 version, u32 URI length, URI,
+ *   u64 size, i64 mtime, u64 end, u32 timescale, u64 duration, u32 entries,
+ *   entries * { u64 moof position, u64 time } */
+#define FRAGINDEX_MAGIC   VLC_FOURCC('m','f','i','x')
+#define FRAGINDEX_VERSION 2 /* 2: times from the tfdt boxes */
+#define FRAGINDEX_HEADER  (8 + 8 + 8 + 4 + 8 + 4)
+
+static char *GetIndexDir( void )
+{
+    char *psz_cachedir = config_GetUserDir( VLC_CACHE_DIR );
+    char *psz_dir;
+
+    if( psz_cachedir == NULL )
+        return NULL;
+
+    if( asprintf( &psz_dir, "%s" DIR_SEP "mp4index", psz_cachedir ) == -1 )
+        psz_dir = NULL;
+    free( psz_cachedir );
+    return psz_dir;
+}
+
+static char *GetIndexPath( const char *psz_uri )
+{
+    char *psz_dir = GetIndexDir();
+    char *psz_path;
+
+    if( psz_dir == NULL )
+        return NULL;
+
+    struct md5_s md5;
+    InitMD5( &md5 );
+    AddMD5( &md5, psz_uri, strlen( psz_uri ) );
+    EndMD5( &md5 );
+    char *psz_hash = psz_md5_hash( &md5 );
+
+    if( psz_hash == NULL ||
+        asprintf( &psz_path, "%s" DIR_SEP "%s", psz_dir, psz_hash ) == -1 )
+        psz_path = NULL;
+    free( psz_hash );
+    free( psz_dir );
+    return psz_path;
+}
+
+int MP4_FragIndexLoad( vlc_object_t *p_obj, const char *psz_uri,
+                       mp4_fragindex_t *p_index )
+{
+    char *psz_path = GetIndexPath( psz_uri );
+    if( psz_path == NULL )
+        return VLC_ENOMEM;
+
+    FILE *p_file = vlc_fopen( psz_path, "rb" );
+    free( psz_path );
+    if( p_file == NULL )
+        return VLC_EGENERIC;
+
+    const size_t i_uri = strlen( psz_uri );
+    uint8_t header[12];
+    uint8_t *p_data = NULL;
+    mp4_fragindex_entry_t *p_entries = NULL;
+
+    if( fread( header, sizeof(header), 1, p_file ) != 1 ||
+        GetDWBE( &header[0] ) != FRAGINDEX_MAGIC ||
+        GetDWBE( &header[4] ) != FRAGINDEX_VERSION ||
+        GetDWBE( &header[8] ) != i_uri )
+        goto error;
+
+    p_data = malloc( __MAX( i_uri, FRAGINDEX_HEADER ) );
+    if( p_data == NULL ||
+        fread( p_data, i_uri, 1, p_file ) != 1 ||
+        memcmp( p_data, psz_uri, i_uri ) ||
+        fread( p_data, FRAGINDEX_HEADER, 1, p_file ) != 1 )
+        goto error;
+
+    /* the entries must fit in what is left of the file */
+    struct stat st;
+    const uint32_t i_entries = GetDWBE( &p_data[36] );
+    const uint64_t i_header = 12 + i_uri + FRAGINDEX_HEADER;
+    if( i_entries == 0 || fstat( fileno( p_file ), &st ) ||
+        (uint64_t)st.st_size < i_header ||
+        i_entries > ((uint64_t)st.st_size - i_header) / 16 )
+        goto error;
+
+    /* allocated by 256 entries, as the demuxer appends to it */
+    p_entries = malloc( ((i_entries + 0xFF) & ~0xFF) * sizeof(*p_entries) );
+    if( p_entries == NULL )
+        goto error;
+
+    for( uint32_t i = 0; i < i_entries; i++ )
+    {
+        uint8_t entry[16];
+        if( fread( entry, sizeof(entry), 1, p_file ) != 1 )
+            goto error;
+        p_entries[i].i_moof_pos = GetQWBE( &entry[0] );
+        p_entries[i].i_time = GetQWBE( &entry[8] );
+        if( i > 0 && ( p_entries[i].i_moof_pos <= p_entries[i - 1].i_moof_pos ||
+                       p_entries[i].i_time < p_entries[i - 1].i_time ) )
+            goto error;
+    }
+
+    fclose( p_file );
+
+    MP4_FragIndexClean( p_index );
+    p_index->i_size = GetQWBE( &p_data[0] );
+    p_index->i_mtime = GetQWBE( &p_data[8] );
+    p_index->i_end = GetQWBE( &p_data[16] );
+    p_index->i_timescale = GetDWBE( &p_data[24] );
+    p_index->i_duration = GetQWBE( &p_data[28] );
+    p_index->i_entries = i_entries;
+    p_index->p_entries = p_entries;
+    free( p_data );
+
+    msg_Dbg( p_obj, "loaded index of %"PRIu32" fragments", i_entries );
+    return VLC_SUCCESS;
+
+error:
+    msg_Warn( p_obj, "ignoring invalid fragments index" );
+    fclose( p_file );
+    free( p_entries );
+    free( p_data );
+    return VLC_EGENERIC;
+}
+
+int MP4_FragIndexStore( vlc_object_t *p_obj, const char *psz_uri,
+                        const mp4_fragindex_t *p_index )
+{
+    char *psz_dir = GetIndexDir();
+    if( psz_dir == NULL )
+        return VLC_ENOMEM;
+
+    /* the cache directory itself might not exist yet */
+    char *psz_parent = strrchr( psz_dir, DIR_SEP_CHAR );
+    if( psz_parent != NULL )
+    {
+        *psz_parent = '\0';
+        vlc_mkdir( psz_dir, 0700 );
+        *psz_parent = DIR_SEP_CHAR;
+    }
+    vlc_mkdir( psz_dir, 0700 );
+    free( psz_dir );
+
+    char *psz_path = GetIndexPath( psz_uri );
+    char *psz_tmp;
+    if( psz_path == NULL || asprintf( &psz_tmp, "%s.XXXXXX", psz_path ) == -1 )
+    {
+        free( psz_path );
+        return VLC_ENOMEM;
+    }
+
+    /* written aside then renamed, so that a concurrent reader never gets a
+     * truncated index, and concurrent writers do not mix their data */
+    FILE *p_file = NULL;
+    int fd = vlc_mkstemp( psz_tmp );
+    if( fd != -1 && (p_file = fdopen( fd, "wb" )) == NULL )
+    {
+        close( fd );
+        vlc_unlink( psz_tmp );
+    }
+    if( p_file == NULL )
+    {
+        msg_Warn( p_obj, "cannot create fragments index %s: %s", psz_tmp,
+                  vlc_strerror_c( errno ) );
+        free( psz_tmp );
+        free( psz_path );
+        return VLC_EGENERIC;
+    }
+
+    const size_t i_uri = strlen( psz_uri );
+    uint8_t header[12 + FRAGINDEX_HEADER];
+    bool b_error;
+
+    SetDWBE( &header[0], FRAGINDEX_MAGIC );
+    SetDWBE( &header[4], FRAGINDEX_VERSION );
+    SetDWBE( &header[8], i_uri );
+    b_error = fwrite( header, 12, 1, p_file ) != 1 ||
+              fwrite( psz_uri, i_uri, 1, p_file ) != 1;
+
+    SetQWBE( &header[0], p_index->i_size );
+    SetQWBE( &header[8], p_index->i_mtime );
+    SetQWBE( &header[16], p_index->i_end );
+    SetDWBE( &header[24], p_index->i_timescale );
+    SetQWBE( &header[28], p_index->i_duration );
+    SetDWBE( &header[36], p_index->i_entries );
+    b_error |= fwrite( header, FRAGINDEX_HEADER, 1, p_file ) != 1;
+
+    for( uint32_t i = 0; i < p_index->i_entries && !b_error; i++ )
+    {
+        uint8_t entry[16];
+        SetQWBE( &entry[0], p_index->p_entries[i].i_moof_pos );
+        SetQWBE( &entry[8], p_index->p_entries[i].i_time );
+        b_error = fwrite( entry, sizeof(entry), 1, p_file ) != 1;
+    }
+
+    if( fclose( p_file ) )
+        b_error = true;
+
+    if( b_error || vlc_rename( psz_tmp, psz_path ) )
+    {
+        msg_Warn( p_obj, "cannot write fragments index %s", psz_path );
+        vlc_unlink( psz_tmp );
+        b_error = true;
+    }
+    else
+        msg_Dbg( p_obj, "stored index of %"PRIu32" fragments",
+                 p_index->i_entries );
+
+    free( psz_tmp );
+    free( psz_path );
+    return b_error ? VLC_EGENERIC : VLC_SUCCESS;
+}
+
+void MP4_FragIndexClean( mp4_fragindex_t *p_index )
+{
+    free( p_index->p_entries );
+    memset( p_index, 0, sizeof(*p_index) );
+}
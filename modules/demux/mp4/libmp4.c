@@ -1257,7 +1257,7 @@ static int MP4_ReadBox_stts( stream_t *p_stream, MP4_Box_t *p_box )
     p_box->data.p_stts->pi_sample_count =
         calloc( p_box->data.p_stts->i_entry_count, sizeof(uint32_t) );
     p_box->data.p_stts->pi_sample_delta =
-        calloc( p_box->data.p_stts->i_entry_count, sizeof(int32_t) );
+        calloc( p_box->data.p_stts->i_entry_count, sizeof(uint32_t) );
     if( p_box->data.p_stts->pi_sample_count == NULL
      || p_box->data.p_stts->pi_sample_delta == NULL )
     {
@@ -36,8 +36,10 @@
 #include <vlc_charset.h>                           /* EnsureUTF8 */
 #include <vlc_input.h>
 #include <vlc_aout.h>
+#include <vlc_fs.h>
 #include <assert.h>
 #include <limits.h>
+#include <sys/stat.h>
 
 /*****************************************************************************
  * Module descriptor
@@ -45,6 +47,12 @@
 static int  Open ( vlc_object_t * );
 static void Close( vlc_object_t * );
 
+#define FRAGINDEX_TEXT N_("Cache the fragments index")
+#define FRAGINDEX_LONGTEXT N_( \
+    "Store the position and time of the fragments of fragmented files " \
+    "in the cache directory, so that they can be seeked as soon as they " \
+    "are opened again, without reading all the fragments first.")
+
 vlc_module_begin ()
     set_category( CAT_INPUT )
     set_subcategory( SUBCAT_INPUT_DEMUX )
@@ -52,6 +60,9 @@ vlc_module_begin ()
     set_shortname( N_("MP4") )
     set_capability( "demux", 240 )
     set_callbacks( Open, Close )
+
+    add_bool( "mp4-fragment-index-cache", false,
+              FRAGINDEX_TEXT, FRAGINDEX_LONGTEXT, true )
 vlc_module_end ()
 
 /*****************************************************************************
@@ -90,6 +101,9 @@ struct demux_sys_t
     bool            b_fragments_probed;
     mp4_fragment_t  moovfragment; /* moov */
     mp4_fragment_t *p_fragments;  /* known fragments (moof following moov) */
+    mp4_fragment_t *p_lastfragment; /* last moof fragment, by position */
+    bool            b_fragindex;  /* fragments index cache enabled */
+    mp4_fragindex_t fragindex;    /* cached fragments index, if any */
 
     struct
     {
@@ -99,6 +113,15 @@ struct demux_sys_t
         uint32_t        i_lastseqnumber;
     } context;
 
+    /* coalesced reads of the upcoming samples of all tracks */
+    struct
+    {
+        block_t    *p_block;    /* data read ahead, or NULL */
+        uint64_t    i_pos;      /* file offset of p_block->p_buffer */
+        uint64_t    i_reads;    /* reads issued */
+        uint64_t    i_seeks;    /* seeks issued */
+    } readahead;
+
     /* */
     MP4_Box_t    *p_tref_chap;
 
@@ -115,11 +138,20 @@ struct demux_sys_t
 /*****************************************************************************
  * Declaration of local function
  *****************************************************************************/
+
+/* Bounds of the read planner: a single read covers at most that many bytes,
+ * and that many chunks of each track. Holes up to MP4_READAHEAD_GAP between
+ * the chunks are read and dropped, as that is cheaper than seeking. */
+#define MP4_READAHEAD_MAX       (2 * 1024 * 1024)
+#define MP4_READAHEAD_CHUNKS    8
+#define MP4_READAHEAD_GAP       (32 * 1024)
+
 static void MP4_TrackCreate ( demux_t *, mp4_track_t *, MP4_Box_t  *, bool b_force_enable );
 static int MP4_frg_TrackCreate( demux_t *, mp4_track_t *, MP4_Box_t *);
 static void MP4_TrackDestroy(  mp4_track_t * );
 
 static block_t * MP4_Block_Read( demux_t *, const mp4_track_t *, int );
+static block_t * MP4_Block_ReadAhead( demux_t *, const mp4_track_t *, uint64_t, uint32_t );
 static void MP4_Block_Send( demux_t *, mp4_track_t *, block_t * );
 
 static int  MP4_TrackSelect ( demux_t *, mp4_track_t *, mtime_t );
@@ -128,6 +160,7 @@ static void MP4_TrackUnselect(demux_t *, mp4_track_t * );
 static int  MP4_TrackSeek   ( demux_t *, mp4_track_t *, mtime_t );
 
 static uint64_t MP4_TrackGetPos    ( mp4_track_t * );
+static uint64_t MP4_TrackGetChunkBytes( const mp4_track_t *, uint32_t, uint32_t );
 static uint32_t MP4_TrackGetReadSize( mp4_track_t *, uint32_t * );
 static int      MP4_TrackNextSample( demux_t *, mp4_track_t *, uint32_t );
 static void     MP4_TrackSetELST( demux_t *, mp4_track_t *, int64_t );
@@ -143,6 +176,9 @@ static void MP4_GetDefaultSizeAndDuration( demux_t *p_demux,
 static bool AddFragment( demux_t *p_demux, MP4_Box_t *p_moox );
 static int  ProbeFragments( demux_t *p_demux, bool b_force );
 static int  ProbeIndex( demux_t *p_demux );
+static void FragIndexOpen( demux_t *p_demux );
+static int  FragIndexGetMoofPosByTime( demux_t *p_demux, const mtime_t i_target_time,
+                                       uint64_t *pi_pos, mtime_t *pi_mooftime );
 static mp4_fragment_t *GetFragmentByPos( demux_t *p_demux, uint64_t i_pos, bool b_exact );
 static mp4_fragment_t *GetFragmentByTime( demux_t *p_demux, const mtime_t i_time );
 
@@ -230,6 +266,18 @@ static MP4_Box_t * MP4_GetTrakByTrackID( MP4_Box_t *p_moov, const uint32_t i_id
     return p_trak;
 }
 
+/* Number of samples of the chunk in its i_index-th stts/ctts entry, except
+ * for the last entry, which can go on in the next chunks */
+static inline uint32_t MP4_ChunkGetDTSCount( const mp4_chunk_t *ck, uint32_t i_index )
+{
+    return ck->p_sample_count_dts[i_index] - ( i_index ? 0 : ck->i_dts_skip );
+}
+
+static inline uint32_t MP4_ChunkGetPTSCount( const mp4_chunk_t *ck, uint32_t i_index )
+{
+    return ck->p_sample_count_pts[i_index] - ( i_index ? 0 : ck->i_pts_skip );
+}
+
 /* Return time in microsecond of a track */
 static inline int64_t MP4_TrackGetDTS( demux_t *p_demux, mp4_track_t *p_track )
 {
@@ -246,11 +294,11 @@ static inline int64_t MP4_TrackGetDTS( demux_t *p_demux, mp4_track_t *p_track )
 
     while( i_sample > 0 && i_index < p_chunk->i_entries_dts )
     {
-        if( i_sample > p_chunk->p_sample_count_dts[i_index] )
+        const uint32_t i_count = MP4_ChunkGetDTSCount( p_chunk, i_index );
+        if( i_sample > i_count )
         {
-            i_dts += p_chunk->p_sample_count_dts[i_index] *
-                p_chunk->p_sample_delta_dts[i_index];
-            i_sample -= p_chunk->p_sample_count_dts[i_index];
+            i_dts += i_count * p_chunk->p_sample_delta_dts[i_index];
+            i_sample -= i_count;
             i_index++;
         }
         else
@@ -302,14 +350,15 @@ static inline bool MP4_TrackGetPTSDelta( demux_t *p_demux, mp4_track_t *p_track,
 
     for( i_index = 0; i_index < ck->i_entries_pts ; i_index++ )
     {
-        if( i_sample < ck->p_sample_count_pts[i_index] )
+        const uint32_t i_count = MP4_ChunkGetPTSCount( ck, i_index );
+        if( i_sample < i_count )
         {
             *pi_delta = ck->p_sample_offset_pts[i_index] * CLOCK_FREQ /
                         (int64_t)p_track->i_timescale;
             return true;
         }
 
-        i_sample -= ck->p_sample_count_pts[i_index];
+        i_sample -= i_count;
     }
     return false;
 }
@@ -478,12 +527,8 @@ static block_t * MP4_EIA608_Convert( block_t * p_block )
     return p_newblock;
 }
 
-static block_t * MP4_Block_Read( demux_t *p_demux, const mp4_track_t *p_track, int i_size )
+static block_t * MP4_Block_Convert( const mp4_track_t *p_track, block_t *p_block )
 {
-    block_t *p_block = stream_Block( p_demux->s, i_size );
-    if ( !p_block )
-        return NULL;
-
     /* might have some encap */
     if( p_track->fmt.i_cat == SPU_ES )
     {
@@ -505,10 +550,176 @@ static block_t * MP4_Block_Read( demux_t *p_demux, const mp4_track_t *p_track, i
     return p_block;
 }
 
+static block_t * MP4_Block_Read( demux_t *p_demux, const mp4_track_t *p_track, int i_size )
+{
+    block_t *p_block = stream_Block( p_demux->s, i_size );
+    if ( !p_block )
+        return NULL;
+
+    return MP4_Block_Convert( p_track, p_block );
+}
+
+typedef struct
+{
+    uint64_t i_start;
+    uint64_t i_end;
+} mp4_range_t;
+
+static int CmpRange( const void *a, const void *b )
+{
+    const mp4_range_t *ra = a, *rb = b;
+    if( ra->i_start != rb->i_start )
+        return ra->i_start < rb->i_start ? -1 : 1;
+    return 0;
+}
+
+/* Returns the end of the byte range starting at i_pos that holds, without
+ * large holes, the upcoming chunks of all selected tracks */
+static uint64_t MP4_ReadAheadPlan( demux_t *p_demux, uint64_t i_pos, uint32_t i_size )
+{
+    demux_sys_t *p_sys = p_demux->p_sys;
+    const uint64_t i_max = i_pos + __MAX( i_size, MP4_READAHEAD_MAX );
+    uint64_t i_end = i_pos + i_size;
+
+    mp4_range_t *p_ranges = calloc( p_sys->i_tracks * MP4_READAHEAD_CHUNKS,
+                                    sizeof( *p_ranges ) );
+    if( !p_ranges )
+        return i_end;
+
+    size_t i_ranges = 0;
+    for( unsigned i_track = 0; i_track < p_sys->i_tracks; i_track++ )
+    {
+        mp4_track_t *tk = &p_sys->track[i_track];
+        if( !tk->b_ok || tk->b_chapter || !tk->b_selected ||
+            tk->i_sample >= tk->i_sample_count )
+            continue;
+
+        for( uint32_t i_chunk = tk->i_chunk;
+             i_chunk < tk->i_chunk_count &&
+             i_chunk - tk->i_chunk < MP4_READAHEAD_CHUNKS; i_chunk++ )
+        {
+            const mp4_chunk_t *ck = &tk->chunk[i_chunk];
+            mp4_range_t *p_range = &p_ranges[i_ranges];
+
+            /* the current chunk is only needed from the next sample */
+            p_range->i_start = ( i_chunk == tk->i_chunk ) ? MP4_TrackGetPos( tk )
+                                                          : ck->i_offset;
+            p_range->i_end = ck->i_offset +
+                             MP4_TrackGetChunkBytes( tk, i_chunk, ck->i_sample_count );
+
+            /* data behind will need a seek anyway */
+            if( p_range->i_start >= i_pos && p_range->i_end > p_range->i_start )
+                i_ranges++;
+        }
+    }
+
+    qsort( p_ranges, i_ranges, sizeof( *p_ranges ), CmpRange );
+
+    for( size_t i = 0; i < i_ranges && i_end < i_max; i++ )
+    {
+        if( p_ranges[i].i_start > i_end + MP4_READAHEAD_GAP )
+            break;
+        if( p_ranges[i].i_end > i_end )
+            i_end = __MIN( p_ranges[i].i_end, i_max );
+    }
+
+    free( p_ranges );
+    return i_end;
+}
+
+/*****************************************************************************
+ * MP4_ReadAheadStatsPublish: update the read planner statistics variables
+ *****************************************************************************
+ * This is done every MP4_STATS_PERIOD reads issued, not for every sample.
+ *****************************************************************************/
+#define MP4_STATS_PERIOD 64
+
+static void MP4_ReadAheadStatsPublish( demux_t *p_demux )
+{
+    demux_sys_t *p_sys = p_demux->p_sys;
+
+    var_SetInteger( p_demux, "mp4-reads", p_sys->readahead.i_reads );
+    var_SetInteger( p_demux, "mp4-seeks", p_sys->readahead.i_seeks );
+}
+
+/* Releases the data read ahead, which a seek makes stale. The samples
+ * handed out may still share it, but are not served twice. */
+static void MP4_ReadAheadDrop( demux_sys_t *p_sys )
+{
+    if( p_sys->readahead.p_block )
+        block_Release( p_sys->readahead.p_block );
+    p_sys->readahead.p_block = NULL;
+}
+
+/* Returns the i_size bytes at i_pos, from the data read ahead when possible.
+ * Otherwise, a single read fetches them with the upcoming samples of all
+ * tracks stored right after, so that interleaved tracks cost one read
+ * instead of one read and possibly one seek per sample. */
+static block_t * MP4_Block_ReadAhead( demux_t *p_demux, const mp4_track_t *p_track,
+                                      uint64_t i_pos, uint32_t i_size )
+{
+    demux_sys_t *p_sys = p_demux->p_sys;
+    block_t *p_ahead = p_sys->readahead.p_block;
+
+    if( !p_ahead || i_pos < p_sys->readahead.i_pos ||
+        i_pos + i_size > p_sys->readahead.i_pos + p_ahead->i_buffer )
+    {
+        const uint64_t i_end = MP4_ReadAheadPlan( p_demux, i_pos, i_size );
+        uint64_t i_current_pos;
+
+        MP4_ReadAheadDrop( p_sys );
+
+        if( i_end - i_pos > INT_MAX ||
+            !MP4_stream_Tell( p_demux->s, &i_current_pos ) )
+            return NULL;
+
+        if( i_current_pos != i_pos )
+        {
+            p_sys->readahead.i_seeks++;
+            if( stream_Seek( p_demux->s, i_pos ) )
+                return NULL;
+        }
+
+        if( (++p_sys->readahead.i_reads % MP4_STATS_PERIOD) == 0 )
+            MP4_ReadAheadStatsPublish( p_demux );
+        /* The samples are handed out as shared views anyway */
+        p_ahead = stream_BlockShared( p_demux->s, i_end - i_pos );
+        if( !p_ahead )
+            return NULL;
+        if( p_ahead->i_buffer < i_size )
+        {
+            block_Release( p_ahead );
+            return NULL;
+        }
+
+        p_sys->readahead.p_block = p_ahead = block_Share( p_ahead );
+        p_sys->readahead.i_pos = i_pos;
+    }
+
+    /* Hand out a view of the sample within the data read ahead. The data is
+     * narrowed meanwhile so that a copy, if any, is limited to the sample. */
+    uint8_t *p_buffer = p_ahead->p_buffer;
+    const size_t i_buffer = p_ahead->i_buffer;
+
+    p_ahead->p_buffer += i_pos - p_sys->readahead.i_pos;
+    p_ahead->i_buffer = i_size;
+    block_t *p_block = block_Clone( p_ahead );
+    p_ahead->p_buffer = p_buffer;
+    p_ahead->i_buffer = i_buffer;
+
+    if( !p_block )
+        return NULL;
+
+    return MP4_Block_Convert( p_track, p_block );
+}
+
 static void MP4_Block_Send( demux_t *p_demux, mp4_track_t *p_track, block_t *p_block )
 {
     if ( p_track->b_chans_reorder && aout_BitsPerSample( p_track->fmt.i_codec ) )
     {
+        /* samples read ahead are shared */
+        if( !(p_block = block_Writable( p_block )) )
+            return;
         aout_ChannelReorder( p_block->p_buffer, p_block->i_buffer,
                              p_track->fmt.audio.i_channels,
                              p_track->rgi_chans_reordering,
@@ -599,6 +810,10 @@ static int Open( vlc_object_t * p_this )
 
     p_demux->p_sys = p_sys;
 
+    /* read planner statistics */
+    var_Create( p_demux, "mp4-reads", VLC_VAR_INTEGER );
+    var_Create( p_demux, "mp4-seeks", VLC_VAR_INTEGER );
+
     if( stream_Peek( p_demux->s, &p_peek, 24 ) < 24 ) return VLC_EGENERIC;
     if( !CmpUUID( (UUID_t *)(p_peek + 8), &SmooBoxUUID ) )
     {
@@ -664,12 +879,19 @@ static int Open( vlc_object_t * p_this )
 
     if( MP4_BoxCount( p_sys->p_root, "/moov/mvex" ) > 0 )
     {
-        if ( p_sys->b_seekable && !p_sys->b_smooth && !p_sys->b_dash )
+        p_sys->b_fragindex = p_sys->b_seekable && !p_sys->b_smooth &&
+                             var_InheritBool( p_demux, "mp4-fragment-index-cache" );
+
+        if ( p_sys->b_seekable && !p_sys->b_smooth && ( !p_sys->b_dash || p_sys->b_fragindex ) )
         {
             /* Probe remaining to check if there's really fragments
                or if that file is just ready to append fragments */
             ProbeFragments( p_demux, false );
-            p_sys->b_fragmented = !!MP4_BoxCount( p_sys->p_root, "/moof" );
+            p_sys->b_fragmented = p_sys->b_dash || !!MP4_BoxCount( p_sys->p_root, "/moof" );
+
+            /* Reuse, complete or create the index, then no need to probe */
+            if ( p_sys->b_fragmented && p_sys->b_fragindex )
+                FragIndexOpen( p_demux );
 
             if ( p_sys->b_fragmented && !p_sys->i_overall_duration )
                 ProbeFragments( p_demux, true );
@@ -1066,16 +1288,6 @@ static int Demux( demux_t *p_demux )
         msg_Dbg( p_demux, "Could not select track by data position" );
         goto end;
     }
-    else if ( p_sys->b_seekmode )
-    {
-        if( stream_Seek( p_demux->s, i_candidate_pos ) )
-        {
-            msg_Warn( p_demux, "track[0x%x] will be disabled (eof?)",
-                      tk->i_track_ID );
-            MP4_TrackUnselect( p_demux, tk );
-            goto end;
-        }
-    }
 
 #if 0
     msg_Dbg( p_demux, "tk(%i)=%"PRId64" mv=%"PRId64" pos=%"PRIu64, tk->i_track_ID,
@@ -1089,31 +1301,14 @@ static int Demux( demux_t *p_demux )
     {
         block_t *p_block;
         int64_t i_delta;
-        uint64_t i_current_pos;
 
         /* go,go go ! */
-        if ( !MP4_stream_Tell( p_demux->s, &i_current_pos ) )
-            goto end;
-
-        if( i_current_pos != i_candidate_pos )
-        {
-            if( stream_Seek( p_demux->s, i_candidate_pos ) )
-            {
-                msg_Warn( p_demux, "track[0x%x] will be disabled (eof?)"
-                          ": Failed to seek to %"PRIu64,
-                          tk->i_track_ID, i_candidate_pos );
-                MP4_TrackUnselect( p_demux, tk );
-                goto end;
-            }
-            i_current_pos = i_candidate_pos;
-        }
-
-        /* now read pes */
-        if( !(p_block = MP4_Block_Read( p_demux, tk, i_samplessize )) )
+        if( !(p_block = MP4_Block_ReadAhead( p_demux, tk, i_candidate_pos,
+                                             i_samplessize )) )
         {
             msg_Warn( p_demux, "track[0x%x] will be disabled (eof?)"
-                      ": Failed to read %d bytes sample at %"PRIu64,
-                      tk->i_track_ID, i_samplessize, i_current_pos );
+                      ": Failed to read %"PRIu32" bytes sample at %"PRIu64,
+                      tk->i_track_ID, i_samplessize, i_candidate_pos );
             MP4_TrackUnselect( p_demux, tk );
             goto end;
         }
@@ -1199,6 +1394,7 @@ static int Seek( demux_t *p_demux, mtime_t i_date )
     /* First update global time */
     p_sys->i_time = i_date * p_sys->i_timescale / CLOCK_FREQ;
     p_sys->i_pcr  = VLC_TS_INVALID;
+    MP4_ReadAheadDrop( p_sys );
 
     /* Now for each stream try to go to this time */
     for( i_track = 0; i_track < p_sys->i_tracks; i_track++ )
@@ -1263,14 +1459,48 @@ static int LeafSeekIntoFragment( demux_t *p_demux, mp4_fragment_t *p_fragment )
     return VLC_SUCCESS;
 }
 
+/* Seeks to a moof that might not have been read yet */
+static int LeafSeekToMoof( demux_t *p_demux, uint64_t i_pos, mtime_t i_mooftime )
+{
+    demux_sys_t *p_sys = p_demux->p_sys;
+
+    if( stream_Seek( p_demux->s, i_pos ) )
+    {
+        msg_Err( p_demux, "seek to moof failed %"PRIu64, i_pos );
+        return VLC_EGENERIC;
+    }
+    p_sys->context.i_current_box_type = 0;
+    p_sys->context.i_mdatbytesleft = 0;
+    p_sys->context.p_fragment = NULL;
+    for( unsigned int i_track = 0; i_track < p_sys->i_tracks; i_track++ )
+    {
+        p_sys->track[i_track].i_time = i_mooftime * p_sys->track[i_track].i_timescale / CLOCK_FREQ;
+    }
+    p_sys->i_time = i_mooftime * p_sys->i_timescale / CLOCK_FREQ;
+    p_sys->i_pcr  = VLC_TS_INVALID;
+
+    return VLC_SUCCESS;
+}
+
 static int LeafSeekToTime( demux_t *p_demux, mtime_t i_nztime )
 {
     demux_sys_t *p_sys = p_demux->p_sys;
     mp4_fragment_t *p_fragment;
     uint64_t i64 = 0;
+    mtime_t i_mooftime;
     if ( !p_sys->i_timescale || !p_sys->i_overall_duration || !p_sys->b_seekable )
          return VLC_EGENERIC;
 
+    /* Fragments were not all read, but their position is cached */
+    if ( !p_sys->b_fragments_probed &&
+         FragIndexGetMoofPosByTime( p_demux, i_nztime, &i64, &i_mooftime ) == VLC_SUCCESS )
+    {
+        msg_Dbg( p_demux, "seek going to cached fragment at %"PRIu64, i64 );
+        if ( LeafSeekToMoof( p_demux, i64, i_mooftime ) != VLC_SUCCESS )
+            return VLC_EGENERIC;
+        goto end;
+    }
+
     if ( !p_sys->b_fragments_probed && !p_sys->b_index_probed && p_sys->b_seekable )
     {
         ProbeIndex( p_demux );
@@ -1280,25 +1510,12 @@ static int LeafSeekToTime( demux_t *p_demux, mtime_t i_nztime )
     p_fragment = GetFragmentByTime( p_demux, i_nztime );
     if ( !p_fragment )
     {
-        mtime_t i_mooftime;
         msg_Dbg( p_demux, "seek can't find matching fragment for %"PRId64", trying index", i_nztime );
         if ( LeafIndexGetMoofPosByTime( p_demux, i_nztime, &i64, &i_mooftime ) == VLC_SUCCESS )
         {
             msg_Dbg( p_demux, "seek trying to go to unknown but indexed fragment at %"PRId64, i64 );
-            if( stream_Seek( p_demux->s, i64 ) )
-            {
-                msg_Err( p_demux, "seek to moof failed %"PRId64, i64 );
+            if ( LeafSeekToMoof( p_demux, i64, i_mooftime ) != VLC_SUCCESS )
                 return VLC_EGENERIC;
-            }
-            p_sys->context.i_current_box_type = 0;
-            p_sys->context.i_mdatbytesleft = 0;
-            p_sys->context.p_fragment = NULL;
-            for( unsigned int i_track = 0; i_track < p_sys->i_tracks; i_track++ )
-            {
-                p_sys->track[i_track].i_time = i_mooftime / CLOCK_FREQ * p_sys->track[i_track].i_timescale;
-            }
-            p_sys->i_time = i_mooftime / CLOCK_FREQ * p_sys->i_timescale;
-            p_sys->i_pcr  = VLC_TS_INVALID;
         }
         else
         {
@@ -1314,6 +1531,7 @@ static int LeafSeekToTime( demux_t *p_demux, mtime_t i_nztime )
             return VLC_EGENERIC;
     }
 
+end:
     MP4ASF_ResetFrames( p_sys );
     /* And set next display time in that trun/fragment */
     es_out_Control( p_demux->out, ES_OUT_SET_NEXT_DISPLAY_TIME, VLC_TS_0 + i_nztime );
@@ -1708,6 +1926,14 @@ static void Close ( vlc_object_t * p_this )
 
     msg_Dbg( p_demux, "freeing all memory" );
 
+    if( p_demux->pf_demux == Demux )
+    {
+        msg_Dbg( p_demux, "%"PRIu64" reads and %"PRIu64" seeks issued",
+                 p_sys->readahead.i_reads, p_sys->readahead.i_seeks );
+        MP4_ReadAheadStatsPublish( p_demux );
+    }
+    MP4_ReadAheadDrop( p_sys );
+
     MP4_BoxFree( p_demux->s, p_sys->p_root );
     for( i_track = 0; i_track < p_sys->i_tracks; i_track++ )
     {
@@ -1727,6 +1953,8 @@ static void Close ( vlc_object_t * p_this )
     }
     free( p_sys->moovfragment.p_durations );
 
+    MP4_FragIndexClean( &p_sys->fragindex );
+
     free( p_sys );
 }
 
@@ -1872,9 +2100,11 @@ static int TrackCreateChunksIndex( demux_t *p_demux,
 
         ck->i_first_dts = 0;
         ck->i_entries_dts = 0;
+        ck->i_dts_skip = 0;
         ck->p_sample_count_dts = NULL;
         ck->p_sample_delta_dts = NULL;
         ck->i_entries_pts = 0;
+        ck->i_pts_skip = 0;
         ck->p_sample_count_pts = NULL;
         ck->p_sample_offset_pts = NULL;
     }
@@ -1927,54 +2157,6 @@ static int TrackCreateChunksIndex( demux_t *p_demux,
     return VLC_SUCCESS;
 }
 
-static int xTTS_CountEntries( demux_t *p_demux, uint32_t *pi_entry /* out */,
-                              const uint32_t i_index,
-                              uint32_t i_index_samples_left,
-                              uint32_t i_sample_count,
-                              const uint32_t *pi_index_sample_count,
-                              const uint32_t i_table_count )
-{
-    uint32_t i_array_offset;
-    while( i_sample_count > 0 )
-    {
-        if ( likely((UINT32_MAX - i_index) >= *pi_entry) )
-            i_array_offset = i_index + *pi_entry;
-        else
-            return VLC_EGENERIC;
-
-        if ( i_array_offset >= i_table_count )
-        {
-            msg_Err( p_demux, "invalid index counting total samples %u %u", i_array_offset,  i_table_count );
-            return VLC_ENOVAR;
-        }
-
-        if ( i_index_samples_left )
-        {
-            if ( i_index_samples_left > i_sample_count )
-            {
-                i_index_samples_left -= i_sample_count;
-                i_sample_count = 0;
-                *pi_entry +=1; /* No samples left, go copy */
-                break;
-            }
-            else
-            {
-                i_sample_count -= i_index_samples_left;
-                i_index_samples_left = 0;
-                *pi_entry += 1;
-                continue;
-            }
-        }
-        else
-        {
-            i_sample_count -= __MIN( i_sample_count, pi_index_sample_count[i_array_offset] );
-            *pi_entry += 1;
-        }
-    }
-
-    return VLC_SUCCESS;
-}
-
 static int TrackCreateSamplesIndex( demux_t *p_demux,
                                     mp4_track_t *p_demux_track )
 {
@@ -2007,19 +2189,26 @@ static int TrackCreateSamplesIndex( demux_t *p_demux,
     }
     else
     {
-        /* 2: each sample can have a different size */
+        /* 2: each sample can have a different size, use the stsz table
+         * as is: it lives as long as the track */
         p_demux_track->i_sample_size = 0;
-        p_demux_track->p_sample_size =
-            calloc( p_demux_track->i_sample_count, sizeof( uint32_t ) );
+        p_demux_track->p_sample_size = stsz->i_entry_size;
         if( p_demux_track->p_sample_size == NULL )
             return VLC_ENOMEM;
 
-        for( uint32_t i_sample = 0; i_sample < p_demux_track->i_sample_count; i_sample++ )
+        /* and sum the sizes of each chunk once for the read planner */
+        for( uint32_t i_chunk = 0; i_chunk < p_demux_track->i_chunk_count; i_chunk++ )
         {
-            p_demux_track->p_sample_size[i_sample] =
-                    stsz->i_entry_size[i_sample];
+            mp4_chunk_t *ck = &p_demux_track->chunk[i_chunk];
+
+            ck->i_bytes = 0;
+            for( uint32_t i = ck->i_sample_first;
+                 i - ck->i_sample_first < ck->i_sample_count &&
+                 i < stsz->i_sample_count; i++ )
+                ck->i_bytes += stsz->i_entry_size[i];
         }
     }
+    p_demux_track->i_pos_chunk = UINT32_MAX; /* no cached position */
 
     if ( p_demux_track->i_chunk_count )
     {
@@ -2051,12 +2240,9 @@ static int TrackCreateSamplesIndex( demux_t *p_demux,
 
     /* Use stts table to create a sample number -> dts table.
      * XXX: if we don't want to waste too much memory, we can't expand
-     *  the box! so each chunk will contain an "extract" of this table
-     *  for fast research (problem with raw stream where a sample is sometime
-     *  just channels*bits_per_sample/8 */
-
-     /* FIXME: refactor STTS & CTTS, STTS having now only few extra lines and
-      *        differing in 2/2 fields and 1 signedness */
+     *  the box! so each chunk only points to the entries of the table
+     *  covering its samples (problem with raw stream where a sample is
+     *  sometime just channels*bits_per_sample/8 */
 
     mtime_t i_next_dts = 0;
     /* Find stts
@@ -2074,96 +2260,51 @@ static int TrackCreateSamplesIndex( demux_t *p_demux,
 
         msg_Warn( p_demux, "STTS table of %"PRIu32" entries", stts->i_entry_count );
 
-        /* Create sample -> dts table per chunk */
+        /* Point each chunk to its entries */
         uint32_t i_index = 0;
-        uint32_t i_current_index_samples_left = 0;
+        uint32_t i_index_skip = 0; /* samples of entry i_index already used */
 
         for( uint32_t i_chunk = 0; i_chunk < p_demux_track->i_chunk_count; i_chunk++ )
         {
             mp4_chunk_t *ck = &p_demux_track->chunk[i_chunk];
-            uint32_t i_sample_count;
+            uint32_t i_sample_count = ck->i_sample_count;
 
             /* save first dts */
             ck->i_first_dts = i_next_dts;
             ck->i_last_dts  = i_next_dts;
 
-            /* count how many entries are needed for this chunk
-             * for p_sample_delta_dts and p_sample_count_dts */
             ck->i_entries_dts = 0;
+            ck->i_dts_skip = i_index_skip;
+            ck->p_sample_count_dts = &stts->pi_sample_count[i_index];
+            ck->p_sample_delta_dts = &stts->pi_sample_delta[i_index];
 
-            int i_ret = xTTS_CountEntries( p_demux, &ck->i_entries_dts, i_index,
-                                           i_current_index_samples_left,
-                                           ck->i_sample_count,
-                                           stts->pi_sample_count,
-                                           stts->i_entry_count );
-            if ( i_ret == VLC_EGENERIC )
-                return i_ret;
-
-            /* allocate them */
-            ck->p_sample_count_dts = calloc( ck->i_entries_dts, sizeof( uint32_t ) );
-            ck->p_sample_delta_dts = calloc( ck->i_entries_dts, sizeof( uint32_t ) );
-            if( !ck->p_sample_count_dts || !ck->p_sample_delta_dts )
+            while( i_sample_count > 0 )
             {
-                free( ck->p_sample_count_dts );
-                free( ck->p_sample_delta_dts );
-                msg_Err( p_demux, "can't allocate memory for i_entry=%"PRIu32, ck->i_entries_dts );
-                ck->i_entries_dts = 0;
-                return VLC_ENOMEM;
-            }
+                if( i_index >= stts->i_entry_count )
+                {
+                    msg_Err( p_demux, "invalid index counting total samples %u %u",
+                             i_index, stts->i_entry_count );
+                    break;
+                }
 
-            /* now copy */
-            i_sample_count = ck->i_sample_count;
+                const uint32_t i_delta = stts->pi_sample_delta[i_index];
+                uint32_t i_count = stts->pi_sample_count[i_index] - i_index_skip;
+                if( i_count ) ck->i_last_dts = i_next_dts;
+                ck->i_entries_dts++;
 
-            for( uint32_t i = 0; i < ck->i_entries_dts; i++ )
-            {
-                if ( i_current_index_samples_left )
+                if( i_count > i_sample_count )
                 {
-                    if ( i_current_index_samples_left > i_sample_count )
-                    {
-                        if ( i_sample_count ) ck->i_last_dts = i_next_dts;
-                        ck->p_sample_count_dts[i] = i_sample_count;
-                        ck->p_sample_delta_dts[i] = stts->pi_sample_delta[i_index];
-                        i_next_dts += ck->p_sample_count_dts[i] * stts->pi_sample_delta[i_index];
-                        i_current_index_samples_left -= i_sample_count;
-                        i_sample_count = 0;
-                        assert( i == ck->i_entries_dts - 1 );
-                        break;
-                    }
-                    else
-                    {
-                        if ( i_current_index_samples_left ) ck->i_last_dts = i_next_dts;
-                        ck->p_sample_count_dts[i] = i_current_index_samples_left;
-                        ck->p_sample_delta_dts[i] = stts->pi_sample_delta[i_index];
-                        i_next_dts += ck->p_sample_count_dts[i] * stts->pi_sample_delta[i_index];
-                        i_sample_count -= i_current_index_samples_left;
-                        i_current_index_samples_left = 0;
-                        i_index++;
-                    }
+                    /* the entry goes on in the next chunk */
+                    i_index_skip += i_sample_count;
+                    i_count = i_sample_count;
                 }
                 else
                 {
-                    if ( stts->pi_sample_count[i_index] > i_sample_count )
-                    {
-                        if ( i_sample_count ) ck->i_last_dts = i_next_dts;
-                        ck->p_sample_count_dts[i] = i_sample_count;
-                        ck->p_sample_delta_dts[i] = stts->pi_sample_delta[i_index];
-                        i_next_dts += ck->p_sample_count_dts[i] * stts->pi_sample_delta[i_index];
-                        i_current_index_samples_left = stts->pi_sample_count[i_index] - i_sample_count;
-                        i_sample_count = 0;
-                        assert( i == ck->i_entries_dts - 1 );
-                        // keep building from same index
-                    }
-                    else
-                    {
-                        if ( stts->pi_sample_count[i_index] ) ck->i_last_dts = i_next_dts;
-                        ck->p_sample_count_dts[i] = stts->pi_sample_count[i_index];
-                        ck->p_sample_delta_dts[i] = stts->pi_sample_delta[i_index];
-                        i_next_dts += ck->p_sample_count_dts[i] * stts->pi_sample_delta[i_index];
-                        i_sample_count -= stts->pi_sample_count[i_index];
-                        i_index++;
-                    }
+                    i_index_skip = 0;
+                    i_index++;
                 }
-
+                i_next_dts += i_count * i_delta;
+                i_sample_count -= i_count;
             }
         }
     }
@@ -2179,84 +2320,43 @@ static int TrackCreateSamplesIndex( demux_t *p_demux,
 
         msg_Warn( p_demux, "CTTS table of %"PRIu32" entries", ctts->i_entry_count );
 
-        /* Create pts-dts table per chunk */
+        /* Point each chunk to its pts-dts entries */
         uint32_t i_index = 0;
-        uint32_t i_current_index_samples_left = 0;
+        uint32_t i_index_skip = 0;
 
         for( uint32_t i_chunk = 0; i_chunk < p_demux_track->i_chunk_count; i_chunk++ )
         {
             mp4_chunk_t *ck = &p_demux_track->chunk[i_chunk];
-            uint32_t i_sample_count;
+            uint32_t i_sample_count = ck->i_sample_count;
 
-            /* count how many entries are needed for this chunk
-             * for p_sample_offset_pts and p_sample_count_pts */
             ck->i_entries_pts = 0;
-            int i_ret = xTTS_CountEntries( p_demux, &ck->i_entries_pts, i_index,
-                                           i_current_index_samples_left,
-                                           ck->i_sample_count,
-                                           ctts->pi_sample_count,
-                                           ctts->i_entry_count );
-            if ( i_ret == VLC_EGENERIC )
-                return i_ret;
-
-            /* allocate them */
-            ck->p_sample_count_pts = calloc( ck->i_entries_pts, sizeof( uint32_t ) );
-            ck->p_sample_offset_pts = calloc( ck->i_entries_pts, sizeof( int32_t ) );
-            if( !ck->p_sample_count_pts || !ck->p_sample_offset_pts )
+            ck->i_pts_skip = i_index_skip;
+            ck->p_sample_count_pts = &ctts->pi_sample_count[i_index];
+            ck->p_sample_offset_pts = &ctts->pi_sample_offset[i_index];
+
+            while( i_sample_count > 0 )
             {
-                free( ck->p_sample_count_pts );
-                free( ck->p_sample_offset_pts );
-                msg_Err( p_demux, "can't allocate memory for i_entry=%"PRIu32, ck->i_entries_pts );
-                ck->i_entries_pts = 0;
-                return VLC_ENOMEM;
-            }
+                if( i_index >= ctts->i_entry_count )
+                {
+                    msg_Err( p_demux, "invalid index counting total samples %u %u",
+                             i_index, ctts->i_entry_count );
+                    break;
+                }
 
-            /* now copy */
-            i_sample_count = ck->i_sample_count;
+                const uint32_t i_count = ctts->pi_sample_count[i_index] - i_index_skip;
+                ck->i_entries_pts++;
 
-            for( uint32_t i = 0; i < ck->i_entries_pts; i++ )
-            {
-                if ( i_current_index_samples_left )
+                if( i_count > i_sample_count )
                 {
-                    if ( i_current_index_samples_left > i_sample_count )
-                    {
-                        ck->p_sample_count_pts[i] = i_sample_count;
-                        ck->p_sample_offset_pts[i] = ctts->pi_sample_offset[i_index];
-                        i_current_index_samples_left -= i_sample_count;
-                        i_sample_count = 0;
-                        assert( i == ck->i_entries_pts - 1 );
-                        break;
-                    }
-                    else
-                    {
-                        ck->p_sample_count_pts[i] = i_current_index_samples_left;
-                        ck->p_sample_offset_pts[i] = ctts->pi_sample_offset[i_index];
-                        i_sample_count -= i_current_index_samples_left;
-                        i_current_index_samples_left = 0;
-                        i_index++;
-                    }
+                    i_index_skip += i_sample_count;
+                    i_sample_count = 0;
                 }
                 else
                 {
-                    if ( ctts->pi_sample_count[i_index] > i_sample_count )
-                    {
-                        ck->p_sample_count_pts[i] = i_sample_count;
-                        ck->p_sample_offset_pts[i] = ctts->pi_sample_offset[i_index];
-                        i_current_index_samples_left = ctts->pi_sample_count[i_index] - i_sample_count;
-                        i_sample_count = 0;
-                        assert( i == ck->i_entries_pts - 1 );
-                        // keep building from same index
-                    }
-                    else
-                    {
-                        ck->p_sample_count_pts[i] = ctts->pi_sample_count[i_index];
-                        ck->p_sample_offset_pts[i] = ctts->pi_sample_offset[i_index];
-                        i_sample_count -= ctts->pi_sample_count[i_index];
-                        i_index++;
-                    }
+                    i_index_skip = 0;
+                    i_index++;
+                    i_sample_count -= i_count;
                 }
-
-
             }
         }
     }
@@ -2423,7 +2523,7 @@ static int TrackTimeToSampleChunk( demux_t *p_demux, mp4_track_t *p_track,
     uint64_t     i_dts;
     unsigned int i_sample;
     unsigned int i_chunk;
-    int          i_index;
+    uint32_t     i_index;
 
     /* FIXME see if it's needed to check p_track->i_chunk_count */
     if( p_track->i_chunk_count == 0 )
@@ -2467,49 +2567,40 @@ static int TrackTimeToSampleChunk( demux_t *p_demux, mp4_track_t *p_track,
         i_start = i_start * p_track->i_timescale / CLOCK_FREQ;
     }
 
-    /* we start from sample 0/chunk 0, hope it won't take too much time */
     /* *** find good chunk *** */
-    for( i_chunk = 0; ; i_chunk++ )
+    /* the last one starting at or before i_start, by bisection as chunks
+       are in dts order; if i_start is past the end, it will be checked
+       while searching i_sample */
+    uint32_t i_chunk_max = p_track->i_chunk_count - 1;
+    i_chunk = 0;
+    while( i_chunk < i_chunk_max )
     {
-        if( i_chunk + 1 >= p_track->i_chunk_count )
-        {
-            /* at the end and can't check if i_start in this chunk,
-               it will be check while searching i_sample */
-            i_chunk = p_track->i_chunk_count - 1;
-            break;
-        }
+        uint32_t i_mid = i_chunk + ( i_chunk_max - i_chunk + 1 ) / 2;
 
-        if( (uint64_t)i_start >= p_track->chunk[i_chunk].i_first_dts &&
-            (uint64_t)i_start <  p_track->chunk[i_chunk + 1].i_first_dts )
-        {
-            break;
-        }
+        if( p_track->chunk[i_mid].i_first_dts <= (uint64_t)i_start )
+            i_chunk = i_mid;
+        else
+            i_chunk_max = i_mid - 1;
     }
 
     /* *** find sample in the chunk *** */
-    i_sample = p_track->chunk[i_chunk].i_sample_first;
-    i_dts    = p_track->chunk[i_chunk].i_first_dts;
-    for( i_index = 0; i_sample < p_track->chunk[i_chunk].i_sample_count; )
+    const mp4_chunk_t *ck = &p_track->chunk[i_chunk];
+    i_sample = ck->i_sample_first;
+    i_dts    = ck->i_first_dts;
+    for( i_index = 0; i_index < ck->i_entries_dts; i_index++ )
     {
-        if( i_dts +
-            p_track->chunk[i_chunk].p_sample_count_dts[i_index] *
-            p_track->chunk[i_chunk].p_sample_delta_dts[i_index] < (uint64_t)i_start )
-        {
-            i_dts    +=
-                p_track->chunk[i_chunk].p_sample_count_dts[i_index] *
-                p_track->chunk[i_chunk].p_sample_delta_dts[i_index];
+        const uint32_t i_count = MP4_ChunkGetDTSCount( ck, i_index );
 
-            i_sample += p_track->chunk[i_chunk].p_sample_count_dts[i_index];
-            i_index++;
+        if( i_dts + (uint64_t)i_count * ck->p_sample_delta_dts[i_index] <
+            (uint64_t)i_start )
+        {
+            i_dts    += (uint64_t)i_count * ck->p_sample_delta_dts[i_index];
+            i_sample += i_count;
         }
         else
         {
-            if( p_track->chunk[i_chunk].p_sample_delta_dts[i_index] <= 0 )
-            {
-                break;
-            }
-            i_sample += ( i_start - i_dts ) /
-                p_track->chunk[i_chunk].p_sample_delta_dts[i_index];
+            if( ck->p_sample_delta_dts[i_index] > 0 )
+                i_sample += ( i_start - i_dts ) / ck->p_sample_delta_dts[i_index];
             break;
         }
     }
@@ -2529,31 +2620,38 @@ static int TrackTimeToSampleChunk( demux_t *p_demux, mp4_track_t *p_track,
         MP4_Box_data_stss_t *p_stss = p_box_stss->data.p_stss;
         msg_Dbg( p_demux, "track[Id 0x%x] using Sync Sample Box (stss)",
                  p_track->i_track_ID );
-        for( unsigned i_index = 0; i_index < p_stss->i_entry_count; i_index++ )
+        if( p_stss->i_entry_count > 0 )
         {
-            if( i_index >= p_stss->i_entry_count - 1 ||
-                i_sample < p_stss->i_sample_number[i_index+1] )
+            /* the last entry not after i_sample, or the first one */
+            uint32_t i_sync = 0, i_sync_max = p_stss->i_entry_count - 1;
+            while( i_sync < i_sync_max )
             {
-                unsigned i_sync_sample = p_stss->i_sample_number[i_index];
-                msg_Dbg( p_demux, "stss gives %d --> %d (sample number)",
-                         i_sample, i_sync_sample );
+                uint32_t i_mid = i_sync + ( i_sync_max - i_sync + 1 ) / 2;
 
-                if( i_sync_sample <= i_sample )
-                {
-                    while( i_chunk > 0 &&
-                           i_sync_sample < p_track->chunk[i_chunk].i_sample_first )
-                        i_chunk--;
-                }
+                if( p_stss->i_sample_number[i_mid] <= i_sample )
+                    i_sync = i_mid;
                 else
-                {
-                    while( i_chunk < p_track->i_chunk_count - 1 &&
-                           i_sync_sample >= p_track->chunk[i_chunk].i_sample_first +
-                                            p_track->chunk[i_chunk].i_sample_count )
-                        i_chunk++;
-                }
-                i_sample = i_sync_sample;
-                break;
+                    i_sync_max = i_mid - 1;
+            }
+
+            unsigned i_sync_sample = p_stss->i_sample_number[i_sync];
+            msg_Dbg( p_demux, "stss gives %d --> %d (sample number)",
+                     i_sample, i_sync_sample );
+
+            if( i_sync_sample <= i_sample )
+            {
+                while( i_chunk > 0 &&
+                       i_sync_sample < p_track->chunk[i_chunk].i_sample_first )
+                    i_chunk--;
             }
+            else
+            {
+                while( i_chunk < p_track->i_chunk_count - 1 &&
+                       i_sync_sample >= p_track->chunk[i_chunk].i_sample_first +
+                                        p_track->chunk[i_chunk].i_sample_count )
+                    i_chunk++;
+            }
+            i_sample = i_sync_sample;
         }
     }
     else
@@ -2901,35 +2999,20 @@ static void FreeAndResetChunk( mp4_chunk_t *ck )
  ****************************************************************************/
 static void MP4_TrackDestroy( mp4_track_t *p_track )
 {
-    unsigned int i_chunk;
-
     p_track->b_ok = false;
     p_track->b_enable   = false;
     p_track->b_selected = false;
 
     es_format_Clean( &p_track->fmt );
 
-    for( i_chunk = 0; i_chunk < p_track->i_chunk_count; i_chunk++ )
-    {
-        if( p_track->chunk )
-        {
-           FREENULL(p_track->chunk[i_chunk].p_sample_count_dts);
-           FREENULL(p_track->chunk[i_chunk].p_sample_delta_dts );
-
-           FREENULL(p_track->chunk[i_chunk].p_sample_count_pts);
-           FREENULL(p_track->chunk[i_chunk].p_sample_offset_pts );
-        }
-    }
+    /* the tables of the moov chunks belong to the stts and ctts boxes */
     FREENULL( p_track->chunk );
     if( p_track->cchunk ) {
         FreeAndResetChunk( p_track->cchunk );
         FREENULL( p_track->cchunk );
     }
 
-    if( !p_track->i_sample_size )
-    {
-        FREENULL( p_track->p_sample_size );
-    }
+    p_track->p_sample_size = NULL;
 
     if ( p_track->asfinfo.p_frame )
         block_ChainRelease( p_track->asfinfo.p_frame );
@@ -3177,6 +3260,47 @@ static uint32_t MP4_TrackGetReadSize( mp4_track_t *p_track, uint32_t *pi_nb_samp
     return i_size;
 }
 
+/* Bytes taken in the file by the first i_samples samples of a chunk */
+static uint64_t MP4_TrackGetChunkBytes( const mp4_track_t *p_track, uint32_t i_chunk,
+                                        uint32_t i_samples )
+{
+    const mp4_chunk_t *ck = &p_track->chunk[i_chunk];
+
+    if( p_track->i_sample_size == 0 )
+    {
+        if( i_samples >= ck->i_sample_count )
+            return ck->i_bytes;
+
+        uint64_t i_bytes = 0;
+        for( uint32_t i = ck->i_sample_first;
+             i - ck->i_sample_first < i_samples && i < p_track->i_sample_count; i++ )
+            i_bytes += p_track->p_sample_size[i];
+        return i_bytes;
+    }
+
+    const MP4_Box_data_sample_soun_t *p_soun =
+        p_track->p_sample->data.p_sample_soun;
+
+    /* Quicktime builtin support, _must_ ignore sample tables */
+    if( p_track->fmt.i_cat == AUDIO_ES && p_soun->i_compressionid == 0 &&
+        p_track->i_sample_size == 1 && p_track->fmt.i_codec == VLC_CODEC_GSM )
+    {
+        /* # Samples > data size */
+        return (uint64_t)i_samples / 160 * 33;
+    }
+
+    if( p_track->fmt.i_cat != AUDIO_ES || p_soun->i_qt_version == 0 ||
+        p_track->fmt.audio.i_blockalign <= 1 ||
+        p_soun->i_sample_per_packet * p_soun->i_bytes_per_frame == 0 )
+    {
+        return (uint64_t)i_samples * MP4_GetFixedSampleSize( p_track, p_soun );
+    }
+
+    /* we read chunk by chunk unless a blockalign is requested */
+    return (uint64_t)i_samples / p_soun->i_sample_per_packet *
+           p_soun->i_bytes_per_frame;
+}
+
 static uint64_t MP4_TrackGetPos( mp4_track_t *p_track )
 {
     unsigned int i_sample;
@@ -3186,46 +3310,30 @@ static uint64_t MP4_TrackGetPos( mp4_track_t *p_track )
 
     if( p_track->i_sample_size )
     {
-        MP4_Box_data_sample_soun_t *p_soun =
-            p_track->p_sample->data.p_sample_soun;
+        i_pos += MP4_TrackGetChunkBytes( p_track, p_track->i_chunk, p_track->i_sample -
+                                         p_track->chunk[p_track->i_chunk].i_sample_first );
+    }
+    else
+    {
+        const mp4_chunk_t *ck = &p_track->chunk[p_track->i_chunk];
 
-        /* Quicktime builtin support, _must_ ignore sample tables */
-        if( p_track->fmt.i_cat == AUDIO_ES && p_soun->i_compressionid == 0 &&
-            p_track->i_sample_size == 1 )
+        /* Restart from the chunk offset only when going backward or to
+         * another chunk: reading a chunk is then linear, not quadratic */
+        if( p_track->i_pos_chunk != p_track->i_chunk ||
+            p_track->i_pos_sample > p_track->i_sample )
         {
-            switch( p_track->fmt.i_codec )
-            {
-            case VLC_CODEC_GSM: /* # Samples > data size */
-                i_pos += ( p_track->i_sample -
-                           p_track->chunk[p_track->i_chunk].i_sample_first ) / 160 * 33;
-                return i_pos;
-            default:
-                break;
-            }
+            p_track->i_pos_chunk = p_track->i_chunk;
+            p_track->i_pos_sample = ck->i_sample_first;
+            p_track->i_pos = ck->i_offset;
         }
 
-        if( p_track->fmt.i_cat != AUDIO_ES || p_soun->i_qt_version == 0 ||
-            p_track->fmt.audio.i_blockalign <= 1 ||
-            p_soun->i_sample_per_packet * p_soun->i_bytes_per_frame == 0 )
-        {
-            i_pos += ( p_track->i_sample -
-                       p_track->chunk[p_track->i_chunk].i_sample_first ) *
-                     MP4_GetFixedSampleSize( p_track, p_soun );
-        }
-        else
-        {
-            /* we read chunk by chunk unless a blockalign is requested */
-            i_pos += ( p_track->i_sample - p_track->chunk[p_track->i_chunk].i_sample_first ) /
-                        p_soun->i_sample_per_packet * p_soun->i_bytes_per_frame;
-        }
-    }
-    else
-    {
-        for( i_sample = p_track->chunk[p_track->i_chunk].i_sample_first;
+        for( i_sample = p_track->i_pos_sample;
              i_sample < p_track->i_sample; i_sample++ )
         {
-            i_pos += p_track->p_sample_size[i_sample];
+            p_track->i_pos += p_track->p_sample_size[i_sample];
         }
+        p_track->i_pos_sample = i_sample;
+        i_pos = p_track->i_pos;
     }
 
     return i_pos;
@@ -4121,19 +4229,21 @@ static bool AddFragment( demux_t *p_demux, MP4_Box_t *p_moox )
     else // p_moox->i_type == ATOM_moof
     {
         assert(p_moox->i_type == ATOM_moof);
+        /* keep the fragments sorted by position: as they are mostly found
+         * in order, try after the last one first */
         mp4_fragment_t *p_fragment = p_sys->moovfragment.p_next;
-        while ( p_fragment )
+        if ( p_sys->p_lastfragment &&
+             p_moox->i_pos > p_sys->p_lastfragment->p_moox->i_pos )
         {
-            if ( !p_base_fragment->p_moox || p_moox->i_pos > p_base_fragment->p_moox->i_pos )
-            {
-                p_base_fragment = p_fragment;
-                p_fragment = p_fragment->p_next;
-            }
-            else if ( p_moox->i_pos == p_base_fragment->p_moox->i_pos )
-            {
-                /* already exists */
-                return false;
-            }
+            p_base_fragment = p_sys->p_lastfragment;
+            p_fragment = NULL;
+        }
+        while ( p_fragment && p_moox->i_pos >= p_fragment->p_moox->i_pos )
+        {
+            if ( p_moox->i_pos == p_fragment->p_moox->i_pos )
+                return false; /* already exists */
+            p_base_fragment = p_fragment;
+            p_fragment = p_fragment->p_next;
         }
     }
 
@@ -4150,6 +4260,8 @@ static bool AddFragment( demux_t *p_demux, MP4_Box_t *p_moox )
     }
     p_new->p_next = p_base_fragment->p_next;
     p_base_fragment->p_next = p_new;
+    if ( !p_new->p_next )
+        p_sys->p_lastfragment = p_new;
     msg_Dbg( p_demux, "added fragment %4.4s", (char*) &p_moox->i_type );
 
     /* we have to probe all fragments :/ */
@@ -4358,6 +4470,245 @@ static int ProbeIndex( demux_t *p_demux )
     return stream_Seek( p_demux->s, i_backup_pos );
 }
 
+/* Fragments index cache */
+static char * FragIndexGetURI( demux_t *p_demux )
+{
+    char *psz_uri;
+    if ( asprintf( &psz_uri, "%s://%s", p_demux->psz_access,
+                   p_demux->psz_location ) == -1 )
+        return NULL;
+    return psz_uri;
+}
+
+static int64_t FragIndexGetMTime( demux_t *p_demux )
+{
+    struct stat st;
+    if ( !p_demux->psz_file || !*p_demux->psz_file ||
+         vlc_stat( p_demux->psz_file, &st ) )
+        return 0; /* unknown, the index will be checked against the file */
+    return st.st_mtime;
+}
+
+/* Samples in the moov are not indexed, only the moof ones */
+static bool FragIndexMoovHasSamples( demux_sys_t *p_sys )
+{
+    MP4_Box_t *p_trak;
+    for ( int i = 0; (p_trak = MP4_BoxGet( p_sys->p_root, "/moov/trak[%d]", i )); i++ )
+    {
+        MP4_Box_t *p_stts = MP4_BoxGet( p_trak, "mdia/minf/stbl/stts" );
+        if ( p_stts && BOXDATA(p_stts) && BOXDATA(p_stts)->i_entry_count )
+            return true;
+    }
+    return false;
+}
+
+/* End of the last top level box read, if it is complete */
+static uint64_t FragIndexGetEnd( demux_sys_t *p_sys, uint64_t i_size )
+{
+    uint64_t i_end = 0;
+    for ( MP4_Box_t *p_box = p_sys->p_root->p_first; p_box; p_box = p_box->p_next )
+    {
+        if ( p_box->i_pos + p_box->i_size <= i_size )
+            i_end = __MAX( i_end, p_box->i_pos + p_box->i_size );
+    }
+    return i_end;
+}
+
+/* Start time of a fragment in the movie timescale, from the decode time
+ * of its earliest track, or -1 if it has no tfdt box */
+static int64_t FragIndexGetTime( demux_sys_t *p_sys, MP4_Box_t *p_moof )
+{
+    int64_t i_time = -1;
+
+    for ( MP4_Box_t *p_traf = MP4_BoxGet( p_moof, "traf" ); p_traf;
+          p_traf = p_traf->p_next )
+    {
+        MP4_Box_t *p_tfhd = MP4_BoxGet( p_traf, "tfhd" );
+        MP4_Box_t *p_tfdt = MP4_BoxGet( p_traf, "tfdt" );
+        if ( p_traf->i_type != ATOM_traf || !p_tfhd || !BOXDATA(p_tfhd) ||
+             !p_tfdt || !BOXDATA(p_tfdt) )
+            continue;
+
+        /* tracks are not created yet: the timescale is in the moov */
+        MP4_Box_t *p_trak;
+        for ( int i = 0; (p_trak = MP4_BoxGet( p_sys->p_root, "/moov/trak[%d]", i )); i++ )
+        {
+            MP4_Box_t *p_tkhd = MP4_BoxGet( p_trak, "tkhd" );
+            MP4_Box_t *p_mdhd = MP4_BoxGet( p_trak, "mdia/mdhd" );
+            if ( !p_tkhd || !BOXDATA(p_tkhd) || !p_mdhd || !BOXDATA(p_mdhd) ||
+                 BOXDATA(p_tkhd)->i_track_ID != BOXDATA(p_tfhd)->i_track_ID ||
+                 !BOXDATA(p_mdhd)->i_timescale )
+                continue;
+
+            const int64_t i_track_time = BOXDATA(p_tfdt)->i_base_media_decode_time *
+                                         p_sys->i_timescale / BOXDATA(p_mdhd)->i_timescale;
+            if ( i_time < 0 || i_track_time < i_time )
+                i_time = i_track_time;
+            break;
+        }
+    }
+    return i_time;
+}
+
+/* Appends the known fragments complete before i_end, from i_start on */
+static int FragIndexAppend( demux_t *p_demux, uint64_t i_start, uint64_t i_end )
+{
+    demux_sys_t *p_sys = p_demux->p_sys;
+    mp4_fragindex_t *p_index = &p_sys->fragindex;
+
+    for ( mp4_fragment_t *p_fragment = p_sys->moovfragment.p_next; p_fragment;
+          p_fragment = p_fragment->p_next )
+    {
+        const MP4_Box_t *p_moof = p_fragment->p_moox;
+        if ( p_moof->i_pos < i_start || p_moof->i_pos + p_moof->i_size > i_end )
+            continue;
+
+        if ( ( p_index->i_entries & 0xFF ) == 0 )
+        {
+            mp4_fragindex_entry_t *p_realloc =
+                realloc( p_index->p_entries, ( p_index->i_entries + 256 ) *
+                                             sizeof(*p_index->p_entries) );
+            if ( !p_realloc )
+                return VLC_ENOMEM;
+            p_index->p_entries = p_realloc;
+        }
+
+        /* without tfdt, the fragments are assumed to follow each other */
+        const int64_t i_time = FragIndexGetTime( p_sys, p_fragment->p_moox );
+        mp4_fragindex_entry_t *p_entry = &p_index->p_entries[p_index->i_entries];
+        p_entry->i_moof_pos = p_moof->i_pos;
+        p_entry->i_time = i_time >= 0 ? (uint64_t)i_time : p_index->i_duration;
+        /* the entries must stay sorted for the lookups */
+        if ( p_index->i_entries > 0 && p_entry->i_time < p_entry[-1].i_time )
+            p_entry->i_time = p_entry[-1].i_time;
+        p_index->i_entries++;
+
+        uint64_t i_length = 0;
+        for ( unsigned int i = 0; i < p_fragment->i_durations; i++ )
+            i_length = __MAX( i_length, p_fragment->p_durations[i].i_duration );
+        p_index->i_duration = __MAX( p_index->i_duration, p_entry->i_time + i_length );
+    }
+
+    p_index->i_end = i_end;
+    return VLC_SUCCESS;
+}
+
+/* Loads the cached index of the file, completes it with the fragments
+ * appended since, or creates it by reading all the fragments */
+static void FragIndexOpen( demux_t *p_demux )
+{
+    demux_sys_t *p_sys = p_demux->p_sys;
+    mp4_fragindex_t *p_index = &p_sys->fragindex;
+    const uint64_t i_size = stream_Size( p_demux->s );
+    const int64_t i_mtime = FragIndexGetMTime( p_demux );
+    uint64_t i_backup_pos;
+    char *psz_uri = NULL;
+    bool b_store = true;
+
+    if ( !p_sys->i_timescale || FragIndexMoovHasSamples( p_sys ) ||
+         !MP4_stream_Tell( p_demux->s, &i_backup_pos ) ||
+         !(psz_uri = FragIndexGetURI( p_demux )) )
+    {
+        /* probe as without index */
+        if ( p_sys->b_fastseekable )
+            ProbeFragments( p_demux, true );
+        return;
+    }
+
+    if ( MP4_FragIndexLoad( VLC_OBJECT(p_demux), psz_uri, p_index ) == VLC_SUCCESS )
+    {
+        const uint64_t i_last = p_index->p_entries[p_index->i_entries - 1].i_moof_pos;
+        MP4_Box_t box;
+
+        if ( p_index->i_timescale != p_sys->i_timescale ||
+             p_index->i_size > i_size || p_index->i_end > i_size )
+        {
+            msg_Dbg( p_demux, "cached fragments index does not match" );
+            MP4_FragIndexClean( p_index );
+        }
+        else if ( i_mtime && i_mtime == p_index->i_mtime && i_size == p_index->i_size )
+        {
+            b_store = false; /* file unchanged */
+        }
+        else if ( stream_Seek( p_demux->s, i_last ) ||
+                  !MP4_PeekBoxHeader( p_demux->s, &box ) || box.i_type != ATOM_moof )
+        {
+            msg_Dbg( p_demux, "cached fragments index does not match" );
+            MP4_FragIndexClean( p_index );
+        }
+        else if ( i_size == p_index->i_size )
+        {
+            b_store = i_mtime != p_index->i_mtime;
+        }
+        else
+        {
+            /* The file grew: only read the fragments added since */
+            const uint64_t i_start = __MAX( p_index->i_end,
+                                            FragIndexGetEnd( p_sys, i_size ) );
+            msg_Dbg( p_demux, "probing fragments appended from %"PRIu64, i_start );
+            if ( stream_Seek( p_demux->s, i_start ) == VLC_SUCCESS )
+            {
+                MP4_ReadBoxContainerChildren( p_demux->s, p_sys->p_root, 0 );
+                for ( MP4_Box_t *p_moof = MP4_BoxGet( p_sys->p_root, "moof" );
+                      p_moof; p_moof = p_moof->p_next )
+                {
+                    if ( p_moof->i_type == ATOM_moof && p_moof->i_pos >= p_index->i_end )
+                        AddFragment( p_demux, p_moof );
+                }
+                FragIndexAppend( p_demux, p_index->i_end, FragIndexGetEnd( p_sys, i_size ) );
+            }
+        }
+    }
+
+    if ( !p_index->i_entries )
+    {
+        /* No usable index: read all the fragments once */
+        MP4_FragIndexClean( p_index );
+        stream_Seek( p_demux->s, i_backup_pos );
+        ProbeFragments( p_demux, true );
+        FragIndexAppend( p_demux, 0, FragIndexGetEnd( p_sys, i_size ) );
+    }
+
+    if ( p_index->i_entries )
+    {
+        p_index->i_size = i_size;
+        p_index->i_mtime = i_mtime;
+        p_index->i_timescale = p_sys->i_timescale;
+        if ( b_store )
+            MP4_FragIndexStore( VLC_OBJECT(p_demux), psz_uri, p_index );
+
+        if ( !p_sys->i_overall_duration )
+            p_sys->i_overall_duration = p_index->i_duration;
+    }
+    free( psz_uri );
+
+    stream_Seek( p_demux->s, i_backup_pos );
+}
+
+static int FragIndexGetMoofPosByTime( demux_t *p_demux, const mtime_t i_target_time,
+                                      uint64_t *pi_pos, mtime_t *pi_mooftime )
+{
+    const mp4_fragindex_t *p_index = &p_demux->p_sys->fragindex;
+    if ( !p_index->i_entries || !p_index->i_timescale )
+        return VLC_EGENERIC;
+
+    /* last fragment starting before the target */
+    const uint64_t i_time = __MAX( i_target_time, 0 ) * p_index->i_timescale / CLOCK_FREQ;
+    uint32_t i_lo = 0, i_hi = p_index->i_entries;
+    while ( i_hi - i_lo > 1 )
+    {
+        const uint32_t i_mid = i_lo + (i_hi - i_lo) / 2;
+        if ( p_index->p_entries[i_mid].i_time <= i_time )
+            i_lo = i_mid;
+        else
+            i_hi = i_mid;
+    }
+
+    *pi_pos = p_index->p_entries[i_lo].i_moof_pos;
+    *pi_mooftime = CLOCK_FREQ * p_index->p_entries[i_lo].i_time / p_index->i_timescale;
+    return VLC_SUCCESS;
+}
+
 static int ProbeFragments( demux_t *p_demux, bool b_force )
 {
     demux_sys_t *p_sys = p_demux->p_sys;
@@ -4368,7 +4719,8 @@ static int ProbeFragments( demux_t *p_demux, bool b_force )
 
     assert( p_sys->p_root );
 
-    if ( p_sys->b_fastseekable || b_force )
+    /* With the index cache, fragments are only read when needed */
+    if ( ( p_sys->b_fastseekable && !p_sys->b_fragindex ) || b_force )
     {
         MP4_ReadBoxContainerChildren( p_demux->s, p_sys->p_root, 0 ); /* Get the rest of the file */
         p_sys->b_fragments_probed = true;
@@ -4457,8 +4809,10 @@ static mp4_fragment_t * GetFragmentByTime( demux_t *p_demux, const mtime_t i_tim
         }
 
         i_length = i_length * CLOCK_FREQ / p_demux->p_sys->i_timescale; /* movie scale to time */
+        /* a time at the boundary belongs to the next fragment, if any */
         if ( i_time >= i_base_time &&
-             i_time <= i_base_time + i_length )
+             ( i_time < i_base_time + i_length ||
+               ( i_time == i_base_time + i_length && !p_fragment->p_next ) ) )
         {
             free( pi_tracks_duration_total );
             return p_fragment;
@@ -4677,13 +5031,13 @@ static inline mtime_t LeafGetMOOVTimeInChunk( const mp4_chunk_t *p_chunk, uint32
     mtime_t i_time = 0;
     uint32_t i_index = 0;
 
-    while( i_sample > 0 )
+    while( i_sample > 0 && i_index < p_chunk->i_entries_dts )
     {
-        if( i_sample > p_chunk->p_sample_count_dts[i_index] )
+        const uint32_t i_count = MP4_ChunkGetDTSCount( p_chunk, i_index );
+        if( i_sample > i_count )
         {
-            i_time += p_chunk->p_sample_count_dts[i_index] *
-                p_chunk->p_sample_delta_dts[i_index];
-            i_sample -= p_chunk->p_sample_count_dts[i_index];
+            i_time += i_count * p_chunk->p_sample_delta_dts[i_index];
+            i_sample -= i_count;
             i_index++;
         }
         else
@@ -49,16 +49,22 @@ typedef struct
     uint64_t     i_first_dts;   /* DTS of the first sample */
     uint64_t     i_last_dts;    /* DTS of the last sample */
 
+    /* For moov chunks, these point into the stts and ctts tables, which
+       are not copied: the first entry can start in a previous chunk, and the
+       last one can end in a next chunk. Fragment chunks own their tables. */
     uint32_t     i_entries_dts;
+    uint32_t     i_dts_skip;    /* samples of the first entry in previous chunks */
     uint32_t     *p_sample_count_dts;
     uint32_t     *p_sample_delta_dts;   /* dts delta */
 
     uint32_t     i_entries_pts;
+    uint32_t     i_pts_skip;
     uint32_t     *p_sample_count_pts;
     int32_t      *p_sample_offset_pts;  /* pts-dts */
 
     uint8_t      **p_sample_data;     /* set when b_fragmented is true */
     uint32_t     *p_sample_size;
+    uint64_t     i_bytes;   /* size of all the samples, if they vary (moov) */
     /* TODO if needed add pts
         but quickly *add* support for edts and seeking */
 
@@ -111,8 +117,13 @@ typedef struct
     /* sample size, p_sample_size defined only if i_sample_size == 0
         else i_sample_size is size for all sample */
     uint32_t         i_sample_size;
-    uint32_t         *p_sample_size; /* XXX perhaps add file offset if take
-                                    too much time to do sumations each time*/
+    const uint32_t   *p_sample_size; /* points into the stsz table */
+
+    /* file offset of sample i_pos_sample in chunk i_pos_chunk, so that
+       sequential reads do not sum sizes from the chunk start each time */
+    uint32_t         i_pos_chunk;
+    uint32_t         i_pos_sample;
+    uint64_t         i_pos;
 
     uint32_t     i_sample_first; /* i_sample_first value
                                                    of the next chunk */
@@ -163,6 +174,29 @@ struct mp4_fragment_t
     mp4_fragment_t *p_next;
 };
 
+/* Persistent index of the fragments of a file, so that seeking does not
+ * require reading all the moof boxes first */
+typedef struct
+{
+    uint64_t i_moof_pos;    /* position of the moof box */
+    uint64_t i_time;        /* start time of the fragment, movie scaled */
+} mp4_fragindex_entry_t;
+
+typedef struct
+{
+    uint64_t i_size;        /* file size when indexed */
+    int64_t  i_mtime;       /* file modification time when indexed, or 0 */
+    uint64_t i_end;         /* end of the last complete box indexed */
+    uint32_t i_timescale;   /* movie timescale */
+    uint64_t i_duration;    /* end time of the last fragment, movie scaled */
+    uint32_t i_entries;
+    mp4_fragindex_entry_t *p_entries;
+} mp4_fragindex_t;
+
+int  MP4_FragIndexLoad( vlc_object_t *, const char *psz_uri, mp4_fragindex_t * );
+int  MP4_FragIndexStore( vlc_object_t *, const char *psz_uri, const mp4_fragindex_t * );
+void MP4_FragIndexClean( mp4_fragindex_t * );
+
 int SetupVideoES( demux_t *p_demux, mp4_track_t *p_track, MP4_Box_t *p_sample );
 int SetupAudioES( demux_t *p_demux, mp4_track_t *p_track, MP4_Box_t *p_sample );
 int SetupSpuES( demux_t *p_demux, mp4_track_t *p_track, MP4_Box_t *p_sample );
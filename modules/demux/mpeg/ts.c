@@ -256,6 +256,7 @@ typedef struct
     int         i_data_gathered;
     block_t     *p_data;
     block_t     **pp_last;
+    bool        b_data_held; /* p_data was pending at the last batch read */
 
     block_t *   p_prepcr_outqueue;
 
@@ -344,6 +345,13 @@ typedef struct
 #define MIN_PAT_INTERVAL CLOCK_FREQ // DVB is 500ms
 
 #define PID_ALLOC_CHUNK 16
+#define TS_PID_COUNT 8192
+
+/* Size of the stream reads: one UDP/RTP datagram worth of packets for live
+ * streams (so as not to add latency), much larger reads otherwise */
+#define TS_BATCH_PACKETS_LIVE 7
+#define TS_BATCH_BYTES_MAX    (128 * 1024)
+#define TS_BATCH_PACKETS_MAX  (TS_BATCH_BYTES_MAX / 188)
 
 struct demux_sys_t
 {
@@ -361,6 +369,15 @@ struct demux_sys_t
     /* how many TS packet we read at once */
     unsigned    i_ts_read;
 
+    /* TS packets read from the stream but not yet demuxed; packets are
+     * handed out as views sharing this block payload */
+    block_t    *p_batch;
+    unsigned    i_batch_packets;
+    size_t      i_batch_offset; /* bytes consumed since the batch was read */
+    /* Packets of the batch descrambled by DescrambleBatch(), by index.
+     * Their scrambling control is cleared, but their ES is scrambled. */
+    uint64_t    descrambled[(TS_BATCH_PACKETS_MAX + 63) / 64];
+
     bool        b_force_seek_per_percent;
 
     struct
@@ -381,9 +398,8 @@ struct demux_sys_t
         ts_pid_t **pp_all;
         int        i_all;
         int        i_all_alloc;
-        /* last recently used */
-        uint16_t   i_last_pid;
-        ts_pid_t  *p_last;
+        /* direct lookup of the above by PID */
+        ts_pid_t  *pp_map[TS_PID_COUNT];
     } pids;
 
     bool        b_user_pmt;
@@ -478,6 +494,11 @@ static void AddAndCreateES( demux_t *p_demux, ts_pid_t *pid, bool );
 static void ProgramSetPCR( demux_t *p_demux, ts_pmt_t *p_prg, mtime_t i_pcr );
 
 static block_t* ReadTSPacket( demux_t *p_demux );
+static bool SkipUnselectedTSPacket( demux_t *p_demux );
+static void FlushBatch( demux_sys_t *p_sys );
+static block_t *GatherPrivate( block_t *p_chain );
+static int64_t TSTell( demux_sys_t *p_sys );
+static int TSSeek( demux_sys_t *p_sys, uint64_t i_pos );
 static int ProbeStart( demux_t *p_demux, int i_program );
 static int ProbeEnd( demux_t *p_demux, int i_program );
 static int SeekToTime( demux_t *p_demux, ts_pmt_t *, int64_t time );
@@ -1003,6 +1024,9 @@ static int Open( vlc_object_t *p_this )
     p_sys->i_packet_size = i_packet_size;
     p_sys->i_packet_header_size = i_packet_header_size;
     p_sys->i_ts_read = 50;
+    p_sys->p_batch = NULL;
+    p_sys->i_batch_packets = TS_BATCH_PACKETS_LIVE;
+    p_sys->i_batch_offset = 0;
     p_sys->csa = NULL;
     p_sys->b_start_record = false;
 
@@ -1130,6 +1154,8 @@ static int Open( vlc_object_t *p_this )
 
     stream_Control( p_sys->stream, STREAM_CAN_SEEK, &p_sys->b_canseek );
     stream_Control( p_sys->stream, STREAM_CAN_FASTSEEK, &p_sys->b_canfastseek );
+    if( p_sys->b_canfastseek )
+        p_sys->i_batch_packets = TS_BATCH_BYTES_MAX / p_sys->i_packet_size;
 
     /* Preparse time */
     if( p_sys->b_canseek )
@@ -1187,6 +1213,8 @@ static void Close( vlc_object_t *p_this )
 
     vlc_mutex_destroy( &p_sys->csa_lock );
 
+    FlushBatch( p_sys );
+
     /* Release all non default pids */
     for( int i = 0; i < p_sys->pids.i_all; i++ )
     {
@@ -1241,6 +1269,10 @@ static int Demux( demux_t *p_demux )
     {
         bool         b_frame = false;
         block_t     *p_pkt;
+
+        if( SkipUnselectedTSPacket( p_demux ) )
+            continue;
+
         if( !(p_pkt = ReadTSPacket( p_demux )) )
         {
             return VLC_DEMUXER_EOF;
@@ -1248,16 +1280,34 @@ static int Demux( demux_t *p_demux )
 
         if( p_sys->b_start_record )
         {
-            /* Enable recording once synchronized */
-            stream_Control( p_sys->stream, STREAM_SET_RECORD_STATE, true, "ts" );
+            /* Enable recording once synchronized. The packets following
+             * this one were already read in the batch: read them again
+             * through the recording stream if possible, else record the
+             * rest of the batch as is. */
+            const int64_t i_pos = TSTell( p_sys );
+
+            if( stream_Control( p_sys->stream, STREAM_SET_RECORD_STATE,
+                                true, "ts" ) == VLC_SUCCESS &&
+                p_sys->p_batch != NULL )
+            {
+                if( p_sys->b_canseek )
+                    TSSeek( p_sys, i_pos );
+                else
+                    stream_Control( p_sys->stream, STREAM_RECORD_DATA,
+                                    (const void *)p_sys->p_batch->p_buffer,
+                                    p_sys->p_batch->i_buffer );
+            }
             p_sys->b_start_record = false;
         }
 
         /* Parse the TS packet */
         ts_pid_t *p_pid = GetPID( p_sys, PIDGet( p_pkt ) );
 
-        if( SCRAMBLED(*p_pid) != !!(p_pkt->p_buffer[3] & 0x80) )
-            UpdateScrambledState( p_demux, p_pid, p_pkt->p_buffer[3] & 0x80 );
+        const bool b_scrambled = (p_pkt->p_buffer[3] & 0x80) ||
+                                 (p_pkt->i_flags & BLOCK_FLAG_SCRAMBLED);
+        p_pkt->i_flags &= ~BLOCK_FLAG_SCRAMBLED;
+        if( !!SCRAMBLED(*p_pid) != b_scrambled )
+            UpdateScrambledState( p_demux, p_pid, b_scrambled );
 
         if( !SEEN(p_pid) )
         {
@@ -1483,7 +1533,7 @@ static int Control( demux_t *p_demux, int i_query, va_list args )
 
         if( (i64 = stream_Size( p_sys->stream) ) > 0 )
         {
-            int64_t offset = stream_Tell( p_sys->stream );
+            int64_t offset = TSTell( p_sys );
             *pf = (double)offset / (double)i64;
             return VLC_SUCCESS;
         }
@@ -1528,7 +1578,7 @@ static int Control( demux_t *p_demux, int i_query, va_list args )
 
         i64 = stream_Size( p_sys->stream );
         if( i64 > 0 &&
-            stream_Seek( p_sys->stream, (int64_t)(i64 * f) ) == VLC_SUCCESS )
+            TSSeek( p_sys, (int64_t)(i64 * f) ) == VLC_SUCCESS )
         {
             ReadyQueuesPostSeek( p_demux );
             return VLC_SUCCESS;
@@ -1652,9 +1702,11 @@ static int Control( demux_t *p_demux, int i_query, va_list args )
     }
 
     case DEMUX_SET_TITLE:
+        FlushBatch( p_sys );
         return stream_vaControl( p_sys->stream, STREAM_SET_TITLE, args );
 
     case DEMUX_SET_SEEKPOINT:
+        FlushBatch( p_sys );
         return stream_vaControl( p_sys->stream, STREAM_SET_SEEKPOINT, args );
 
     case DEMUX_GET_META:
@@ -2176,7 +2228,7 @@ static void ParsePES( demux_t *p_demux, ts_pid_t *pid, block_t *p_pes )
 
         p_pes->i_length = i_length * 100 / 9;
 
-        p_block = block_ChainGather( p_pes );
+        p_block = GatherPrivate( p_pes );
         if( pid->u.p_pes->es.fmt.i_codec == VLC_CODEC_SUBT )
         {
             if( i_pes_size > 0 && p_block->i_buffer > i_pes_size )
@@ -2468,6 +2520,7 @@ static void ParseData( demux_t *p_demux, ts_pid_t *pid )
 
     /* remove the pes from pid */
     pid->u.p_pes->p_data = NULL;
+    pid->u.p_pes->b_data_held = false;
     pid->u.p_pes->i_data_size = 0;
     pid->u.p_pes->i_data_gathered = 0;
     pid->u.p_pes->pp_last = &pid->u.p_pes->p_data;
@@ -2486,77 +2539,306 @@ static void ParseData( demux_t *p_demux, ts_pid_t *pid )
     }
 }
 
-static block_t* ReadTSPacket( demux_t *p_demux )
+/* Returns the stream position of the next TS packet to be demuxed */
+static int64_t TSTell( demux_sys_t *p_sys )
 {
-    demux_sys_t *p_sys = p_demux->p_sys;
+    int64_t i_pos = stream_Tell( p_sys->stream );
 
-    block_t     *p_pkt;
+    if( p_sys->p_batch )
+        i_pos -= p_sys->p_batch->i_buffer;
+    return i_pos;
+}
+
+static void FlushBatch( demux_sys_t *p_sys )
+{
+    if( p_sys->p_batch )
+        block_Release( p_sys->p_batch );
+    p_sys->p_batch = NULL;
+}
+
+static int TSSeek( demux_sys_t *p_sys, uint64_t i_pos )
+{
+    FlushBatch( p_sys );
+    return stream_Seek( p_sys->stream, i_pos );
+}
 
-    /* Get a new TS packet */
-    if( !( p_pkt = stream_Block( p_sys->stream, p_sys->i_packet_size ) ) )
+static void DescrambleBatchFlush( demux_sys_t *p_sys, uint8_t **pp_pkts,
+                                  const unsigned *pi_index, unsigned i_pkts )
+{
+    csa_DecryptBatch( p_sys->csa, pp_pkts, i_pkts, p_sys->i_csa_pkt_size );
+
+    for( unsigned i = 0; i < i_pkts; i++ )
+        p_sys->descrambled[pi_index[i] / 64] |= UINT64_C(1) << (pi_index[i] % 64);
+}
+
+/* Descrambles the packets of the selected ES all at once, which is much
+ * faster than one by one in GatherData() */
+static void DescrambleBatch( demux_t *p_demux, block_t *p_block )
+{
+    demux_sys_t *p_sys = p_demux->p_sys;
+    uint8_t *pp_pkts[64];
+    unsigned pi_index[64];
+    unsigned i_pkts = 0;
+
+    vlc_mutex_lock( &p_sys->csa_lock );
+    for( size_t i = 0; i + p_sys->i_packet_size <= p_block->i_buffer;
+         i += p_sys->i_packet_size )
     {
-        if( stream_Tell( p_sys->stream ) == stream_Size( p_sys->stream ) )
-            msg_Dbg( p_demux, "EOF at %"PRId64, stream_Tell( p_sys->stream ) );
-        else
-            msg_Dbg( p_demux, "Can't read TS packet at %"PRId64, stream_Tell(p_sys->stream) );
-        return NULL;
+        uint8_t *p = p_block->p_buffer + i + p_sys->i_packet_header_size;
+        if( p[0] != 0x47 )
+            break;
+        if( (p[3] & 0x80) == 0 )
+            continue;
+
+        const ts_pid_t *p_pid = p_sys->pids.pp_map[((p[1] & 0x1f) << 8) | p[2]];
+        if( p_pid == NULL || p_pid->type != TYPE_PES ||
+            !( p_sys->b_access_control || (p_pid->i_flags & FLAG_FILTERED) ||
+               p_sys->es_creation == DELAY_ES ) )
+            continue;
+
+        assert( i / p_sys->i_packet_size < TS_BATCH_PACKETS_MAX );
+        pi_index[i_pkts] = i / p_sys->i_packet_size;
+        pp_pkts[i_pkts++] = p;
+        if( i_pkts == sizeof(pp_pkts)/sizeof(*pp_pkts) )
+        {
+            DescrambleBatchFlush( p_sys, pp_pkts, pi_index, i_pkts );
+            i_pkts = 0;
+        }
     }
+    if( i_pkts > 0 )
+        DescrambleBatchFlush( p_sys, pp_pkts, pi_index, i_pkts );
+    vlc_mutex_unlock( &p_sys->csa_lock );
+}
 
-    if( p_pkt->i_buffer < TS_HEADER_SIZE + p_sys->i_packet_header_size )
+/* Gathers a chain of packets into a block of its own. Packets are views of
+ * a whole batch, which must not be kept allocated by a single packet. */
+static block_t *GatherPrivate( block_t *p_chain )
+{
+    if( p_chain->p_next != NULL )
+        return block_ChainGather( p_chain );
+    if( !block_IsShareable( p_chain ) )
+        return p_chain;
+
+    block_t *p_block = block_Duplicate( p_chain );
+    block_Release( p_chain );
+    return p_block;
+}
+
+/* Gathers the data of the PES which were already pending at the previous
+ * batch read, so that sparse ES do not keep old batches allocated */
+static void ReleaseHeldBatches( demux_sys_t *p_sys )
+{
+    for( int i = 0; i < p_sys->pids.i_all; i++ )
     {
-        block_Release( p_pkt );
-        return NULL;
+        ts_pid_t *pid = p_sys->pids.pp_all[i];
+        if( pid->type != TYPE_PES || pid->u.p_pes->p_data == NULL )
+            continue;
+
+        ts_pes_t *p_pes = pid->u.p_pes;
+        if( !p_pes->b_data_held )
+        {
+            p_pes->b_data_held = true;
+            continue;
+        }
+
+        block_t *p_data = GatherPrivate( p_pes->p_data );
+        p_pes->p_data = p_data;
+        p_pes->pp_last = p_data ? &p_data->p_next : &p_pes->p_data;
+        if( p_data == NULL )
+            p_pes->i_data_size = p_pes->i_data_gathered = 0;
+        p_pes->b_data_held = false;
     }
+}
 
-    /* Skip header (BluRay streams).
-     * re-sync logic would do this (by adjusting packet start), but this would result in losing first and last ts packets.
-     * First packet is usually PAT, and losing it means losing whole first GOP. This is fatal with still-image based menus.
-     */
-    p_pkt->p_buffer += p_sys->i_packet_header_size;
-    p_pkt->i_buffer -= p_sys->i_packet_header_size;
+/* Reads the next batch of packets, keeping the incomplete packet (or
+ * unsynchronized bytes) left from the previous batch in front of it. */
+static bool FillBatch( demux_t *p_demux )
+{
+    demux_sys_t *p_sys = p_demux->p_sys;
+    const size_t i_size = p_sys->i_packet_size * p_sys->i_batch_packets;
+    size_t i_tail = 0;
 
-    /* Check sync byte and re-sync if needed */
-    if( p_pkt->p_buffer[0] != 0x47 )
+    ReleaseHeldBatches( p_sys );
+
+    if( p_sys->p_batch && p_sys->p_batch->i_buffer == 0 )
+        FlushBatch( p_sys );
+
+    block_t *p_block;
+
+    if( p_sys->p_batch == NULL )
     {
-        msg_Warn( p_demux, "lost synchro" );
-        block_Release( p_pkt );
-        for( ;; )
-        {
-            const uint8_t *p_peek;
-            int i_peek = 0;
-            unsigned i_skip = 0;
+        /* Usually, the previous batch was consumed entirely: reference the
+         * stream data rather than copying them, if the stream allows it.
+         * Descrambling modifies the batch in place. */
+        p_block = stream_BlockShared( p_sys->stream, i_size );
+        if( p_block != NULL && p_sys->csa )
+            p_block = block_Writable( p_block );
+        if( p_block == NULL )
+            return false;
+    }
+    else
+    {
+        p_block = block_Alloc( i_size );
+        if( unlikely(p_block == NULL) )
+            return false;
 
-            i_peek = stream_Peek( p_sys->stream, &p_peek,
-                    p_sys->i_packet_size * 10 );
-            if( i_peek < 0 || (unsigned)i_peek < p_sys->i_packet_size + 1 )
-            {
-                msg_Dbg( p_demux, "eof ?" );
-                return NULL;
-            }
+        i_tail = p_sys->p_batch->i_buffer;
+        assert( i_tail < i_size );
+        memcpy( p_block->p_buffer, p_sys->p_batch->p_buffer, i_tail );
+        FlushBatch( p_sys );
 
-            while( i_skip < i_peek - p_sys->i_packet_size )
-            {
-                if( p_peek[i_skip + p_sys->i_packet_header_size] == 0x47 &&
-                        p_peek[i_skip + p_sys->i_packet_header_size + p_sys->i_packet_size] == 0x47 )
-                {
-                    break;
-                }
-                i_skip++;
-            }
-            msg_Dbg( p_demux, "skipping %d bytes of garbage", i_skip );
-            stream_Read( p_sys->stream, NULL, i_skip );
+        int i_read = stream_Read( p_sys->stream, p_block->p_buffer + i_tail,
+                                  i_size - i_tail );
+        p_block->i_buffer = i_tail + __MAX( i_read, 0 );
+    }
+
+    p_sys->i_batch_offset = 0;
+    memset( p_sys->descrambled, 0, sizeof(p_sys->descrambled) );
+    if( p_sys->csa )
+        DescrambleBatch( p_demux, p_block );
+
+    p_sys->p_batch = block_Share( p_block );
+    return p_sys->p_batch->i_buffer >= p_sys->i_packet_size;
+}
+
+/* Consumes bytes at the start of the batch */
+static void BatchSkip( demux_sys_t *p_sys, size_t i_skip )
+{
+    p_sys->p_batch->p_buffer += i_skip;
+    p_sys->p_batch->i_buffer -= i_skip;
+    p_sys->i_batch_offset += i_skip;
+}
+
+/* Whether the next packet of the batch was descrambled by DescrambleBatch() */
+static bool BatchDescrambled( const demux_sys_t *p_sys )
+{
+    const size_t i_index = p_sys->i_batch_offset / p_sys->i_packet_size;
+
+    if( p_sys->i_batch_offset % p_sys->i_packet_size ||
+        i_index >= TS_BATCH_PACKETS_MAX )
+        return false;
+    return (p_sys->descrambled[i_index / 64] >> (i_index % 64)) & 1;
+}
+
+/* Skips garbage until two consecutive sync bytes are found */
+static bool ResyncBatch( demux_t *p_demux )
+{
+    demux_sys_t *p_sys = p_demux->p_sys;
+    const unsigned i_header = p_sys->i_packet_header_size;
+    const unsigned i_size = p_sys->i_packet_size;
 
-            if( i_skip < i_peek - p_sys->i_packet_size )
+    for( ;; )
+    {
+        block_t *p_batch = p_sys->p_batch;
+        const uint8_t *p = p_batch->p_buffer + i_header;
+        size_t i_skip = 0;
+        bool b_found = false;
+
+        while( i_skip + i_header + i_size < p_batch->i_buffer )
+        {
+            if( p[i_skip] == 0x47 && p[i_skip + i_size] == 0x47 )
             {
+                b_found = true;
                 break;
             }
+            i_skip++;
         }
-        if( !( p_pkt = stream_Block( p_sys->stream, p_sys->i_packet_size ) ) )
+        msg_Dbg( p_demux, "skipping %zu bytes of garbage", i_skip );
+        BatchSkip( p_sys, i_skip );
+
+        if( b_found )
+            return true;
+        if( !FillBatch( p_demux ) )
+            return false;
+    }
+}
+
+/* Skips the next packet if Demux() would drop it anyway, i.e. if it belongs
+ * to an unselected ES or cannot be descrambled, without creating a block */
+static bool SkipUnselectedTSPacket( demux_t *p_demux )
+{
+    demux_sys_t *p_sys = p_demux->p_sys;
+    block_t     *p_batch = p_sys->p_batch;
+
+    if( p_batch == NULL || p_batch->i_buffer < p_sys->i_packet_size ||
+        p_sys->b_start_record || !SEEN( GetPID( p_sys, 0 ) ) )
+        return false;
+
+    const uint8_t *p = p_batch->p_buffer + p_sys->i_packet_header_size;
+    if( p[0] != 0x47 )
+        return false;
+
+    const ts_pid_t *p_pid = p_sys->pids.pp_map[((p[1] & 0x1f) << 8) | p[2]];
+    if( p_pid == NULL || !SEEN(p_pid) ||
+        !SCRAMBLED(*p_pid) != !( (p[3] & 0x80) || BatchDescrambled( p_sys ) ) )
+        return false;
+
+    if( !SCRAMBLED(*p_pid) || p_sys->csa )
+    {
+        if( p_pid->type != TYPE_PES || p_sys->b_access_control ||
+            (p_pid->i_flags & FLAG_FILTERED) || p_sys->es_creation == DELAY_ES )
+            return false;
+        p_sys->b_end_preparse = true;
+    }
+
+    BatchSkip( p_sys, p_sys->i_packet_size );
+    return true;
+}
+
+static block_t* ReadTSPacket( demux_t *p_demux )
+{
+    demux_sys_t *p_sys = p_demux->p_sys;
+    block_t     *p_batch = p_sys->p_batch;
+    block_t     *p_pkt;
+
+    /* Get new TS packets */
+    if( p_batch == NULL || p_batch->i_buffer < p_sys->i_packet_size )
+    {
+        if( !FillBatch( p_demux ) )
+        {
+            if( stream_Tell( p_sys->stream ) == stream_Size( p_sys->stream ) )
+                msg_Dbg( p_demux, "EOF at %"PRId64, TSTell( p_sys ) );
+            else
+                msg_Dbg( p_demux, "Can't read TS packet at %"PRId64, TSTell( p_sys ) );
+            return NULL;
+        }
+        p_batch = p_sys->p_batch;
+    }
+
+    /* Check sync byte and re-sync if needed */
+    if( p_batch->p_buffer[p_sys->i_packet_header_size] != 0x47 )
+    {
+        msg_Warn( p_demux, "lost synchro" );
+        if( !ResyncBatch( p_demux ) )
         {
             msg_Dbg( p_demux, "eof ?" );
             return NULL;
         }
+        p_batch = p_sys->p_batch;
     }
+
+    /* Hand out a view of the packet within the batch. The batch length is
+     * narrowed meanwhile so that a copy, if any, is limited to that packet. */
+    const size_t i_left = p_batch->i_buffer;
+    const bool b_descrambled = BatchDescrambled( p_sys );
+
+    p_batch->i_buffer = p_sys->i_packet_size;
+    p_pkt = block_Clone( p_batch );
+    p_batch->i_buffer = i_left;
+    BatchSkip( p_sys, p_sys->i_packet_size );
+
+    if( unlikely(p_pkt == NULL) )
+        return NULL;
+    if( b_descrambled )
+        p_pkt->i_flags |= BLOCK_FLAG_SCRAMBLED;
+
+    /* Skip header (BluRay streams).
+     * re-sync logic would do this (by adjusting packet start), but this would result in losing first and last ts packets.
+     * First packet is usually PAT, and losing it means losing whole first GOP. This is fatal with still-image based menus.
+     */
+    p_pkt->p_buffer += p_sys->i_packet_header_size;
+    p_pkt->i_buffer -= p_sys->i_packet_header_size;
+
     return p_pkt;
 }
 
@@ -2623,6 +2905,7 @@ static inline void FlushESBuffer( ts_pes_t *p_pes )
         block_ChainRelease( p_pes->p_data );
         p_pes->p_data = NULL;
         p_pes->pp_last = &p_pes->p_data;
+        p_pes->b_data_held = false;
     }
 
     if( p_pes->sl.p_data )
@@ -2679,12 +2962,12 @@ static int SeekToTime( demux_t *p_demux, ts_pmt_t *p_pmt, int64_t i_scaledtime )
 
     /* Deal with common but worst binary search case */
     if( p_pmt->pcr.i_first == i_scaledtime && p_sys->b_canseek )
-        return stream_Seek( p_sys->stream, 0 );
+        return TSSeek( p_sys, 0 );
 
     if( !p_sys->b_canfastseek )
         return VLC_EGENERIC;
 
-    int64_t i_initial_pos = stream_Tell( p_sys->stream );
+    int64_t i_initial_pos = TSTell( p_sys );
 
     /* Find the time position by using binary search algorithm. */
     int64_t i_head_pos = 0;
@@ -2700,7 +2983,7 @@ static int SeekToTime( demux_t *p_demux, ts_pmt_t *p_pmt, int64_t i_scaledtime )
         int64_t i_div = i_splitpos % p_sys->i_packet_size;
         i_splitpos -= i_div;
 
-        if ( stream_Seek( p_sys->stream, i_splitpos ) != VLC_SUCCESS )
+        if ( TSSeek( p_sys, i_splitpos ) != VLC_SUCCESS )
             break;
 
         int64_t i_pos = i_splitpos;
@@ -2714,7 +2997,7 @@ static int SeekToTime( demux_t *p_demux, ts_pmt_t *p_pmt, int64_t i_scaledtime )
                 break;
             }
             else
-                i_pos = stream_Tell( p_sys->stream );
+                i_pos = TSTell( p_sys );
 
             int i_pid = PIDGet( p_pkt );
             if( i_pid != 0x1FFF && GetPID(p_sys, i_pid)->type == TYPE_PES &&
@@ -2768,7 +3051,7 @@ static int SeekToTime( demux_t *p_demux, ts_pmt_t *p_pmt, int64_t i_scaledtime )
     if( !b_found )
     {
         msg_Dbg( p_demux, "Seek():cannot find a time position." );
-        stream_Seek( p_sys->stream, i_initial_pos );
+        TSSeek( p_sys, i_initial_pos );
         return VLC_EGENERIC;
     }
     return VLC_SUCCESS;
@@ -2783,20 +3066,12 @@ static ts_pid_t *GetPID( demux_sys_t *p_sys, uint16_t i_pid )
         case 0x1FFF:
             return &p_sys->pids.dummy;
         default:
-            if( p_sys->pids.i_last_pid == i_pid )
-                return p_sys->pids.p_last;
         break;
     }
 
-    for( int i=0; i < p_sys->pids.i_all; i++ )
-    {
-        if( p_sys->pids.pp_all[i]->i_pid == i_pid )
-        {
-            p_sys->pids.p_last = p_sys->pids.pp_all[i];
-            p_sys->pids.i_last_pid = i_pid;
-            return p_sys->pids.p_last;
-        }
-    }
+    assert( i_pid < TS_PID_COUNT );
+    if( likely(p_sys->pids.pp_map[i_pid] != NULL) )
+        return p_sys->pids.pp_map[i_pid];
 
     if( p_sys->pids.i_all >= p_sys->pids.i_all_alloc )
     {
@@ -2817,9 +3092,7 @@ static ts_pid_t *GetPID( demux_sys_t *p_sys, uint16_t i_pid )
 
     p_pid->i_pid = i_pid;
     p_sys->pids.pp_all[p_sys->pids.i_all++] = p_pid;
-
-    p_sys->pids.p_last = p_pid;
-    p_sys->pids.i_last_pid = i_pid;
+    p_sys->pids.pp_map[i_pid] = p_pid;
 
     return p_pid;
 }
@@ -2935,7 +3208,7 @@ static int ProbeChunk( demux_t *p_demux, int i_program, bool b_end, int64_t *pi_
 static int ProbeStart( demux_t *p_demux, int i_program )
 {
     demux_sys_t *p_sys = p_demux->p_sys;
-    const int64_t i_initial_pos = stream_Tell( p_sys->stream );
+    const int64_t i_initial_pos = TSTell( p_sys );
     int64_t i_stream_size = stream_Size( p_sys->stream );
 
     int i_probe_count = 0;
@@ -2948,7 +3221,7 @@ static int ProbeStart( demux_t *p_demux, int i_program )
         i_pos = p_sys->i_packet_size * i_probe_count;
         i_pos = __MIN( i_pos, i_stream_size );
 
-        if( stream_Seek( p_sys->stream, i_pos ) )
+        if( TSSeek( p_sys, i_pos ) )
             return VLC_EGENERIC;
 
         ProbeChunk( p_demux, i_program, false, &i_pcr, &b_found );
@@ -2957,7 +3230,7 @@ static int ProbeStart( demux_t *p_demux, int i_program )
         i_probe_count += PROBE_CHUNK_COUNT;
     } while( i_pos > 0 && (i_pcr == -1 || !b_found) && i_probe_count < (2 * PROBE_CHUNK_COUNT) );
 
-    stream_Seek( p_sys->stream, i_initial_pos );
+    TSSeek( p_sys, i_initial_pos );
 
     return (b_found) ? VLC_SUCCESS : VLC_EGENERIC;
 }
@@ -2965,7 +3238,7 @@ static int ProbeStart( demux_t *p_demux, int i_program )
 static int ProbeEnd( demux_t *p_demux, int i_program )
 {
     demux_sys_t *p_sys = p_demux->p_sys;
-    const int64_t i_initial_pos = stream_Tell( p_sys->stream );
+    const int64_t i_initial_pos = TSTell( p_sys );
     int64_t i_stream_size = stream_Size( p_sys->stream );
 
     int i_probe_count = PROBE_CHUNK_COUNT;
@@ -2978,7 +3251,7 @@ static int ProbeEnd( demux_t *p_demux, int i_program )
         i_pos = i_stream_size - (p_sys->i_packet_size * i_probe_count);
         i_pos = __MAX( i_pos, 0 );
 
-        if( stream_Seek( p_sys->stream, i_pos ) )
+        if( TSSeek( p_sys, i_pos ) )
             return VLC_EGENERIC;
 
         ProbeChunk( p_demux, i_program, true, &i_pcr, &b_found );
@@ -2987,7 +3260,7 @@ static int ProbeEnd( demux_t *p_demux, int i_program )
         i_probe_count += PROBE_CHUNK_COUNT;
     } while( i_pos > 0 && (i_pcr == -1 || !b_found) && i_probe_count < (6 * PROBE_CHUNK_COUNT) );
 
-    stream_Seek( p_sys->stream, i_initial_pos );
+    TSSeek( p_sys, i_initial_pos );
 
     return (b_found) ? VLC_SUCCESS : VLC_EGENERIC;
 }
@@ -5640,6 +5913,7 @@ static ts_pes_t *ts_pes_New( demux_t *p_demux )
     pes->i_data_gathered = 0;
     pes->p_data = NULL;
     pes->pp_last = &pes->p_data;
+    pes->b_data_held = false;
     pes->p_prepcr_outqueue = NULL;
     pes->sl.p_data = NULL;
     pes->sl.pp_last = &pes->sl.p_data;
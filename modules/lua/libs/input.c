@@ -193,6 +193,7 @@ static int vlclua_input_item_stats( lua_State *L )
         STATS_FLOAT( average_demux_bitrate )
         STATS_INT( demux_corrupted )
         STATS_INT( demux_discontinuity )
+        STATS_FLOAT( demux_buffer_level )
         STATS_INT( decoded_audio )
         STATS_INT( decoded_video )
         STATS_INT( displayed_pictures )
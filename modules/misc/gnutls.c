@@ -33,6 +33,7 @@
 #include <vlc_tls.h>
 #include <vlc_block.h>
 #include <vlc_dialog.h>
+#include <vlc_network.h>
 
 #include <gnutls/gnutls.h>
 #include <gnutls/x509.h>
@@ -159,6 +160,122 @@ static int gnutls_Recv (void *opaque, void *buf, size_t length)
     return (val < 0) ? gnutls_Error (tls, val) : val;
 }
 
+/*
+ * Client session resumption cache
+ *
+ * Sessions can only be resumed with the credentials that established them,
+ * so each client credentials remember the parameters of the last session
+ * established with each server, identified by host name and port, most
+ * recent last.
+ */
+#define SESSION_CACHE_SIZE 16
+
+typedef struct vlc_tls_client_sys
+{
+    gnutls_certificate_credentials_t x509_cred;
+    vlc_mutex_t lock;
+    unsigned cache_count;
+    struct
+    {
+        char *server;
+        void *data;
+        size_t size;
+    } cache[SESSION_CACHE_SIZE];
+} vlc_tls_client_sys_t;
+
+/* Client session private pointer, identifying the cache entry */
+typedef struct
+{
+    vlc_tls_client_sys_t *sys;
+    char server[];
+} gnutls_cache_key_t;
+
+static void gnutls_CacheRemove (vlc_tls_client_sys_t *sys, unsigned i)
+{
+    free (sys->cache[i].server);
+    free (sys->cache[i].data);
+    sys->cache_count--;
+    memmove (sys->cache + i, sys->cache + i + 1,
+             (sys->cache_count - i) * sizeof (*sys->cache));
+}
+
+/**
+ * Sets the parameters of the last session with the server, if any, so that
+ * the handshake resumes that session rather than starting a new one.
+ */
+static void gnutls_CacheLoad (gnutls_session_t session)
+{
+    const gnutls_cache_key_t *key = gnutls_session_get_ptr (session);
+    vlc_tls_client_sys_t *sys = key->sys;
+
+    vlc_mutex_lock (&sys->lock);
+    for (unsigned i = 0; i < sys->cache_count; i++)
+        if (!strcmp (sys->cache[i].server, key->server))
+        {
+            gnutls_session_set_data (session, sys->cache[i].data,
+                                     sys->cache[i].size);
+            break;
+        }
+    vlc_mutex_unlock (&sys->lock);
+}
+
+/**
+ * Saves the parameters of an established client session for later reuse.
+ */
+static void gnutls_CacheSave (gnutls_session_t session)
+{
+    const gnutls_cache_key_t *key = gnutls_session_get_ptr (session);
+    gnutls_datum_t datum;
+
+    if (key == NULL || gnutls_session_get_data2 (session, &datum))
+        return;
+
+    vlc_tls_client_sys_t *sys = key->sys;
+    char *server = strdup (key->server);
+    void *data = malloc (datum.size);
+    if (unlikely(server == NULL || data == NULL))
+    {
+        free (data);
+        free (server);
+        gnutls_free (datum.data);
+        return;
+    }
+    memcpy (data, datum.data, datum.size);
+    gnutls_free (datum.data);
+
+    vlc_mutex_lock (&sys->lock);
+    for (unsigned i = 0; i < sys->cache_count; i++)
+        if (!strcmp (sys->cache[i].server, server))
+        {
+            gnutls_CacheRemove (sys, i);
+            break;
+        }
+    if (sys->cache_count == SESSION_CACHE_SIZE)
+        gnutls_CacheRemove (sys, 0);
+    sys->cache[sys->cache_count].server = server;
+    sys->cache[sys->cache_count].data = data;
+    sys->cache[sys->cache_count].size = datum.size;
+    sys->cache_count++;
+    vlc_mutex_unlock (&sys->lock);
+}
+
+#if (GNUTLS_VERSION_NUMBER >= 0x030603)
+/**
+ * TLS 1.3 servers send session tickets after the handshake, along with
+ * application data.
+ */
+static int gnutls_TicketHook (gnutls_session_t session, unsigned htype,
+                              unsigned when, unsigned incoming,
+                              const gnutls_datum_t *msg)
+{
+    if (gnutls_protocol_get_version (session) == GNUTLS_TLS1_3)
+        gnutls_CacheSave (session);
+
+    (void) htype; (void) when; (void) incoming; (void) msg;
+    return 0;
+}
+#endif
+
 static int gnutls_SessionOpen (vlc_tls_t *tls, int type,
                                gnutls_certificate_credentials_t x509, int fd,
                                const char *const *alpn)
@@ -303,6 +420,7 @@ static void gnutls_SessionClose (vlc_tls_t *tls)
     if (tls->sock.p_sys != NULL)
         gnutls_bye (session, GNUTLS_SHUT_WR);
 
+    free (gnutls_session_get_ptr (session));
     gnutls_deinit (session);
 }
 
@@ -310,7 +428,9 @@ static int gnutls_ClientSessionOpen (vlc_tls_creds_t *crd, vlc_tls_t *tls,
                                      int fd, const char *hostname,
                                      const char *const *alpn)
 {
-    int val = gnutls_SessionOpen (tls, GNUTLS_CLIENT, crd->sys, fd, alpn);
+    vlc_tls_client_sys_t *sys = crd->sys;
+    int val = gnutls_SessionOpen (tls, GNUTLS_CLIENT, sys->x509_cred, fd,
+                                  alpn);
     if (val != VLC_SUCCESS)
         return val;
 
@@ -320,10 +440,36 @@ static int gnutls_ClientSessionOpen (vlc_tls_creds_t *crd, vlc_tls_t *tls,
     gnutls_dh_set_prime_bits (session, 1024);
 
     if (likely(hostname != NULL))
+    {
         /* fill Server Name Indication */
         gnutls_server_name_set (session, GNUTLS_NAME_DNS,
                                 hostname, strlen (hostname));
 
+        /* try to resume the last session with the same server */
+        char addr[NI_MAXNUMERICHOST];
+        int port;
+
+        if (var_InheritBool (tls, "gnutls-resumption")
+         && net_GetPeerAddress (fd, addr, &port) == 0)
+        {
+            size_t len = strlen (hostname) + sizeof (":65535");
+            gnutls_cache_key_t *key = malloc (sizeof (*key) + len);
+
+            if (likely(key != NULL))
+            {
+                key->sys = sys;
+                snprintf (key->server, len, "%s:%d", hostname, port);
+                gnutls_session_set_ptr (session, key);
+                gnutls_CacheLoad (session);
+#if (GNUTLS_VERSION_NUMBER >= 0x030603)
+                gnutls_handshake_set_hook_function (session,
+                    GNUTLS_HANDSHAKE_NEW_SESSION_TICKET, GNUTLS_HOOK_POST,
+                    gnutls_TicketHook);
+#endif
+            }
+        }
+    }
+
     return VLC_SUCCESS;
 }
 
@@ -338,6 +484,9 @@ static int gnutls_ClientHandshake (vlc_tls_t *tls, const char *host,
     gnutls_session_t session = tls->sys;
     unsigned status;
 
+    if (gnutls_session_is_resumed (session))
+        msg_Dbg (tls, "TLS session resumed");
+
     val = gnutls_certificate_verify_peers3 (session, host, &status);
     if (val)
     {
@@ -352,6 +501,10 @@ failure:
     {   /* Good certificate */
 success:
         tls->sock.p_sys = tls;
+#if (GNUTLS_VERSION_NUMBER >= 0x030603)
+        if (gnutls_protocol_get_version (session) != GNUTLS_TLS1_3)
+#endif
+            gnutls_CacheSave (session);
         return 0;
     }
 
@@ -460,31 +613,40 @@ success:
  */
 static int OpenClient (vlc_tls_creds_t *crd)
 {
-    gnutls_certificate_credentials_t x509;
-
     if (gnutls_Init (VLC_OBJECT(crd)))
         return VLC_EGENERIC;
 
-    int val = gnutls_certificate_allocate_credentials (&x509);
+    vlc_tls_client_sys_t *sys = malloc (sizeof (*sys));
+    if (unlikely(sys == NULL))
+    {
+        gnutls_Deinit ();
+        return VLC_ENOMEM;
+    }
+
+    int val = gnutls_certificate_allocate_credentials (&sys->x509_cred);
     if (val != 0)
     {
         msg_Err (crd, "cannot allocate credentials: %s",
                  gnutls_strerror (val));
+        free (sys);
         gnutls_Deinit ();
         return VLC_EGENERIC;
     }
 
-    val = gnutls_certificate_set_x509_system_trust (x509);
+    val = gnutls_certificate_set_x509_system_trust (sys->x509_cred);
     if (val < 0)
         msg_Err (crd, "cannot load trusted Certificate Authorities: %s",
                  gnutls_strerror (val));
     else
         msg_Dbg (crd, "loaded %d trusted CAs", val);
 
-    gnutls_certificate_set_verify_flags (x509,
+    gnutls_certificate_set_verify_flags (sys->x509_cred,
                                          GNUTLS_VERIFY_ALLOW_X509_V1_CA_CRT);
 
-    crd->sys = x509;
+    vlc_mutex_init (&sys->lock);
+    sys->cache_count = 0;
+
+    crd->sys = sys;
     crd->open = gnutls_ClientSessionOpen;
     crd->handshake = gnutls_ClientHandshake;
     crd->close = gnutls_SessionClose;
@@ -494,9 +656,14 @@ static int OpenClient (vlc_tls_creds_t *crd)
 
 static void CloseClient (vlc_tls_creds_t *crd)
 {
-    gnutls_certificate_credentials_t x509 = crd->sys;
+    vlc_tls_client_sys_t *sys = crd->sys;
 
-    gnutls_certificate_free_credentials (x509);
+    /* all sessions depending on the credentials are now deinitialized */
+    while (sys->cache_count > 0)
+        gnutls_CacheRemove (sys, 0);
+    vlc_mutex_destroy (&sys->lock);
+    gnutls_certificate_free_credentials (sys->x509_cred);
+    free (sys);
     gnutls_Deinit ();
 }
 
@@ -508,6 +675,7 @@ typedef struct vlc_tls_creds_sys
 {
     gnutls_certificate_credentials_t x509_cred;
     gnutls_dh_params_t dh_params;
+    gnutls_datum_t ticket_key;
 } vlc_tls_creds_sys_t;
 
 /**
@@ -520,7 +688,12 @@ static int gnutls_ServerSessionOpen (vlc_tls_creds_t *crd, vlc_tls_t *tls,
     vlc_tls_creds_sys_t *sys = crd->sys;
 
     assert (hostname == NULL);
-    return gnutls_SessionOpen (tls, GNUTLS_SERVER, sys->x509_cred, fd, alpn);
+    int val = gnutls_SessionOpen (tls, GNUTLS_SERVER, sys->x509_cred, fd,
+                                  alpn);
+    if (val == VLC_SUCCESS && sys->ticket_key.data != NULL)
+        /* let clients resume sessions without a server-side cache */
+        gnutls_session_ticket_enable_server (tls->sys, &sys->ticket_key);
+    return val;
 }
 
 static int gnutls_ServerHandshake (vlc_tls_t *tls, const char *host,
@@ -621,6 +794,15 @@ static int OpenServer (vlc_tls_creds_t *crd, const char *cert, const char *key)
                  gnutls_strerror (val));
     }
 
+    /* session tickets are encrypted with a key private to this server */
+    val = gnutls_session_ticket_key_generate (&sys->ticket_key);
+    if (val < 0)
+    {
+        msg_Warn (crd, "cannot generate session ticket key: %s",
+                  gnutls_strerror (val));
+        sys->ticket_key.data = NULL;
+    }
+
     crd->sys = sys;
     crd->open = gnutls_ServerSessionOpen;
     crd->handshake = gnutls_ServerHandshake;
@@ -645,6 +827,7 @@ static void CloseServer (vlc_tls_creds_t *crd)
     /* all sessions depending on the server are now deinitialized */
     gnutls_certificate_free_credentials (sys->x509_cred);
     gnutls_dh_params_deinit (sys->dh_params);
+    gnutls_free (sys->ticket_key.data);
     free (sys);
     gnutls_Deinit ();
 }
@@ -654,6 +837,10 @@ static void CloseServer (vlc_tls_creds_t *crd)
 #define PRIORITIES_LONGTEXT N_("Ciphers, key exchange methods, " \
     "hash functions and compression methods can be selected. " \
     "Refer to GNU TLS documentation for detailed syntax.")
+#define RESUMPTION_TEXT N_("TLS session resumption")
+#define RESUMPTION_LONGTEXT N_("Remember the sessions established with " \
+    "servers, and resume them when connecting again to the same server, " \
+    "which saves most of the TLS handshake.")
 static const char *const priorities_values[] = {
     "PERFORMANCE",
     "NORMAL",
@@ -679,6 +866,8 @@ vlc_module_begin ()
     add_string ("gnutls-priorities", "NORMAL", PRIORITIES_TEXT,
                 PRIORITIES_LONGTEXT, false)
         change_string_list (priorities_values, priorities_text)
+    add_bool ("gnutls-resumption", true, RESUMPTION_TEXT,
+              RESUMPTION_LONGTEXT, true)
 #ifdef ENABLE_SOUT
     add_submodule ()
         set_description( N_("GNU TLS server") )
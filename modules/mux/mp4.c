@@ -767,6 +767,11 @@ static block_t *ConvertFromAnnexB(block_t *p_block)
         return NULL;
     }
 
+    /* start codes are rewritten in place */
+    p_block = block_Writable(p_block);
+    if( !p_block )
+        return NULL;
+
     if(memcmp(p_block->p_buffer, avc1_start_code, 4))
     {
         if(!memcmp(p_block->p_buffer, avc1_short_start_code, 3))
@@ -610,3 +610,499 @@ static void csa_BlockCypher( uint8_t kk[57], uint8_t bd[8], uint8_t ib[8] )
     }
 }
 
+/*****************************************************************************
+ * Batch processing
+ *****************************************************************************
+ * The stream cypher, which is by far the most expensive part, is bitsliced:
+ * every bit of its state is stored in a machine word holding that bit for up
+ * to CSA_BATCH packets, so that all of them are processed at once. The block
+ * cypher is table driven, but the rounds of different packets are
+ * interleaved so that the table lookups do not wait for each other.
+ *****************************************************************************/
+typedef uint64_t csa_slice_t;
+#define CSA_BATCH (8 * sizeof (csa_slice_t))
+
+typedef struct
+{
+    csa_slice_t A[11][4];
+    csa_slice_t B[11][4];
+    csa_slice_t X[4], Y[4], Z[4];
+    csa_slice_t D[4], E[4], F[4];
+    csa_slice_t p, q, r;
+} csa_slices_t;
+
+/* inputs of the s-boxes as (A register, bit), most significant first */
+static const uint8_t sbox_in[7][5][2] =
+{
+    { {4,0}, {1,2}, {6,1}, {7,3}, {9,0} },
+    { {2,1}, {3,2}, {6,3}, {7,0}, {9,1} },
+    { {1,3}, {2,0}, {5,1}, {5,3}, {6,2} },
+    { {3,3}, {1,1}, {2,3}, {4,2}, {8,0} },
+    { {5,2}, {4,3}, {6,0}, {8,1}, {9,2} },
+    { {3,1}, {4,1}, {5,0}, {7,2}, {9,3} },
+    { {2,2}, {3,0}, {7,1}, {8,2}, {8,3} },
+};
+
+/* sbox1..sbox7 as truth tables, for output bit 0 and 1 */
+static const uint32_t sbox_tt[7][2] =
+{
+    { 0x78c6b16c, 0x4b368771 },
+    { 0xe41b4b63, 0x58b98679 },
+    { 0xe41b1be4, 0x69d25879 },
+    { 0x92ad994b, 0x66b492ad },
+    { 0x35e29e58, 0x9c274cf1 },
+    { 0x66d2e61a, 0x691bb46c },
+    { 0x266d9d92, 0xb38c691e },
+};
+
+/* Evaluates a 5 to 1 bit function given by its truth table */
+static inline csa_slice_t csa_SlicedSbox( uint32_t tt, const csa_slice_t x[5] )
+{
+    csa_slice_t v[16];
+
+    for( int i = 0; i < 16; i++ )
+    {
+        switch( (tt >> (2 * i)) & 3 )
+        {
+            case 0: v[i] = 0;                   break;
+            case 1: v[i] = ~x[0];               break;
+            case 2: v[i] = x[0];                break;
+            case 3: v[i] = ~(csa_slice_t)0;     break;
+        }
+    }
+
+    for( int b = 1, n = 8; b < 5; b++, n /= 2 )
+        for( int i = 0; i < n; i++ )
+            v[i] = v[2*i] ^ ((v[2*i] ^ v[2*i+1]) & x[b]);
+
+    return v[0];
+}
+
+static void csa_SlicedInit( csa_slices_t *s, const uint8_t ck[8] )
+{
+    memset( s, 0, sizeof( *s ) );
+
+    for( int i = 0; i < 4; i++ )
+        for( int k = 0; k < 4; k++ )
+        {
+            s->A[1+2*i][k] = -(csa_slice_t)(( ck[i] >> (4 + k) )&1);
+            s->A[2+2*i][k] = -(csa_slice_t)(( ck[i] >> k )&1);
+            s->B[1+2*i][k] = -(csa_slice_t)(( ck[4+i] >> (4 + k) )&1);
+            s->B[2+2*i][k] = -(csa_slice_t)(( ck[4+i] >> k )&1);
+        }
+}
+
+/* One iteration of csa_StreamCypher() inner loop, producing 2 bits */
+static void csa_SlicedStep( csa_slices_t *s,
+                            const csa_slice_t *in_a, const csa_slice_t *in_b,
+                            csa_slice_t *hi, csa_slice_t *lo )
+{
+    csa_slice_t sb[7][2];
+
+    for( int i = 0; i < 7; i++ )
+    {
+        csa_slice_t x[5];
+
+        for( int k = 0; k < 5; k++ )
+            x[4-k] = s->A[sbox_in[i][k][0]][sbox_in[i][k][1]];
+        sb[i][0] = csa_SlicedSbox( sbox_tt[i][0], x );
+        sb[i][1] = csa_SlicedSbox( sbox_tt[i][1], x );
+    }
+
+    /* 4x4 xor to produce the extra nibble for T3 */
+    csa_slice_t extra[4];
+    extra[3] = s->B[3][0] ^ s->B[6][1] ^ s->B[7][2] ^ s->B[9][3];
+    extra[2] = s->B[6][0] ^ s->B[8][1] ^ s->B[3][3] ^ s->B[4][2];
+    extra[1] = s->B[5][3] ^ s->B[8][2] ^ s->B[4][0] ^ s->B[5][1];
+    extra[0] = s->B[9][2] ^ s->B[6][3] ^ s->B[3][1] ^ s->B[8][0];
+
+    /* T1 and T2 */
+    csa_slice_t next_A1[4], next_B1[4], rot_B1[4];
+    for( int k = 0; k < 4; k++ )
+    {
+        next_A1[k] = s->A[10][k] ^ s->X[k];
+        next_B1[k] = s->B[7][k] ^ s->B[10][k] ^ s->Y[k];
+        if( in_a != NULL )
+        {
+            next_A1[k] ^= s->D[k] ^ in_a[k];
+            next_B1[k] ^= in_b[k];
+        }
+    }
+    for( int k = 0; k < 4; k++ )
+        rot_B1[k] = next_B1[(k + 3) & 3];
+    for( int k = 0; k < 4; k++ )
+        next_B1[k] ^= (next_B1[k] ^ rot_B1[k]) & s->p;
+
+    /* T3, and T4 as a ripple carry adder */
+    csa_slice_t carry = s->r;
+    for( int k = 0; k < 4; k++ )
+    {
+        const csa_slice_t z_e = s->Z[k] ^ s->E[k];
+        const csa_slice_t sum = z_e ^ carry;
+        const csa_slice_t next_F = s->E[k] ^ ((s->E[k] ^ sum) & s->q);
+
+        carry = (s->Z[k] & s->E[k]) | (carry & z_e);
+        s->D[k] = z_e ^ extra[k];
+        s->E[k] = s->F[k];
+        s->F[k] = next_F;
+    }
+    s->r ^= (s->r ^ carry) & s->q;
+
+    memmove( &s->A[2], &s->A[1], 9 * sizeof( s->A[0] ) );
+    memmove( &s->B[2], &s->B[1], 9 * sizeof( s->B[0] ) );
+    memcpy( s->A[1], next_A1, sizeof( next_A1 ) );
+    memcpy( s->B[1], next_B1, sizeof( next_B1 ) );
+
+    s->X[3] = sb[3][0]; s->X[2] = sb[2][0]; s->X[1] = sb[1][1]; s->X[0] = sb[0][1];
+    s->Y[3] = sb[5][0]; s->Y[2] = sb[4][0]; s->Y[1] = sb[3][1]; s->Y[0] = sb[2][1];
+    s->Z[3] = sb[1][0]; s->Z[2] = sb[0][0]; s->Z[1] = sb[5][1]; s->Z[0] = sb[4][1];
+    s->p = sb[6][1];
+    s->q = sb[6][0];
+
+    *hi = s->D[2] ^ s->D[3];
+    *lo = s->D[0] ^ s->D[1];
+}
+
+/* Runs the stream cypher over 8 bytes. Bit b of byte i is found in
+ * slices[8*i+b]. During initialisation (sb != NULL), nothing is output. */
+static void csa_SlicedStream( csa_slices_t *s,
+                              const csa_slice_t *sb, csa_slice_t *cb )
+{
+    for( int i = 0; i < 8; i++ )
+    {
+        /* high and low nibbles of the input byte */
+        const csa_slice_t *in1 = sb ? &sb[8*i+4] : NULL;
+        const csa_slice_t *in2 = sb ? &sb[8*i] : NULL;
+
+        for( int j = 0; j < 4; j++ )
+        {
+            csa_slice_t hi, lo;
+
+            csa_SlicedStep( s, (j % 2) ? in2 : in1, (j % 2) ? in1 : in2,
+                            &hi, &lo );
+            if( cb != NULL )
+            {
+                cb[8*i+7-2*j] = hi;
+                cb[8*i+6-2*j] = lo;
+            }
+        }
+    }
+}
+
+static void csa_Slice( csa_slice_t sl[64], uint8_t *const *blocks, unsigned n )
+{
+    memset( sl, 0, 64 * sizeof( *sl ) );
+
+    for( unsigned l = 0; l < n; l++ )
+        for( int i = 0; i < 8; i++ )
+            for( unsigned v = blocks[l][i], b = 0; v != 0; v >>= 1, b++ )
+                if( v & 1 )
+                    sl[8*i+b] |= (csa_slice_t)1 << l;
+}
+
+static void csa_Unslice( const csa_slice_t sl[64], unsigned l, uint8_t out[8] )
+{
+    for( int i = 0; i < 8; i++ )
+    {
+        out[i] = 0;
+        for( int b = 0; b < 8; b++ )
+            out[i] |= ((sl[8*i+b] >> l) & 1) << b;
+    }
+}
+
+static int csa_HeaderSize( const uint8_t *pkt )
+{
+    /* skip adaption field */
+    return ( pkt[3]&0x20 ) ? 5 + pkt[4] : 4;
+}
+
+/* csa_BlockDecypher() on several blocks at once: the rounds of a block
+ * depend on each other, those of different packets do not. */
+static void csa_BlockDecypherBatch( const uint8_t kk[57],
+                                    uint8_t (*ib)[8], uint8_t (*bd)[8],
+                                    unsigned count )
+{
+    uint8_t R[CSA_BATCH][8];
+
+    memcpy( R, ib, 8 * count );
+
+    // loop over kk[56]..kk[1]
+    for( int i = 56; i > 0; i-- )
+        for( unsigned l = 0; l < count; l++ )
+        {
+            uint8_t *r = R[l];
+            const uint8_t sbox_out = block_sbox[ kk[i]^r[6] ];
+            const uint8_t next_R1 = r[7] ^ sbox_out;
+
+            r[7] = r[6];
+            r[6] = r[5] ^ block_perm[sbox_out];
+            r[5] = r[4];
+            r[4] = r[3] ^ next_R1;
+            r[3] = r[2] ^ next_R1;
+            r[2] = r[1] ^ next_R1;
+            r[1] = r[0];
+            r[0] = next_R1;
+        }
+
+    memcpy( bd, R, 8 * count );
+}
+
+/* csa_BlockCypher() on several blocks at once */
+static void csa_BlockCypherBatch( const uint8_t kk[57],
+                                  uint8_t (*bd)[8], uint8_t (*ib)[8],
+                                  unsigned count )
+{
+    uint8_t R[CSA_BATCH][8];
+
+    memcpy( R, bd, 8 * count );
+
+    // loop over kk[1]..kk[56]
+    for( int i = 1; i <= 56; i++ )
+        for( unsigned l = 0; l < count; l++ )
+        {
+            uint8_t *r = R[l];
+            const uint8_t sbox_out = block_sbox[ kk[i]^r[7] ];
+            const uint8_t next_R1 = r[1];
+
+            r[1] = r[2] ^ r[0];
+            r[2] = r[3] ^ r[0];
+            r[3] = r[4] ^ r[0];
+            r[4] = r[5];
+            r[5] = r[6] ^ block_perm[sbox_out];
+            r[6] = r[7];
+            r[7] = r[0] ^ sbox_out;
+            r[0] = next_R1;
+        }
+
+    memcpy( ib, R, 8 * count );
+}
+
+/* Decrypts packets sharing the same key, with at least one full block */
+static void csa_SlicedDecrypt( csa_t *c, uint8_t *const *pkts, unsigned count,
+                               int i_pkt_size, bool odd )
+{
+    uint8_t *ck = odd ? c->o_ck : c->e_ck;
+    uint8_t *kk = odd ? c->o_kk : c->e_kk;
+
+    uint8_t *payload[CSA_BATCH];
+    uint8_t  ib[CSA_BATCH][8], block[CSA_BATCH][8];
+    int      n[CSA_BATCH], i_residue[CSA_BATCH];
+    int      i_last = 0, i_stream = 0;
+
+    csa_slices_t s;
+    csa_slice_t  sl[64];
+
+    for( unsigned l = 0; l < count; l++ )
+    {
+        const int i_hdr = csa_HeaderSize( pkts[l] );
+
+        payload[l] = &pkts[l][i_hdr];
+        n[l] = (i_pkt_size - i_hdr) / 8;
+        i_residue[l] = (i_pkt_size - i_hdr) % 8;
+        memcpy( ib[l], payload[l], 8 );
+
+        i_last = __MAX( i_last, n[l] );
+        i_stream = __MAX( i_stream, i_residue[l] > 0 ? n[l] : n[l] - 1 );
+    }
+
+    /* init csa state */
+    csa_SlicedInit( &s, ck );
+    csa_Slice( sl, payload, count );
+    csa_SlicedStream( &s, sl, NULL );
+
+    for( int i = 1; i <= i_last; i++ )
+    {
+        /* packets already done are decyphered too, and ignored */
+        csa_BlockDecypherBatch( kk, ib, block, count );
+        if( i <= i_stream )
+            csa_SlicedStream( &s, NULL, sl );
+
+        for( unsigned l = 0; l < count; l++ )
+        {
+            uint8_t *p = payload[l];
+            uint8_t  stream[8];
+
+            if( i > n[l] )
+                continue;
+
+            if( i != n[l] )
+            {
+                csa_Unslice( sl, l, stream );
+                for( int j = 0; j < 8; j++ )
+                {
+                    /* xor ib with stream */
+                    ib[l][j] = p[8*i+j] ^ stream[j];
+                    p[8*(i-1)+j] = ib[l][j] ^ block[l][j];
+                }
+            }
+            else
+            {
+                /* last block */
+                memcpy( &p[8*(i-1)], block[l], 8 );
+
+                if( i_residue[l] > 0 )
+                {
+                    csa_Unslice( sl, l, stream );
+                    for( int j = 0; j < i_residue[l]; j++ )
+                        pkts[l][i_pkt_size - i_residue[l] + j] ^= stream[j];
+                }
+            }
+        }
+    }
+}
+
+/* Encrypts packets with at least one full block */
+static void csa_SlicedEncrypt( csa_t *c, uint8_t *const *pkts, unsigned count,
+                               int i_pkt_size )
+{
+    uint8_t *ck = c->use_odd ? c->o_ck : c->e_ck;
+    uint8_t *kk = c->use_odd ? c->o_kk : c->e_kk;
+
+    uint8_t *payload[CSA_BATCH];
+    uint8_t  ib[CSA_BATCH][8], block[CSA_BATCH][8];
+    int      n[CSA_BATCH], i_residue[CSA_BATCH];
+    int      i_last = 0, i_stream = 0;
+
+    csa_slices_t s;
+    csa_slice_t  sl[64];
+
+    for( unsigned l = 0; l < count; l++ )
+    {
+        const int i_hdr = csa_HeaderSize( pkts[l] );
+
+        payload[l] = &pkts[l][i_hdr];
+        n[l] = (i_pkt_size - i_hdr) / 8;
+        i_residue[l] = (i_pkt_size - i_hdr) % 8;
+        memset( ib[l], 0, 8 );
+
+        i_last = __MAX( i_last, n[l] );
+        i_stream = __MAX( i_stream, i_residue[l] > 0 ? n[l] : n[l] - 1 );
+    }
+
+    /* chain the block cypher backwards, in place */
+    for( int i = i_last; i > 0; i-- )
+    {
+        for( unsigned l = 0; l < count; l++ )
+            for( int j = 0; j < 8; j++ )
+                block[l][j] = i <= n[l] ? payload[l][8*(i-1)+j] ^ ib[l][j] : 0;
+
+        csa_BlockCypherBatch( kk, block, ib, count );
+
+        for( unsigned l = 0; l < count; l++ )
+        {
+            if( i <= n[l] )
+                memcpy( &payload[l][8*(i-1)], ib[l], 8 );
+            else
+                memset( ib[l], 0, 8 );
+        }
+    }
+
+    /* init csa state */
+    csa_SlicedInit( &s, ck );
+    csa_Slice( sl, payload, count );
+    csa_SlicedStream( &s, sl, NULL );
+
+    for( int i = 1; i <= i_stream; i++ )
+    {
+        csa_SlicedStream( &s, NULL, sl );
+
+        for( unsigned l = 0; l < count; l++ )
+        {
+            uint8_t stream[8];
+
+            if( i < n[l] )
+            {
+                csa_Unslice( sl, l, stream );
+                for( int j = 0; j < 8; j++ )
+                    payload[l][8*i+j] ^= stream[j];
+            }
+            else if( i == n[l] && i_residue[l] > 0 )
+            {
+                csa_Unslice( sl, l, stream );
+                for( int j = 0; j < i_residue[l]; j++ )
+                    pkts[l][i_pkt_size - i_residue[l] + j] ^= stream[j];
+            }
+        }
+    }
+}
+
+/*****************************************************************************
+ * csa_DecryptBatch:
+ *****************************************************************************
+ * Same as calling csa_Decrypt() on each packet in turn.
+ *****************************************************************************/
+void csa_DecryptBatch( csa_t *c, uint8_t *const *pkts, unsigned count,
+                       int i_pkt_size )
+{
+    uint8_t *lanes[2][CSA_BATCH];
+    unsigned n[2] = { 0, 0 };
+
+    for( unsigned i = 0; i < count; i++ )
+    {
+        uint8_t *pkt = pkts[i];
+
+        /* transport scrambling control */
+        if( (pkt[3]&0x80) == 0 )
+            continue;
+
+        const int i_hdr = csa_HeaderSize( pkt );
+        if( 188 - i_hdr < 8 || i_pkt_size - i_hdr < 8 )
+        {
+            /* corner cases are left to the reference implementation */
+            csa_Decrypt( c, pkt, i_pkt_size );
+            continue;
+        }
+
+        const bool odd = pkt[3]&0x40;
+
+        /* clear transport scrambling control */
+        pkt[3] &= 0x3f;
+
+        lanes[odd][n[odd]++] = pkt;
+        if( n[odd] == CSA_BATCH )
+        {
+            csa_SlicedDecrypt( c, lanes[odd], n[odd], i_pkt_size, odd );
+            n[odd] = 0;
+        }
+    }
+
+    for( int odd = 0; odd < 2; odd++ )
+        if( n[odd] > 0 )
+            csa_SlicedDecrypt( c, lanes[odd], n[odd], i_pkt_size, odd );
+}
+
+/*****************************************************************************
+ * csa_EncryptBatch:
+ *****************************************************************************
+ * Same as calling csa_Encrypt() on each packet in turn.
+ *****************************************************************************/
+void csa_EncryptBatch( csa_t *c, uint8_t *const *pkts, unsigned count,
+                       int i_pkt_size )
+{
+    uint8_t *lanes[CSA_BATCH];
+    unsigned n = 0;
+
+    for( unsigned i = 0; i < count; i++ )
+    {
+        uint8_t *pkt = pkts[i];
+
+        if( i_pkt_size - csa_HeaderSize( pkt ) < 8 )
+        {
+            csa_Encrypt( c, pkt, i_pkt_size );
+            continue;
+        }
+
+        /* set transport scrambling control */
+        pkt[3] |= c->use_odd ? 0xc0 : 0x80;
+
+        lanes[n++] = pkt;
+        if( n == CSA_BATCH )
+        {
+            csa_SlicedEncrypt( c, lanes, n, i_pkt_size );
+            n = 0;
+        }
+    }
+
+    if( n > 0 )
+        csa_SlicedEncrypt( c, lanes, n, i_pkt_size );
+}
@@ -1781,30 +1781,50 @@ static void TSDate( sout_mux_t *p_mux, sout_buffer_chain_t *p_chain_ts,
     }
 
     /* msg_Dbg( p_mux, "real pck=%d", i_packet_count ); */
-    for (int i = 0; i < i_packet_count; i++ )
+    for (int i = 0; i < i_packet_count; )
     {
-        block_t *p_ts = BufferChainGet( p_chain_ts );
-        mtime_t i_new_dts = i_pcr_dts + i_pcr_length * i / i_packet_count;
+        /* packets are scrambled in batches, which is much faster */
+        block_t *pp_ts[64];
+        uint8_t *pp_scrambled[64];
+        int i_count = __MIN( i_packet_count - i, 64 );
+        unsigned i_scrambled = 0;
 
-        p_ts->i_dts    = i_new_dts;
-        p_ts->i_length = i_pcr_length / i_packet_count;
-
-        if( p_ts->i_flags & BLOCK_FLAG_CLOCK )
+        for( int j = 0; j < i_count; j++ )
         {
-            /* msg_Dbg( p_mux, "pcr=%lld ms", p_ts->i_dts / 1000 ); */
-            TSSetPCR( p_ts, p_ts->i_dts - p_sys->i_dts_delay - p_sys->first_dts );
+            block_t *p_ts = BufferChainGet( p_chain_ts );
+            mtime_t i_new_dts = i_pcr_dts + i_pcr_length * (i + j) / i_packet_count;
+
+            p_ts->i_dts    = i_new_dts;
+            p_ts->i_length = i_pcr_length / i_packet_count;
+
+            if( p_ts->i_flags & BLOCK_FLAG_CLOCK )
+            {
+                /* msg_Dbg( p_mux, "pcr=%lld ms", p_ts->i_dts / 1000 ); */
+                TSSetPCR( p_ts, p_ts->i_dts - p_sys->i_dts_delay - p_sys->first_dts );
+            }
+            if( p_ts->i_flags & BLOCK_FLAG_SCRAMBLED )
+                pp_scrambled[i_scrambled++] = p_ts->p_buffer;
+            pp_ts[j] = p_ts;
         }
-        if( p_ts->i_flags & BLOCK_FLAG_SCRAMBLED )
+
+        if( i_scrambled > 0 )
         {
             vlc_mutex_lock( &p_sys->csa_lock );
-            csa_Encrypt( p_sys->csa, p_ts->p_buffer, p_sys->i_csa_pkt_size );
+            csa_EncryptBatch( p_sys->csa, pp_scrambled, i_scrambled,
+                              p_sys->i_csa_pkt_size );
             vlc_mutex_unlock( &p_sys->csa_lock );
         }
 
-        /* latency */
-        p_ts->i_dts += p_sys->i_shaping_delay * 3 / 2;
+        for( int j = 0; j < i_count; j++ )
+        {
+            block_t *p_ts = pp_ts[j];
+
+            /* latency */
+            p_ts->i_dts += p_sys->i_shaping_delay * 3 / 2;
 
-        sout_AccessOutWrite( p_mux->p_access, p_ts );
+            sout_AccessOutWrite( p_mux->p_access, p_ts );
+        }
+        i += i_count;
     }
 }
 
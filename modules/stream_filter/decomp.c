@@ -22,34 +22,62 @@
 # include "config.h"
 #endif
 
+/* Formats with a library are decompressed in-process, the other ones by an
+ * external program, but on Windows */
+#if defined (HAVE_ZLIB_H) || defined (HAVE_LIBBZ2) || defined (HAVE_LIBLZMA)
+# define DECOMP_LIBRARY 1
+#endif
+#if !defined (_WIN32) && \
+    (!defined (HAVE_ZLIB_H) || !defined (HAVE_LIBBZ2) || !defined (HAVE_LIBLZMA))
+# define DECOMP_PROGRAM 1
+#endif
+
 #include <vlc_common.h>
 #include <vlc_plugin.h>
 #include <vlc_stream.h>
-#include <vlc_network.h>
-#include <vlc_fs.h>
 #include <assert.h>
-#include <unistd.h>
-#include <errno.h>
-#ifndef _POSIX_SPAWN
-# define _POSIX_SPAWN (-1)
+#ifdef DECOMP_PROGRAM
+# include <vlc_network.h>
+# include <vlc_fs.h>
+# include <unistd.h>
+# include <errno.h>
+# ifndef _POSIX_SPAWN
+#  define _POSIX_SPAWN (-1)
+# endif
+# include <fcntl.h>
+# if (_POSIX_SPAWN >= 0)
+#  include <spawn.h>
+# endif
+# include <sys/wait.h>
+# include <sys/ioctl.h>
+# if defined (__linux__) && defined (HAVE_VMSPLICE)
+#  include <sys/uio.h>
+#  include <sys/mman.h>
+# else
+#  undef HAVE_VMSPLICE
+# endif
 #endif
-#include <fcntl.h>
-#if (_POSIX_SPAWN >= 0)
-# include <spawn.h>
+#ifdef HAVE_ZLIB_H
+# include <zlib.h>
 #endif
-#include <sys/wait.h>
-#include <sys/ioctl.h>
-#if defined (__linux__) && defined (HAVE_VMSPLICE)
-# include <sys/uio.h>
-# include <sys/mman.h>
-#else
-# undef HAVE_VMSPLICE
+#ifdef HAVE_LIBBZ2
+# include <bzlib.h>
+#endif
+#ifdef HAVE_LIBLZMA
+# include <lzma.h>
 #endif
 
 static int  OpenGzip (vlc_object_t *);
 static int  OpenBzip2 (vlc_object_t *);
 static int  OpenXZ (vlc_object_t *);
+#ifdef DECOMP_PROGRAM
 static void Close (vlc_object_t *);
+#else
+# define Close NULL /* the formats without library are not supported */
+#endif
+#ifdef DECOMP_LIBRARY
+static void CloseDecoder (vlc_object_t *);
+#endif
 
 vlc_module_begin ()
     set_category (CAT_INPUT)
@@ -57,22 +85,52 @@ vlc_module_begin ()
     set_capability ("stream_filter", 20)
 
     set_description (N_("LZMA decompression"))
+#ifdef HAVE_LIBLZMA
+    set_callbacks (OpenXZ, CloseDecoder)
+#else
     set_callbacks (OpenXZ, Close)
+#endif
 
     add_submodule ()
     set_description (N_("Burrows-Wheeler decompression"))
+#ifdef HAVE_LIBBZ2
+    set_callbacks (OpenBzip2, CloseDecoder)
+#else
     set_callbacks (OpenBzip2, Close)
+#endif
     /* TODO: access shortnames for stream_UrlNew() */
 
     add_submodule ()
     set_description (N_("gzip decompression"))
+#ifdef HAVE_ZLIB_H
+    set_callbacks (OpenGzip, CloseDecoder)
+#else
     set_callbacks (OpenGzip, Close)
+#endif
 vlc_module_end ()
 
+/**
+ * Point of the decompressed stream where decoding can resume.
+ */
+typedef struct
+{
+    uint64_t in;          /**< compressed offset */
+    uint64_t out;         /**< decompressed offset */
+    unsigned bits;        /**< bits of the compressed byte before, if any */
+    uint8_t *window;      /**< history, or NULL at the start of a stream */
+    unsigned window_size;
+    bool     in_stream;   /**< xz: at a block header, past the stream one */
+    unsigned check;       /**< xz: integrity check type of that stream */
+} seek_point_t;
+
+struct decoder_ops;
+
 struct stream_sys_t
 {
+#ifdef DECOMP_PROGRAM
     /* Thread data */
     int          write_fd;
+#endif
 
     /* Shared data */
     vlc_cond_t   wait;
@@ -81,20 +139,51 @@ struct stream_sys_t
 
     /* Caller data */
     vlc_thread_t thread;
+#ifdef DECOMP_PROGRAM
     pid_t        pid;
+#endif
 
     uint64_t     offset;
     block_t      *peeked;
 
+#ifdef DECOMP_PROGRAM
     int          read_fd;
+#endif
     bool         can_pace;
     bool         can_pause;
     int64_t      pts_delay;
+
+    /* In-process decoding, shared data */
+    vlc_cond_t   wait_data;
+    block_t     *queue;
+    block_t    **queue_last;
+    size_t       queued;
+    uint64_t     seek; /**< pending seek target, or UINT64_MAX */
+    uint64_t     size; /**< decompressed size, 0 until known */
+    bool         eof;
+    bool         dead;
+    bool         can_seek;
+
+    /* In-process decoding, thread data */
+    const struct decoder_ops *ops;
+    void        *codec;
+    uint8_t     *in_buf;
+    const uint8_t *in_next;
+    size_t       in_avail;
+    uint64_t     in_pos; /**< compressed offset of the end of in_buf */
+    uint64_t     out_pos; /**< decompressed offset of the next output */
+    uint64_t     skip; /**< decompressed bytes to discard */
+    int          status;
+    int          canc; /**< cancellation state outside of source reads */
+    seek_point_t *points;
+    size_t       point_count;
 };
 
+static const size_t bufsize = 65536;
+
+#ifdef DECOMP_PROGRAM
 extern char **environ;
 
-static const size_t bufsize = 65536;
 #ifdef HAVE_VMSPLICE
 static void cleanup_mmap (void *addr)
 {
@@ -443,7 +532,1050 @@ static void Close (vlc_object_t *obj)
     vlc_cond_destroy (&p_sys->wait);
     free (p_sys);
 }
+#endif /* DECOMP_PROGRAM */
+
+/* The probes also find the streams concatenated after the first one */
+static bool ProbeGzip (const uint8_t *peek, int len)
+{
+    return len >= 3 && !memcmp (peek, "\x1f\x8b\x08", 3);
+}
+
+static bool ProbeBzip2 (const uint8_t *peek, int len)
+{
+    /* (Try to) parse the bzip2 header */
+    return len >= 10 && !memcmp (peek, "BZh", 3)
+        && (peek[3] >= '1') && (peek[3] <= '9')
+        && !memcmp (peek + 4, "\x31\x41\x59\x26\x53\x59", 6);
+}
+
+static bool ProbeXZ (const uint8_t *peek, int len)
+{
+    /* (Try to) parse the xz stream header */
+    return len >= 6 && !memcmp (peek, "\xfd\x37\x7a\x58\x5a", 6);
+}
+
+#ifdef DECOMP_LIBRARY
+/* Decompressed data ahead of the reader */
+#define QUEUE_SIZE (1 << 21)
+#define BLOCK_SIZE (1 << 16)
+/* Decompressed distance between two seek points within a gzip member */
+#define SEEK_SPAN  (1 << 22)
+#define PROBE_SIZE 10
+
+enum
+{
+    DECODE_OK,
+    DECODE_END, /**< end of the compressed stream */
+    DECODE_ERROR,
+};
+
+/**
+ * Decompression library callbacks.
+ * They run on the decoder thread, and read from the input buffer with Fill().
+ */
+struct decoder_ops
+{
+    bool (*probe) (const uint8_t *, int);
+    int  (*init) (stream_t *);
+    /* restarts at a seek point, or at a new stream if NULL */
+    int  (*reset) (stream_t *, const seek_point_t *);
+    /* decompresses up to *len bytes and updates out_pos and *len */
+    int  (*decode) (stream_t *, uint8_t *, size_t *);
+    void (*end) (stream_t *);
+};
+
+/**
+ * Ensures that at least some compressed bytes are buffered, if possible.
+ * @return the number of buffered bytes
+ */
+static size_t Fill (stream_t *stream, size_t min)
+{
+    stream_sys_t *sys = stream->p_sys;
+
+    if (sys->in_avail >= min)
+        return sys->in_avail;
+
+    memmove (sys->in_buf, sys->in_next, sys->in_avail);
+    sys->in_next = sys->in_buf;
+    while (sys->in_avail < min)
+    {
+        /* The source may block on the network: CloseDecoder() cancels the
+         * thread there, where it holds no lock. */
+        vlc_restorecancel (sys->canc);
+        int val = stream_Read (stream->p_source, sys->in_buf + sys->in_avail,
+                               bufsize - sys->in_avail);
+        sys->canc = vlc_savecancel ();
+        if (val <= 0)
+            break;
+        sys->in_avail += val;
+        sys->in_pos += val;
+    }
+    return sys->in_avail;
+}
+
+/**
+ * Gets more compressed data for the decompressor, which needs some.
+ */
+static bool Refill (stream_t *stream)
+{
+    if (Fill (stream, 1) > 0)
+        return true;
+    msg_Err (stream, "unexpected end of compressed stream");
+    return false;
+}
+
+static void Consume (stream_t *stream, size_t len)
+{
+    stream_sys_t *sys = stream->p_sys;
+
+    assert (len <= sys->in_avail);
+    sys->in_next += len;
+    sys->in_avail -= len;
+}
+
+/**
+ * Records a seek point at the current decompressed offset, unless the
+ * index already covers it. The window is owned by the index then.
+ * @return whether the point was recorded
+ */
+static bool AddPoint (stream_t *stream, uint64_t in, unsigned bits,
+                      uint8_t *window, unsigned window_size)
+{
+    stream_sys_t *sys = stream->p_sys;
+    seek_point_t *points = sys->points;
+
+    if (sys->out_pos <= points[sys->point_count - 1].out)
+        goto drop;
+
+    points = realloc (points, (sys->point_count + 1) * sizeof (*points));
+    if (unlikely(points == NULL))
+        goto drop;
+
+    sys->points = points;
+    points[sys->point_count++] = (seek_point_t){
+        .in = in, .out = sys->out_pos, .bits = bits,
+        .window = window, .window_size = window_size,
+    };
+    return true;
+drop:
+    free (window);
+    return false;
+}
+
+static const seek_point_t *LastPoint (stream_sys_t *sys)
+{
+    return &sys->points[sys->point_count - 1];
+}
+
+/**
+ * Finds the last seek point before a decompressed offset.
+ */
+static const seek_point_t *FindPoint (stream_sys_t *sys, uint64_t offset)
+{
+    size_t low = 0, high = sys->point_count;
+
+    /* the first point is always at the start */
+    while (high - low > 1)
+    {
+        size_t mid = (low + high) / 2;
+
+        if (sys->points[mid].out <= offset)
+            low = mid;
+        else
+            high = mid;
+    }
+    return &sys->points[low];
+}
+
+#ifdef HAVE_ZLIB_H
+struct gzip
+{
+    z_stream z;
+    bool     raw; /**< resumed from a seek point, without member header */
+};
+
+static int GzipInit (stream_t *stream)
+{
+    struct gzip *gz = calloc (1, sizeof (*gz));
+    if (unlikely(gz == NULL))
+        return VLC_ENOMEM;
+
+    if (inflateInit2 (&gz->z, MAX_WBITS + 16) != Z_OK)
+    {
+        free (gz);
+        return VLC_EGENERIC;
+    }
+    stream->p_sys->codec = gz;
+    return VLC_SUCCESS;
+}
+
+static int GzipReset (stream_t *stream, const seek_point_t *point)
+{
+    stream_sys_t *sys = stream->p_sys;
+    struct gzip *gz = sys->codec;
+
+    gz->raw = point != NULL && point->window != NULL;
+    if (!gz->raw)
+        return inflateReset2 (&gz->z, MAX_WBITS + 16) == Z_OK
+               ? VLC_SUCCESS : VLC_EGENERIC;
+
+    if (inflateReset2 (&gz->z, -MAX_WBITS) != Z_OK)
+        return VLC_EGENERIC;
+    if (point->bits > 0)
+    {   /* the deflate block started within that byte */
+        if (Fill (stream, 1) < 1)
+            return VLC_EGENERIC;
+        inflatePrime (&gz->z, point->bits,
+                      sys->in_next[0] >> (8 - point->bits));
+        Consume (stream, 1);
+    }
+    return inflateSetDictionary (&gz->z, point->window, point->window_size)
+           == Z_OK ? VLC_SUCCESS : VLC_EGENERIC;
+}
+
+static void GzipIndex (stream_t *stream)
+{
+    stream_sys_t *sys = stream->p_sys;
+    struct gzip *gz = sys->codec;
+    uInt size = 32768;
+    uint8_t *window = malloc (size);
+
+    if (unlikely(window == NULL))
+        return;
+    inflateGetDictionary (&gz->z, window, &size);
+    AddPoint (stream, sys->in_pos - sys->in_avail, gz->z.data_type & 7,
+              window, size);
+}
+
+static int GzipDecode (stream_t *stream, uint8_t *buf, size_t *len)
+{
+    stream_sys_t *sys = stream->p_sys;
+    struct gzip *gz = sys->codec;
+    z_stream *z = &gz->z;
+    int ret = DECODE_OK;
+
+    z->next_out = buf;
+    z->avail_out = *len;
+    while (z->avail_out > 0)
+    {
+        if (sys->in_avail == 0 && !Refill (stream))
+        {
+            ret = DECODE_ERROR;
+            break;
+        }
+
+        uInt avail_out = z->avail_out;
+        z->next_in = (Bytef *)sys->in_next;
+        z->avail_in = sys->in_avail;
+        /* stop at the end of each deflate block */
+        int val = inflate (z, Z_BLOCK);
+        Consume (stream, sys->in_avail - z->avail_in);
+        sys->out_pos += avail_out - z->avail_out;
+
+        if (val == Z_STREAM_END)
+        {
+            /* without the header, zlib does not check the trailer either */
+            if (gz->raw)
+            {
+                if (Fill (stream, 8) < 8)
+                    ret = DECODE_ERROR;
+                else
+                    Consume (stream, 8);
+            }
+            if (ret == DECODE_OK)
+                ret = DECODE_END;
+            break;
+        }
+        if (val != Z_OK)
+        {
+            msg_Err (stream, "corrupt gzip stream: %s",
+                     (z->msg != NULL) ? z->msg : "unknown error");
+            ret = DECODE_ERROR;
+            break;
+        }
+
+        /* Deflate blocks can start anywhere in a byte and refer to up to 32
+         * KiB of earlier data: keep both for the seek points */
+        if ((z->data_type & 128) && !(z->data_type & 64)
+         && sys->out_pos >= LastPoint (sys)->out + SEEK_SPAN)
+            GzipIndex (stream);
+    }
+    *len -= z->avail_out;
+    return ret;
+}
+
+static void GzipEnd (stream_t *stream)
+{
+    struct gzip *gz = stream->p_sys->codec;
+
+    inflateEnd (&gz->z);
+    free (gz);
+}
+
+static const struct decoder_ops gzip_ops = {
+    ProbeGzip, GzipInit, GzipReset, GzipDecode, GzipEnd,
+};
+#endif
+
+#ifdef HAVE_LIBBZ2
+static int Bzip2Init (stream_t *stream)
+{
+    bz_stream *bz = calloc (1, sizeof (*bz));
+    if (unlikely(bz == NULL))
+        return VLC_ENOMEM;
+
+    if (BZ2_bzDecompressInit (bz, 0, 0) != BZ_OK)
+    {
+        free (bz);
+        return VLC_EGENERIC;
+    }
+    stream->p_sys->codec = bz;
+    return VLC_SUCCESS;
+}
+
+static int Bzip2Reset (stream_t *stream, const seek_point_t *point)
+{
+    bz_stream *bz = stream->p_sys->codec;
+
+    assert (point == NULL || point->window == NULL);
+    (void) point;
+    BZ2_bzDecompressEnd (bz);
+    return BZ2_bzDecompressInit (bz, 0, 0) == BZ_OK
+           ? VLC_SUCCESS : VLC_EGENERIC;
+}
+
+static int Bzip2Decode (stream_t *stream, uint8_t *buf, size_t *len)
+{
+    stream_sys_t *sys = stream->p_sys;
+    bz_stream *bz = sys->codec;
+    int ret = DECODE_OK;
+
+    bz->next_out = (char *)buf;
+    bz->avail_out = *len;
+    while (bz->avail_out > 0)
+    {
+        if (sys->in_avail == 0 && !Refill (stream))
+        {
+            ret = DECODE_ERROR;
+            break;
+        }
+
+        unsigned avail_out = bz->avail_out;
+        bz->next_in = (char *)sys->in_next;
+        bz->avail_in = sys->in_avail;
+        int val = BZ2_bzDecompress (bz);
+        Consume (stream, sys->in_avail - bz->avail_in);
+        sys->out_pos += avail_out - bz->avail_out;
+
+        if (val == BZ_STREAM_END)
+        {
+            ret = DECODE_END;
+            break;
+        }
+        if (val != BZ_OK)
+        {
+            msg_Err (stream, "corrupt bzip2 stream (error %d)", val);
+            ret = DECODE_ERROR;
+            break;
+        }
+    }
+    *len -= bz->avail_out;
+    return ret;
+}
+
+static void Bzip2End (stream_t *stream)
+{
+    bz_stream *bz = stream->p_sys->codec;
+
+    BZ2_bzDecompressEnd (bz);
+    free (bz);
+}
+
+static const struct decoder_ops bzip2_ops = {
+    ProbeBzip2, Bzip2Init, Bzip2Reset, Bzip2Decode, Bzip2End,
+};
+#endif
+
+#ifdef HAVE_LIBLZMA
+/* Blocks are decoded one at a time, rather than with the stream decoder, so
+ * that decoding can resume at the start of any block, given the integrity
+ * check of its stream. */
+enum
+{
+    XZ_STREAM_HEADER,
+    XZ_BLOCK_HEADER,
+    XZ_BLOCK,
+    XZ_INDEX,
+    XZ_STREAM_FOOTER,
+};
+
+struct xz
+{
+    lzma_stream       s;
+    lzma_stream_flags flags;
+    lzma_block        block; /**< used by the block decoder until its end */
+    lzma_filter       filters[LZMA_FILTERS_MAX + 1];
+    lzma_index       *index;
+    int               state;
+};
+
+static int XZInit (stream_t *stream)
+{
+    struct xz *xz = malloc (sizeof (*xz));
+    if (unlikely(xz == NULL))
+        return VLC_ENOMEM;
+
+    xz->s = (lzma_stream)LZMA_STREAM_INIT;
+    xz->index = NULL;
+    xz->state = XZ_STREAM_HEADER;
+    stream->p_sys->codec = xz;
+    return VLC_SUCCESS;
+}
+
+static int XZReset (stream_t *stream, const seek_point_t *point)
+{
+    struct xz *xz = stream->p_sys->codec;
+
+    assert (point == NULL || point->window == NULL);
+    if (point != NULL && point->in_stream)
+    {   /* at a block header */
+        xz->flags = (lzma_stream_flags){
+            .version = 0, .check = point->check,
+            .backward_size = LZMA_VLI_UNKNOWN,
+        };
+        xz->state = XZ_BLOCK_HEADER;
+    }
+    else
+        xz->state = XZ_STREAM_HEADER;
+    return VLC_SUCCESS;
+}
+
+static int XZStreamHeader (stream_t *stream)
+{
+    stream_sys_t *sys = stream->p_sys;
+    struct xz *xz = sys->codec;
+
+    if (Fill (stream, LZMA_STREAM_HEADER_SIZE) < LZMA_STREAM_HEADER_SIZE
+     || lzma_stream_header_decode (&xz->flags, sys->in_next) != LZMA_OK)
+    {
+        msg_Err (stream, "corrupt xz stream header");
+        return DECODE_ERROR;
+    }
+    Consume (stream, LZMA_STREAM_HEADER_SIZE);
+    xz->state = XZ_BLOCK_HEADER;
+    return DECODE_OK;
+}
+
+static void XZIndex (stream_t *stream)
+{
+    stream_sys_t *sys = stream->p_sys;
+    struct xz *xz = sys->codec;
+
+    if (AddPoint (stream, sys->in_pos - sys->in_avail, 0, NULL, 0))
+    {
+        seek_point_t *point = &sys->points[sys->point_count - 1];
+
+        point->check = xz->flags.check;
+        point->in_stream = true;
+    }
+}
+
+static int XZBlockHeader (stream_t *stream)
+{
+    stream_sys_t *sys = stream->p_sys;
+    struct xz *xz = sys->codec;
+
+    if (!Refill (stream))
+        return DECODE_ERROR;
+
+    if (sys->in_next[0] == 0x00)
+    {   /* index indicator: no more blocks in this stream */
+        if (lzma_index_decoder (&xz->s, &xz->index, UINT64_MAX) != LZMA_OK)
+            return DECODE_ERROR;
+        xz->state = XZ_INDEX;
+        return DECODE_OK;
+    }
+
+    if (sys->out_pos >= LastPoint (sys)->out + SEEK_SPAN)
+        XZIndex (stream);
+
+    lzma_block *block = &xz->block;
+
+    *block = (lzma_block){
+        .version = 0,
+        .header_size = lzma_block_header_size_decode (sys->in_next[0]),
+        .check = xz->flags.check,
+        .filters = xz->filters,
+    };
+    if (Fill (stream, block->header_size) < block->header_size
+     || lzma_block_header_decode (block, NULL, sys->in_next) != LZMA_OK)
+    {
+        msg_Err (stream, "corrupt xz block header");
+        return DECODE_ERROR;
+    }
+    Consume (stream, block->header_size);
+
+    lzma_ret val = lzma_block_decoder (&xz->s, block);
+    /* the decoder keeps its own copy of the filter options */
+    for (size_t i = 0; xz->filters[i].id != LZMA_VLI_UNKNOWN; i++)
+        free (xz->filters[i].options);
+    if (val != LZMA_OK && val != LZMA_UNSUPPORTED_CHECK)
+        return DECODE_ERROR;
+
+    xz->state = XZ_BLOCK;
+    return DECODE_OK;
+}
+
+static int XZStreamFooter (stream_t *stream)
+{
+    stream_sys_t *sys = stream->p_sys;
+    struct xz *xz = sys->codec;
+    lzma_stream_flags footer;
+
+    if (Fill (stream, LZMA_STREAM_HEADER_SIZE) < LZMA_STREAM_HEADER_SIZE
+     || lzma_stream_footer_decode (&footer, sys->in_next) != LZMA_OK
+     || lzma_stream_flags_compare (&xz->flags, &footer) != LZMA_OK)
+    {
+        msg_Err (stream, "corrupt xz stream footer");
+        return DECODE_ERROR;
+    }
+    Consume (stream, LZMA_STREAM_HEADER_SIZE);
+
+    /* skip the stream padding */
+    while (Fill (stream, 1) > 0 && sys->in_next[0] == 0)
+        Consume (stream, 1);
+    return DECODE_END;
+}
+
+/**
+ * Decodes block data, or the index.
+ */
+static int XZCode (stream_t *stream)
+{
+    stream_sys_t *sys = stream->p_sys;
+    struct xz *xz = sys->codec;
+    lzma_stream *s = &xz->s;
+
+    if (sys->in_avail == 0 && !Refill (stream))
+        return DECODE_ERROR;
+
+    size_t avail_out = s->avail_out;
+    s->next_in = sys->in_next;
+    s->avail_in = sys->in_avail;
+    lzma_ret val = lzma_code (s, LZMA_RUN);
+    Consume (stream, sys->in_avail - s->avail_in);
+    sys->out_pos += avail_out - s->avail_out;
+
+    if (val == LZMA_STREAM_END)
+    {
+        if (xz->state == XZ_INDEX)
+        {
+            lzma_index_end (xz->index, NULL);
+            xz->index = NULL;
+            xz->state = XZ_STREAM_FOOTER;
+        }
+        else
+            xz->state = XZ_BLOCK_HEADER;
+        return DECODE_OK;
+    }
+    if (val != LZMA_OK)
+    {
+        msg_Err (stream, "corrupt xz stream (error %d)", (int)val);
+        return DECODE_ERROR;
+    }
+    return DECODE_OK;
+}
+
+static int XZDecode (stream_t *stream, uint8_t *buf, size_t *len)
+{
+    struct xz *xz = stream->p_sys->codec;
+    int ret = DECODE_OK;
+
+    xz->s.next_out = buf;
+    xz->s.avail_out = *len;
+    while (xz->s.avail_out > 0 && ret == DECODE_OK)
+    {
+        switch (xz->state)
+        {
+            case XZ_STREAM_HEADER:
+                ret = XZStreamHeader (stream);
+                break;
+            case XZ_BLOCK_HEADER:
+                ret = XZBlockHeader (stream);
+                break;
+            case XZ_STREAM_FOOTER:
+                ret = XZStreamFooter (stream);
+                break;
+            default:
+                ret = XZCode (stream);
+                break;
+        }
+    }
+    *len -= xz->s.avail_out;
+    return ret;
+}
+
+static void XZEnd (stream_t *stream)
+{
+    struct xz *xz = stream->p_sys->codec;
+
+    lzma_end (&xz->s);
+    if (xz->index != NULL)
+        lzma_index_end (xz->index, NULL);
+    free (xz);
+}
+
+static const struct decoder_ops xz_ops = {
+    ProbeXZ, XZInit, XZReset, XZDecode, XZEnd,
+};
+#endif
+
+/**
+ * Continues with the next concatenated stream, if any.
+ */
+static int NextStream (stream_t *stream)
+{
+    stream_sys_t *sys = stream->p_sys;
+
+    if (!sys->ops->probe (sys->in_next, Fill (stream, PROBE_SIZE)))
+        return DECODE_END; /* end of file, or trailing garbage */
+
+    AddPoint (stream, sys->in_pos - sys->in_avail, 0, NULL, 0);
+    return sys->ops->reset (stream, NULL) ? DECODE_ERROR : DECODE_OK;
+}
+
+/**
+ * Decompresses the next block, minus the data to skip.
+ */
+static void ReleaseBlock (void *block)
+{
+    block_Release (block);
+}
+
+static block_t *DecodeBlock (stream_t *stream)
+{
+    stream_sys_t *sys = stream->p_sys;
+    block_t *block = block_Alloc (BLOCK_SIZE);
+    size_t len = 0;
+
+    if (unlikely(block == NULL))
+    {
+        sys->status = DECODE_ERROR;
+        return NULL;
+    }
+
+    vlc_cleanup_push (ReleaseBlock, block); /* cancelled in Fill() */
+    while (len < BLOCK_SIZE && sys->status == DECODE_OK)
+    {
+        size_t size = BLOCK_SIZE - len;
+        int val = sys->ops->decode (stream, block->p_buffer + len, &size);
+
+        len += size;
+        if (val == DECODE_END)
+            val = NextStream (stream);
+        sys->status = val;
+    }
+    vlc_cleanup_pop ();
+
+    size_t skip = (sys->skip < len) ? sys->skip : len;
+    sys->skip -= skip;
+    block->p_buffer += skip;
+    block->i_buffer = len - skip;
+    return block;
+}
+
+/**
+ * Moves the decoder to a decompressed offset, from the closest seek point
+ * if it is behind or far ahead.
+ */
+static void Reposition (stream_t *stream, uint64_t offset)
+{
+    stream_sys_t *sys = stream->p_sys;
+    const seek_point_t *point = FindPoint (sys, offset);
+
+    if (offset >= sys->out_pos
+     && (point->out <= sys->out_pos || !sys->can_seek))
+    {   /* decompress and discard */
+        sys->skip = offset - sys->out_pos;
+        return;
+    }
+
+    sys->status = DECODE_ERROR;
+    if (!sys->can_seek)
+    {
+        msg_Err (stream, "cannot seek backward");
+        return;
+    }
+
+    uint64_t pos = point->in - (point->bits > 0);
+    msg_Dbg (stream, "resuming at %"PRIu64" from %"PRIu64" (%"PRIu64
+             " compressed)", offset, point->out, pos);
+    sys->in_next = sys->in_buf;
+    sys->in_avail = 0;
+    if (stream_Seek (stream->p_source, pos))
+        return;
+    sys->in_pos = pos;
+    sys->out_pos = point->out;
+    sys->skip = offset - point->out;
+    if (sys->ops->reset (stream, point) == VLC_SUCCESS)
+        sys->status = DECODE_OK;
+}
+
+static void *DecoderThread (void *data)
+{
+    stream_t *stream = data;
+    stream_sys_t *sys = stream->p_sys;
+    bool paused = false;
+
+    sys->canc = vlc_savecancel ();
+    vlc_mutex_lock (&sys->lock);
+    while (!sys->dead)
+    {
+        if (sys->paused != paused)
+        {   /* only this thread uses the source */
+            paused = sys->paused;
+            vlc_mutex_unlock (&sys->lock);
+            stream_Control (stream->p_source, STREAM_SET_PAUSE_STATE, paused);
+            vlc_mutex_lock (&sys->lock);
+            continue;
+        }
+
+        if (sys->seek != UINT64_MAX)
+        {
+            uint64_t offset = sys->seek;
 
+            sys->seek = UINT64_MAX;
+            vlc_mutex_unlock (&sys->lock);
+            Reposition (stream, offset);
+            vlc_mutex_lock (&sys->lock);
+            continue;
+        }
+
+        if (sys->status != DECODE_OK && !sys->eof)
+        {
+            if (sys->status == DECODE_END)
+                sys->size = sys->out_pos;
+            sys->eof = true;
+            vlc_cond_signal (&sys->wait_data);
+        }
+
+        if (paused || sys->eof || sys->queued >= QUEUE_SIZE)
+        {
+            vlc_cond_wait (&sys->wait, &sys->lock);
+            continue;
+        }
+        vlc_mutex_unlock (&sys->lock);
+
+        block_t *block = DecodeBlock (stream);
+
+        vlc_mutex_lock (&sys->lock);
+        if (block == NULL)
+            continue;
+
+        uint64_t start = sys->out_pos - block->i_buffer;
+        if (sys->seek >= start && sys->seek <= sys->out_pos)
+        {   /* seeked within the new block while decoding it */
+            block->p_buffer += sys->seek - start;
+            block->i_buffer -= sys->seek - start;
+            sys->seek = UINT64_MAX;
+        }
+
+        if (sys->seek != UINT64_MAX || block->i_buffer == 0)
+        {
+            block_Release (block);
+            continue;
+        }
+
+        *(sys->queue_last) = block;
+        sys->queue_last = &block->p_next;
+        sys->queued += block->i_buffer;
+        vlc_cond_signal (&sys->wait_data);
+    }
+    vlc_mutex_unlock (&sys->lock);
+    vlc_restorecancel (sys->canc);
+    return NULL;
+}
+
+/**
+ * Takes the next decompressed block, waiting for it if needed.
+ * @return NULL at the end of the stream
+ */
+static block_t *Dequeue (stream_t *stream)
+{
+    stream_sys_t *sys = stream->p_sys;
+    block_t *block;
+
+    vlc_mutex_lock (&sys->lock);
+    while ((block = sys->queue) == NULL && !sys->eof)
+        vlc_cond_wait (&sys->wait_data, &sys->lock);
+
+    if (block != NULL)
+    {
+        sys->queue = block->p_next;
+        if (sys->queue == NULL)
+            sys->queue_last = &sys->queue;
+        sys->queued -= block->i_buffer;
+        block->p_next = NULL;
+        vlc_cond_signal (&sys->wait);
+    }
+    vlc_mutex_unlock (&sys->lock);
+    return block;
+}
+
+static int DecoderRead (stream_t *stream, void *buf, unsigned int buflen)
+{
+    stream_sys_t *sys = stream->p_sys;
+    unsigned ret = 0;
+
+    while (ret < buflen)
+    {
+        block_t *block = sys->peeked;
+
+        if (block == NULL && (block = Dequeue (stream)) == NULL)
+            break;
+
+        size_t length = block->i_buffer;
+        if (length > buflen - ret)
+            length = buflen - ret;
+
+        if (buf != NULL) /* or the caller skips data */
+            memcpy ((char *)buf + ret, block->p_buffer, length);
+        block->p_buffer += length;
+        block->i_buffer -= length;
+        ret += length;
+
+        if (block->i_buffer > 0)
+            sys->peeked = block;
+        else
+        {
+            block_Release (block);
+            sys->peeked = NULL;
+        }
+    }
+    sys->offset += ret;
+    return ret;
+}
+
+static int DecoderPeek (stream_t *stream, const uint8_t **pbuf,
+                        unsigned int len)
+{
+    stream_sys_t *sys = stream->p_sys;
+    block_t *peeked = sys->peeked;
+
+    while (peeked == NULL || peeked->i_buffer < len)
+    {
+        block_t *block = Dequeue (stream);
+        if (block == NULL)
+            break;
+
+        if (peeked == NULL)
+        {
+            peeked = block;
+            continue;
+        }
+
+        size_t curlen = peeked->i_buffer;
+        peeked = block_Realloc (peeked, 0, curlen + block->i_buffer);
+        if (likely(peeked != NULL))
+            memcpy (peeked->p_buffer + curlen, block->p_buffer,
+                    block->i_buffer);
+        block_Release (block);
+        if (unlikely(peeked == NULL))
+            break;
+    }
+
+    sys->peeked = peeked;
+    if (unlikely(peeked == NULL))
+        return 0;
+    *pbuf = peeked->p_buffer;
+    return (peeked->i_buffer < len) ? peeked->i_buffer : len;
+}
+
+static int DecoderSeek (stream_t *stream, uint64_t offset)
+{
+    stream_sys_t *sys = stream->p_sys;
+
+    if (offset >= sys->offset)
+    {   /* within the decompressed data already? */
+        uint64_t buffered = (sys->peeked != NULL) ? sys->peeked->i_buffer : 0;
+
+        vlc_mutex_lock (&sys->lock);
+        buffered += sys->queued;
+        vlc_mutex_unlock (&sys->lock);
+
+        if (offset - sys->offset <= buffered)
+        {
+            DecoderRead (stream, NULL, offset - sys->offset);
+            return VLC_SUCCESS;
+        }
+    }
+    else if (!sys->can_seek)
+        return VLC_EGENERIC;
+
+    if (sys->peeked != NULL)
+    {
+        block_Release (sys->peeked);
+        sys->peeked = NULL;
+    }
+
+    vlc_mutex_lock (&sys->lock);
+    block_ChainRelease (sys->queue);
+    sys->queue = NULL;
+    sys->queue_last = &sys->queue;
+    sys->queued = 0;
+    sys->seek = offset;
+    sys->eof = false;
+    vlc_cond_signal (&sys->wait);
+    vlc_mutex_unlock (&sys->lock);
+
+    sys->offset = offset;
+    return VLC_SUCCESS;
+}
+
+static int DecoderControl (stream_t *stream, int query, va_list args)
+{
+    stream_sys_t *sys = stream->p_sys;
+
+    switch (query)
+    {
+        case STREAM_CAN_SEEK:
+            *(va_arg (args, bool *)) = sys->can_seek;
+            break;
+        case STREAM_CAN_FASTSEEK:
+            *(va_arg (args, bool *)) = false;
+            break;
+        case STREAM_CAN_PAUSE:
+             *(va_arg (args, bool *)) = sys->can_pause;
+            break;
+        case STREAM_CAN_CONTROL_PACE:
+            *(va_arg (args, bool *)) = sys->can_pace;
+            break;
+        case STREAM_GET_POSITION:
+            *(va_arg (args, uint64_t *)) = sys->offset;
+            break;
+        case STREAM_GET_SIZE:
+            /* known once the whole stream was decompressed */
+            vlc_mutex_lock (&sys->lock);
+            *(va_arg (args, uint64_t *)) = sys->size;
+            vlc_mutex_unlock (&sys->lock);
+            break;
+        case STREAM_GET_PTS_DELAY:
+            *va_arg (args, int64_t *) = sys->pts_delay;
+            break;
+        case STREAM_SET_PAUSE_STATE:
+            vlc_mutex_lock (&sys->lock);
+            sys->paused = va_arg (args, unsigned);
+            vlc_cond_signal (&sys->wait);
+            vlc_mutex_unlock (&sys->lock);
+            break;
+        case STREAM_SET_POSITION:
+            return DecoderSeek (stream, va_arg (args, uint64_t));
+        default:
+            return VLC_EGENERIC;
+    }
+    return VLC_SUCCESS;
+}
+
+/**
+ * Decompresses data in-process, from a thread.
+ * Seek points are recorded while decompressing, so that seeking back does
+ * not restart from the beginning.
+ */
+static int OpenDecoder (stream_t *stream, const struct decoder_ops *ops)
+{
+    stream_sys_t *sys = stream->p_sys = malloc (sizeof (*sys));
+    if (unlikely(sys == NULL))
+        return VLC_ENOMEM;
+
+    sys->in_buf = malloc (bufsize);
+    sys->points = malloc (sizeof (*sys->points));
+    if (unlikely(sys->in_buf == NULL || sys->points == NULL))
+        goto error;
+
+    sys->ops = ops;
+    if (ops->init (stream))
+        goto error;
+
+    sys->offset = 0;
+    sys->peeked = NULL;
+    sys->paused = false;
+    sys->queue = NULL;
+    sys->queue_last = &sys->queue;
+    sys->queued = 0;
+    sys->seek = UINT64_MAX;
+    sys->size = 0;
+    sys->eof = false;
+    sys->dead = false;
+    sys->in_next = sys->in_buf;
+    sys->in_avail = 0;
+    sys->in_pos = stream_Tell (stream->p_source);
+    sys->out_pos = 0;
+    sys->skip = 0;
+    sys->status = DECODE_OK;
+    sys->points[0] = (seek_point_t){ .in = sys->in_pos };
+    sys->point_count = 1;
+
+    stream_Control (stream->p_source, STREAM_CAN_SEEK, &sys->can_seek);
+    stream_Control (stream->p_source, STREAM_CAN_PAUSE, &sys->can_pause);
+    stream_Control (stream->p_source, STREAM_CAN_CONTROL_PACE,
+                    &sys->can_pace);
+    stream_Control (stream->p_source, STREAM_GET_PTS_DELAY, &sys->pts_delay);
+
+    vlc_mutex_init (&sys->lock);
+    vlc_cond_init (&sys->wait);
+    vlc_cond_init (&sys->wait_data);
+
+    if (vlc_clone (&sys->thread, DecoderThread, stream,
+                   VLC_THREAD_PRIORITY_INPUT))
+    {
+        vlc_cond_destroy (&sys->wait_data);
+        vlc_cond_destroy (&sys->wait);
+        vlc_mutex_destroy (&sys->lock);
+        ops->end (stream);
+        goto error;
+    }
+
+    stream->pf_read = DecoderRead;
+    stream->pf_peek = DecoderPeek;
+    stream->pf_control = DecoderControl;
+    return VLC_SUCCESS;
+
+error:
+    free (sys->points);
+    free (sys->in_buf);
+    free (sys);
+    return VLC_EGENERIC;
+}
+
+static void CloseDecoder (vlc_object_t *obj)
+{
+    stream_t *stream = (stream_t *)obj;
+    stream_sys_t *sys = stream->p_sys;
+
+    vlc_mutex_lock (&sys->lock);
+    sys->dead = true;
+    vlc_cond_signal (&sys->wait);
+    vlc_mutex_unlock (&sys->lock);
+    vlc_cancel (sys->thread); /* wakes up a blocked source read */
+    vlc_join (sys->thread, NULL);
+
+    msg_Dbg (obj, "%zu seek point(s) for %"PRIu64" bytes", sys->point_count,
+             LastPoint (sys)->out);
+    sys->ops->end (stream);
+
+    block_ChainRelease (sys->queue);
+    if (sys->peeked != NULL)
+        block_Release (sys->peeked);
+    for (size_t i = 0; i < sys->point_count; i++)
+        free (sys->points[i].window);
+    free (sys->points);
+    free (sys->in_buf);
+    vlc_cond_destroy (&sys->wait_data);
+    vlc_cond_destroy (&sys->wait);
+    vlc_mutex_destroy (&sys->lock);
+    free (sys);
+}
+#endif /* DECOMP_LIBRARY */
 
 /**
  * Detects gzip file format
@@ -453,14 +1585,18 @@ static int OpenGzip (vlc_object_t *obj)
     stream_t      *stream = (stream_t *)obj;
     const uint8_t *peek;
 
-    if (stream_Peek (stream->p_source, &peek, 3) < 3)
-        return VLC_EGENERIC;
-
-    if (memcmp (peek, "\x1f\x8b\x08", 3))
+    int len = stream_Peek (stream->p_source, &peek, 3);
+    if (!ProbeGzip (peek, len))
         return VLC_EGENERIC;
 
     msg_Dbg (obj, "detected gzip compressed stream");
+#if defined (HAVE_ZLIB_H)
+    return OpenDecoder (stream, &gzip_ops);
+#elif defined (DECOMP_PROGRAM)
     return Open (stream, "zcat");
+#else
+    return VLC_EGENERIC;
+#endif
 }
 
 
@@ -472,16 +1608,18 @@ static int OpenBzip2 (vlc_object_t *obj)
     stream_t      *stream = (stream_t *)obj;
     const uint8_t *peek;
 
-    /* (Try to) parse the bzip2 header */
-    if (stream_Peek (stream->p_source, &peek, 10) < 10)
-        return VLC_EGENERIC;
-
-    if (memcmp (peek, "BZh", 3) || (peek[3] < '1') || (peek[3] > '9')
-     || memcmp (peek + 4, "\x31\x41\x59\x26\x53\x59", 6))
+    int len = stream_Peek (stream->p_source, &peek, 10);
+    if (!ProbeBzip2 (peek, len))
         return VLC_EGENERIC;
 
     msg_Dbg (obj, "detected bzip2 compressed stream");
+#if defined (HAVE_LIBBZ2)
+    return OpenDecoder (stream, &bzip2_ops);
+#elif defined (DECOMP_PROGRAM)
     return Open (stream, "bzcat");
+#else
+    return VLC_EGENERIC;
+#endif
 }
 
 /**
@@ -492,13 +1630,16 @@ static int OpenXZ (vlc_object_t *obj)
     stream_t      *stream = (stream_t *)obj;
     const uint8_t *peek;
 
-    /* (Try to) parse the xz stream header */
-    if (stream_Peek (stream->p_source, &peek, 8) < 8)
-        return VLC_EGENERIC;
-
-    if (memcmp (peek, "\xfd\x37\x7a\x58\x5a", 6))
+    int len = stream_Peek (stream->p_source, &peek, 8);
+    if (!ProbeXZ (peek, len))
         return VLC_EGENERIC;
 
     msg_Dbg (obj, "detected xz compressed stream");
+#if defined (HAVE_LIBLZMA)
+    return OpenDecoder (stream, &xz_ops);
+#elif defined (DECOMP_PROGRAM)
     return Open (stream, "xzcat");
+#else
+    return VLC_EGENERIC;
+#endif
 }
@@ -50,11 +50,18 @@
 static int  Open (vlc_object_t *);
 static void Close(vlc_object_t *);
 
+#define PARALLEL_TEXT N_("Parallel segment downloads")
+#define PARALLEL_LONGTEXT N_("Number of segments downloaded at the same " \
+    "time. Downloading several segments at once hides the latency of the " \
+    "server when the segments are short.")
+
 vlc_module_begin()
     set_category(CAT_INPUT)
     set_subcategory(SUBCAT_INPUT_STREAM_FILTER)
     set_description(N_("Http Live Streaming stream filter"))
     set_capability("stream_filter", 20)
+    add_integer_with_range("hls-parallel", 3, 1, 8,
+                           PARALLEL_TEXT, PARALLEL_LONGTEXT, true)
     set_callbacks(Open, Close)
 vlc_module_end()
 
@@ -62,6 +69,9 @@ vlc_module_end()
  *
  *****************************************************************************/
 #define AES_BLOCK_SIZE 16 /* Only support AES-128 */
+#define HLS_MAX_AHEAD 6 /* segments downloaded ahead of playback */
+#define HLS_RETRY_DELAY (CLOCK_FREQ) /* before a worker retries a segment */
+#define HLS_BANDWIDTH_WINDOW (10 * CLOCK_FREQ) /* throughput measurement */
 typedef struct segment_s
 {
     int         sequence;   /* unique sequence number */
@@ -78,6 +88,13 @@ typedef struct segment_s
 
     vlc_mutex_t lock;
     block_t     *data;      /* data */
+
+    /* Download statistics */
+    mtime_t     latency;    /* time until the response started */
+    mtime_t     transfer;   /* time taken by the whole download */
+    unsigned    parallel;   /* downloads in flight when it started */
+    bool        b_fetching; /* claimed by a download worker */
+    mtime_t     failed;     /* last failed download by a worker */
 } segment_t;
 
 typedef struct hls_stream_s
@@ -106,12 +123,15 @@ struct stream_sys_t
     char         *m3u8;         /* M3U8 url */
     vlc_thread_t  reload;       /* HLS m3u8 reload thread */
     vlc_thread_t  thread;       /* HLS segment download thread */
+    vlc_thread_t *workers;      /* HLS segment download ahead threads */
+    unsigned      i_workers;
 
     block_t      *peeked;
 
     /* */
     vlc_array_t  *hls_stream;   /* bandwidth adaptation */
-    uint64_t      bandwidth;    /* measured bandwidth (bits per second) */
+    uint64_t      bandwidth;    /* measured bandwidth (bits per second),
+                                   protected by lock */
 
     /* Download */
     struct hls_download_s
@@ -119,10 +139,24 @@ struct stream_sys_t
         int         stream;     /* current hls_stream  */
         int         segment;    /* current segment for downloading */
         int         seek;       /* segment requested by seek (default -1) */
+        int         parallel;   /* segments downloaded at the same time */
         vlc_mutex_t lock_wait;  /* protect segment download counter */
         vlc_cond_t  wait;       /* some condition to wait on */
     } download;
 
+    /* Download statistics, protected by lock */
+    struct hls_stats_s
+    {
+        unsigned    segments;   /* segments downloaded */
+        uint64_t    bytes;      /* bytes downloaded */
+        mtime_t     latency;    /* sum of the response latencies */
+        mtime_t     transfer;   /* sum of the download times */
+        unsigned    active;     /* downloads in flight */
+        uint64_t    received;   /* bytes received so far */
+        mtime_t     window;     /* start of the throughput measurement */
+        uint64_t    window_bytes; /* bytes received before it */
+    } stats;
+
     /* Playback */
     struct hls_playback_s
     {
@@ -174,6 +208,7 @@ static char *ReadLine(uint8_t *buffer, uint8_t **pos, size_t len);
 static int hls_Download(stream_t *s, segment_t *segment);
 
 static void* hls_Thread(void *);
+static void* hls_Worker(void *);
 static void* hls_Reload(void *);
 
 static segment_t *segment_GetSegment(hls_stream_t *hls, int wanted);
@@ -397,6 +432,11 @@ static segment_t *segment_New(hls_stream_t* hls, const int duration, const char
         return NULL;
     }
     segment->data = NULL;
+    segment->latency = 0;
+    segment->transfer = 0;
+    segment->parallel = 0;
+    segment->b_fetching = false;
+    segment->failed = VLC_TS_INVALID;
     vlc_array_append(hls->segments, segment);
     vlc_mutex_init(&segment->lock);
     segment->b_key_loaded = false;
@@ -1198,16 +1238,17 @@ static int parse_M3U8(stream_t *s, vlc_array_t *streams, uint8_t *buffer, const
 }
 
 
-static int hls_DownloadSegmentKey(stream_t *s, segment_t *seg)
+static int hls_DownloadSegmentKey(stream_t *s, const char *psz_path,
+                                  int sequence, uint8_t *key)
 {
-    stream_t *p_m3u8 = stream_UrlNew(s, seg->psz_key_path);
+    stream_t *p_m3u8 = stream_UrlNew(s, psz_path);
     if (p_m3u8 == NULL)
     {
-        msg_Err(s, "Failed to load the AES key for segment sequence %d", seg->sequence);
+        msg_Err(s, "Failed to load the AES key for segment sequence %d", sequence);
         return VLC_EGENERIC;
     }
 
-    int len = stream_Read(p_m3u8, seg->aes_key, sizeof(seg->aes_key));
+    int len = stream_Read(p_m3u8, key, AES_BLOCK_SIZE);
     stream_Delete(p_m3u8);
     if (len != AES_BLOCK_SIZE)
     {
@@ -1218,13 +1259,16 @@ static int hls_DownloadSegmentKey(stream_t *s, segment_t *seg)
     return VLC_SUCCESS;
 }
 
+/* The keys are protected by hls->lock, which is released while a key is
+ * downloaded */
 static int hls_ManageSegmentKeys(stream_t *s, hls_stream_t *hls)
 {
     segment_t   *seg = NULL;
     segment_t   *prev_seg;
-    int         count = vlc_array_count(hls->segments);
+    int         i_ret = VLC_SUCCESS;
 
-    for (int i = 0; i < count; i++)
+    vlc_mutex_lock(&hls->lock);
+    for (int i = 0; i < vlc_array_count(hls->segments); i++)
     {
         prev_seg = seg;
         seg = segment_GetSegment(hls, i);
@@ -1237,31 +1281,83 @@ static int hls_ManageSegmentKeys(stream_t *s, hls_stream_t *hls)
 
         /* if the key has not changed, and already available from previous segment,
          * try to copy it, and don't load the key */
-        if (prev_seg && prev_seg->b_key_loaded && strcmp(seg->psz_key_path, prev_seg->psz_key_path) == 0)
+        if (prev_seg && prev_seg->b_key_loaded && prev_seg->psz_key_path &&
+            strcmp(seg->psz_key_path, prev_seg->psz_key_path) == 0)
         {
             memcpy(seg->aes_key, prev_seg->aes_key, AES_BLOCK_SIZE);
             seg->b_key_loaded = true;
             continue;
         }
-        if (hls_DownloadSegmentKey(s, seg) != VLC_SUCCESS)
-            return VLC_EGENERIC;
-       seg->b_key_loaded = true;
+
+        char *psz_path = strdup(seg->psz_key_path);
+        int sequence = seg->sequence;
+        uint8_t key[AES_BLOCK_SIZE];
+        vlc_mutex_unlock(&hls->lock);
+
+        if (psz_path == NULL)
+            i_ret = VLC_ENOMEM;
+        else
+            i_ret = hls_DownloadSegmentKey(s, psz_path, sequence, key);
+
+        vlc_mutex_lock(&hls->lock);
+        if (i_ret != VLC_SUCCESS)
+        {
+            free(psz_path);
+            break;
+        }
+
+        /* the playlist may have been updated meanwhile */
+        for (int j = 0; j < vlc_array_count(hls->segments); j++)
+        {
+            segment_t *p = segment_GetSegment(hls, j);
+            if (p && p->psz_key_path && !p->b_key_loaded &&
+                strcmp(p->psz_key_path, psz_path) == 0)
+            {
+                memcpy(p->aes_key, key, AES_BLOCK_SIZE);
+                p->b_key_loaded = true;
+            }
+        }
+        free(psz_path);
+        seg = segment_GetSegment(hls, i);
     }
-    return VLC_SUCCESS;
+    vlc_mutex_unlock(&hls->lock);
+    return i_ret;
 }
 
-static int hls_DecodeSegmentData(stream_t *s, hls_stream_t *hls, segment_t *segment)
+/* Copies the key of a segment, loading it first if needed.
+ * Returns false if the segment has no key or it could not be loaded. */
+static bool hls_GetSegmentKey(stream_t *s, hls_stream_t *hls, segment_t *segment,
+                              uint8_t *key)
+{
+    vlc_mutex_lock(&hls->lock);
+    bool b_loaded = segment->b_key_loaded;
+    bool b_needed = segment->psz_key_path != NULL;
+    vlc_mutex_unlock(&hls->lock);
+
+    if (!b_needed)
+        return false;
+    if (!b_loaded)
+        hls_ManageSegmentKeys(s, hls);
+
+    vlc_mutex_lock(&hls->lock);
+    b_loaded = segment->b_key_loaded;
+    if (b_loaded)
+        memcpy(key, segment->aes_key, AES_BLOCK_SIZE);
+    vlc_mutex_unlock(&hls->lock);
+    return b_loaded;
+}
+
+static int hls_DecodeSegmentData(stream_t *s, segment_t *segment,
+                                 const uint8_t *key)
 {
     /* Did the segment need to be decoded ? */
     if (segment->psz_key_path == NULL)
         return VLC_SUCCESS;
 
-    /* Do we have loaded the key ? */
-    if (!segment->b_key_loaded)
+    if (key == NULL)
     {
-        /* No ? try to download it now */
-        if (hls_ManageSegmentKeys(s, hls) != VLC_SUCCESS)
-            return VLC_EGENERIC;
+        msg_Err(s, "no AES key for segment %d", segment->sequence);
+        return VLC_EGENERIC;
     }
 
     /* For now, we only decode AES-128 data */
@@ -1278,8 +1374,7 @@ static int hls_DecodeSegmentData(stream_t *s, hls_stream_t *hls, segment_t *segm
     }
 
     /* Set key */
-    i_gcrypt_err = gcry_cipher_setkey(aes_ctx, segment->aes_key,
-                                       sizeof(segment->aes_key));
+    i_gcrypt_err = gcry_cipher_setkey(aes_ctx, key, AES_BLOCK_SIZE);
     if (i_gcrypt_err)
     {
         msg_Err(s, "gcry_cipher_setkey failed: %s", gpg_strerror(i_gcrypt_err));
@@ -1529,7 +1624,7 @@ static int hls_ReloadPlaylist(stream_t *s)
     if (stream_appended == true)
     {
         vlc_mutex_lock(&p_sys->download.lock_wait);
-        vlc_cond_signal(&p_sys->download.wait);
+        vlc_cond_broadcast(&p_sys->download.wait);
         vlc_mutex_unlock(&p_sys->download.lock_wait);
     }
 
@@ -1576,6 +1671,14 @@ static int hls_DownloadSegmentData(stream_t *s, hls_stream_t *hls, segment_t *se
     assert(hls);
     assert(segment);
 
+    /* hls->lock is never taken with a segment lock held */
+    uint8_t key[AES_BLOCK_SIZE];
+    bool b_key = hls_GetSegmentKey(s, hls, segment, key);
+
+    vlc_mutex_lock(&p_sys->lock);
+    uint64_t bandwidth = p_sys->bandwidth;
+    vlc_mutex_unlock(&p_sys->lock);
+
     vlc_mutex_lock(&segment->lock);
     if (segment->data != NULL)
     {
@@ -1585,10 +1688,10 @@ static int hls_DownloadSegmentData(stream_t *s, hls_stream_t *hls, segment_t *se
     }
 
     /* sanity check - can we download this segment on time? */
-    if ((p_sys->bandwidth > 0) && (hls->bandwidth > 0))
+    if ((bandwidth > 0) && (hls->bandwidth > 0))
     {
         uint64_t size = (segment->duration * hls->bandwidth); /* bits */
-        int estimated = (int)(size / p_sys->bandwidth);
+        int estimated = (int)(size / bandwidth);
         if (estimated > segment->duration)
         {
             msg_Warn(s,"downloading segment %d predicted to take %ds, which exceeds its length (%ds)",
@@ -1596,8 +1699,6 @@ static int hls_DownloadSegmentData(stream_t *s, hls_stream_t *hls, segment_t *se
         }
     }
 
-    mtime_t start = mdate();
-
     int i_ret = hls_Download(s, segment);
     if (i_ret != VLC_SUCCESS)
     {
@@ -1607,7 +1708,6 @@ static int hls_DownloadSegmentData(stream_t *s, hls_stream_t *hls, segment_t *se
         return i_ret;
     }
 
-    mtime_t duration = mdate() - start;
     if (hls->bandwidth == 0 && segment->duration > 0)
     {
         /* Try to estimate the bandwidth for this stream */
@@ -1615,18 +1715,32 @@ static int hls_DownloadSegmentData(stream_t *s, hls_stream_t *hls, segment_t *se
     }
 
     /* If the segment is encrypted, decode it */
-    i_ret = hls_DecodeSegmentData(s, hls, segment);
+    i_ret = hls_DecodeSegmentData(s, segment, b_key ? key : NULL);
 
     vlc_mutex_unlock(&segment->lock);
 
     if(i_ret != VLC_SUCCESS)
         return i_ret;
 
-    msg_Dbg(s, "downloaded segment %d from stream %d",
-                segment->sequence, *cur_stream);
+    msg_Dbg(s, "downloaded segment %d from stream %d: %"PRIu64" bytes in "
+             "%"PRId64" ms, %"PRId64" ms latency, %u in parallel",
+             segment->sequence, *cur_stream, segment->size,
+             segment->transfer / 1000, segment->latency / 1000,
+             segment->parallel);
 
-    uint64_t bw = segment->size * 8 * 1000000 / __MAX(1, duration); /* bits / s */
+    /* The downloads in flight share the link: the bandwidth is the bytes
+     * received by all of them over the wall time they were running */
+    vlc_mutex_lock(&p_sys->lock);
+    mtime_t now = mdate();
+    uint64_t bw = (p_sys->stats.received - p_sys->stats.window_bytes) * 8
+                * CLOCK_FREQ / __MAX(1, now - p_sys->stats.window); /* bits / s */
+    if (now - p_sys->stats.window >= HLS_BANDWIDTH_WINDOW)
+    {
+        p_sys->stats.window = now;
+        p_sys->stats.window_bytes = p_sys->stats.received;
+    }
     p_sys->bandwidth = bw;
+    vlc_mutex_unlock(&p_sys->lock);
     if (p_sys->b_meta && (hls->bandwidth != bw))
     {
         int newstream = BandwidthAdaptation(s, hls->id, &bw);
@@ -1642,6 +1756,17 @@ static int hls_DownloadSegmentData(stream_t *s, hls_stream_t *hls, segment_t *se
     return VLC_SUCCESS;
 }
 
+/* The stream being downloaded, changed by the bandwidth adaptation */
+static int hls_DownloadStream(stream_t *s)
+{
+    stream_sys_t *p_sys = s->p_sys;
+
+    vlc_mutex_lock(&p_sys->download.lock_wait);
+    int stream = p_sys->download.stream;
+    vlc_mutex_unlock(&p_sys->download.lock_wait);
+    return stream;
+}
+
 static void* hls_Thread(void *p_this)
 {
     stream_t *s = (stream_t *)p_this;
@@ -1649,7 +1774,8 @@ static void* hls_Thread(void *p_this)
 
     for( ;; )
     {
-        hls_stream_t *hls = hls_Get(p_sys->hls_stream, p_sys->download.stream);
+        int stream = hls_DownloadStream(s);
+        hls_stream_t *hls = hls_Get(p_sys->hls_stream, stream);
         assert(hls);
 
         /* Sliding window (~60 seconds worth of movie) */
@@ -1658,13 +1784,13 @@ static void* hls_Thread(void *p_this)
         vlc_mutex_unlock(&hls->lock);
 
         /* Is there a new segment to process? */
-        if ((!p_sys->b_live && (p_sys->playback.segment < (count - 6))) ||
+        if ((!p_sys->b_live && (p_sys->playback.segment < (count - HLS_MAX_AHEAD))) ||
             (p_sys->download.segment >= count))
         {
             /* wait */
             vlc_mutex_lock(&p_sys->download.lock_wait);
             mutex_cleanup_push(&p_sys->download.lock_wait); //CO
-            while (((p_sys->download.segment - p_sys->playback.segment > 6) ||
+            while (((p_sys->download.segment - p_sys->playback.segment > HLS_MAX_AHEAD) ||
                     (p_sys->download.segment >= count)) &&
                    (p_sys->download.seek == -1))
             {
@@ -1698,13 +1824,16 @@ static void* hls_Thread(void *p_this)
             vlc_cond_wait(&p_sys->wait, &p_sys->lock);
         vlc_cleanup_run( ); //C1 vlc_mutex_unlock(&p_sys->lock);
 
+        /* not kept in a register across the cleanup handlers (longjmp) */
+        hls = hls_Get(p_sys->hls_stream, stream);
         vlc_mutex_lock(&hls->lock);
         segment_t *segment = segment_GetSegment(hls, p_sys->download.segment);
         vlc_mutex_unlock(&hls->lock);
 
         int i_canc = vlc_savecancel();
+        int cur_stream = stream;
         if ((segment != NULL) &&
-            (hls_DownloadSegmentData(s, hls, segment, &p_sys->download.stream) != VLC_SUCCESS))
+            (hls_DownloadSegmentData(s, hls, segment, &cur_stream) != VLC_SUCCESS))
         {
             if (!p_sys->b_live)
             {
@@ -1717,6 +1846,8 @@ static void* hls_Thread(void *p_this)
         /* download succeeded */
         /* determine next segment to download */
         vlc_mutex_lock(&p_sys->download.lock_wait);
+        if (cur_stream != stream && p_sys->download.stream == stream)
+            p_sys->download.stream = cur_stream;
         if (p_sys->download.seek >= 0)
         {
             p_sys->download.segment = p_sys->download.seek;
@@ -1724,7 +1855,10 @@ static void* hls_Thread(void *p_this)
         }
         else if (p_sys->download.segment < count)
             p_sys->download.segment++;
-        vlc_cond_signal(&p_sys->download.wait);
+        /* the reader is signaled below, it must not wait for more data */
+        if (!p_sys->b_live && p_sys->download.segment >= count)
+            atomic_store(&p_sys->eof, true);
+        vlc_cond_broadcast(&p_sys->download.wait);
         vlc_mutex_unlock(&p_sys->download.lock_wait);
 
         // In case of a successful download signal the read thread that data is available
@@ -1738,6 +1872,102 @@ static void* hls_Thread(void *p_this)
     return NULL;
 }
 
+/* Claims the next segment ahead of the download thread that nobody is
+ * downloading yet. Called with download.lock_wait held. */
+static segment_t *hls_ClaimSegment(stream_t *s, hls_stream_t **hls_out)
+{
+    stream_sys_t *p_sys = s->p_sys;
+
+    if (p_sys->download.seek >= 0)
+        return NULL;
+
+    hls_stream_t *hls = hls_Get(p_sys->hls_stream, p_sys->download.stream);
+    if (hls == NULL)
+        return NULL;
+
+    int last = __MIN(p_sys->download.segment + p_sys->download.parallel,
+                     p_sys->playback.segment + HLS_MAX_AHEAD);
+    segment_t *segment = NULL;
+    mtime_t now = mdate();
+
+    vlc_mutex_lock(&hls->lock);
+    for (int n = p_sys->download.segment + 1; n < last; n++)
+    {
+        segment_t *candidate = segment_GetSegment(hls, n);
+        if (candidate == NULL)
+            break;
+        if (candidate->b_fetching)
+            continue;
+        if (candidate->failed != VLC_TS_INVALID &&
+            now < candidate->failed + HLS_RETRY_DELAY)
+            continue;
+
+        /* A locked segment is being downloaded or read */
+        if (vlc_mutex_trylock(&candidate->lock) != 0)
+            continue;
+        bool b_missing = (candidate->data == NULL);
+        vlc_mutex_unlock(&candidate->lock);
+
+        if (b_missing)
+        {
+            candidate->b_fetching = true;
+            segment = candidate;
+            break;
+        }
+    }
+    vlc_mutex_unlock(&hls->lock);
+
+    *hls_out = hls;
+    return segment;
+}
+
+static void* hls_Worker(void *p_this)
+{
+    stream_t *s = (stream_t *)p_this;
+    stream_sys_t *p_sys = s->p_sys;
+
+    for( ;; )
+    {
+        vlc_mutex_lock(&p_sys->lock);
+        mutex_cleanup_push(&p_sys->lock);
+        while (p_sys->paused)
+            vlc_cond_wait(&p_sys->wait, &p_sys->lock);
+        vlc_cleanup_run( );
+
+        hls_stream_t *hls;
+        segment_t *segment;
+        int stream;
+
+        vlc_mutex_lock(&p_sys->download.lock_wait);
+        mutex_cleanup_push(&p_sys->download.lock_wait);
+        while ((segment = hls_ClaimSegment(s, &hls)) == NULL)
+            vlc_cond_wait(&p_sys->download.wait, &p_sys->download.lock_wait);
+        stream = p_sys->download.stream;
+        vlc_cleanup_run( );
+
+        int canc = vlc_savecancel();
+        int cur_stream = stream;
+        bool b_ok = hls_DownloadSegmentData(s, hls, segment, &cur_stream) == VLC_SUCCESS;
+        vlc_restorecancel(canc);
+
+        vlc_mutex_lock(&p_sys->download.lock_wait);
+        /* A failed segment is left to the download thread for a while */
+        segment->b_fetching = false;
+        if (!b_ok)
+            segment->failed = mdate();
+        if (cur_stream != stream && p_sys->download.stream == stream)
+            p_sys->download.stream = cur_stream;
+        vlc_cond_broadcast(&p_sys->download.wait);
+        vlc_mutex_unlock(&p_sys->download.lock_wait);
+
+        vlc_mutex_lock(&p_sys->read.lock_wait);
+        vlc_cond_signal(&p_sys->read.wait);
+        vlc_mutex_unlock(&p_sys->read.lock_wait);
+    }
+
+    return NULL;
+}
+
 static void* hls_Reload(void *p_this)
 {
     stream_t *s = (stream_t *)p_this;
@@ -1778,7 +2008,7 @@ static void* hls_Reload(void *p_this)
 
             vlc_restorecancel(canc);
 
-            hls_stream_t *hls = hls_Get(p_sys->hls_stream, p_sys->download.stream);
+            hls_stream_t *hls = hls_Get(p_sys->hls_stream, hls_DownloadStream(s));
             assert(hls);
 
             /* determine next time to update playlist */
@@ -1856,9 +2086,27 @@ static int hls_Download(stream_t *s, segment_t *segment)
     stream_sys_t *p_sys = s->p_sys;
     assert(segment);
 
+    mtime_t start = mdate();
+
+    vlc_mutex_lock(&p_sys->lock);
+    /* the link was idle: start measuring the throughput anew */
+    if (p_sys->stats.active++ == 0)
+    {
+        p_sys->stats.window = start;
+        p_sys->stats.window_bytes = p_sys->stats.received;
+    }
+    segment->parallel = p_sys->stats.active;
+    vlc_mutex_unlock(&p_sys->lock);
+
     stream_t *p_ts = stream_UrlNew(s, segment->url);
     if (p_ts == NULL)
+    {
+        vlc_mutex_lock(&p_sys->lock);
+        p_sys->stats.active--;
+        vlc_mutex_unlock(&p_sys->lock);
         return VLC_EGENERIC;
+    }
+    segment->latency = mdate() - start;
 
     int64_t size = stream_Size(p_ts);
     if (size < 0)
@@ -1910,15 +2158,30 @@ static int hls_Download(stream_t *s, segment_t *segment)
 
         i_total_read += i_length;
 
+        vlc_mutex_lock(&p_sys->lock);
+        p_sys->stats.received += i_length;
+        vlc_mutex_unlock(&p_sys->lock);
+
         if (atomic_load(&p_sys->closing))
             break;
     };
 
     segment->data = p_segment_data;
     segment->size = p_segment_data->i_buffer;
+    segment->transfer = mdate() - start;
+
+    vlc_mutex_lock(&p_sys->lock);
+    p_sys->stats.segments++;
+    p_sys->stats.bytes += segment->size;
+    p_sys->stats.latency += segment->latency;
+    p_sys->stats.transfer += segment->transfer;
+    vlc_mutex_unlock(&p_sys->lock);
 
 end:
     stream_Delete(p_ts);
+    vlc_mutex_lock(&p_sys->lock);
+    p_sys->stats.active--;
+    vlc_mutex_unlock(&p_sys->lock);
     return i_return;
 }
 
@@ -2117,6 +2380,7 @@ static int Open(vlc_object_t *p_this)
     p_sys->download.stream = current;
     p_sys->playback.stream = current;
     p_sys->download.seek = -1;
+    p_sys->download.parallel = var_InheritInteger(s, "hls-parallel");
 
     vlc_mutex_init(&p_sys->download.lock_wait);
     vlc_cond_init(&p_sys->download.wait);
@@ -2148,6 +2412,18 @@ static int Open(vlc_object_t *p_this)
         goto fail_thread;
     }
 
+    /* The download thread fetches the segments in order, the workers fetch
+     * the next ones meanwhile */
+    p_sys->workers = malloc((p_sys->download.parallel - 1) *
+                            sizeof(*p_sys->workers));
+    for (int i = 0; p_sys->workers && i < p_sys->download.parallel - 1; i++)
+    {
+        if (vlc_clone(&p_sys->workers[p_sys->i_workers], hls_Worker, s,
+                      VLC_THREAD_PRIORITY_INPUT))
+            break;
+        p_sys->i_workers++;
+    }
+
     return VLC_SUCCESS;
 
 fail_thread:
@@ -2196,7 +2472,7 @@ static void Close(vlc_object_t *p_this)
     /* negate the condition variable's predicate */
     p_sys->download.segment = p_sys->playback.segment = 0;
     p_sys->download.seek = 0; /* better safe than sorry */
-    vlc_cond_signal(&p_sys->download.wait);
+    vlc_cond_broadcast(&p_sys->download.wait);
     vlc_mutex_unlock(&p_sys->download.lock_wait);
 
     vlc_cond_signal(&p_sys->read.wait); /* set closing first */
@@ -2208,8 +2484,20 @@ static void Close(vlc_object_t *p_this)
         vlc_join(p_sys->reload, NULL);
     }
 
+    for (unsigned i = 0; i < p_sys->i_workers; i++)
+        vlc_cancel(p_sys->workers[i]);
     vlc_cancel(p_sys->thread);
+    for (unsigned i = 0; i < p_sys->i_workers; i++)
+        vlc_join(p_sys->workers[i], NULL);
     vlc_join(p_sys->thread, NULL);
+    free(p_sys->workers);
+
+    if (p_sys->stats.segments > 0)
+        msg_Dbg(s, "downloaded %u segments (%"PRIu64" bytes), average "
+                 "latency %"PRId64" ms, average download time %"PRId64" ms",
+                 p_sys->stats.segments, p_sys->stats.bytes,
+                 p_sys->stats.latency / p_sys->stats.segments / 1000,
+                 p_sys->stats.transfer / p_sys->stats.segments / 1000);
 
     vlc_mutex_destroy(&p_sys->download.lock_wait);
     vlc_cond_destroy(&p_sys->download.wait);
@@ -2275,6 +2563,11 @@ static segment_t *GetSegment(stream_t *s)
         if (hls == NULL)
             return NULL;
 
+        /* not under the stream lock, which nests in this one */
+        vlc_mutex_lock(&p_sys->download.lock_wait);
+        int i_segment = p_sys->download.segment;
+        vlc_mutex_unlock(&p_sys->download.lock_wait);
+
         vlc_mutex_lock(&hls->lock);
         segment = segment_GetSegment(hls, p_sys->playback.segment);
         if (segment == NULL)
@@ -2283,10 +2576,6 @@ static segment_t *GetSegment(stream_t *s)
             break;
         }
 
-        vlc_mutex_lock(&p_sys->download.lock_wait);
-        int i_segment = p_sys->download.segment;
-        vlc_mutex_unlock(&p_sys->download.lock_wait);
-
         vlc_mutex_lock(&segment->lock);
         /* This segment is ready? */
         if ((segment->data != NULL) &&
@@ -2371,7 +2660,7 @@ static ssize_t hls_Read(stream_t *s, uint8_t *p_read, unsigned int i_read)
             /* signal download thread */
             vlc_mutex_lock(&p_sys->download.lock_wait);
             p_sys->playback.segment++;
-            vlc_cond_signal(&p_sys->download.wait);
+            vlc_cond_broadcast(&p_sys->download.wait);
             vlc_mutex_unlock(&p_sys->download.lock_wait);
             continue;
         }
@@ -2688,7 +2977,7 @@ static int segment_Seek(stream_t *s, const uint64_t pos)
         /* Wake up download thread */
         vlc_mutex_lock(&p_sys->download.lock_wait);
         p_sys->download.seek = p_sys->playback.segment;
-        vlc_cond_signal(&p_sys->download.wait);
+        vlc_cond_broadcast(&p_sys->download.wait);
 
         /* Wait for download to be finished */
         msg_Dbg(s, "seek to segment %d", p_sys->playback.segment);
@@ -34,6 +34,7 @@
 #include <assert.h>
 #include <vlc_stream.h>
 #include <vlc_input.h>
+#include <vlc_sout.h>
 #include <vlc_fs.h>
 
 
@@ -56,21 +57,29 @@ vlc_module_end()
  *****************************************************************************/
 struct stream_sys_t
 {
-    FILE *f;        /* TODO it could be replaced by access_output_t one day */
+    sout_access_out_t *p_out; /* Writes from its own thread */
+    FILE *f;                  /* Without the file access output */
     bool b_error;
 };
 
+static inline bool IsRecording( const stream_sys_t *p_sys )
+{
+    return p_sys->p_out != NULL || p_sys->f != NULL;
+}
+
 
 /****************************************************************************
  * Local prototypes
  ****************************************************************************/
 static int  Read   ( stream_t *, void *p_read, unsigned int i_read );
 static int  Peek   ( stream_t *, const uint8_t **pp_peek, unsigned int i_peek );
+static block_t *Block( stream_t *, unsigned int i_read );
 static int  Control( stream_t *, int i_query, va_list );
 
 static int  Start  ( stream_t *, const char *psz_extension );
 static int  Stop   ( stream_t * );
-static void Write  ( stream_t *, const uint8_t *p_buffer, size_t i_buffer );
+static void Write  ( stream_t *, block_t *p_block );
+static int  RecordData( stream_t *, va_list );
 
 /****************************************************************************
  * Open
@@ -85,11 +94,13 @@ static int Open ( vlc_object_t *p_this )
     if( !p_sys )
         return VLC_ENOMEM;
 
+    p_sys->p_out = NULL;
     p_sys->f = NULL;
 
     /* */
     s->pf_read = Read;
     s->pf_peek = Peek;
+    s->pf_block = Block;
     s->pf_control = Control;
     stream_FilterSetDefaultReadDir( s );
 
@@ -104,7 +115,7 @@ static void Close( vlc_object_t *p_this )
     stream_t *s = (stream_t*)p_this;
     stream_sys_t *p_sys = s->p_sys;
 
-    if( p_sys->f )
+    if( IsRecording( p_sys ) )
         Stop( s );
 
     free( p_sys );
@@ -116,27 +127,56 @@ static void Close( vlc_object_t *p_this )
 static int Read( stream_t *s, void *p_read, unsigned int i_read )
 {
     stream_sys_t *p_sys = s->p_sys;
-    void *p_record = p_read;
 
-    /* Allocate a temporary buffer for record when no p_read */
-    if( p_sys->f && !p_record )
-        p_record = malloc( i_read );
+    if( !IsRecording( p_sys ) )
+        return stream_Read( s->p_source, p_read, i_read );
 
-    /* */
-    const int i_record = stream_Read( s->p_source, p_record, i_read );
+    /* Read into a block handed over to the writer */
+    block_t *p_record = block_Alloc( i_read );
+    if( !p_record )
+        return stream_Read( s->p_source, p_read, i_read );
+
+    const int i_record = stream_Read( s->p_source, p_record->p_buffer, i_read );
 
     /* Dump read data */
-    if( p_sys->f )
+    if( i_record > 0 )
     {
-        if( p_record && i_record > 0 )
-            Write( s, p_record, i_record );
-        if( !p_read )
-            free( p_record );
+        if( p_read )
+            memcpy( p_read, p_record->p_buffer, i_record );
+        p_record->i_buffer = i_record;
+        Write( s, p_record );
     }
+    else
+        block_Release( p_record );
 
     return i_record;
 }
 
+static block_t *Block( stream_t *s, unsigned int i_read )
+{
+    stream_sys_t *p_sys = s->p_sys;
+
+    /* Do not defeat zero copy from the source: not stream_Block(), our
+     * caller makes the block writable if needed */
+    block_t *p_block;
+    if( s->p_source->pf_block != NULL )
+        p_block = s->p_source->pf_block( s->p_source, i_read );
+    else
+        p_block = stream_Block( s->p_source, i_read );
+
+    /* Dump read data, the writer references the same payload */
+    if( IsRecording( p_sys ) && p_block && p_block->i_buffer > 0 )
+    {
+        p_block = block_Share( p_block );
+
+        block_t *p_record = block_Clone( p_block );
+        if( p_record )
+            Write( s, p_record );
+    }
+
+    return p_block;
+}
+
 static int Peek( stream_t *s, const uint8_t **pp_peek, unsigned int i_peek )
 {
     return stream_Peek( s->p_source, pp_peek, i_peek );
@@ -144,6 +184,8 @@ static int Peek( stream_t *s, const uint8_t **pp_peek, unsigned int i_peek )
 
 static int Control( stream_t *s, int i_query, va_list args )
 {
+    if( i_query == STREAM_RECORD_DATA )
+        return RecordData( s, args );
     if( i_query != STREAM_SET_RECORD_STATE )
         return stream_vaControl( s->p_source, i_query, args );
 
@@ -152,7 +194,7 @@ static int Control( stream_t *s, int i_query, va_list args )
     if( b_active )
         psz_extension = (const char*)va_arg( args, const char* );
 
-    if( !s->p_sys->f == !b_active )
+    if( IsRecording( s->p_sys ) == b_active )
         return VLC_SUCCESS;
 
     if( b_active )
@@ -169,7 +211,7 @@ static int Start( stream_t *s, const char *psz_extension )
     stream_sys_t *p_sys = s->p_sys;
 
     char *psz_file;
-    FILE *f;
+    sout_access_out_t *p_out;
 
     /* */
     if( !psz_extension )
@@ -192,9 +234,20 @@ static int Start( stream_t *s, const char *psz_extension )
     if( !psz_file )
         return VLC_ENOMEM;
 
-    f = vlc_fopen( psz_file, "wb" );
-    if( !f )
+    FILE *f = NULL;
+#ifdef ENABLE_SOUT
+    /* Written from the access output thread, with an 8 MiB queue */
+    p_out = sout_AccessOutNew( s, "file{no-append,no-format,buffer=8192}",
+                               psz_file );
+#else
+    p_out = NULL;
+#endif
+    /* Write synchronously without the file access output */
+    if( !p_out )
+        f = vlc_fopen( psz_file, "wb" );
+    if( !p_out && !f )
     {
+        msg_Err( s, "cannot record into %s", psz_file );
         free( psz_file );
         return VLC_EGENERIC;
     }
@@ -206,6 +259,7 @@ static int Start( stream_t *s, const char *psz_extension )
     free( psz_file );
 
     /* */
+    p_sys->p_out = p_out;
     p_sys->f = f;
     p_sys->b_error = false;
     return VLC_SUCCESS;
@@ -214,31 +268,62 @@ static int Stop( stream_t *s )
 {
     stream_sys_t *p_sys = s->p_sys;
 
-    assert( p_sys->f );
+    assert( IsRecording( p_sys ) );
 
-    msg_Dbg( s, "Recording completed" );
-    fclose( p_sys->f );
+    /* Waits for the queued data to be written */
+    if( p_sys->p_out )
+        sout_AccessOutDelete( p_sys->p_out );
+    else
+        fclose( p_sys->f );
+    p_sys->p_out = NULL;
     p_sys->f = NULL;
+    msg_Dbg( s, "Recording completed" );
+    return VLC_SUCCESS;
+}
+
+/* Data read before recording started, copied as the caller keeps it */
+static int RecordData( stream_t *s, va_list args )
+{
+    const void *p_data = va_arg( args, const void * );
+    size_t i_data = va_arg( args, size_t );
+
+    if( !IsRecording( s->p_sys ) )
+        return VLC_EGENERIC;
+    if( i_data == 0 )
+        return VLC_SUCCESS;
+
+    block_t *p_record = block_Alloc( i_data );
+    if( !p_record )
+        return VLC_ENOMEM;
+    memcpy( p_record->p_buffer, p_data, i_data );
+    Write( s, p_record );
     return VLC_SUCCESS;
 }
 
-static void Write( stream_t *s, const uint8_t *p_buffer, size_t i_buffer )
+static void Write( stream_t *s, block_t *p_block )
 {
     stream_sys_t *p_sys = s->p_sys;
 
-    assert( p_sys->f );
+    assert( IsRecording( p_sys ) );
 
-    if( i_buffer > 0 )
-    {
-        const bool b_previous_error = p_sys->b_error;
-        const size_t i_written = fwrite( p_buffer, 1, i_buffer, p_sys->f );
+    const bool b_previous_error = p_sys->b_error;
 
-        p_sys->b_error = i_written != i_buffer;
+    if( p_sys->p_out )
+    {
+        /* Only queued: the file access output writes from its own thread */
+        p_sys->b_error = sout_AccessOutWrite( p_sys->p_out, p_block ) < 0;
+    }
+    else
+    {
+        const size_t i_buffer = p_block->i_buffer;
 
-        /* TODO maybe a intf_UserError or something like that ? */
-        if( p_sys->b_error && !b_previous_error )
-            msg_Err( s, "Failed to record data (begin)" );
-        else if( !p_sys->b_error && b_previous_error )
-            msg_Err( s, "Failed to record data (end)" );
+        p_sys->b_error = fwrite( p_block->p_buffer, 1, i_buffer, p_sys->f ) != i_buffer;
+        block_Release( p_block );
     }
+
+    /* TODO maybe a intf_UserError or something like that ? */
+    if( p_sys->b_error && !b_previous_error )
+        msg_Err( s, "Failed to record data (begin)" );
+    else if( !p_sys->b_error && b_previous_error )
+        msg_Err( s, "Failed to record data (end)" );
 }
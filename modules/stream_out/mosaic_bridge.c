@@ -510,6 +510,11 @@ static int Send( sout_stream_t *p_stream, sout_stream_id_sys_t *id,
         return VLC_SUCCESS;
     }
 
+    /* the decoder may modify its input in place */
+    p_buffer = block_Writable( p_buffer );
+    if( p_buffer == NULL )
+        return VLC_ENOMEM;
+
     while ( (p_pic = p_sys->p_decoder->pf_decode_video( p_sys->p_decoder,
                                                         &p_buffer )) )
     {
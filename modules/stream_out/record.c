@@ -328,8 +328,9 @@ static int OutputNew( sout_stream_t *p_stream,
     }
     free( psz_tmp );
 
-    if( asprintf( &psz_output, "std{access=file{no-append,no-format},"
-                  "mux='%s',dst='%s'}", psz_muxer, psz_file ) < 0 )
+    /* Written from the access output thread, with an 8 MiB queue */
+    if( asprintf( &psz_output, "std{access=file{no-append,no-format,"
+                  "buffer=8192},mux='%s',dst='%s'}", psz_muxer, psz_file ) < 0 )
     {
         psz_output = NULL;
         goto error;
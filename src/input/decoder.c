@@ -33,6 +33,7 @@
 
 #include <vlc_common.h>
 
+#include <vlc_atomic.h>
 #include <vlc_block.h>
 #include <vlc_vout.h>
 #include <vlc_aout.h>
@@ -84,6 +85,18 @@ struct decoder_owner_sys_t
 
     /* fifo */
     block_fifo_t *p_fifo;
+    struct
+    {
+        mtime_t      i_max;  /* live inputs: dropped beyond */
+        mtime_t      i_pace; /* paced inputs: read ahead */
+
+        mtime_t      i_last_in;  /* input thread only */
+        mtime_t      i_last_out; /* with p_fifo locked */
+
+        atomic_llong i_duration;
+        atomic_llong i_duration_max;
+        atomic_uint  i_dropped;
+    } fifo;
 
     /* Lock for communication with decoder thread */
     vlc_mutex_t lock;
@@ -135,6 +148,47 @@ struct decoder_owner_sys_t
 /* */
 #define DECODER_SPU_VOUT_WAIT_DURATION ((int)(0.200*CLOCK_FREQ))
 
+/* Timestamp gaps longer than this are not counted in the FIFO duration */
+#define DECODER_FIFO_MAX_GAP (10*CLOCK_FREQ)
+
+/**
+ * Returns the duration a block accounts for in the decoder FIFO: its length,
+ * or else the time elapsed since the previous block. The input thread and the
+ * decoder thread compute it on the same sequence of blocks, and thus agree.
+ */
+static mtime_t DecoderBlockDuration( const block_t *p_block, mtime_t *pi_last )
+{
+    mtime_t i_date = p_block->i_dts > VLC_TS_INVALID ? p_block->i_dts
+                                                     : p_block->i_pts;
+    mtime_t i_duration = 0;
+
+    if( p_block->i_length > 0 )
+        i_duration = p_block->i_length;
+    else if( i_date > VLC_TS_INVALID && *pi_last > VLC_TS_INVALID &&
+             i_date > *pi_last && i_date - *pi_last < DECODER_FIFO_MAX_GAP )
+        i_duration = i_date - *pi_last;
+
+    if( i_date > VLC_TS_INVALID )
+        *pi_last = i_date;
+    return i_duration;
+}
+
+static mtime_t DecoderFifoDuration( decoder_owner_sys_t *p_owner )
+{
+    return __MAX( atomic_load( &p_owner->fifo.i_duration ), 0 );
+}
+
+/**
+ * Empties the FIFO. The FIFO must be locked by the input thread.
+ */
+static void DecoderFifoEmpty( decoder_owner_sys_t *p_owner )
+{
+    block_ChainRelease( vlc_fifo_DequeueAllUnlocked( p_owner->p_fifo ) );
+    atomic_store( &p_owner->fifo.i_duration, 0 );
+    p_owner->fifo.i_last_in = VLC_TS_INVALID;
+    p_owner->fifo.i_last_out = VLC_TS_INVALID;
+}
+
 static void DecoderUpdateFormatLocked( decoder_t *p_dec )
 {
     decoder_owner_sys_t *p_owner = p_dec->p_owner;
@@ -842,8 +896,8 @@ static void DecoderGetCc( decoder_t *p_dec, decoder_t *p_dec_cc )
         if( !p_owner->cc.pp_decoder[i] )
             continue;
 
-        block_FifoPut( p_owner->cc.pp_decoder[i]->p_owner->p_fifo,
-            (i_cc_decoder > 1) ? block_Duplicate(p_cc) : p_cc);
+        input_DecoderDecode( p_owner->cc.pp_decoder[i],
+            (i_cc_decoder > 1) ? block_Duplicate(p_cc) : p_cc, false );
 
         i_cc_decoder--;
         b_processed = true;
@@ -1435,6 +1489,9 @@ static void *DecoderThread( void *p_data )
         }
 
         p_block = vlc_fifo_DequeueUnlocked( p_owner->p_fifo );
+        if( p_block != NULL )
+            atomic_fetch_sub( &p_owner->fifo.i_duration,
+                DecoderBlockDuration( p_block, &p_owner->fifo.i_last_out ) );
         vlc_cleanup_run();
 
         int canc = vlc_savecancel();
@@ -1539,6 +1596,32 @@ static decoder_t * CreateDecoder( vlc_object_t *p_parent,
         return NULL;
     }
 
+    switch( fmt->i_cat )
+    {
+        case AUDIO_ES:
+            p_owner->fifo.i_max = var_InheritInteger( p_dec, "audio-decoder-buffer" );
+            break;
+        case VIDEO_ES:
+            p_owner->fifo.i_max = var_InheritInteger( p_dec, "video-decoder-buffer" );
+            break;
+        default:
+            p_owner->fifo.i_max = var_InheritInteger( p_dec, "sub-decoder-buffer" );
+            break;
+    }
+    p_owner->fifo.i_max *= 1000;
+    p_owner->fifo.i_pace = var_InheritInteger( p_dec, "decoder-read-ahead" ) * 1000;
+    p_owner->fifo.i_last_in = VLC_TS_INVALID;
+    p_owner->fifo.i_last_out = VLC_TS_INVALID;
+    atomic_init( &p_owner->fifo.i_duration, 0 );
+    atomic_init( &p_owner->fifo.i_duration_max, 0 );
+    atomic_init( &p_owner->fifo.i_dropped, 0 );
+    /* FIFO statistics, published by the ES output */
+    var_Create( p_dec, "fifo-count", VLC_VAR_INTEGER );
+    var_Create( p_dec, "fifo-bytes", VLC_VAR_INTEGER );
+    var_Create( p_dec, "fifo-duration", VLC_VAR_INTEGER );
+    var_Create( p_dec, "fifo-duration-max", VLC_VAR_INTEGER );
+    var_Create( p_dec, "fifo-dropped", VLC_VAR_INTEGER );
+
     vlc_mutex_init( &p_owner->lock );
     vlc_cond_init( &p_owner->wait_request );
     vlc_cond_init( &p_owner->wait_acknowledge );
@@ -1634,9 +1717,14 @@ static void DeleteDecoder( decoder_t * p_dec )
 {
     decoder_owner_sys_t *p_owner = p_dec->p_owner;
 
-    msg_Dbg( p_dec, "killing decoder fourcc `%4.4s', %u PES in FIFO",
-             (char*)&p_dec->fmt_in.i_codec,
-             (unsigned)block_FifoCount( p_owner->p_fifo ) );
+    decoder_fifo_stats_t stats;
+
+    input_DecoderGetFifoStats( p_dec, &stats );
+    msg_Dbg( p_dec, "killing decoder fourcc `%4.4s', %zu PES in FIFO "
+             "(%"PRId64" ms, at most %"PRId64" ms, %u dropped)",
+             (char*)&p_dec->fmt_in.i_codec, stats.i_count,
+             stats.i_duration / 1000, stats.i_duration_max / 1000,
+             stats.i_dropped );
 
     /* Free all packets still in the decoder fifo. */
     block_FifoRelease( p_owner->p_fifo );
@@ -1842,41 +1930,95 @@ void input_DecoderDelete( decoder_t *p_dec )
     DeleteDecoder( p_dec );
 }
 
+/* Whether a live input is queueing data faster than it is decoded */
+static bool DecoderFifoIsOverflowing( decoder_owner_sys_t *p_owner )
+{
+    mtime_t i_duration = DecoderFifoDuration( p_owner );
+
+    if( i_duration > 0 && p_owner->fifo.i_max > 0 &&
+        i_duration > p_owner->fifo.i_max )
+        return true;
+
+    /* Also bound the size, whatever the timestamps say:
+     * 400 MiB, i.e. ~ 50mb/s for 60s */
+    return vlc_fifo_GetBytes( p_owner->p_fifo ) > 400*1024*1024;
+}
+
+/* Whether a paced input has read far enough ahead */
+static bool DecoderFifoIsFull( decoder_owner_sys_t *p_owner )
+{
+    size_t i_count = vlc_fifo_GetCount( p_owner->p_fifo );
+    mtime_t i_duration = DecoderFifoDuration( p_owner );
+
+    if( i_count == 0 )
+        return false;
+    if( i_duration > 0 )
+        return i_duration >= p_owner->fifo.i_pace;
+
+    /* No timestamps */
+    return i_count >= 10;
+}
+
 /**
  * Put a block_t in the decoder's fifo.
  * Thread-safe w.r.t. the decoder. May be a cancellation point.
  *
+ * Calls for a given decoder must not overlap, as blocks are queued with
+ * vlc_fifo_Push(). Within VLC, that holds for every producer:
+ *  - the ES output calls this with its lock held, including when the
+ *    timeshift thread forwards blocks to it, and flushes from its control
+ *    function, also with its lock held;
+ *  - closed captions decoders are only fed by their parent decoder thread;
+ *  - stream outputs are called with the stream output lock held.
+ *
  * \param p_dec the decoder object
  * \param p_block the data block
+ * \param b_do_pace whether to wait for the decoder to catch up
  */
 void input_DecoderDecode( decoder_t *p_dec, block_t *p_block, bool b_do_pace )
 {
     decoder_owner_sys_t *p_owner = p_dec->p_owner;
 
-    vlc_fifo_Lock( p_owner->p_fifo );
+    /* The FIFO is only locked in the uncommon cases below. Otherwise, the
+     * block is pushed without locking, and the decoder thread is only woken
+     * up if it is idle. The FIFO levels can be read without the lock as
+     * hints, and are checked again with the lock held. */
     if( !b_do_pace )
     {
-        /* FIXME: ideally we would check the time amount of data
-         * in the FIFO instead of its size. */
-        /* 400 MiB, i.e. ~ 50mb/s for 60s */
-        if( vlc_fifo_GetBytes( p_owner->p_fifo ) > 400*1024*1024 )
+        if( DecoderFifoIsOverflowing( p_owner ) )
         {
-            msg_Warn( p_dec, "decoder/packetizer fifo full (data not "
-                      "consumed quickly enough), resetting fifo!" );
-            block_ChainRelease( vlc_fifo_DequeueAllUnlocked( p_owner->p_fifo ) );
+            vlc_fifo_Lock( p_owner->p_fifo );
+            if( DecoderFifoIsOverflowing( p_owner ) )
+            {
+                msg_Warn( p_dec, "decoder/packetizer fifo full (data not "
+                          "consumed quickly enough), resetting fifo!" );
+                atomic_fetch_add( &p_owner->fifo.i_dropped,
+                                  vlc_fifo_GetCount( p_owner->p_fifo ) );
+                DecoderFifoEmpty( p_owner );
+            }
+            vlc_fifo_Unlock( p_owner->p_fifo );
         }
     }
     else
-    if( !p_owner->b_waiting )
+    if( !p_owner->b_waiting && DecoderFifoIsFull( p_owner ) )
     {   /* The FIFO is not consumed when waiting, so pacing would deadlock VLC.
          * Locking is not necessary as b_waiting is only read, not written by
          * the decoder thread. */
-        while( vlc_fifo_GetCount( p_owner->p_fifo ) >= 10 )
+        vlc_fifo_Lock( p_owner->p_fifo );
+        while( DecoderFifoIsFull( p_owner ) )
             vlc_fifo_WaitCond( p_owner->p_fifo, &p_owner->wait_fifo );
+        vlc_fifo_Unlock( p_owner->p_fifo );
     }
 
-    vlc_fifo_QueueUnlocked( p_owner->p_fifo, p_block );
-    vlc_fifo_Unlock( p_owner->p_fifo );
+    /* Account for the block before the decoder thread can dequeue it */
+    atomic_fetch_add( &p_owner->fifo.i_duration,
+        DecoderBlockDuration( p_block, &p_owner->fifo.i_last_in ) );
+
+    mtime_t i_duration = DecoderFifoDuration( p_owner );
+    if( i_duration > atomic_load( &p_owner->fifo.i_duration_max ) )
+        atomic_store( &p_owner->fifo.i_duration_max, i_duration );
+
+    vlc_fifo_Push( p_owner->p_fifo, p_block );
 }
 
 bool input_DecoderIsEmpty( decoder_t * p_dec )
@@ -1928,7 +2070,7 @@ static void DecoderFlush( decoder_t *p_dec )
 
     vlc_fifo_Lock( p_owner->p_fifo );
     /* Empty the fifo */
-    block_ChainRelease( vlc_fifo_DequeueAllUnlocked( p_owner->p_fifo ) );
+    DecoderFifoEmpty( p_owner );
     p_owner->b_draining = false; /* flush supersedes drain */
     vlc_fifo_Unlock( p_owner->p_fifo );
 
@@ -2192,6 +2334,20 @@ size_t input_DecoderGetFifoSize( decoder_t *p_dec )
     return block_FifoSize( p_owner->p_fifo );
 }
 
+void input_DecoderGetFifoStats( decoder_t *p_dec, decoder_fifo_stats_t *p_stats )
+{
+    decoder_owner_sys_t *p_owner = p_dec->p_owner;
+
+    vlc_fifo_Lock( p_owner->p_fifo );
+    p_stats->i_count = vlc_fifo_GetCount( p_owner->p_fifo );
+    p_stats->i_bytes = vlc_fifo_GetBytes( p_owner->p_fifo );
+    p_stats->i_duration = DecoderFifoDuration( p_owner );
+    vlc_fifo_Unlock( p_owner->p_fifo );
+
+    p_stats->i_duration_max = atomic_load( &p_owner->fifo.i_duration_max );
+    p_stats->i_dropped = atomic_load( &p_owner->fifo.i_dropped );
+}
+
 void input_DecoderGetObjects( decoder_t *p_dec,
                               vout_thread_t **pp_vout, audio_output_t **pp_aout )
 {
@@ -103,6 +103,23 @@ bool input_DecoderHasFormatChanged( decoder_t *p_dec, es_format_t *p_fmt, vlc_me
  */
 size_t input_DecoderGetFifoSize( decoder_t *p_dec );
 
+/**
+ * Decoder fifo statistics
+ */
+typedef struct
+{
+    size_t   i_count;        /**< number of queued blocks */
+    size_t   i_bytes;        /**< size of queued blocks */
+    mtime_t  i_duration;     /**< duration of queued blocks */
+    mtime_t  i_duration_max; /**< highest duration queued so far */
+    unsigned i_dropped;      /**< number of blocks dropped on overflow */
+} decoder_fifo_stats_t;
+
+/**
+ * This function returns the current fill statistics of the decoder fifo
+ */
+void input_DecoderGetFifoStats( decoder_t *p_dec, decoder_fifo_stats_t *p_stats );
+
 /**
  * This function returns the objects associated to a decoder
  *
@@ -322,6 +322,7 @@ int demux_vaControlHelper( stream_t *s,
         case DEMUX_CAN_RECORD:
         case DEMUX_SET_RECORD_STATE:
         case DEMUX_GET_SIGNAL:
+        case DEMUX_GET_BUFFER_LEVEL:
             return VLC_EGENERIC;
 
         default:
@@ -824,6 +824,20 @@ static void EsOutFrameNext( es_out_t *out )
 
     p_sys->i_preroll_end = -1;
 }
+
+/* Publishes the decoder FIFO statistics as variables of the decoder */
+static void EsOutPublishFifoStats( decoder_t *p_dec )
+{
+    decoder_fifo_stats_t stats;
+
+    input_DecoderGetFifoStats( p_dec, &stats );
+    var_SetInteger( p_dec, "fifo-count", stats.i_count );
+    var_SetInteger( p_dec, "fifo-bytes", stats.i_bytes );
+    var_SetInteger( p_dec, "fifo-duration", stats.i_duration );
+    var_SetInteger( p_dec, "fifo-duration-max", stats.i_duration_max );
+    var_SetInteger( p_dec, "fifo-dropped", stats.i_dropped );
+}
+
 static mtime_t EsOutGetBuffering( es_out_t *out )
 {
     es_out_sys_t *p_sys = out->p_sys;
@@ -2628,6 +2642,16 @@ static int EsOutControlLocked( es_out_t *out, int i_query, va_list args )
 
             input_SendEventPosition( p_sys->p_input, f_position, i_time );
         }
+
+        for( int i = 0; i < p_sys->i_es; i++ )
+        {
+            es_out_id_t *es = p_sys->es[i];
+
+            if( es->p_dec != NULL )
+                EsOutPublishFifoStats( es->p_dec );
+            if( es->p_dec_record != NULL )
+                EsOutPublishFifoStats( es->p_dec_record );
+        }
         return VLC_SUCCESS;
     }
     case ES_OUT_SET_JITTER:
@@ -36,6 +36,10 @@
 #endif
 #include <sys/stat.h>
 #include <unistd.h>
+#ifdef HAVE_MMAP
+#   include <fcntl.h>
+#   include <sys/mman.h>
+#endif
 
 #include <vlc_common.h>
 #include <vlc_fs.h>
@@ -150,23 +154,55 @@ typedef struct attribute_packed
     } u;
 } ts_cmd_t;
 
+/* Properties of a block, stored in front of its data */
+typedef struct
+{
+    mtime_t  i_dts;
+    mtime_t  i_pts;
+    mtime_t  i_length;
+    uint32_t i_flags;
+    unsigned i_nb_samples;
+    size_t   i_buffer;
+} ts_block_header_t;
+
+#define TS_STORAGE_CMD_MAX (30000)
+
+/* Time index entry, for each clock reference */
+typedef struct
+{
+    mtime_t i_time;
+    int     i_cmd;
+} ts_index_t;
+
 typedef struct ts_storage_t ts_storage_t;
 struct ts_storage_t
 {
     ts_storage_t *p_next;
 
     /* */
-    char    *psz_file;  /* Filename */
     size_t  i_file_max; /* Max size in bytes */
     int64_t i_file_size;/* Current size in bytes */
+#ifdef HAVE_MMAP
+    int     i_fd;       /* Preallocated and already unlinked file */
+    uint8_t *p_map;     /* Mapping of the whole file, NULL when unmapped */
+#else
+    char    *psz_file;  /* Filename */
     FILE    *p_filew;   /* FILE handle for data writing */
     FILE    *p_filer;   /* FILE handle for data reading */
+#endif
 
     /* */
     int      i_cmd_r;
     int      i_cmd_w;
     int      i_cmd_max;
     ts_cmd_t *p_cmd;
+
+    /* Increasing clock references, the ones before i_index_r were played or
+     * skipped */
+    int        i_index_r;
+    int        i_index;
+    int        i_index_max;
+    ts_index_t *p_index;
 };
 
 typedef struct
@@ -176,6 +212,7 @@ typedef struct
     es_out_t       *p_out;
     int64_t        i_tmp_size_max;
     const char     *psz_tmp_path;
+    int            i_tmp_count_max;
 
     /* Lock for all following fields */
     vlc_mutex_t    lock;
@@ -197,6 +234,8 @@ typedef struct
     /* */
     ts_storage_t   *p_storage_r;
     ts_storage_t   *p_storage_w;
+    ts_storage_t   *p_storage_spare; /* Consumed, kept to reuse its file */
+    int            i_storage_count;  /* Number of temporary files */
 
     mtime_t        i_cmd_delay;
 
@@ -215,6 +254,7 @@ struct es_out_sys_t
     /* Configuration */
     int64_t        i_tmp_size_max;    /* Maximal temporary file size in byte */
     char           *psz_tmp_path;     /* Path for temporary files */
+    int            i_tmp_count_max;   /* Maximal number of temporary files, 0 for no limit */
 
     /* Lock for all following fields */
     vlc_mutex_t    lock;
@@ -250,15 +290,22 @@ static bool         TsHasCmd( ts_thread_t * );
 static bool         TsIsUnused( ts_thread_t * );
 static int          TsChangePause( ts_thread_t *, bool b_source_paused, bool b_paused, mtime_t i_date );
 static int          TsChangeRate( ts_thread_t *, int i_src_rate, int i_rate );
+static int          TsSeek( ts_thread_t *, mtime_t i_offset );
 
 static void         *TsRun( void * );
 
 static ts_storage_t *TsStorageNew( const char *psz_path, int64_t i_tmp_size_max );
 static void         TsStorageDelete( ts_storage_t * );
+static bool         TsStorageReset( ts_storage_t * );
+static void         TsStorageDrop( ts_storage_t *, ts_storage_t *p_dst );
+static bool         TsStorageSkip( ts_storage_t *, int i_end );
+static void         TsStoragePushReset( ts_storage_t *, mtime_t i_date );
+static int          TsStorageFind( ts_storage_t *, mtime_t i_time );
 static void         TsStoragePack( ts_storage_t *p_storage );
+static bool         TsStorageHasFile( ts_storage_t * );
 static bool         TsStorageIsFull( ts_storage_t *, const ts_cmd_t *p_cmd );
 static bool         TsStorageIsEmpty( ts_storage_t * );
-static void         TsStoragePushCmd( ts_storage_t *, const ts_cmd_t *p_cmd, bool b_flush );
+static void         TsStoragePushCmd( ts_storage_t *, const ts_cmd_t *p_cmd );
 static void         TsStoragePopCmd( ts_storage_t *p_storage, ts_cmd_t *p_cmd, bool b_flush );
 
 static void CmdClean( ts_cmd_t * );
@@ -268,6 +315,7 @@ static int  CmdInitAdd    ( ts_cmd_t *, es_out_id_t *, const es_format_t *, bool
 static void CmdInitSend   ( ts_cmd_t *, es_out_id_t *, block_t * );
 static int  CmdInitDel    ( ts_cmd_t *, es_out_id_t * );
 static int  CmdInitControl( ts_cmd_t *, int i_query, va_list, bool b_copy );
+static void CmdInitReset  ( ts_cmd_t *, mtime_t i_date );
 
 /* */
 static void CmdCleanAdd    ( ts_cmd_t * );
@@ -282,7 +330,11 @@ static int  CmdExecuteControl( es_out_t *, ts_cmd_t * );
 
 /* File helpers */
 static char *GetTmpPath( char *psz_path );
+#ifdef HAVE_MMAP
+static int GetTmpFd( const char *psz_path, int64_t i_size );
+#else
 static FILE *GetTmpFile( char **ppsz_file, const char *psz_path );
+#endif
 
 /*****************************************************************************
  * input_EsOutTimeshiftNew:
@@ -330,11 +382,20 @@ es_out_t *input_EsOutTimeshiftNew( input_thread_t *p_input, es_out_t *p_next_out
     else
         p_sys->i_tmp_size_max = __MAX( i_tmp_size_max, 1*1024*1024 );
 
+    const int64_t i_size_max = var_CreateGetInteger( p_input, "input-timeshift-size" );
+    if( i_size_max > 0 )
+        p_sys->i_tmp_count_max = __MAX( i_size_max / p_sys->i_tmp_size_max, 2 );
+    else
+        p_sys->i_tmp_count_max = 0;
+
     char *psz_tmp_path = var_CreateGetNonEmptyString( p_input, "input-timeshift-path" );
     p_sys->psz_tmp_path = GetTmpPath( psz_tmp_path );
 
     msg_Dbg( p_input, "using timeshift granularity of %d MiB, in path '%s'",
              (int)p_sys->i_tmp_size_max/(1024*1024), p_sys->psz_tmp_path );
+    if( p_sys->i_tmp_count_max > 0 )
+        msg_Dbg( p_input, "timeshift limited to %d MiB",
+                 (int)(p_sys->i_tmp_count_max * p_sys->i_tmp_size_max/(1024*1024)) );
 
 #if 0
 #define S(t) msg_Err( p_input, "SIZEOF("#t")=%d", sizeof(t) )
@@ -556,6 +617,15 @@ static int ControlLockedSetTime( es_out_t *p_out, mtime_t i_date )
 {
     es_out_sys_t *p_sys = p_out->p_sys;
 
+    /* A time is a seek of the input within what is buffered */
+    if( i_date >= 0 )
+    {
+        if( !p_sys->b_delayed )
+            return VLC_EGENERIC;
+        return TsSeek( p_sys->p_ts,
+                       i_date - var_GetTime( p_sys->p_input, "time" ) );
+    }
+
     if( !p_sys->b_delayed )
         return es_out_SetTime( p_sys->p_out, i_date );
 
@@ -742,6 +812,7 @@ static int TsStart( es_out_t *p_out )
 
     p_ts->i_tmp_size_max = p_sys->i_tmp_size_max;
     p_ts->psz_tmp_path = p_sys->psz_tmp_path;
+    p_ts->i_tmp_count_max = p_sys->i_tmp_count_max;
     p_ts->p_input = p_sys->p_input;
     p_ts->p_out = p_sys->p_out;
     vlc_mutex_init( &p_ts->lock );
@@ -756,6 +827,8 @@ static int TsStart( es_out_t *p_out )
     p_ts->i_cmd_delay = 0;
     p_ts->p_storage_r = NULL;
     p_ts->p_storage_w = NULL;
+    p_ts->p_storage_spare = NULL;
+    p_ts->i_storage_count = 0;
 
     p_sys->b_delayed = true;
     if( vlc_clone( &p_ts->thread, TsRun, p_ts, VLC_THREAD_PRIORITY_INPUT ) )
@@ -800,17 +873,115 @@ static void TsStop( ts_thread_t *p_ts )
     assert( !p_ts->p_storage_r || !p_ts->p_storage_r->p_next );
     if( p_ts->p_storage_r )
         TsStorageDelete( p_ts->p_storage_r );
+    if( p_ts->p_storage_spare )
+        TsStorageDelete( p_ts->p_storage_spare );
     vlc_mutex_unlock( &p_ts->lock );
 
     TsDestroy( p_ts );
 }
+static void TsRecycleStorageLocked( ts_thread_t *p_ts, ts_storage_t *p_storage )
+{
+    vlc_assert_locked( &p_ts->lock );
+
+    /* Keep one consumed storage to reuse its file */
+    if( !p_ts->p_storage_spare && TsStorageHasFile( p_storage ) &&
+        TsStorageReset( p_storage ) )
+    {
+        p_ts->p_storage_spare = p_storage;
+        return;
+    }
+
+    if( TsStorageHasFile( p_storage ) )
+        p_ts->i_storage_count--;
+    TsStorageDelete( p_storage );
+}
+static void TsNextStorageLocked( ts_thread_t *p_ts )
+{
+    vlc_assert_locked( &p_ts->lock );
+
+    while( p_ts->p_storage_r && TsStorageIsEmpty( p_ts->p_storage_r ) )
+    {
+        ts_storage_t *p_next = p_ts->p_storage_r->p_next;
+        if( !p_next )
+            break;
+
+        TsRecycleStorageLocked( p_ts, p_ts->p_storage_r );
+        p_ts->p_storage_r = p_next;
+    }
+}
+static ts_storage_t *TsDropLocked( ts_thread_t *p_ts )
+{
+    vlc_assert_locked( &p_ts->lock );
+
+    /* Find the oldest data still stored */
+    ts_storage_t *p_old = p_ts->p_storage_r;
+    while( p_old != p_ts->p_storage_w && !TsStorageHasFile( p_old ) )
+        p_old = p_old->p_next;
+    if( p_old == p_ts->p_storage_w )
+        return NULL;
+
+    ts_storage_t *p_storage = TsStorageNew( NULL, 0 );
+    if( !p_storage )
+        return NULL;
+
+    /* The playback jumps over the dropped data */
+    const ts_storage_t *p_next = p_old->p_next;
+    mtime_t i_gap = 0;
+    if( !TsStorageIsEmpty( p_old ) && p_next->i_cmd_w > 0 )
+        i_gap = p_next->p_cmd[0].i_date - p_old->p_cmd[p_old->i_cmd_r].i_date;
+
+    msg_Warn( p_ts->p_input, "es out timeshift: buffer full, dropping %"PRId64" ms",
+              i_gap / 1000 );
+
+    /* The output is reset by the reading thread, like after a seek, so that
+     * the clock does not see the gap */
+    TsStorageDrop( p_old, p_storage );
+    TsNextStorageLocked( p_ts );
+
+    p_ts->i_cmd_delay -= i_gap;
+
+    return p_storage;
+}
+static ts_storage_t *TsGetStorageLocked( ts_thread_t *p_ts, size_t i_size )
+{
+    vlc_assert_locked( &p_ts->lock );
+
+    ts_storage_t *p_storage = p_ts->p_storage_spare;
+    if( p_storage && p_storage->i_file_max >= i_size )
+    {
+        p_ts->p_storage_spare = NULL;
+        return p_storage;
+    }
+
+    /* When the size limit is reached, reuse the file of the oldest data */
+    if( p_ts->i_tmp_count_max > 0 && p_ts->i_storage_count >= p_ts->i_tmp_count_max )
+    {
+        p_storage = TsDropLocked( p_ts );
+        if( !p_storage || p_storage->i_file_max >= i_size )
+            return p_storage;
+
+        TsStorageDelete( p_storage );
+        p_ts->i_storage_count--;
+    }
+
+    /* A block bigger than the granularity gets a file of its own */
+    p_storage = TsStorageNew( p_ts->psz_tmp_path,
+                              __MAX( p_ts->i_tmp_size_max, (int64_t)i_size ) );
+    if( p_storage )
+        p_ts->i_storage_count++;
+    return p_storage;
+}
 static void TsPushCmd( ts_thread_t *p_ts, ts_cmd_t *p_cmd )
 {
     vlc_mutex_lock( &p_ts->lock );
 
     if( !p_ts->p_storage_w || TsStorageIsFull( p_ts->p_storage_w, p_cmd ) )
     {
-        ts_storage_t *p_storage = TsStorageNew( p_ts->psz_tmp_path, p_ts->i_tmp_size_max );
+        size_t i_size = 0;
+        if( p_cmd->i_type == C_SEND )
+            i_size = sizeof(ts_block_header_t) + p_cmd->u.send.p_block->i_buffer;
+
+        ts_storage_t *p_storage = TsGetStorageLocked( p_ts, i_size );
 
         if( !p_storage )
         {
@@ -833,7 +1004,7 @@ static void TsPushCmd( ts_thread_t *p_ts, ts_cmd_t *p_cmd )
     }
 
     /* TODO return error and warn the user (but only once) */
-    TsStoragePushCmd( p_ts->p_storage_w, p_cmd, p_ts->p_storage_r == p_ts->p_storage_w );
+    TsStoragePushCmd( p_ts->p_storage_w, p_cmd );
 
     vlc_cond_signal( &p_ts->wait );
 
@@ -847,16 +1018,7 @@ static int TsPopCmdLocked( ts_thread_t *p_ts, ts_cmd_t *p_cmd, bool b_flush )
         return VLC_EGENERIC;
 
     TsStoragePopCmd( p_ts->p_storage_r, p_cmd, b_flush );
-
-    while( p_ts->p_storage_r && TsStorageIsEmpty( p_ts->p_storage_r ) )
-    {
-        ts_storage_t *p_next = p_ts->p_storage_r->p_next;
-        if( !p_next )
-            break;
-
-        TsStorageDelete( p_ts->p_storage_r );
-        p_ts->p_storage_r = p_next;
-    }
+    TsNextStorageLocked( p_ts );
 
     return VLC_SUCCESS;
 }
@@ -931,6 +1093,58 @@ static int TsChangeRate( ts_thread_t *p_ts, int i_src_rate, int i_rate )
 
     return i_ret;
 }
+static int TsSeek( ts_thread_t *p_ts, mtime_t i_offset )
+{
+    vlc_mutex_lock( &p_ts->lock );
+
+    /* The data played is not kept, only the data ahead can be reached */
+    ts_storage_t *p_current = p_ts->p_storage_r;
+    while( p_current && p_current->i_index_r >= p_current->i_index )
+        p_current = p_current->p_next;
+    if( i_offset < 0 || !p_current )
+    {
+        vlc_mutex_unlock( &p_ts->lock );
+        return VLC_EGENERIC;
+    }
+    const mtime_t i_time = p_current->p_index[p_current->i_index_r].i_time + i_offset;
+
+    /* Find the first clock reference at or after i_time, there are only a
+     * few storages and each one is searched by bisection */
+    ts_storage_t *p_target = NULL;
+    int i_target = -1;
+    for( ts_storage_t *p = p_current; p && i_target < 0; p = p->p_next )
+    {
+        p_target = p;
+        i_target = TsStorageFind( p, i_time );
+    }
+    if( i_target < 0 )
+    {
+        vlc_mutex_unlock( &p_ts->lock );
+        return VLC_EGENERIC;
+    }
+
+    ts_storage_t *p_reset = NULL;
+    const mtime_t i_date = p_ts->p_storage_r->p_cmd[p_ts->p_storage_r->i_cmd_r].i_date;
+    for( ts_storage_t *p = p_ts->p_storage_r; ; p = p->p_next )
+    {
+        if( TsStorageSkip( p, p == p_target ? i_target : p->i_cmd_w ) )
+            p_reset = p;
+        if( p == p_target )
+            break;
+    }
+    TsNextStorageLocked( p_ts );
+
+    if( p_reset )
+    {
+        /* Like after a seek, so that the clock does not see the jump */
+        TsStoragePushReset( p_reset, i_date );
+        p_ts->i_cmd_delay -= p_target->p_cmd[i_target].i_date - i_date;
+        vlc_cond_signal( &p_ts->wait );
+    }
+    vlc_mutex_unlock( &p_ts->lock );
+
+    return VLC_SUCCESS;
+}
 
 static void *TsRun( void *p_data )
 {
@@ -1062,21 +1276,33 @@ static ts_storage_t *TsStorageNew( const char *psz_tmp_path, int64_t i_tmp_size_
     /* */
     p_storage->p_next = NULL;
 
-    /* */
+    /* Without path, the file is handed over later by TsStorageDrop */
     p_storage->i_file_max = i_tmp_size_max;
     p_storage->i_file_size = 0;
-    p_storage->p_filew = GetTmpFile( &p_storage->psz_file, psz_tmp_path );
-    if( p_storage->psz_file )
-        p_storage->p_filer = vlc_fopen( p_storage->psz_file, "rb" );
+#ifdef HAVE_MMAP
+    p_storage->p_map = NULL;
+    p_storage->i_fd = psz_tmp_path ? GetTmpFd( psz_tmp_path, i_tmp_size_max ) : -1;
+#else
+    if( psz_tmp_path )
+    {
+        p_storage->p_filew = GetTmpFile( &p_storage->psz_file, psz_tmp_path );
+        if( p_storage->psz_file )
+            p_storage->p_filer = vlc_fopen( p_storage->psz_file, "rb" );
+    }
+#endif
 
     /* */
     p_storage->i_cmd_w = 0;
     p_storage->i_cmd_r = 0;
-    p_storage->i_cmd_max = 30000;
+    p_storage->i_cmd_max = TS_STORAGE_CMD_MAX;
     p_storage->p_cmd = malloc( p_storage->i_cmd_max * sizeof(*p_storage->p_cmd) );
+    p_storage->i_index_r = 0;
+    p_storage->i_index = 0;
+    p_storage->i_index_max = 0;
+    p_storage->p_index = NULL;
     //fprintf( stderr, "\nSTORAGE name=%s size=%d KiB\n", p_storage->psz_file, p_storage->i_cmd_max * sizeof(*p_storage->p_cmd) /1024 );
 
-    if( !p_storage->p_cmd || !p_storage->p_filew || !p_storage->p_filer )
+    if( !p_storage->p_cmd || ( psz_tmp_path && !TsStorageHasFile( p_storage ) ) )
     {
         TsStorageDelete( p_storage );
         return NULL;
@@ -1094,7 +1320,14 @@ static void TsStorageDelete( ts_storage_t *p_storage )
         CmdClean( &cmd );
     }
     free( p_storage->p_cmd );
+    free( p_storage->p_index );
 
+#ifdef HAVE_MMAP
+    if( p_storage->p_map )
+        munmap( p_storage->p_map, p_storage->i_file_max );
+    if( p_storage->i_fd >= 0 )
+        close( p_storage->i_fd );
+#else
     if( p_storage->p_filer )
         fclose( p_storage->p_filer );
     if( p_storage->p_filew )
@@ -1105,11 +1338,76 @@ static void TsStorageDelete( ts_storage_t *p_storage )
         vlc_unlink( p_storage->psz_file );
         free( p_storage->psz_file );
     }
+#endif
 
     free( p_storage );
 }
+static bool TsStorageReset( ts_storage_t *p_storage )
+{
+    assert( TsStorageIsEmpty( p_storage ) );
+
+    /* Undo TsStoragePack() */
+    if( p_storage->i_cmd_max < TS_STORAGE_CMD_MAX )
+    {
+        ts_cmd_t *p_new = realloc( p_storage->p_cmd, TS_STORAGE_CMD_MAX * sizeof(*p_storage->p_cmd) );
+        if( !p_new )
+            return false;
+        p_storage->p_cmd = p_new;
+        p_storage->i_cmd_max = TS_STORAGE_CMD_MAX;
+    }
+
+    p_storage->p_next = NULL;
+    p_storage->i_file_size = 0;
+    p_storage->i_cmd_w = 0;
+    p_storage->i_cmd_r = 0;
+    p_storage->i_index_r = 0;
+    p_storage->i_index = 0;
+#ifndef HAVE_MMAP
+    rewind( p_storage->p_filew );
+#endif
+    return true;
+}
+static void TsStorageDrop( ts_storage_t *p_storage, ts_storage_t *p_dst )
+{
+    assert( p_dst->i_cmd_w == 0 && !TsStorageHasFile( p_dst ) );
+
+    /* Drop the data not read yet, the output is reset before the next
+     * one */
+    if( !TsStorageIsEmpty( p_storage ) )
+    {
+        const mtime_t i_date = p_storage->p_cmd[p_storage->i_cmd_r].i_date;
+
+        if( TsStorageSkip( p_storage, p_storage->i_cmd_w ) )
+            TsStoragePushReset( p_storage, i_date );
+    }
+
+    /* Hand the file over */
+    p_dst->i_file_max = p_storage->i_file_max;
+    p_dst->i_file_size = 0;
+#ifdef HAVE_MMAP
+    p_dst->i_fd = p_storage->i_fd;
+    p_dst->p_map = p_storage->p_map;
+    p_storage->i_fd = -1;
+    p_storage->p_map = NULL;
+#else
+    p_dst->psz_file = p_storage->psz_file;
+    p_dst->p_filew = p_storage->p_filew;
+    p_dst->p_filer = p_storage->p_filer;
+    p_storage->psz_file = NULL;
+    p_storage->p_filew = NULL;
+    p_storage->p_filer = NULL;
+    rewind( p_dst->p_filew );
+#endif
+}
 static void TsStoragePack( ts_storage_t *p_storage )
 {
+#ifdef HAVE_MMAP
+    /* Only the storages being read or written are mapped */
+    if( p_storage->p_map )
+        munmap( p_storage->p_map, p_storage->i_file_max );
+    p_storage->p_map = NULL;
+#endif
+
     /* Try to release a bit of memory */
     if( p_storage->i_cmd_w >= p_storage->i_cmd_max )
         return;
@@ -1120,13 +1418,21 @@ static void TsStoragePack( ts_storage_t *p_storage )
     if( p_new )
         p_storage->p_cmd = p_new;
 }
+static bool TsStorageHasFile( ts_storage_t *p_storage )
+{
+#ifdef HAVE_MMAP
+    return p_storage->i_fd >= 0;
+#else
+    return p_storage->p_filew && p_storage->p_filer;
+#endif
+}
 static bool TsStorageIsFull( ts_storage_t *p_storage, const ts_cmd_t *p_cmd )
 {
-    if( p_cmd && p_cmd->i_type == C_SEND && p_storage->i_cmd_w > 0 )
+    if( p_cmd && p_cmd->i_type == C_SEND )
     {
-        size_t i_size = sizeof(*p_cmd->u.send.p_block) + p_cmd->u.send.p_block->i_buffer;
+        size_t i_size = sizeof(ts_block_header_t) + p_cmd->u.send.p_block->i_buffer;
 
-        if( p_storage->i_file_size + i_size >= p_storage->i_file_max )
+        if( p_storage->i_file_size + i_size > p_storage->i_file_max )
             return true;
     }
     return p_storage->i_cmd_w >= p_storage->i_cmd_max;
@@ -1135,7 +1441,54 @@ static bool TsStorageIsEmpty( ts_storage_t *p_storage )
 {
     return !p_storage || p_storage->i_cmd_r >= p_storage->i_cmd_w;
 }
-static void TsStoragePushCmd( ts_storage_t *p_storage, const ts_cmd_t *p_cmd, bool b_flush )
+#ifdef HAVE_MMAP
+static bool TsStorageMap( ts_storage_t *p_storage )
+{
+    if( p_storage->p_map )
+        return true;
+    if( p_storage->i_fd < 0 )
+        return false;
+
+    void *p_map = mmap( NULL, p_storage->i_file_max, PROT_READ|PROT_WRITE,
+                        MAP_SHARED, p_storage->i_fd, 0 );
+    if( p_map == MAP_FAILED )
+        return false;
+    p_storage->p_map = p_map;
+    return true;
+}
+#endif
+static bool TsStorageWrite( ts_storage_t *p_storage, const void *p_data, size_t i_data )
+{
+#ifdef HAVE_MMAP
+    if( p_storage->i_file_size + i_data > p_storage->i_file_max ||
+        !TsStorageMap( p_storage ) )
+        return false;
+    memcpy( &p_storage->p_map[p_storage->i_file_size], p_data, i_data );
+#else
+    if( i_data > 0 && fwrite( p_data, i_data, 1, p_storage->p_filew ) != 1 )
+        return false;
+#endif
+    p_storage->i_file_size += i_data;
+    return true;
+}
+static bool TsStorageRead( ts_storage_t *p_storage, int64_t i_offset, void *p_data, size_t i_data )
+{
+    if( i_offset < 0 || i_offset + i_data > (uint64_t)p_storage->i_file_size )
+        return false;
+#ifdef HAVE_MMAP
+    if( !TsStorageMap( p_storage ) )
+        return false;
+    memcpy( p_data, &p_storage->p_map[i_offset], i_data );
+    return true;
+#else
+    /* The data may still be buffered by the writer */
+    return i_data == 0 ||
+           ( !fflush( p_storage->p_filew ) &&
+             !fseek( p_storage->p_filer, i_offset, SEEK_SET ) &&
+             fread( p_data, i_data, 1, p_storage->p_filer ) == 1 );
+#endif
+}
+static void TsStoragePushCmd( ts_storage_t *p_storage, const ts_cmd_t *p_cmd )
 {
     ts_cmd_t cmd = *p_cmd;
 
@@ -1144,29 +1497,52 @@ static void TsStoragePushCmd( ts_storage_t *p_storage, const ts_cmd_t *p_cmd, bo
     if( cmd.i_type == C_SEND )
     {
         block_t *p_block = cmd.u.send.p_block;
+        const ts_block_header_t header = {
+            .i_dts = p_block->i_dts,
+            .i_pts = p_block->i_pts,
+            .i_length = p_block->i_length,
+            .i_flags = p_block->i_flags,
+            .i_nb_samples = p_block->i_nb_samples,
+            .i_buffer = p_block->i_buffer,
+        };
 
         cmd.u.send.p_block = NULL;
-        cmd.u.send.i_offset = ftell( p_storage->p_filew );
+        cmd.u.send.i_offset = p_storage->i_file_size;
 
-        if( fwrite( p_block, sizeof(*p_block), 1, p_storage->p_filew ) != 1 )
-        {
-            block_Release( p_block );
+        /* With a mapping, this is a plain copy: the kernel writes the
+         * pages back in the background */
+        const bool b_written = TsStorageWrite( p_storage, &header, sizeof(header) ) &&
+                               TsStorageWrite( p_storage, p_block->p_buffer, p_block->i_buffer );
+        block_Release( p_block );
+        if( !b_written )
             return;
-        }
-        p_storage->i_file_size += sizeof(*p_block);
-        if( p_block->i_buffer > 0 )
+    }
+    else if( cmd.i_type == C_CONTROL &&
+             ( cmd.u.control.i_query == ES_OUT_SET_PCR ||
+               cmd.u.control.i_query == ES_OUT_SET_GROUP_PCR ) )
+    {
+        const mtime_t i_time = cmd.u.control.i_query == ES_OUT_SET_PCR ?
+                               cmd.u.control.u.i_i64 : cmd.u.control.u.int_i64.i_i64;
+
+        /* Restart the index on a discontinuity, so that it stays sorted */
+        if( p_storage->i_index > p_storage->i_index_r &&
+            p_storage->p_index[p_storage->i_index - 1].i_time > i_time )
+            p_storage->i_index_r = p_storage->i_index;
+
+        if( p_storage->i_index >= p_storage->i_index_max )
         {
-            if( fwrite( p_block->p_buffer, p_block->i_buffer, 1, p_storage->p_filew ) != 1 )
+            const int i_max = __MAX( 2 * p_storage->i_index_max, 64 );
+            ts_index_t *p_new = realloc( p_storage->p_index, i_max * sizeof(*p_new) );
+            if( p_new )
             {
-                block_Release( p_block );
-                return;
+                p_storage->p_index = p_new;
+                p_storage->i_index_max = i_max;
             }
         }
-        p_storage->i_file_size += p_block->i_buffer;
-        block_Release( p_block );
-
-        if( b_flush )
-            fflush( p_storage->p_filew );
+        /* Without room, this reference cannot be seeked to */
+        if( p_storage->i_index < p_storage->i_index_max )
+            p_storage->p_index[p_storage->i_index++] = (ts_index_t){
+                .i_time = i_time, .i_cmd = p_storage->i_cmd_w };
     }
     p_storage->p_cmd[p_storage->i_cmd_w++] = cmd;
 }
@@ -1175,32 +1551,90 @@ static void TsStoragePopCmd( ts_storage_t *p_storage, ts_cmd_t *p_cmd, bool b_fl
     assert( !TsStorageIsEmpty( p_storage ) );
 
     *p_cmd = p_storage->p_cmd[p_storage->i_cmd_r++];
+
+    /* The references played cannot be seeked to anymore */
+    while( p_storage->i_index_r < p_storage->i_index &&
+           p_storage->p_index[p_storage->i_index_r].i_cmd < p_storage->i_cmd_r )
+        p_storage->i_index_r++;
+
     if( p_cmd->i_type == C_SEND )
     {
-        block_t block;
+        const int64_t i_offset = p_cmd->u.send.i_offset;
+        ts_block_header_t header;
+        block_t *p_block = NULL;
 
         if( !b_flush &&
-            !fseek( p_storage->p_filer, p_cmd->u.send.i_offset, SEEK_SET ) &&
-            fread( &block, sizeof(block), 1, p_storage->p_filer ) == 1 )
+            TsStorageRead( p_storage, i_offset, &header, sizeof(header) ) )
         {
-            block_t *p_block = block_Alloc( block.i_buffer );
+            p_block = block_Alloc( header.i_buffer );
+            if( p_block &&
+                !TsStorageRead( p_storage, i_offset + sizeof(header),
+                                p_block->p_buffer, header.i_buffer ) )
+            {
+                block_Release( p_block );
+                p_block = NULL;
+            }
             if( p_block )
             {
-                p_block->i_dts      = block.i_dts;
-                p_block->i_pts      = block.i_pts;
-                p_block->i_flags    = block.i_flags;
-                p_block->i_length   = block.i_length;
-                p_block->i_nb_samples = block.i_nb_samples;
-                p_block->i_buffer = fread( p_block->p_buffer, 1, block.i_buffer, p_storage->p_filer );
+                p_block->i_dts      = header.i_dts;
+                p_block->i_pts      = header.i_pts;
+                p_block->i_flags    = header.i_flags;
+                p_block->i_length   = header.i_length;
+                p_block->i_nb_samples = header.i_nb_samples;
             }
-            p_cmd->u.send.p_block = p_block;
         }
+        p_cmd->u.send.p_block = p_block;
+    }
+}
+static bool TsStorageSkip( ts_storage_t *p_storage, int i_end )
+{
+    /* Skip the data not read yet before i_end, but keep the commands changing
+     * the state of the output, packed right before i_end */
+    int i_cmd_r = i_end;
+    for( int i = i_end - 1; i >= p_storage->i_cmd_r; i-- )
+    {
+        const ts_cmd_t *p_cmd = &p_storage->p_cmd[i];
+
+        if( p_cmd->i_type == C_SEND )
+            continue;
+        if( p_cmd->i_type == C_CONTROL &&
+            ( p_cmd->u.control.i_query == ES_OUT_SET_PCR ||
+              p_cmd->u.control.i_query == ES_OUT_SET_GROUP_PCR ) )
+            continue;
+        p_storage->p_cmd[--i_cmd_r] = *p_cmd;
+    }
+    const bool b_skipped = i_cmd_r > p_storage->i_cmd_r;
+    p_storage->i_cmd_r = i_cmd_r;
+
+    /* The references skipped do not point to themselves anymore */
+    while( p_storage->i_index_r < p_storage->i_index &&
+           p_storage->p_index[p_storage->i_index_r].i_cmd < i_end )
+        p_storage->i_index_r++;
+
+    return b_skipped;
+}
+static void TsStoragePushReset( ts_storage_t *p_storage, mtime_t i_date )
+{
+    /* Takes the place of a skipped command */
+    assert( p_storage->i_cmd_r > 0 );
+
+    CmdInitReset( &p_storage->p_cmd[--p_storage->i_cmd_r], i_date );
+}
+static int TsStorageFind( ts_storage_t *p_storage, mtime_t i_time )
+{
+    int i_low = p_storage->i_index_r;
+    int i_high = p_storage->i_index;
+
+    while( i_low < i_high )
+    {
+        const int i_middle = i_low + ( i_high - i_low ) / 2;
+
+        if( p_storage->p_index[i_middle].i_time < i_time )
+            i_low = i_middle + 1;
         else
-        {
-            //perror( "TsStoragePopCmd" );
-            p_cmd->u.send.p_block = block_Alloc( 1 );
-        }
+            i_high = i_middle;
     }
+    return i_low < p_storage->i_index ? p_storage->p_index[i_low].i_cmd : -1;
 }
 
 /*****************************************************************************
@@ -1443,6 +1877,14 @@ static int CmdInitControl( ts_cmd_t *p_cmd, int i_query, va_list args, bool b_co
 
     return VLC_SUCCESS;
 }
+static void CmdInitReset( ts_cmd_t *p_cmd, mtime_t i_date )
+{
+    /* Reset of the output after a jump in the data */
+    p_cmd->i_type = C_CONTROL;
+    p_cmd->i_date = i_date;
+    p_cmd->u.control.i_query = ES_OUT_SET_TIME;
+    p_cmd->u.control.u.i_i64 = -1;
+}
 static int CmdExecuteControl( es_out_t *p_out, ts_cmd_t *p_cmd )
 {
     const int i_query = p_cmd->u.control.i_query;
@@ -1457,6 +1899,7 @@ static int CmdExecuteControl( es_out_t *p_out, ts_cmd_t *p_cmd )
 
     case ES_OUT_SET_PCR:                /* arg1=int64_t i_pcr(microsecond!) (using default group 0)*/
     case ES_OUT_SET_NEXT_DISPLAY_TIME:  /* arg1=int64_t i_pts(microsecond) */
+    case ES_OUT_SET_TIME:               /* arg1=mtime_t, only queued by CmdInitReset */
         return es_out_Control( p_out, i_query, p_cmd->u.control.u.i_i64 );
 
     case ES_OUT_SET_GROUP_PCR:          /* arg1= int i_group, arg2=int64_t i_pcr(microsecond!)*/
@@ -1533,7 +1976,7 @@ static void CmdCleanControl( ts_cmd_t *p_cmd )
 
 
 /*****************************************************************************
- * GetTmpFile/Path:
+ * GetTmpFd/File/Path:
  *****************************************************************************/
 static char *GetTmpPath( char *psz_path )
 {
@@ -1586,6 +2029,39 @@ static char *GetTmpPath( char *psz_path )
     return psz_path;
 }
 
+#ifdef HAVE_MMAP
+static int GetTmpFd( const char *psz_path, int64_t i_size )
+{
+    char *psz_name;
+    int fd;
+
+    /* */
+    if( asprintf( &psz_name, "%s"DIR_SEP"vlc-timeshift.XXXXXX", psz_path ) < 0 )
+        return -1;
+
+    /* The file is only used through its descriptor */
+    fd = vlc_mkstemp( psz_name );
+    if( fd >= 0 )
+        vlc_unlink( psz_name );
+    free( psz_name );
+
+    if( fd < 0 )
+        return -1;
+
+    /* Allocate the blocks now: running out of disk space while writing
+     * to the mapping would raise SIGBUS */
+#ifdef HAVE_POSIX_FALLOCATE
+    if( posix_fallocate( fd, 0, i_size ) )
+#else
+    if( ftruncate( fd, i_size ) )
+#endif
+    {
+        close( fd );
+        return -1;
+    }
+    return fd;
+}
+#else
 static FILE *GetTmpFile( char **ppsz_file, const char *psz_path )
 {
     char *psz_name;
@@ -1611,4 +2087,5 @@ static FILE *GetTmpFile( char **ppsz_file, const char *psz_path )
 
     return f;
 }
+#endif
 
@@ -683,6 +683,18 @@ static void MainLoopStatistics( input_thread_t *p_input )
     vlc_mutex_unlock( &p_input->p->p_item->lock );
 
     stats_ComputeInputStats( p_input, p_input->p->p_item->p_stats );
+
+    int64_t i_buffer_level;
+    if( libvlc_stats( p_input ) &&
+        !demux_Control( p_input->p->input.p_demux,
+                        DEMUX_GET_BUFFER_LEVEL, &i_buffer_level ) )
+    {
+        input_stats_t *p_stats = p_input->p->p_item->p_stats;
+
+        vlc_mutex_lock( &p_stats->lock );
+        p_stats->f_demux_buffer_level = (float)i_buffer_level / CLOCK_FREQ;
+        vlc_mutex_unlock( &p_stats->lock );
+    }
     input_SendEventStatistics( p_input );
 }
 
@@ -1688,6 +1700,13 @@ static bool Control( input_thread_t *p_input,
             if( i_time < 0 )
                 i_time = 0;
 
+            /* Seek within the timeshift buffer first, if ahead */
+            if( !es_out_SetTime( p_input->p->p_es_out, i_time ) )
+            {
+                b_force_update = true;
+                break;
+            }
+
             /* Reset the decoders states and clock sync (before calling the demuxer */
             es_out_SetTime( p_input->p->p_es_out, -1 );
 
@@ -2340,6 +2359,21 @@ static int InputSourceInit( input_thread_t *p_input,
             goto error;
         }
 
+        /* Read ahead from a background thread */
+        int64_t i_prefetch = var_InheritInteger( p_input, "prefetch-buffer-size" );
+        bool b_dir;
+
+        if( i_prefetch > 0 && !p_input->b_preparsing
+         && stream_Control( p_stream, STREAM_IS_DIRECTORY, &b_dir ) == VLC_SUCCESS
+         && !b_dir )
+        {
+            stream_t *p_prefetch = stream_PrefetchNew( p_stream,
+                i_prefetch * 1024,
+                var_InheritInteger( p_input, "prefetch-read-size" ) * 1024 );
+            if( p_prefetch != NULL )
+                p_stream = p_prefetch;
+        }
+
         /* Add stream filters */
         char *psz_stream_filter = var_GetNonEmptyString( p_input,
                                                          "stream-filter" );
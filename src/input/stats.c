@@ -117,6 +117,13 @@ void stats_ComputeInputStats(input_thread_t *input, input_stats_t *st)
 
     vlc_mutex_unlock(&st->lock);
     vlc_mutex_unlock(&input->p->counters.counters_lock);
+
+    /* Block allocator (process-wide, published on the instance) */
+    uint64_t hits, misses, retained;
+    block_PoolStats(&hits, &misses, &retained);
+    var_SetInteger(input->p_libvlc, "block-pool-hits", hits);
+    var_SetInteger(input->p_libvlc, "block-pool-misses", misses);
+    var_SetInteger(input->p_libvlc, "block-pool-retained", retained);
 }
 
 void stats_ReinitInputStats( input_stats_t *p_stats )
@@ -127,11 +134,11 @@ void stats_ReinitInputStats( input_stats_t *p_stats )
     p_stats->i_demux_read_packets = p_stats->i_demux_read_bytes =
     p_stats->f_demux_bitrate = p_stats->f_average_demux_bitrate =
     p_stats->i_demux_corrupted = p_stats->i_demux_discontinuity =
+    p_stats->f_demux_buffer_level =
     p_stats->i_displayed_pictures = p_stats->i_lost_pictures =
     p_stats->i_played_abuffers = p_stats->i_lost_abuffers =
     p_stats->i_decoded_video = p_stats->i_decoded_audio =
-    p_stats->i_sent_bytes = p_stats->i_sent_packets = p_stats->f_send_bitrate
-     = 0;
+    p_stats->i_sent_bytes = p_stats->i_sent_packets = p_stats->f_send_bitrate = 0;
     vlc_mutex_unlock( &p_stats->lock );
 }
 
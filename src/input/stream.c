@@ -179,6 +179,8 @@ struct stream_sys_t
 
 /* Method 1: */
 static int  AStreamReadBlock( stream_t *s, void *p_read, unsigned int i_read );
+static block_t *AStreamBlockBlock( stream_t *s, unsigned int i_read );
+static block_t *BlockCopy( stream_t *s, int i_size );
 static int  AStreamPeekBlock( stream_t *s, const uint8_t **p_peek, unsigned int i_read );
 static int  AStreamSeekBlock( stream_t *s, uint64_t i_pos );
 static void AStreamPrebufferBlock( stream_t *s );
@@ -366,6 +368,7 @@ stream_t *stream_AccessNew( access_t *p_access, char **ppsz_list )
         msg_Dbg( s, "Using block method for AStream*" );
         s->pf_read = AStreamReadBlock;
         s->pf_peek = AStreamPeekBlock;
+        s->pf_block = AStreamBlockBlock;
 
         /* Init all fields of p_sys->block */
         p_sys->block.i_start = p_sys->i_pos;
@@ -649,6 +652,7 @@ static int AStreamControl( stream_t *s, int i_query, va_list args )
         }
 
         case STREAM_SET_RECORD_STATE:
+        case STREAM_RECORD_DATA:
         default:
             msg_Err( s, "invalid stream_vaControl query=0x%x", i_query );
             return VLC_EGENERIC;
@@ -780,6 +784,42 @@ static int AStreamReadBlock( stream_t *s, void *p_read, unsigned int i_read )
     return i_data;
 }
 
+static block_t *AStreamBlockBlock( stream_t *s, unsigned int i_read )
+{
+    stream_sys_t *p_sys = s->p_sys;
+    block_t *b = p_sys->block.p_current;
+
+    /* Reference the data directly if the access blocks allow it, e.g. when
+     * they come from a memory mapping */
+    if( b == NULL || !block_IsShareable( b )
+     || b->i_buffer - p_sys->block.i_offset < i_read )
+        return BlockCopy( s, i_read );
+
+    block_t *p_bk = block_Clone( b );
+    if( p_bk == NULL )
+        return NULL;
+
+    p_bk->p_buffer += p_sys->block.i_offset;
+    p_bk->i_buffer = i_read;
+    p_bk->i_flags = 0;
+    p_bk->i_pts = p_bk->i_dts = VLC_TS_INVALID;
+    p_bk->i_length = 0;
+
+    p_sys->i_pos += i_read;
+    p_sys->block.i_offset += i_read;
+    if( p_sys->block.i_offset >= b->i_buffer )
+    {
+        /* Current block is now empty, switch to next */
+        p_sys->block.i_offset = 0;
+        p_sys->block.p_current = b->p_next;
+
+        /* Get a new block if needed (or EOF) */
+        if( p_sys->block.p_current == NULL )
+            AStreamRefillBlock( s );
+    }
+    return p_bk;
+}
+
 static int AStreamPeekBlock( stream_t *s, const uint8_t **pp_peek, unsigned int i_read )
 {
     stream_sys_t *p_sys = s->p_sys;
@@ -1914,8 +1954,36 @@ int stream_Control( stream_t *s, int i_query, ... )
  * Read "i_size" bytes and store them in a block_t.
  * It always read i_size bytes unless you are at the end of the stream
  * where it return what is available.
+ * The caller owns the block and may modify its payload in place.
  */
 block_t *stream_Block( stream_t *s, int i_size )
+{
+    block_t *p_block = stream_BlockShared( s, i_size );
+
+    if( p_block != NULL )
+        p_block = block_Writable( p_block );
+    return p_block;
+}
+
+/**
+ * Same as stream_Block(), but the block may reference read-only stream
+ * data (see block_Share()), e.g. a memory mapping of the file, instead of
+ * a copy. The caller must call block_Writable() before modifying it.
+ */
+block_t *stream_BlockShared( stream_t *s, int i_size )
+{
+    if( i_size <= 0 ) return NULL;
+
+    if( s->pf_block == NULL )
+        return BlockCopy( s, i_size );
+
+    return s->pf_block( s, i_size );
+}
+
+/**
+ * Same as stream_Block(), but always copies the data into a new block.
+ */
+static block_t *BlockCopy( stream_t *s, int i_size )
 {
     if( i_size <= 0 ) return NULL;
 
@@ -73,4 +73,14 @@ stream_t *stream_FilterNew( stream_t *p_source,
 stream_t *stream_FilterChainNew( stream_t *p_source,
                                  const char *psz_chain,
                                  bool b_record );
+
+/**
+ * This function creates a stream_t reading ahead of p_source from a
+ * background thread, into a buffer of i_size bytes, i_read_size bytes at a
+ * time.
+ *
+ * p_source is deleted with the returned stream, but not in case of error.
+ */
+stream_t *stream_PrefetchNew( stream_t *p_source, size_t i_size,
+                              size_t i_read_size );
 #endif
@@ -310,6 +310,7 @@ static int DStreamControl( stream_t *s, int i_query, va_list args )
         case STREAM_SET_TITLE:
         case STREAM_SET_SEEKPOINT:
         case STREAM_SET_RECORD_STATE:
+        case STREAM_RECORD_DATA:
         case STREAM_SET_PRIVATE_ID_STATE:
         case STREAM_SET_PRIVATE_ID_CA:
         case STREAM_GET_PRIVATE_ID_STATE:
@@ -0,0 +1,743 @@
+/*****************************************************************************
+ * stream_prefetch.c: asynchronous read-ahead of a stream_t
+ *****************************************************************************
+ * Copyright (C) 2015 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <assert.h>
+
+#include <vlc_common.h>
+#include <vlc_block.h>
+#include <vlc_input.h>
+#include <vlc_stream.h>
+
+#include "stream.h"
+
+/*
+ * A background thread reads the source stream ahead of the reading position,
+ * so that slow reads (network file systems, HTTP...) do not stall the
+ * demuxer as long as the buffer is not drained.
+ *
+ * The buffer is the chain of the blocks read from the source, holding the
+ * data from i_offset to i_offset + i_length. The blocks come from the source
+ * pf_block callback if there is one, so that the data of a zero-copy source
+ * (e.g. a memory mapped file) are not copied here. Buffered blocks are never
+ * modified, so the reader points into them and references them directly.
+ * Data before the reading position are kept (up to a quarter of the buffer)
+ * for short backward seeks and peeks.
+ *
+ * While less than a read size is buffered ahead, e.g. on a live source, the
+ * thread reads in smaller units, so that the reader is not held back until a
+ * full read completes.
+ */
+#define PREFETCH_STATS_PERIOD 64
+
+struct stream_sys_t
+{
+    vlc_mutex_t  lock;
+    vlc_cond_t   wait_data;  /* data, end of stream or seek completion */
+    vlc_cond_t   wait_space; /* room in the buffer, a request, or the end of
+                              * a control */
+    vlc_mutex_t  source_lock; /* serializes accesses to the source */
+    vlc_thread_t thread;
+
+    block_t     *p_first;
+    block_t    **pp_last;
+    size_t       i_size;
+    size_t       i_read_size;
+    uint64_t     i_offset;
+    size_t       i_length;
+    uint64_t     i_pos;
+
+    unsigned     i_generation; /* incremented when the buffer is reset */
+    uint64_t     i_seek;       /* pending seek, or UINT64_MAX */
+    unsigned     i_controls;   /* controls waiting for the source */
+    bool         b_seeking;
+    bool         b_eof;
+    bool         b_error;
+    bool         b_dead;
+
+    /* Constant capabilities */
+    bool         b_can_seek;
+    bool         b_can_fastseek;
+    bool         b_can_pause;
+    bool         b_can_control_pace;
+    int64_t      i_pts_delay;
+
+    /* Source size, refreshed after each read */
+    uint64_t     i_source_size;
+
+    /* Statistics, only accessed by the reader */
+    uint64_t     i_hits;
+    uint64_t     i_stalls;
+    mtime_t      i_stall_time;
+    unsigned     i_calls;
+
+    /* Peek temporary buffer */
+    uint8_t     *p_peek;
+    size_t       i_peek;
+};
+
+static int  Read   ( stream_t *, void *p_read, unsigned int i_read );
+static int  Peek   ( stream_t *, const uint8_t **pp_peek, unsigned int i_peek );
+static block_t *Block( stream_t *, unsigned int i_read );
+static int  Control( stream_t *, int i_query, va_list );
+static int  ReadDir( stream_t *, input_item_node_t * );
+static void Delete ( stream_t * );
+static void *Thread( void * );
+
+stream_t *stream_PrefetchNew( stream_t *p_source, size_t i_size,
+                              size_t i_read_size )
+{
+    stream_t *s = stream_CommonNew( VLC_OBJECT( p_source ) );
+    if( s == NULL )
+        return NULL;
+
+    stream_sys_t *p_sys = malloc( sizeof( *p_sys ) );
+    s->p_sys = p_sys;
+    s->p_input = p_source->p_input;
+    s->psz_access = strdup( p_source->psz_access );
+    s->psz_path = strdup( p_source->psz_path );
+    if( p_sys == NULL || s->psz_access == NULL || s->psz_path == NULL )
+        goto error;
+
+    if( i_read_size > i_size / 4 )
+        i_read_size = i_size / 4;
+    if( i_read_size == 0 )
+        goto error;
+
+    p_sys->p_first = NULL;
+    p_sys->pp_last = &p_sys->p_first;
+    p_sys->i_size = i_size;
+    p_sys->i_read_size = i_read_size;
+    p_sys->i_offset = p_sys->i_pos = stream_Tell( p_source );
+    p_sys->i_length = 0;
+    p_sys->i_generation = 0;
+    p_sys->i_seek = UINT64_MAX;
+    p_sys->i_controls = 0;
+    p_sys->b_seeking = false;
+    p_sys->b_eof = false;
+    p_sys->b_error = false;
+    p_sys->b_dead = false;
+    p_sys->i_hits = p_sys->i_stalls = 0;
+    p_sys->i_stall_time = 0;
+    p_sys->i_calls = 0;
+    p_sys->p_peek = NULL;
+    p_sys->i_peek = 0;
+
+    stream_Control( p_source, STREAM_CAN_SEEK, &p_sys->b_can_seek );
+    stream_Control( p_source, STREAM_CAN_FASTSEEK, &p_sys->b_can_fastseek );
+    stream_Control( p_source, STREAM_CAN_PAUSE, &p_sys->b_can_pause );
+    stream_Control( p_source, STREAM_CAN_CONTROL_PACE,
+                    &p_sys->b_can_control_pace );
+    if( stream_Control( p_source, STREAM_GET_PTS_DELAY,
+                        &p_sys->i_pts_delay ) )
+        p_sys->i_pts_delay = DEFAULT_PTS_DELAY;
+    p_sys->i_source_size = stream_Size( p_source );
+
+    vlc_mutex_init( &p_sys->lock );
+    vlc_cond_init( &p_sys->wait_data );
+    vlc_cond_init( &p_sys->wait_space );
+    vlc_mutex_init( &p_sys->source_lock );
+
+    s->p_source = p_source;
+    s->pf_read = Read;
+    s->pf_peek = Peek;
+    s->pf_block = Block;
+    s->pf_control = Control;
+    s->pf_readdir = ReadDir;
+    s->pf_destroy = Delete;
+
+    if( vlc_clone( &p_sys->thread, Thread, s, VLC_THREAD_PRIORITY_INPUT ) )
+    {
+        vlc_mutex_destroy( &p_sys->source_lock );
+        vlc_cond_destroy( &p_sys->wait_space );
+        vlc_cond_destroy( &p_sys->wait_data );
+        vlc_mutex_destroy( &p_sys->lock );
+        goto error;
+    }
+
+    if( s->p_input != NULL )
+    {
+        var_Create( s->p_input, "prefetch-hits", VLC_VAR_INTEGER );
+        var_Create( s->p_input, "prefetch-stalls", VLC_VAR_INTEGER );
+        var_Create( s->p_input, "prefetch-stall-time", VLC_VAR_INTEGER );
+    }
+
+    msg_Dbg( s, "prefetching %zu KiB in reads of up to %zu KiB",
+             i_size / 1024, i_read_size / 1024 );
+    return s;
+
+error:
+    free( p_sys );
+    stream_CommonDelete( s );
+    return NULL;
+}
+
+/**
+ * Publishes the read-ahead statistics as variables of the input.
+ */
+static void PublishStats( stream_t *s )
+{
+    stream_sys_t *p_sys = s->p_sys;
+    input_thread_t *p_input = s->p_input;
+
+    if( p_input == NULL )
+        return;
+
+    var_SetInteger( p_input, "prefetch-hits", p_sys->i_hits );
+    var_SetInteger( p_input, "prefetch-stalls", p_sys->i_stalls );
+    var_SetInteger( p_input, "prefetch-stall-time", p_sys->i_stall_time );
+}
+
+static void Delete( stream_t *s )
+{
+    stream_sys_t *p_sys = s->p_sys;
+
+    vlc_mutex_lock( &p_sys->lock );
+    p_sys->b_dead = true;
+    vlc_cond_signal( &p_sys->wait_space );
+    vlc_mutex_unlock( &p_sys->lock );
+    vlc_join( p_sys->thread, NULL );
+
+    PublishStats( s );
+
+    vlc_mutex_destroy( &p_sys->source_lock );
+    vlc_cond_destroy( &p_sys->wait_space );
+    vlc_cond_destroy( &p_sys->wait_data );
+    vlc_mutex_destroy( &p_sys->lock );
+
+    stream_Delete( s->p_source );
+    block_ChainRelease( p_sys->p_first );
+    free( p_sys->p_peek );
+    free( p_sys );
+    stream_CommonDelete( s );
+}
+
+/****************************************************************************
+ * Background thread
+ ****************************************************************************/
+
+/* Number of bytes available at the reading position */
+static size_t Available( const stream_sys_t *p_sys )
+{
+    assert( p_sys->i_pos >= p_sys->i_offset );
+    return p_sys->i_offset + p_sys->i_length - p_sys->i_pos;
+}
+
+/* Forgets the data behind the reading position beyond the kept history, in
+ * whole blocks. The lock must be held. */
+static void Trim( stream_sys_t *p_sys )
+{
+    const size_t i_keep = p_sys->i_size / 4;
+    block_t *p_block;
+
+    while( (p_block = p_sys->p_first) != NULL
+        && p_sys->i_offset + p_block->i_buffer <= p_sys->i_pos
+        && p_sys->i_pos - p_sys->i_offset > i_keep )
+    {
+        p_sys->p_first = p_block->p_next;
+        if( p_sys->p_first == NULL )
+            p_sys->pp_last = &p_sys->p_first;
+        p_sys->i_offset += p_block->i_buffer;
+        p_sys->i_length -= p_block->i_buffer;
+        block_Release( p_block );
+    }
+}
+
+/* Reads up to i_len bytes from the source, without copying them if the
+ * source provides blocks. The source lock must be held. */
+static block_t *ReadSource( stream_t *p_source, size_t i_len )
+{
+    block_t *p_block;
+
+    if( p_source->pf_block != NULL )
+    {   /* not stream_Block(): read-only views are fine here */
+        p_block = p_source->pf_block( p_source, i_len );
+        if( p_block == NULL )
+            return NULL;
+    }
+    else
+    {
+        p_block = block_Alloc( i_len );
+        if( unlikely(p_block == NULL) )
+            return NULL;
+
+        int i_read = stream_Read( p_source, p_block->p_buffer, i_len );
+        p_block->i_buffer = i_read > 0 ? i_read : 0;
+    }
+
+    if( p_block->i_buffer == 0 )
+    {
+        block_Release( p_block );
+        return NULL;
+    }
+    /* Let the reader reference the data without copying them */
+    return block_Share( p_block );
+}
+
+static void *Thread( void *data )
+{
+    stream_t *s = data;
+    stream_sys_t *p_sys = s->p_sys;
+    int canc = vlc_savecancel();
+
+    vlc_mutex_lock( &p_sys->lock );
+    while( !p_sys->b_dead )
+    {
+        const unsigned i_generation = p_sys->i_generation;
+
+        if( p_sys->i_controls > 0 )
+        {   /* Let the controls through first */
+            vlc_cond_wait( &p_sys->wait_space, &p_sys->lock );
+            continue;
+        }
+
+        if( p_sys->i_seek != UINT64_MAX )
+        {
+            const uint64_t i_seek = p_sys->i_seek;
+
+            p_sys->i_seek = UINT64_MAX;
+            vlc_mutex_unlock( &p_sys->lock );
+
+            vlc_mutex_lock( &p_sys->source_lock );
+            const bool b_error = stream_Seek( s->p_source, i_seek ) != 0;
+            vlc_mutex_unlock( &p_sys->source_lock );
+
+            vlc_mutex_lock( &p_sys->lock );
+            if( i_generation == p_sys->i_generation )
+            {
+                p_sys->b_error = b_error;
+                p_sys->b_seeking = false;
+                vlc_cond_signal( &p_sys->wait_data );
+            }
+            continue;
+        }
+
+        /* Forget old data once the buffer is full */
+        if( p_sys->i_length == p_sys->i_size )
+            Trim( p_sys );
+
+        if( p_sys->b_eof || p_sys->b_error
+         || p_sys->i_length == p_sys->i_size )
+        {
+            vlc_cond_wait( &p_sys->wait_space, &p_sys->lock );
+            continue;
+        }
+
+        /* Fill the free space, within the read size, or within a fraction
+         * of it while the reader is (about to be) waiting */
+        size_t i_len = p_sys->i_size - p_sys->i_length;
+        size_t i_max = p_sys->i_read_size;
+
+        if( Available( p_sys ) < i_max )
+            i_max = __MAX( i_max / 8, 1 );
+        if( i_len > i_max )
+            i_len = i_max;
+        vlc_mutex_unlock( &p_sys->lock );
+
+        vlc_mutex_lock( &p_sys->source_lock );
+        block_t *p_block = ReadSource( s->p_source, i_len );
+        const uint64_t i_source_size = stream_Size( s->p_source );
+        vlc_mutex_unlock( &p_sys->source_lock );
+
+        vlc_mutex_lock( &p_sys->lock );
+        if( i_generation != p_sys->i_generation )
+        {   /* the buffer was reset in the mean time */
+            if( p_block != NULL )
+                block_Release( p_block );
+            continue;
+        }
+
+        p_sys->i_source_size = i_source_size;
+        if( p_block == NULL || p_block->i_buffer < i_len )
+            p_sys->b_eof = true;
+        if( p_block != NULL )
+        {
+            p_sys->i_length += p_block->i_buffer;
+            *p_sys->pp_last = p_block;
+            p_sys->pp_last = &p_block->p_next;
+        }
+        vlc_cond_signal( &p_sys->wait_data );
+    }
+    vlc_mutex_unlock( &p_sys->lock );
+
+    vlc_restorecancel( canc );
+    return NULL;
+}
+
+/****************************************************************************
+ * Reader side
+ ****************************************************************************/
+
+/* Lets the background thread try to read again after the end of the stream,
+ * in case the source grows. The lock must be held. */
+static void Retry( stream_sys_t *p_sys )
+{
+    if( p_sys->b_eof && Available( p_sys ) == 0 )
+    {
+        p_sys->b_eof = false;
+        vlc_cond_signal( &p_sys->wait_space );
+    }
+}
+
+/* Resets the buffer at the given position. The lock must be held. */
+static void Reset( stream_sys_t *p_sys, uint64_t i_pos )
+{
+    block_ChainRelease( p_sys->p_first );
+    p_sys->p_first = NULL;
+    p_sys->pp_last = &p_sys->p_first;
+    p_sys->i_generation++;
+    p_sys->i_offset = p_sys->i_pos = i_pos;
+    p_sys->i_length = 0;
+    p_sys->b_eof = false;
+    p_sys->b_error = false;
+    vlc_cond_signal( &p_sys->wait_space );
+}
+
+/* Finds the buffered block holding the reading position, and the offset of
+ * the position in it. The lock must be held. */
+static block_t *Locate( const stream_sys_t *p_sys, size_t *pi_at )
+{
+    uint64_t i_start = p_sys->i_offset;
+
+    for( block_t *p_block = p_sys->p_first; p_block != NULL;
+         p_block = p_block->p_next )
+    {
+        if( p_sys->i_pos < i_start + p_block->i_buffer )
+        {
+            *pi_at = p_sys->i_pos - i_start;
+            return p_block;
+        }
+        i_start += p_block->i_buffer;
+    }
+    return NULL;
+}
+
+/**
+ * Waits until i_wanted bytes are available at the reading position, or
+ * until no more can become available. The lock must be held.
+ * \return the time spent waiting
+ */
+static mtime_t Wait( stream_sys_t *p_sys, size_t i_wanted )
+{
+    /* At most, the buffer holds the kept history and data ahead */
+    const size_t i_history = p_sys->i_pos - p_sys->i_offset;
+    const size_t i_max = p_sys->i_size - __MIN( i_history, p_sys->i_size / 4 );
+
+    if( i_wanted > i_max )
+        i_wanted = i_max;
+    if( Available( p_sys ) >= i_wanted || p_sys->b_eof || p_sys->b_error )
+        return 0;
+
+    const mtime_t i_start = mdate();
+    do
+        vlc_cond_wait( &p_sys->wait_data, &p_sys->lock );
+    while( Available( p_sys ) < i_wanted && !p_sys->b_eof && !p_sys->b_error );
+    return mdate() - i_start;
+}
+
+static void UpdateStats( stream_t *s, mtime_t i_stall )
+{
+    stream_sys_t *p_sys = s->p_sys;
+
+    if( i_stall > 0 )
+    {
+        p_sys->i_stalls++;
+        p_sys->i_stall_time += i_stall;
+    }
+    else
+        p_sys->i_hits++;
+
+    if( (++p_sys->i_calls % PREFETCH_STATS_PERIOD) == 0 )
+        PublishStats( s );
+}
+
+/* Copies (or skips if p_data is NULL) buffered data, waiting for them as
+ * needed. The lock must be held. */
+static size_t ReadLocked( stream_sys_t *p_sys, uint8_t *p_data, size_t i_read,
+                          mtime_t *pi_stall )
+{
+    size_t i_done = 0;
+
+    while( i_done < i_read )
+    {
+        *pi_stall += Wait( p_sys, 1 );
+
+        size_t i_copy = Available( p_sys );
+        if( i_copy == 0 )
+        {   /* end of stream or error */
+            Retry( p_sys );
+            break;
+        }
+
+        size_t i_at;
+        const block_t *p_block = Locate( p_sys, &i_at );
+
+        assert( p_block != NULL );
+        if( i_copy > i_read - i_done )
+            i_copy = i_read - i_done;
+        if( i_copy > p_block->i_buffer - i_at )
+            i_copy = p_block->i_buffer - i_at;
+
+        if( p_data != NULL )
+        {
+            memcpy( p_data, &p_block->p_buffer[i_at], i_copy );
+            p_data += i_copy;
+        }
+        i_done += i_copy;
+        p_sys->i_pos += i_copy;
+        vlc_cond_signal( &p_sys->wait_space );
+    }
+    return i_done;
+}
+
+static int Read( stream_t *s, void *p_read, unsigned int i_read )
+{
+    stream_sys_t *p_sys = s->p_sys;
+    mtime_t i_stall = 0;
+
+    vlc_mutex_lock( &p_sys->lock );
+    const size_t i_done = ReadLocked( p_sys, p_read, i_read, &i_stall );
+    vlc_mutex_unlock( &p_sys->lock );
+
+    UpdateStats( s, i_stall );
+    return i_done;
+}
+
+static block_t *Block( stream_t *s, unsigned int i_read )
+{
+    stream_sys_t *p_sys = s->p_sys;
+    block_t *p_block;
+
+    vlc_mutex_lock( &p_sys->lock );
+    mtime_t i_stall = Wait( p_sys, i_read );
+
+    size_t i_at;
+    block_t *p_buffered = Locate( p_sys, &i_at );
+
+    if( p_buffered != NULL && p_buffered->i_buffer - i_at >= i_read )
+    {   /* Reference the buffered data */
+        p_block = block_Clone( p_buffered );
+        if( p_block != NULL )
+        {
+            p_block->p_buffer += i_at;
+            p_block->i_buffer = i_read;
+            p_block->i_flags = 0;
+            p_block->i_pts = p_block->i_dts = VLC_TS_INVALID;
+            p_block->i_length = 0;
+            p_sys->i_pos += i_read;
+            vlc_cond_signal( &p_sys->wait_space );
+        }
+    }
+    else
+    {   /* Across blocks, or not buffered yet */
+        p_block = block_Alloc( i_read );
+        if( p_block != NULL )
+        {
+            p_block->i_buffer = ReadLocked( p_sys, p_block->p_buffer, i_read,
+                                            &i_stall );
+            if( p_block->i_buffer == 0 )
+            {
+                block_Release( p_block );
+                p_block = NULL;
+            }
+        }
+    }
+    vlc_mutex_unlock( &p_sys->lock );
+
+    UpdateStats( s, i_stall );
+    return p_block;
+}
+
+static int Peek( stream_t *s, const uint8_t **pp_peek, unsigned int i_peek )
+{
+    stream_sys_t *p_sys = s->p_sys;
+
+    vlc_mutex_lock( &p_sys->lock );
+    const mtime_t i_stall = Wait( p_sys, i_peek );
+
+    size_t i_copy = Available( p_sys );
+    size_t i_at;
+    const block_t *p_block = Locate( p_sys, &i_at );
+
+    if( i_copy > i_peek )
+        i_copy = i_peek;
+    if( i_copy == 0 )
+        Retry( p_sys );
+
+    /* The buffered blocks are not modified, nor released before the
+     * reading position moves past them, so they can be pointed to directly
+     * unless the data span several blocks. */
+    if( p_block == NULL || i_at + i_copy <= p_block->i_buffer )
+    {
+        if( p_block != NULL )
+            *pp_peek = &p_block->p_buffer[i_at];
+    }
+    else
+    {
+        if( p_sys->i_peek < i_copy )
+        {
+            uint8_t *p_peek = realloc( p_sys->p_peek, i_copy );
+            if( p_peek == NULL )
+            {
+                vlc_mutex_unlock( &p_sys->lock );
+                return 0;
+            }
+            p_sys->p_peek = p_peek;
+            p_sys->i_peek = i_copy;
+        }
+
+        for( size_t i_done = 0; i_done < i_copy; p_block = p_block->p_next )
+        {
+            size_t i_len = __MIN( p_block->i_buffer - i_at, i_copy - i_done );
+
+            memcpy( &p_sys->p_peek[i_done], &p_block->p_buffer[i_at], i_len );
+            i_done += i_len;
+            i_at = 0;
+        }
+        *pp_peek = p_sys->p_peek;
+    }
+    vlc_mutex_unlock( &p_sys->lock );
+
+    UpdateStats( s, i_stall );
+    return i_copy;
+}
+
+static int Seek( stream_t *s, uint64_t i_pos )
+{
+    stream_sys_t *p_sys = s->p_sys;
+    int i_ret = VLC_SUCCESS;
+
+    vlc_mutex_lock( &p_sys->lock );
+    if( i_pos >= p_sys->i_offset
+     && i_pos <= p_sys->i_offset + p_sys->i_length )
+    {   /* Already buffered */
+        p_sys->i_pos = i_pos;
+        vlc_cond_signal( &p_sys->wait_space );
+    }
+    else if( i_pos > p_sys->i_pos && !p_sys->b_can_seek )
+    {   /* Skip data */
+        const uint64_t i_skip = i_pos - p_sys->i_pos;
+
+        vlc_mutex_unlock( &p_sys->lock );
+        return (uint64_t)Read( s, NULL, i_skip ) == i_skip ? VLC_SUCCESS
+                                                           : VLC_EGENERIC;
+    }
+    else if( !p_sys->b_can_seek )
+        i_ret = VLC_EGENERIC;
+    else
+    {   /* Invalidate the buffer, and wait for the source to seek */
+        Reset( p_sys, i_pos );
+        p_sys->i_seek = i_pos;
+        p_sys->b_seeking = true;
+        while( p_sys->b_seeking )
+            vlc_cond_wait( &p_sys->wait_data, &p_sys->lock );
+        if( p_sys->b_error )
+            i_ret = VLC_EGENERIC;
+    }
+    vlc_mutex_unlock( &p_sys->lock );
+    return i_ret;
+}
+
+/* Takes the source from the background thread. It may have to wait for the
+ * current read, but no other read starts in the mean time. */
+static void SourceLock( stream_sys_t *p_sys )
+{
+    vlc_mutex_lock( &p_sys->lock );
+    p_sys->i_controls++;
+    vlc_mutex_unlock( &p_sys->lock );
+    vlc_mutex_lock( &p_sys->source_lock );
+}
+
+static void SourceUnlock( stream_sys_t *p_sys )
+{
+    vlc_mutex_unlock( &p_sys->source_lock );
+    vlc_mutex_lock( &p_sys->lock );
+    p_sys->i_controls--;
+    vlc_cond_signal( &p_sys->wait_space );
+    vlc_mutex_unlock( &p_sys->lock );
+}
+
+static int Control( stream_t *s, int i_query, va_list args )
+{
+    stream_sys_t *p_sys = s->p_sys;
+    int i_ret;
+
+    switch( i_query )
+    {
+        case STREAM_CAN_SEEK:
+            *va_arg( args, bool * ) = p_sys->b_can_seek;
+            return VLC_SUCCESS;
+        case STREAM_CAN_FASTSEEK:
+            *va_arg( args, bool * ) = p_sys->b_can_fastseek;
+            return VLC_SUCCESS;
+        case STREAM_CAN_PAUSE:
+            *va_arg( args, bool * ) = p_sys->b_can_pause;
+            return VLC_SUCCESS;
+        case STREAM_CAN_CONTROL_PACE:
+            *va_arg( args, bool * ) = p_sys->b_can_control_pace;
+            return VLC_SUCCESS;
+        case STREAM_GET_PTS_DELAY:
+            *va_arg( args, int64_t * ) = p_sys->i_pts_delay;
+            return VLC_SUCCESS;
+
+        case STREAM_GET_POSITION:
+            vlc_mutex_lock( &p_sys->lock );
+            *va_arg( args, uint64_t * ) = p_sys->i_pos;
+            vlc_mutex_unlock( &p_sys->lock );
+            return VLC_SUCCESS;
+
+        case STREAM_GET_SIZE:
+            vlc_mutex_lock( &p_sys->lock );
+            *va_arg( args, uint64_t * ) = p_sys->i_source_size;
+            vlc_mutex_unlock( &p_sys->lock );
+            return VLC_SUCCESS;
+
+        case STREAM_SET_POSITION:
+            return Seek( s, va_arg( args, uint64_t ) );
+
+        case STREAM_SET_TITLE:
+        case STREAM_SET_SEEKPOINT:
+        {   /* These move the source: start over from its new position */
+            SourceLock( p_sys );
+            i_ret = stream_vaControl( s->p_source, i_query, args );
+            const uint64_t i_pos = stream_Tell( s->p_source );
+            vlc_mutex_lock( &p_sys->lock );
+            Reset( p_sys, i_pos );
+            vlc_mutex_unlock( &p_sys->lock );
+            SourceUnlock( p_sys );
+            return i_ret;
+        }
+
+        default:
+            SourceLock( p_sys );
+            i_ret = stream_vaControl( s->p_source, i_query, args );
+            SourceUnlock( p_sys );
+            return i_ret;
+    }
+}
+
+static int ReadDir( stream_t *s, input_item_node_t *p_node )
+{
+    (void) s; (void) p_node;
+    return VLC_EGENERIC;
+}
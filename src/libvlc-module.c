@@ -508,6 +508,36 @@ static const char *const ppsz_pos_descriptions[] =
 #define NETWORK_CACHING_LONGTEXT N_( \
     "Caching value for network resources, in milliseconds." )
 
+#define PREFETCH_BUFFER_SIZE_TEXT N_("Read-ahead buffer size (KiB)")
+#define PREFETCH_BUFFER_SIZE_LONGTEXT N_( \
+    "Input data are read ahead of the demuxer from a background thread, " \
+    "so that slow reads do not interrupt playback. This is the size of the " \
+    "buffer, in kibibytes. Zero disables reading ahead.")
+
+#define PREFETCH_READ_SIZE_TEXT N_("Read-ahead read size (KiB)")
+#define PREFETCH_READ_SIZE_LONGTEXT N_( \
+    "Size of each read ahead from the input, in kibibytes.")
+
+#define AUDIO_DECODER_BUFFER_TEXT N_("Audio decoder buffer (ms)")
+#define AUDIO_DECODER_BUFFER_LONGTEXT N_( \
+    "Maximum duration of audio data queued for decoding, in milliseconds, " \
+    "before it is discarded. Zero limits the size only.")
+
+#define VIDEO_DECODER_BUFFER_TEXT N_("Video decoder buffer (ms)")
+#define VIDEO_DECODER_BUFFER_LONGTEXT N_( \
+    "Maximum duration of video data queued for decoding, in milliseconds, " \
+    "before it is discarded. Zero limits the size only.")
+
+#define SUB_DECODER_BUFFER_TEXT N_("Subtitles decoder buffer (ms)")
+#define SUB_DECODER_BUFFER_LONGTEXT N_( \
+    "Maximum duration of subtitles and other data queued for decoding, " \
+    "in milliseconds, before it is discarded. Zero limits the size only.")
+
+#define DECODER_READ_AHEAD_TEXT N_("Decoder read-ahead (ms)")
+#define DECODER_READ_AHEAD_LONGTEXT N_( \
+    "Duration of data queued for decoding, in milliseconds, before " \
+    "reading from local files and other paced inputs is suspended.")
+
 #define CR_AVERAGE_TEXT N_("Clock reference average counter")
 #define CR_AVERAGE_LONGTEXT N_( \
     "When using the PVR input (or a very irregular source), you should " \
@@ -676,6 +706,11 @@ static const char *const ppsz_prefres[] = {
     "This is the maximum size in bytes of the temporary files " \
     "that will be used to store the timeshifted streams." )
 
+#define INPUT_TIMESHIFT_SIZE_TEXT N_("Timeshift size")
+#define INPUT_TIMESHIFT_SIZE_LONGTEXT N_( \
+    "This is the maximum size in bytes of the timeshift buffer. When it " \
+    "is full, the oldest data is dropped. 0 means no limit." )
+
 #define INPUT_TITLE_FORMAT_TEXT N_( "Change title according to current media" )
 #define INPUT_TITLE_FORMAT_LONGTEXT N_( "This option allows you to set the title according to what's being played<br>"  \
     "$a: Artist<br>$b: Album<br>$c: Copyright<br>$t: Title<br>$g: Genre<br>"  \
@@ -1829,6 +1864,32 @@ vlc_module_begin ()
     add_obsolete_integer( "tcp-caching" ) /* 2.0.0 */
     add_obsolete_integer( "udp-caching" ) /* 2.0.0 */
 
+    add_integer( "prefetch-buffer-size", 0, PREFETCH_BUFFER_SIZE_TEXT,
+                 PREFETCH_BUFFER_SIZE_LONGTEXT, true )
+        change_integer_range( 0, 1 << 20 )
+        change_safe()
+    add_integer( "prefetch-read-size", 16, PREFETCH_READ_SIZE_TEXT,
+                 PREFETCH_READ_SIZE_LONGTEXT, true )
+        change_integer_range( 1, 1 << 16 )
+        change_safe()
+
+    add_integer( "audio-decoder-buffer", 60000, AUDIO_DECODER_BUFFER_TEXT,
+                 AUDIO_DECODER_BUFFER_LONGTEXT, true )
+        change_integer_range( 0, 600000 )
+        change_safe()
+    add_integer( "video-decoder-buffer", 60000, VIDEO_DECODER_BUFFER_TEXT,
+                 VIDEO_DECODER_BUFFER_LONGTEXT, true )
+        change_integer_range( 0, 600000 )
+        change_safe()
+    add_integer( "sub-decoder-buffer", 60000, SUB_DECODER_BUFFER_TEXT,
+                 SUB_DECODER_BUFFER_LONGTEXT, true )
+        change_integer_range( 0, 600000 )
+        change_safe()
+    add_integer( "decoder-read-ahead", 1000, DECODER_READ_AHEAD_TEXT,
+                 DECODER_READ_AHEAD_LONGTEXT, true )
+        change_integer_range( 0, 60000 )
+        change_safe()
+
     add_integer( "cr-average", 40, CR_AVERAGE_TEXT,
                  CR_AVERAGE_LONGTEXT, true )
     add_integer( "clock-synchro", -1, CLOCK_SYNCHRO_TEXT,
@@ -1850,6 +1911,8 @@ vlc_module_begin ()
                 INPUT_TIMESHIFT_PATH_LONGTEXT, true )
     add_integer( "input-timeshift-granularity", -1, INPUT_TIMESHIFT_GRANULARITY_TEXT,
                  INPUT_TIMESHIFT_GRANULARITY_LONGTEXT, true )
+    add_integer( "input-timeshift-size", 0, INPUT_TIMESHIFT_SIZE_TEXT,
+                 INPUT_TIMESHIFT_SIZE_LONGTEXT, true )
 
     add_string( "input-title-format", "$Z", INPUT_TITLE_FORMAT_TEXT, INPUT_TITLE_FORMAT_LONGTEXT, false );
 
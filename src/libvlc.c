@@ -458,6 +458,11 @@ dbus_out:
     if( var_InheritBool( p_libvlc, "network-synchronisation") )
         libvlc_InternalAddIntf( p_libvlc, "netsync,none" );
 
+    /* Block allocator statistics, refreshed with the input statistics */
+    var_Create( p_libvlc, "block-pool-hits", VLC_VAR_INTEGER );
+    var_Create( p_libvlc, "block-pool-misses", VLC_VAR_INTEGER );
+    var_Create( p_libvlc, "block-pool-retained", VLC_VAR_INTEGER );
+
 #ifdef __APPLE__
     var_Create( p_libvlc, "drawable-view-top", VLC_VAR_INTEGER );
     var_Create( p_libvlc, "drawable-view-left", VLC_VAR_INTEGER );
@@ -535,6 +540,7 @@ void libvlc_InternalCleanup( libvlc_int_t *p_libvlc )
     /* Free module bank. It is refcounted, so we call this each time  */
     vlc_LogDeinit (p_libvlc);
     module_EndBank (true);
+    block_PoolCleanup ();
 #if defined(_WIN32) || defined(__OS2__)
     system_End( );
 #endif
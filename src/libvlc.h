@@ -235,4 +235,10 @@ void stats_CounterClean (counter_t * );
 void stats_ComputeInputStats(input_thread_t*, input_stats_t*);
 void stats_ReinitInputStats(input_stats_t *);
 
+/*
+ * Block allocator
+ */
+void block_PoolStats(uint64_t *hits, uint64_t *misses, uint64_t *retained);
+void block_PoolCleanup(void);
+
 #endif
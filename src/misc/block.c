@@ -37,6 +37,8 @@
 #include <vlc_common.h>
 #include <vlc_block.h>
 #include <vlc_fs.h>
+#include <vlc_atomic.h>
+#include "libvlc.h"
 
 /**
  * @section Block handling functions.
@@ -126,17 +128,350 @@ static void BlockMetaCopy( block_t *restrict out, const block_t *in )
 /* Maximum size of reserved footer before shrinking with realloc(). */
 #define BLOCK_WASTE_SIZE   2048
 
+/**
+ * @section Block pool.
+ *
+ * Small and medium blocks are recycled through size classes rather than
+ * returned to the heap. Each thread keeps a bounded cache per size class,
+ * and exchanges batches with a shared depot when its cache runs empty or
+ * full. Blocks are returned to the cache of the releasing thread, which need
+ * not be the allocating thread.
+ */
+
+/* Size classes go by half octaves, from 256 bytes to 64 KiB of payload */
+#define BLOCK_POOL_MIN_SHIFT 8
+#define BLOCK_POOL_MAX_SHIFT 16
+#define BLOCK_POOL_CLASSES   (2 * (BLOCK_POOL_MAX_SHIFT - BLOCK_POOL_MIN_SHIFT) + 1)
+
+/* Retention bounds (per size class) */
+#define BLOCK_CACHE_BYTES    (128 << 10)
+#define BLOCK_CACHE_MAX      64
+#define BLOCK_DEPOT_BYTES    (4 << 20)
+#define BLOCK_DEPOT_MAX      1024
+
+/* Bytes reserved around the payload by block_Alloc() */
+#define BLOCK_OVERHEAD (BLOCK_ALIGN + (2 * BLOCK_PADDING))
+
+static size_t block_pool_ClassSize (unsigned c)
+{
+    unsigned shift = BLOCK_POOL_MIN_SHIFT + (c / 2);
+
+    return (c & 1) ? (size_t)3 << (shift - 1) : (size_t)1 << shift;
+}
+
+static int block_pool_Class (size_t size)
+{
+    if (size <= ((size_t)1 << BLOCK_POOL_MIN_SHIFT))
+        return 0;
+    if (size > ((size_t)1 << BLOCK_POOL_MAX_SHIFT))
+        return -1;
+
+    /* 2^shift < size <= 2^(shift+1) */
+    unsigned shift = (sizeof (unsigned) * 8) - 1 - clz (size - 1);
+    unsigned c = 2 * (shift - BLOCK_POOL_MIN_SHIFT) + 1;
+
+    if (size > block_pool_ClassSize (c))
+        c++;
+    return c;
+}
+
+static unsigned block_pool_Bound (unsigned c, size_t bytes, unsigned max)
+{
+    size_t n = bytes / block_pool_ClassSize (c);
+
+    if (n < 2)
+        n = 2;
+    return (n < max) ? n : max;
+}
+
+static struct
+{
+    vlc_mutex_t lock;
+    block_t    *head[BLOCK_POOL_CLASSES];
+    unsigned    count[BLOCK_POOL_CLASSES];
+} block_depot = { .lock = VLC_STATIC_MUTEX };
+
+static atomic_uintptr_t block_pool_hits = ATOMIC_VAR_INIT(0);
+static atomic_uintptr_t block_pool_misses = ATOMIC_VAR_INIT(0);
+static atomic_uintptr_t block_pool_retained = ATOMIC_VAR_INIT(0);
+
+typedef struct
+{
+    block_t   *head[BLOCK_POOL_CLASSES];
+    unsigned   count[BLOCK_POOL_CLASSES];
+    /* Statistics not yet accounted in the global counters */
+    unsigned   hits;
+    ptrdiff_t  retained;
+    /* Recycled headers of shared blocks, see block_header_New() */
+    void      *headers;
+    unsigned   header_count;
+} block_cache_t;
+
+static void block_cache_Flush (block_cache_t *cache)
+{
+    if (cache->hits > 0)
+    {
+        atomic_fetch_add (&block_pool_hits, cache->hits);
+        cache->hits = 0;
+    }
+    if (cache->retained > 0)
+        atomic_fetch_add (&block_pool_retained, cache->retained);
+    else if (cache->retained < 0)
+        atomic_fetch_sub (&block_pool_retained, -cache->retained);
+    cache->retained = 0;
+}
+
+/* Moves up to n blocks from the cache to the depot, then frees
+ * whatever exceeds the depot bound. */
+static void block_cache_Drain (block_cache_t *cache, unsigned c, unsigned n)
+{
+    const unsigned max = block_pool_Bound (c, BLOCK_DEPOT_BYTES,
+                                           BLOCK_DEPOT_MAX);
+    block_t *excess = NULL;
+    size_t freed = 0;
+
+    vlc_mutex_lock (&block_depot.lock);
+    while (n > 0 && cache->head[c] != NULL)
+    {
+        block_t *b = cache->head[c];
+
+        cache->head[c] = b->p_next;
+        cache->count[c]--;
+        n--;
+
+        if (block_depot.count[c] < max)
+        {
+            b->p_next = block_depot.head[c];
+            block_depot.head[c] = b;
+            block_depot.count[c]++;
+        }
+        else
+        {
+            b->p_next = excess;
+            excess = b;
+            freed += sizeof (block_t) + b->i_size;
+        }
+    }
+    vlc_mutex_unlock (&block_depot.lock);
+
+    cache->retained -= freed;
+    block_cache_Flush (cache);
+
+    while (excess != NULL)
+    {
+        block_t *b = excess;
+
+        excess = b->p_next;
+        free (b);
+    }
+}
+
+/* Moves up to n blocks from the depot to the cache. */
+static void block_cache_Fill (block_cache_t *cache, unsigned c, unsigned n)
+{
+    vlc_mutex_lock (&block_depot.lock);
+    while (n > 0 && block_depot.head[c] != NULL)
+    {
+        block_t *b = block_depot.head[c];
+
+        block_depot.head[c] = b->p_next;
+        block_depot.count[c]--;
+        n--;
+
+        b->p_next = cache->head[c];
+        cache->head[c] = b;
+        cache->count[c]++;
+    }
+    vlc_mutex_unlock (&block_depot.lock);
+    block_cache_Flush (cache);
+}
+
+static void block_cache_Destroy (void *data)
+{
+    block_cache_t *cache = data;
+
+    for (unsigned c = 0; c < BLOCK_POOL_CLASSES; c++)
+        block_cache_Drain (cache, c, cache->count[c]);
+    while (cache->headers != NULL)
+    {
+        void *h = cache->headers;
+
+        cache->headers = *(void **)h;
+        free (h);
+    }
+    free (cache);
+}
+
+static vlc_threadvar_t block_cache_key;
+static atomic_uint block_cache_state = ATOMIC_VAR_INIT(0);
+
+/* Returns the cache of the calling thread, or NULL if there is none. */
+static block_cache_t *block_cache_Get (void)
+{
+    if (unlikely(atomic_load (&block_cache_state) != 1))
+    {
+        static vlc_mutex_t lock = VLC_STATIC_MUTEX;
+
+        vlc_mutex_lock (&lock);
+        if (atomic_load (&block_cache_state) == 0)
+            atomic_store (&block_cache_state,
+                          vlc_threadvar_create (&block_cache_key,
+                                                block_cache_Destroy) ? 2 : 1);
+        vlc_mutex_unlock (&lock);
+
+        if (atomic_load (&block_cache_state) != 1)
+            return NULL;
+    }
+
+    block_cache_t *cache = vlc_threadvar_get (block_cache_key);
+    if (cache == NULL)
+    {
+        cache = calloc (1, sizeof (*cache));
+        if (unlikely(cache == NULL))
+            return NULL;
+        if (vlc_threadvar_set (block_cache_key, cache))
+        {
+            free (cache);
+            return NULL;
+        }
+    }
+    return cache;
+}
+
+static void block_pool_Release (block_t *block)
+{
+    /* That is always true for blocks allocated with block_Alloc(). */
+    assert (block->p_start == (unsigned char *)(block + 1));
+    block_Invalidate (block);
+
+    int c = block_pool_Class (block->i_size - BLOCK_OVERHEAD);
+    assert (c >= 0);
+
+    block_cache_t *cache = block_cache_Get ();
+    if (unlikely(cache == NULL))
+    {
+        free (block);
+        return;
+    }
+
+    block->p_next = cache->head[c];
+    cache->head[c] = block;
+    cache->count[c]++;
+    cache->retained += sizeof (block_t) + block->i_size;
+
+    const unsigned max = block_pool_Bound (c, BLOCK_CACHE_BYTES,
+                                           BLOCK_CACHE_MAX);
+    if (cache->count[c] > max)
+        block_cache_Drain (cache, c, (max + 1) / 2);
+}
+
+/* Gets a block of size class c from the pool, or NULL if none is left. */
+static block_t *block_pool_Get (unsigned c)
+{
+    block_cache_t *cache = block_cache_Get ();
+    if (unlikely(cache == NULL))
+        return NULL;
+
+    if (cache->head[c] == NULL)
+    {
+        const unsigned max = block_pool_Bound (c, BLOCK_CACHE_BYTES,
+                                               BLOCK_CACHE_MAX);
+        block_cache_Fill (cache, c, (max + 1) / 2);
+        if (cache->head[c] == NULL)
+            return NULL;
+    }
+
+    block_t *b = cache->head[c];
+
+    cache->head[c] = b->p_next;
+    cache->count[c]--;
+    cache->retained -= sizeof (block_t) + b->i_size;
+    if (++cache->hits >= 256)
+        block_cache_Flush (cache);
+    return b;
+}
+
+/**
+ * Reports block pool usage statistics.
+ *
+ * @param hits number of allocations served from the pool [OUT]
+ * @param misses number of pooled allocations served from the heap [OUT]
+ * @param retained number of bytes held by the pool [OUT]
+ */
+void block_PoolStats (uint64_t *hits, uint64_t *misses, uint64_t *retained)
+{
+    *hits = atomic_load (&block_pool_hits);
+    *misses = atomic_load (&block_pool_misses);
+    *retained = atomic_load (&block_pool_retained);
+}
+
+/**
+ * Frees the blocks retained by the depot and by the cache of the calling
+ * thread. The caches of other threads are freed when those threads exit.
+ */
+void block_PoolCleanup (void)
+{
+    if (atomic_load (&block_cache_state) == 1)
+    {
+        block_cache_t *cache = vlc_threadvar_get (block_cache_key);
+
+        if (cache != NULL)
+        {
+            vlc_threadvar_set (block_cache_key, NULL);
+            block_cache_Destroy (cache);
+        }
+    }
+
+    block_t *list[BLOCK_POOL_CLASSES];
+
+    vlc_mutex_lock (&block_depot.lock);
+    for (unsigned c = 0; c < BLOCK_POOL_CLASSES; c++)
+    {
+        list[c] = block_depot.head[c];
+        block_depot.head[c] = NULL;
+        block_depot.count[c] = 0;
+    }
+    vlc_mutex_unlock (&block_depot.lock);
+
+    size_t freed = 0;
+
+    for (unsigned c = 0; c < BLOCK_POOL_CLASSES; c++)
+        while (list[c] != NULL)
+        {
+            block_t *b = list[c];
+
+            list[c] = b->p_next;
+            freed += sizeof (block_t) + b->i_size;
+            free (b);
+        }
+    atomic_fetch_sub (&block_pool_retained, freed);
+}
+
 block_t *block_Alloc (size_t size)
 {
+    int c = block_pool_Class (size);
+    size_t room = size;
+    block_t *b = NULL;
+
+    if (c >= 0)
+    {
+        b = block_pool_Get (c);
+        if (b == NULL)
+            atomic_fetch_add (&block_pool_misses, 1);
+        room = block_pool_ClassSize (c);
+    }
+
     /* 2 * BLOCK_PADDING: pre + post padding */
-    const size_t alloc = sizeof (block_t) + BLOCK_ALIGN + (2 * BLOCK_PADDING)
-                       + size;
-    if (unlikely(alloc <= size))
+    const size_t alloc = sizeof (block_t) + BLOCK_OVERHEAD + room;
+    if (unlikely(alloc <= room))
         return NULL;
 
-    block_t *b = malloc (alloc);
-    if (unlikely(b == NULL))
-        return NULL;
+    if (b == NULL)
+    {
+        b = malloc (alloc);
+        if (unlikely(b == NULL))
+            return NULL;
+    }
 
     block_Init (b, b + 1, alloc - sizeof (*b));
     static_assert ((BLOCK_PADDING % BLOCK_ALIGN) == 0,
@@ -144,10 +479,205 @@ block_t *block_Alloc (size_t size)
     b->p_buffer += BLOCK_PADDING + BLOCK_ALIGN - 1;
     b->p_buffer = (void *)(((uintptr_t)b->p_buffer) & ~(BLOCK_ALIGN - 1));
     b->i_buffer = size;
-    b->pf_release = block_generic_Release;
+    b->pf_release = (c >= 0) ? block_pool_Release : block_generic_Release;
     return b;
 }
 
+/**
+ * @section Shared payload blocks.
+ *
+ * A shared block references the payload of another block (the origin)
+ * instead of owning a copy. The origin is released along with the last
+ * reference to it.
+ */
+typedef struct
+{
+    atomic_uint refs;
+    block_t    *origin;
+} block_payload_t;
+
+typedef struct
+{
+    block_t          self;
+    block_payload_t *payload;
+} block_shared_t;
+
+/* Headers of shared blocks and payload references are small and short-lived,
+ * they are recycled through the cache of the releasing thread. */
+#define BLOCK_HEADER_SIZE      sizeof (block_shared_t)
+#define BLOCK_HEADER_CACHE_MAX 256
+
+static_assert (sizeof (block_payload_t) <= BLOCK_HEADER_SIZE,
+               "payload references must fit in a block header");
+
+static void *block_header_New (void)
+{
+    block_cache_t *cache = block_cache_Get ();
+
+    if (likely(cache != NULL) && cache->headers != NULL)
+    {
+        void *h = cache->headers;
+
+        cache->headers = *(void **)h;
+        cache->header_count--;
+        return h;
+    }
+    return malloc (BLOCK_HEADER_SIZE);
+}
+
+static void block_header_Free (void *h)
+{
+    block_cache_t *cache = block_cache_Get ();
+
+    if (unlikely(cache == NULL)
+     || cache->header_count >= BLOCK_HEADER_CACHE_MAX)
+    {
+        free (h);
+        return;
+    }
+
+    *(void **)h = cache->headers;
+    cache->headers = h;
+    cache->header_count++;
+}
+
+static void block_shared_Release (block_t *block)
+{
+    block_payload_t *payload = ((block_shared_t *)block)->payload;
+
+    block_Invalidate (block);
+    block_header_Free (block);
+
+    if (atomic_fetch_sub (&payload->refs, 1) == 1)
+    {
+        block_Release (payload->origin);
+        block_header_Free (payload);
+    }
+}
+
+static block_t *block_shared_New (block_payload_t *payload,
+                                  const block_t *view)
+{
+    block_shared_t *sh = block_header_New ();
+    if (unlikely(sh == NULL))
+        return NULL;
+
+    block_t *origin = payload->origin;
+
+    block_Init (&sh->self, origin->p_start, origin->i_size);
+    BlockMetaCopy (&sh->self, view);
+    sh->self.p_next = NULL;
+    sh->self.p_buffer = view->p_buffer;
+    sh->self.i_buffer = view->i_buffer;
+    sh->self.pf_release = block_shared_Release;
+    sh->payload = payload;
+    return &sh->self;
+}
+
+/**
+ * Checks whether block_Clone() can reference the payload of a block without
+ * copying it, i.e. whether the block was obtained from block_Share() or
+ * block_Clone().
+ */
+bool block_IsShareable (const block_t *block)
+{
+    return block->pf_release == block_shared_Release;
+}
+
+/**
+ * Turns a block into a shareable block, without copying its payload.
+ *
+ * The payload of a shareable block can then be referenced by any number of
+ * blocks with block_Clone() in constant time. Sharing blocks must treat the
+ * payload as read-only, even once only one of them is left, as the payload
+ * may not be writable at all (e.g. a read-only memory mapping).
+ * block_Realloc() and block_Writable() transparently make a private copy
+ * before the payload is written to.
+ *
+ * @param block block to share (ownership is transferred)
+ * @return the shareable block, or the original block if it could not be
+ * turned into a shareable block (block_Clone() will then copy the payload).
+ */
+block_t *block_Share (block_t *block)
+{
+    block_Check (block);
+
+    if (block->pf_release == block_shared_Release)
+        return block; /* already shareable */
+
+    block_payload_t *payload = block_header_New ();
+    if (unlikely(payload == NULL))
+        return block;
+
+    atomic_init (&payload->refs, 1);
+    payload->origin = block;
+
+    block_t *sh = block_shared_New (payload, block);
+    if (unlikely(sh == NULL))
+    {
+        block_header_Free (payload);
+        return block;
+    }
+
+    sh->p_next = block->p_next;
+    block->p_next = NULL;
+    return sh;
+}
+
+/**
+ * Creates a new reference to the payload of a block.
+ *
+ * If the block was obtained from block_Share() (or block_Clone()), the
+ * payload is not copied: only the block metadata is. Otherwise, this is
+ * equivalent to block_Duplicate().
+ *
+ * @return a new block with the same payload and properties, or NULL on error.
+ */
+block_t *block_Clone (block_t *block)
+{
+    block_Check (block);
+
+    if (block->pf_release != block_shared_Release)
+        return block_Duplicate (block);
+
+    block_payload_t *payload = ((block_shared_t *)block)->payload;
+
+    atomic_fetch_add (&payload->refs, 1);
+
+    block_t *clone = block_shared_New (payload, block);
+    if (unlikely(clone == NULL))
+        atomic_fetch_sub (&payload->refs, 1); /* cannot be the last one */
+    return clone;
+}
+
+/**
+ * Makes the payload of a block writable in place.
+ *
+ * The payload of a shareable block must not be modified (see block_Share()).
+ * Code modifying a block payload in place, other than through
+ * block_Realloc(), must get the block through this function first.
+ *
+ * @param block block to modify (ownership is transferred)
+ * @return the block itself if its payload is not shareable, otherwise a
+ * private copy of it (the block is then released), or NULL on error.
+ */
+block_t *block_Writable (block_t *block)
+{
+    block_Check (block);
+
+    if (!block_IsShareable (block))
+        return block;
+
+    block_t *copy = block_Alloc (block->i_buffer);
+    if (likely(copy != NULL))
+    {
+        BlockMetaCopy (copy, block);
+        memcpy (copy->p_buffer, block->p_buffer, block->i_buffer);
+    }
+    block_Release (block);
+    return copy;
+}
+
 block_t *block_Realloc( block_t *p_block, ssize_t i_prebody, size_t i_body )
 {
     size_t requested = i_prebody + i_body;
@@ -170,7 +700,7 @@ block_t *block_Realloc( block_t *p_block, ssize_t i_prebody, size_t i_body )
          p_block->i_buffer = 0; /* discard current payload */
     if( p_block->i_buffer == 0 )
     {
-        if( requested <= p_block->i_size )
+        if( requested <= p_block->i_size && !block_IsShareable( p_block ) )
         {   /* Enough room: recycle buffer */
             size_t extra = p_block->i_size - requested;
 
@@ -205,10 +735,12 @@ block_t *block_Realloc( block_t *p_block, ssize_t i_prebody, size_t i_body )
     uint8_t *p_start = p_block->p_start;
     uint8_t *p_end = p_start + p_block->i_size;
 
-    /* Second, reallocate the buffer if we lack space. This is done now to
+    /* Second, reallocate the buffer if we lack space, or if the payload is
+     * shareable, hence read-only (copy-on-write). This is done now to
      * minimize the payload size for memory copy. */
     assert( i_prebody >= 0 );
-    if( (size_t)(p_block->p_buffer - p_start) < (size_t)i_prebody
+    if( block_IsShareable( p_block )
+     || (size_t)(p_block->p_buffer - p_start) < (size_t)i_prebody
      || (size_t)(p_end - p_block->p_buffer) < i_body )
     {
         block_t *p_rea = block_Alloc( requested );
@@ -225,9 +757,13 @@ block_t *block_Realloc( block_t *p_block, ssize_t i_prebody, size_t i_body )
         p_block = p_rea;
     }
     else
-    /* We have a very large reserved footer now? Release some of it.
+    /* We have a very large reserved footer now? Release some of it,
+     * unless a new block would come from the same pool size class anyway.
      * XXX it might not preserve the alignment of p_buffer */
-    if( p_end - (p_block->p_buffer + i_body) > BLOCK_WASTE_SIZE )
+    if( p_end - (p_block->p_buffer + i_body) > BLOCK_WASTE_SIZE
+     && !( p_block->pf_release == block_pool_Release
+        && block_pool_Class( requested ) ==
+           block_pool_Class( p_block->i_size - BLOCK_OVERHEAD ) ) )
     {
         block_t *p_rea = block_Alloc( requested );
         if( p_rea )
@@ -260,7 +796,6 @@ block_t *block_Realloc( block_t *p_block, ssize_t i_prebody, size_t i_body )
     return p_block;
 }
 
-
 static void block_heap_Release (block_t *block)
 {
     block_Invalidate (block);
@@ -30,14 +30,21 @@
 
 #include <vlc_common.h>
 #include <vlc_block.h>
+#include <vlc_atomic.h>
 #include "libvlc.h"
 
 /**
  * @section Thread-safe block queue functions
  */
 
+#define FIFO_RING_SIZE 64 /* must be a power of two */
+
 /**
  * Internal state for block queues
+ *
+ * Blocks queued with vlc_fifo_Push() go through a lock-free ring, and are
+ * only moved to the linked-list by the thread holding the lock. The ring
+ * always contains the most recent blocks.
  */
 struct block_fifo_t
 {
@@ -46,10 +53,45 @@ struct block_fifo_t
 
     block_t             *p_first;
     block_t             **pp_last;
-    size_t              i_depth;
-    size_t              i_size;
+    atomic_size_t       i_depth;  /**< Blocks in the list */
+    atomic_size_t       i_size;   /**< Bytes in the list and the ring */
+
+    /* Single producer, single consumer ring */
+    block_t             *ring[FIFO_RING_SIZE];
+    atomic_size_t       ring_head; /**< Written by the producer only */
+    atomic_size_t       ring_tail; /**< Written with the lock held only */
+    atomic_uint         waiters;   /**< Threads in vlc_fifo_Wait() */
+#ifndef NDEBUG
+    atomic_bool         pushing;   /**< Detects concurrent producers */
+#endif
 };
 
+/**
+ * Moves the blocks from the ring to the end of the list.
+ * The FIFO must be locked.
+ */
+static void vlc_fifo_Collect(vlc_fifo_t *fifo)
+{
+    size_t tail = atomic_load_explicit(&fifo->ring_tail, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&fifo->ring_head, memory_order_acquire);
+
+    if (tail == head)
+        return;
+
+    atomic_fetch_add_explicit(&fifo->i_depth, head - tail,
+                              memory_order_relaxed);
+    do
+    {
+        block_t *block = fifo->ring[tail % FIFO_RING_SIZE];
+
+        *(fifo->pp_last) = block;
+        fifo->pp_last = &block->p_next;
+    }
+    while (++tail != head);
+
+    atomic_store_explicit(&fifo->ring_tail, tail, memory_order_release);
+}
+
 /**
  * Locks a block FIFO. No more than one thread can lock the FIFO at any given
  * time, and no other thread can modify the FIFO while it is locked.
@@ -91,6 +133,13 @@ void vlc_fifo_Signal(vlc_fifo_t *fifo)
     vlc_cond_signal(&fifo->wait);
 }
 
+static void vlc_fifo_WaitCleanup(void *data)
+{
+    vlc_fifo_t *fifo = data;
+
+    atomic_fetch_sub(&fifo->waiters, 1);
+}
+
 /**
  * Atomically unlocks the FIFO and waits until one thread signals the FIFO,
  * then locks the FIFO again. A signal can be sent by queueing a block to the
@@ -102,7 +151,17 @@ void vlc_fifo_Signal(vlc_fifo_t *fifo)
  */
 void vlc_fifo_Wait(vlc_fifo_t *fifo)
 {
-    vlc_fifo_WaitCond(fifo, &fifo->wait);
+    /* Tell vlc_fifo_Push() to signal, then check that it did not just push
+     * a block without seeing that. */
+    atomic_fetch_add(&fifo->waiters, 1);
+    if (atomic_load(&fifo->ring_head)
+     == atomic_load_explicit(&fifo->ring_tail, memory_order_relaxed))
+    {
+        vlc_cleanup_push(vlc_fifo_WaitCleanup, fifo);
+        vlc_fifo_WaitCond(fifo, &fifo->wait);
+        vlc_cleanup_pop();
+    }
+    atomic_fetch_sub(&fifo->waiters, 1);
 }
 
 void vlc_fifo_WaitCond(vlc_fifo_t *fifo, vlc_cond_t *condvar)
@@ -115,14 +174,18 @@ void vlc_fifo_WaitCond(vlc_fifo_t *fifo, vlc_cond_t *condvar)
  *
  * @note This function is not cancellation point.
  *
- * @warning The FIFO must be locked by the calling thread using
- * vlc_fifo_Lock(). Otherwise behaviour is undefined.
+ * @note If the FIFO is not locked, the result is only a hint, as other
+ * threads may be queueing and dequeueing blocks at the same time.
  *
  * @return the number of blocks in the FIFO (zero if it is empty)
  */
 size_t vlc_fifo_GetCount(const vlc_fifo_t *fifo)
 {
-    return fifo->i_depth;
+    size_t tail = atomic_load_explicit(&fifo->ring_tail, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&fifo->ring_head, memory_order_acquire);
+
+    return atomic_load_explicit(&fifo->i_depth, memory_order_relaxed)
+           + (head - tail);
 }
 
 /**
@@ -130,8 +193,8 @@ size_t vlc_fifo_GetCount(const vlc_fifo_t *fifo)
  *
  * @note This function is not cancellation point.
  *
- * @warning The FIFO must be locked by the calling thread using
- * vlc_fifo_Lock(). Otherwise behaviour is undefined.
+ * @note If the FIFO is not locked, the result is only a hint, as other
+ * threads may be queueing and dequeueing blocks at the same time.
  *
  * @return the total number of bytes
  *
@@ -141,7 +204,7 @@ size_t vlc_fifo_GetCount(const vlc_fifo_t *fifo)
  */
 size_t vlc_fifo_GetBytes(const vlc_fifo_t *fifo)
 {
-    return fifo->i_size;
+    return atomic_load_explicit(&fifo->i_size, memory_order_relaxed);
 }
 
 /**
@@ -158,6 +221,9 @@ size_t vlc_fifo_GetBytes(const vlc_fifo_t *fifo)
 void vlc_fifo_QueueUnlocked(block_fifo_t *fifo, block_t *block)
 {
     vlc_assert_locked(&fifo->lock);
+
+    /* keep the blocks pushed earlier in front */
+    vlc_fifo_Collect(fifo);
     assert(*(fifo->pp_last) == NULL);
 
     *(fifo->pp_last) = block;
@@ -165,8 +231,9 @@ void vlc_fifo_QueueUnlocked(block_fifo_t *fifo, block_t *block)
     while (block != NULL)
     {
         fifo->pp_last = &block->p_next;
-        fifo->i_depth++;
-        fifo->i_size += block->i_buffer;
+        atomic_fetch_add_explicit(&fifo->i_depth, 1, memory_order_relaxed);
+        atomic_fetch_add_explicit(&fifo->i_size, block->i_buffer,
+                                  memory_order_relaxed);
 
         block = block->p_next;
     }
@@ -174,6 +241,61 @@ void vlc_fifo_QueueUnlocked(block_fifo_t *fifo, block_t *block)
     vlc_fifo_Signal(fifo);
 }
 
+/**
+ * Queues a linked-list of blocks into a FIFO without locking it.
+ *
+ * This is much faster than vlc_fifo_QueueUnlocked(), as the FIFO is only
+ * locked to wake up a thread waiting in vlc_fifo_Wait(), if any. Blocks
+ * queued while the waiting thread has not run yet are thus handed over all
+ * at once.
+ *
+ * @param block the head of the list of blocks
+ *              (if NULL, this function has no effects)
+ *
+ * @note This function is not a cancellation point.
+ *
+ * @warning Only one thread at a time may call this function on a given FIFO,
+ * and the calling thread must not have the FIFO locked.
+ */
+void vlc_fifo_Push(vlc_fifo_t *fifo, block_t *block)
+{
+#ifndef NDEBUG
+    bool concurrent = atomic_exchange(&fifo->pushing, true);
+    assert(!concurrent);
+#endif
+    size_t head = atomic_load_explicit(&fifo->ring_head, memory_order_relaxed);
+
+    while (block != NULL)
+    {
+        size_t tail = atomic_load_explicit(&fifo->ring_tail,
+                                           memory_order_acquire);
+        if (head - tail >= FIFO_RING_SIZE)
+        {   /* Full ring: this also empties it */
+            block_FifoPut(fifo, block);
+            break;
+        }
+
+        block_t *next = block->p_next;
+
+        block->p_next = NULL;
+        fifo->ring[head % FIFO_RING_SIZE] = block;
+        atomic_fetch_add_explicit(&fifo->i_size, block->i_buffer,
+                                  memory_order_relaxed);
+        atomic_store(&fifo->ring_head, ++head);
+        block = next;
+    }
+#ifndef NDEBUG
+    atomic_store(&fifo->pushing, false);
+#endif
+
+    if (atomic_load(&fifo->waiters) > 0)
+    {
+        vlc_fifo_Lock(fifo);
+        vlc_fifo_Signal(fifo);
+        vlc_fifo_Unlock(fifo);
+    }
+}
+
 /**
  * Dequeues the first block from a locked FIFO, if any.
  *
@@ -188,6 +310,9 @@ block_t *vlc_fifo_DequeueUnlocked(block_fifo_t *fifo)
 {
     vlc_assert_locked(&fifo->lock);
 
+    if (fifo->p_first == NULL)
+        vlc_fifo_Collect(fifo);
+
     block_t *block = fifo->p_first;
 
     if (block == NULL)
@@ -198,10 +323,13 @@ block_t *vlc_fifo_DequeueUnlocked(block_fifo_t *fifo)
         fifo->pp_last = &fifo->p_first;
     block->p_next = NULL;
 
-    assert(fifo->i_depth > 0);
-    fifo->i_depth--;
-    assert(fifo->i_size >= block->i_buffer);
-    fifo->i_size -= block->i_buffer;
+    size_t depth = atomic_fetch_sub_explicit(&fifo->i_depth, 1,
+                                             memory_order_relaxed);
+    assert(depth > 0);
+    size_t size = atomic_fetch_sub_explicit(&fifo->i_size, block->i_buffer,
+                                            memory_order_relaxed);
+    assert(size >= block->i_buffer);
+    (void) depth; (void) size;
 
     return block;
 }
@@ -221,13 +349,16 @@ block_t *vlc_fifo_DequeueUnlocked(block_fifo_t *fifo)
 block_t *vlc_fifo_DequeueAllUnlocked(block_fifo_t *fifo)
 {
     vlc_assert_locked(&fifo->lock);
+    vlc_fifo_Collect(fifo);
 
     block_t *block = fifo->p_first;
 
     fifo->p_first = NULL;
     fifo->pp_last = &fifo->p_first;
-    fifo->i_depth = 0;
-    fifo->i_size = 0;
+    atomic_store_explicit(&fifo->i_depth, 0, memory_order_relaxed);
+    for (block_t *b = block; b != NULL; b = b->p_next)
+        atomic_fetch_sub_explicit(&fifo->i_size, b->i_buffer,
+                                  memory_order_relaxed);
 
     return block;
 }
@@ -248,7 +379,14 @@ block_fifo_t *block_FifoNew( void )
     vlc_cond_init( &p_fifo->wait );
     p_fifo->p_first = NULL;
     p_fifo->pp_last = &p_fifo->p_first;
-    p_fifo->i_depth = p_fifo->i_size = 0;
+    atomic_init( &p_fifo->i_depth, 0 );
+    atomic_init( &p_fifo->i_size, 0 );
+    atomic_init( &p_fifo->ring_head, 0 );
+    atomic_init( &p_fifo->ring_tail, 0 );
+    atomic_init( &p_fifo->waiters, 0 );
+#ifndef NDEBUG
+    atomic_init( &p_fifo->pushing, false );
+#endif
 
     return p_fifo;
 }
@@ -259,6 +397,7 @@ block_fifo_t *block_FifoNew( void )
  */
 void block_FifoRelease( block_fifo_t *p_fifo )
 {
+    vlc_fifo_Collect( p_fifo );
     block_ChainRelease( p_fifo->p_first );
     vlc_cond_destroy( &p_fifo->wait );
     vlc_mutex_destroy( &p_fifo->lock );
@@ -331,6 +470,7 @@ block_t *block_FifoShow( block_fifo_t *p_fifo )
     block_t *b;
 
     vlc_mutex_lock( &p_fifo->lock );
+    vlc_fifo_Collect( p_fifo );
     assert(p_fifo->p_first != NULL);
     b = p_fifo->p_first;
     vlc_mutex_unlock( &p_fifo->lock );
@@ -344,7 +484,7 @@ size_t block_FifoSize (block_fifo_t *fifo)
     size_t size;
 
     vlc_mutex_lock (&fifo->lock);
-    size = fifo->i_size;
+    size = vlc_fifo_GetBytes(fifo);
     vlc_mutex_unlock (&fifo->lock);
     return size;
 }
@@ -355,7 +495,7 @@ size_t block_FifoCount (block_fifo_t *fifo)
     size_t depth;
 
     vlc_mutex_lock (&fifo->lock);
-    depth = fifo->i_depth;
+    depth = vlc_fifo_GetCount(fifo);
     vlc_mutex_unlock (&fifo->lock);
     return depth;
 }
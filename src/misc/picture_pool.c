@@ -30,42 +30,44 @@
 # include "config.h"
 #endif
 #include <assert.h>
+#include <limits.h>
 
 #include <vlc_common.h>
 #include <vlc_picture_pool.h>
 
+#include <vlc_atomic.h>
+
 /*****************************************************************************
  *
  *****************************************************************************/
+/* Available pictures are tracked in a bitmap of unsigned words, one bit per
+ * picture. A bit is set while the picture is free; acquiring or releasing a
+ * picture is a single atomic operation on its word, without any lock. */
+#define POOL_WORD_BITS (sizeof (unsigned) * CHAR_BIT)
+
 struct picture_gc_sys_t {
     picture_pool_t *pool;
     picture_t *picture;
-    bool in_use;
-    uint64_t tick;
+    unsigned index;
 };
 
 struct picture_pool_t {
-    uint64_t       tick;
-    /* */
     unsigned       picture_count;
     picture_t      **picture;
 
     int       (*pic_lock)(picture_t *);
     void      (*pic_unlock)(picture_t *);
-    unsigned    refs;
-    vlc_mutex_t lock;
+    atomic_uint refs;
+    unsigned    word_count;
+    atomic_uint *available;
 };
 
 void picture_pool_Release(picture_pool_t *pool)
 {
-    bool destroy;
-
-    vlc_mutex_lock(&pool->lock);
-    assert(pool->refs > 0);
-    destroy = --pool->refs == 0;
-    vlc_mutex_unlock(&pool->lock);
+    unsigned refs = atomic_fetch_sub(&pool->refs, 1);
 
-    if (likely(!destroy))
+    assert(refs > 0);
+    if (likely(refs != 1))
         return;
 
     for (unsigned i = 0; i < pool->picture_count; i++) {
@@ -77,7 +79,7 @@ void picture_pool_Release(picture_pool_t *pool)
         free(picture);
     }
 
-    vlc_mutex_destroy(&pool->lock);
+    free(pool->available);
     free(pool->picture);
     free(pool);
 }
@@ -86,20 +88,22 @@ static void picture_pool_ReleasePicture(picture_t *picture)
 {
     picture_gc_sys_t *sys = picture->gc.p_sys;
     picture_pool_t *pool = sys->pool;
+    unsigned mask = 1u << (sys->index % POOL_WORD_BITS);
 
     if (pool->pic_unlock != NULL)
         pool->pic_unlock(picture);
 
-    vlc_mutex_lock(&pool->lock);
-    assert(sys->in_use);
-    sys->in_use = false;
-    vlc_mutex_unlock(&pool->lock);
+    unsigned prev = atomic_fetch_or(&pool->available[sys->index / POOL_WORD_BITS],
+                                    mask);
+    assert(!(prev & mask));
+    (void) prev;
 
     picture_pool_Release(pool);
 }
 
 static picture_t *picture_pool_ClonePicture(picture_pool_t *pool,
-                                            picture_t *picture)
+                                            picture_t *picture,
+                                            unsigned index)
 {
     picture_gc_sys_t *sys = malloc(sizeof(*sys));
     if (unlikely(sys == NULL))
@@ -107,8 +111,7 @@ static picture_t *picture_pool_ClonePicture(picture_pool_t *pool,
 
     sys->pool = pool;
     sys->picture = picture;
-    sys->in_use = false;
-    sys->tick = 0;
+    sys->index = index;
 
     picture_resource_t res = {
         .p_sys = picture->p_sys,
@@ -136,16 +139,18 @@ static picture_pool_t *Create(int picture_count)
     if (!pool)
         return NULL;
 
-    pool->tick = 1;
     pool->picture_count = picture_count;
     pool->picture = calloc(pool->picture_count, sizeof(*pool->picture));
-    if (!pool->picture) {
+    pool->word_count = (picture_count + POOL_WORD_BITS - 1) / POOL_WORD_BITS;
+    pool->available = calloc(pool->word_count ? pool->word_count : 1,
+                             sizeof(*pool->available));
+    if (!pool->picture || !pool->available) {
+        free(pool->available);
         free(pool->picture);
         free(pool);
         return NULL;
     }
-    pool->refs = 1;
-    vlc_mutex_init(&pool->lock);
+    atomic_init(&pool->refs, 1);
     return pool;
 }
 
@@ -159,7 +164,8 @@ picture_pool_t *picture_pool_NewExtended(const picture_pool_configuration_t *cfg
     pool->pic_unlock = cfg->unlock;
 
     for (unsigned i = 0; i < cfg->picture_count; i++) {
-        picture_t *picture = picture_pool_ClonePicture(pool, cfg->picture[i]);
+        picture_t *picture = picture_pool_ClonePicture(pool, cfg->picture[i],
+                                                       i);
         if (unlikely(picture == NULL))
             abort();
 
@@ -167,6 +173,14 @@ picture_pool_t *picture_pool_NewExtended(const picture_pool_configuration_t *cfg
 
         pool->picture[i] = picture;
     }
+
+    /* Mark all pictures available */
+    for (unsigned w = 0; w < pool->word_count; w++) {
+        unsigned bits = cfg->picture_count - w * POOL_WORD_BITS;
+
+        atomic_init(&pool->available[w], (bits >= POOL_WORD_BITS)
+                                         ? ~0u : (1u << bits) - 1);
+    }
     return pool;
 
 }
@@ -229,62 +243,72 @@ error:
     return NULL;
 }
 
-picture_t *picture_pool_Get(picture_pool_t *pool)
+/**
+ * Atomically claims the lowest available picture from the pool.
+ * \return the picture index, or -1 if all pictures are in use.
+ */
+static int picture_pool_Claim(picture_pool_t *pool)
 {
-    vlc_mutex_lock(&pool->lock);
-    assert(pool->refs > 0);
+    for (unsigned w = 0; w < pool->word_count; w++) {
+        unsigned avail = atomic_load(&pool->available[w]);
 
-    for (unsigned i = 0; i < pool->picture_count; i++) {
-        picture_t *picture = pool->picture[i];
-        picture_gc_sys_t *sys = picture->gc.p_sys;
-        uint64_t tick;
+        while (avail != 0) {
+            unsigned bit = ctz(avail);
 
-        if (sys->in_use)
-            continue;
+            if (atomic_compare_exchange_weak(&pool->available[w], &avail,
+                                             avail & ~(1u << bit)))
+                return w * POOL_WORD_BITS + bit;
+        }
+    }
+    return -1;
+}
+
+picture_t *picture_pool_Get(picture_pool_t *pool)
+{
+    assert(atomic_load(&pool->refs) > 0);
 
-        pool->refs++;
-        tick = ++pool->tick;
-        sys->in_use = true;
-        vlc_mutex_unlock(&pool->lock);
+    int index = picture_pool_Claim(pool);
+    if (index < 0)
+        return NULL;
 
-        if (pool->pic_lock != NULL && pool->pic_lock(picture) != 0) {
-            vlc_mutex_lock(&pool->lock);
-            sys->in_use = false;
-            pool->refs--;
-            continue;
-        }
+    picture_t *picture = pool->picture[index];
 
-        sys->tick = tick;
+    atomic_fetch_add(&pool->refs, 1);
 
-        assert(atomic_load(&picture->gc.refcount) == 0);
-        atomic_init(&picture->gc.refcount, 1);
-        picture->p_next = NULL;
-        return picture;
+    if (pool->pic_lock != NULL && pool->pic_lock(picture) != 0) {
+        /* Keep the picture out of the bitmap while trying the rest of the
+         * pool, so that it is not picked again straight away. */
+        picture_t *next = picture_pool_Get(pool);
+
+        atomic_fetch_or(&pool->available[index / POOL_WORD_BITS],
+                        1u << (index % POOL_WORD_BITS));
+        picture_pool_Release(pool);
+        return next;
     }
 
-    vlc_mutex_unlock(&pool->lock);
-    return NULL;
+    assert(atomic_load(&picture->gc.refcount) == 0);
+    atomic_init(&picture->gc.refcount, 1);
+    picture->p_next = NULL;
+    return picture;
 }
 
 unsigned picture_pool_Reset(picture_pool_t *pool)
 {
     unsigned ret = 0;
-retry:
-    vlc_mutex_lock(&pool->lock);
-    assert(pool->refs > 0);
+
+    assert(atomic_load(&pool->refs) > 0);
 
     for (unsigned i = 0; i < pool->picture_count; i++) {
-        picture_t *picture = pool->picture[i];
-        picture_gc_sys_t *sys = picture->gc.p_sys;
+        const atomic_uint *word = &pool->available[i / POOL_WORD_BITS];
+        unsigned mask = 1u << (i % POOL_WORD_BITS);
 
-        if (sys->in_use) {
-            vlc_mutex_unlock(&pool->lock);
-            picture_Release(picture);
+        /* Release until the picture is back in the pool, as it may be held
+         * more than once. */
+        while (!(atomic_load(word) & mask)) {
+            picture_Release(pool->picture[i]);
             ret++;
-            goto retry;
         }
     }
-    vlc_mutex_unlock(&pool->lock);
 
     return ret;
 }
@@ -84,10 +84,220 @@ static void test_block (void)
     //assert (block == NULL);
 }
 
+static void test_block_Share (void)
+{
+    block_t *block = block_Alloc (sizeof (text));
+    assert (block != NULL);
+    memcpy (block->p_buffer, text, sizeof (text));
+    block->i_pts = 42;
+
+    block = block_Share (block);
+    assert (block != NULL);
+    assert (block->i_buffer == sizeof (text));
+    assert (block->i_pts == 42);
+
+    block_t *clone = block_Clone (block);
+    assert (clone != NULL);
+    assert (clone->p_buffer == block->p_buffer);
+    assert (clone->i_buffer == block->i_buffer);
+    assert (clone->i_pts == 42);
+
+    /* Writing through block_Realloc() must not affect the other reference */
+    clone = block_Realloc (clone, 1, clone->i_buffer);
+    assert (clone != NULL);
+    assert (clone->p_buffer + 1 != block->p_buffer);
+    clone->p_buffer[0] = '!';
+    clone->p_buffer[1] = '?';
+    assert (!memcmp (block->p_buffer, text, sizeof (text)));
+    assert (!memcmp (clone->p_buffer + 2, text + 1, sizeof (text) - 1));
+    block_Release (clone);
+
+    /* block_Writable() copies shared payloads only */
+    clone = block_Clone (block);
+    assert (clone != NULL);
+    clone->i_pts = 43;
+    clone = block_Writable (clone);
+    assert (clone != NULL);
+    assert (clone->p_buffer != block->p_buffer);
+    assert (clone->i_pts == 43);
+    clone->p_buffer[0] = '!';
+    assert (!memcmp (block->p_buffer, text, sizeof (text)));
+    assert (!memcmp (clone->p_buffer + 1, text + 1, sizeof (text) - 1));
+    assert (block_Writable (clone) == clone);
+    block_Release (clone);
+
+    /* The last reference to a shared payload is still read-only */
+    clone = block_Alloc (16);
+    assert (clone != NULL);
+    memset (clone->p_buffer, 0, 16);
+    clone = block_Share (clone);
+    assert (block_IsShareable (clone));
+    const uint8_t *ro = clone->p_buffer;
+    clone = block_Writable (clone);
+    assert (clone != NULL && !block_IsShareable (clone));
+    assert (clone->p_buffer != ro);
+    block_Release (clone);
+
+    /* A view of the payload can outlive the original reference */
+    clone = block_Clone (block);
+    assert (clone != NULL);
+    clone->p_buffer += 5;
+    clone->i_buffer -= 5;
+    block_Release (block);
+    assert (!memcmp (clone->p_buffer, text + 5, sizeof (text) - 5));
+
+    /* The last reference is exclusive and can be modified in place */
+    clone = block_Realloc (clone, 0, clone->i_buffer);
+    assert (clone != NULL);
+    assert (!memcmp (clone->p_buffer, text + 5, sizeof (text) - 5));
+    block_Release (clone);
+
+    /* Not shared: fall back to a copy */
+    block = block_Alloc (sizeof (text));
+    assert (block != NULL);
+    memcpy (block->p_buffer, text, sizeof (text));
+    clone = block_Clone (block);
+    assert (clone != NULL);
+    assert (clone->p_buffer != block->p_buffer);
+    assert (!memcmp (clone->p_buffer, text, sizeof (text)));
+    block_Release (clone);
+    block_Release (block);
+}
+
+static void *test_block_Pool_Release (void *data)
+{
+    block_ChainRelease (data);
+    return NULL;
+}
+
+static void test_block_Pool (void)
+{
+    static const size_t sizes[] = {
+        0, 1, 188, 256, 257, 1316, 1500, 4096, 40000, 65535, 65536, 65537,
+        1 << 20,
+    };
+    block_t *chain = NULL;
+
+    for (unsigned round = 0; round < 3; round++)
+    {
+        for (size_t i = 0; i < sizeof (sizes) / sizeof (sizes[0]); i++)
+        {
+            block_t *block = block_Alloc (sizes[i]);
+            assert (block != NULL);
+            assert (block->i_buffer == sizes[i]);
+            assert (((uintptr_t)block->p_buffer & 31) == 0);
+            memset (block->p_buffer, i, block->i_buffer);
+            block_ChainAppend (&chain, block);
+        }
+
+        /* Blocks released by another thread can be reused by this one */
+        if (round == 1)
+        {
+            vlc_thread_t th;
+
+            assert (vlc_clone (&th, test_block_Pool_Release, chain,
+                               VLC_THREAD_PRIORITY_LOW) == 0);
+            vlc_join (th, NULL);
+        }
+        else
+            block_ChainRelease (chain);
+        chain = NULL;
+    }
+
+    /* Growing a pooled block keeps its payload */
+    block_t *block = block_Alloc (1000);
+    assert (block != NULL);
+    memset (block->p_buffer, 'x', 1000);
+    block = block_Realloc (block, 16, 1000 + 30000);
+    assert (block != NULL);
+    assert (block->i_buffer == 16 + 1000 + 30000);
+    for (size_t i = 0; i < 1000; i++)
+        assert (block->p_buffer[16 + i] == 'x');
+    block_Release (block);
+}
+
+#define FIFO_BLOCKS 200000
+
+static void *test_block_Fifo_Thread (void *data)
+{
+    block_fifo_t *fifo = data;
+
+    /* Blocks are numbered through their dates */
+    for (unsigned i = 0; i < FIFO_BLOCKS; i++)
+    {
+        block_t *block = block_Alloc (i % 3);
+        assert (block != NULL);
+        block->i_dts = i;
+
+        if (i % 1000 == 999) /* mixing both ways keeps the order */
+            block_FifoPut (fifo, block);
+        else
+            vlc_fifo_Push (fifo, block);
+    }
+    return NULL;
+}
+
+static void test_block_Fifo (void)
+{
+    block_fifo_t *fifo = block_FifoNew ();
+    assert (fifo != NULL);
+
+    /* Single thread, beyond the ring capacity */
+    block_t *chain = NULL;
+    for (unsigned i = 0; i < 1000; i++)
+    {
+        block_t *block = block_Alloc (i);
+        assert (block != NULL);
+        block->i_dts = i;
+        if (i % 100 == 0)
+        {
+            vlc_fifo_Push (fifo, chain);
+            chain = NULL;
+        }
+        block_ChainAppend (&chain, block);
+    }
+    vlc_fifo_Push (fifo, chain);
+    assert (block_FifoCount (fifo) == 1000);
+    assert (vlc_fifo_GetBytes (fifo) == 1000 * 999 / 2);
+    assert (block_FifoShow (fifo)->i_dts == 0);
+
+    for (unsigned i = 0; i < 500; i++)
+    {
+        block_t *block = block_FifoGet (fifo);
+        assert (block->i_dts == i);
+        block_Release (block);
+    }
+    assert (block_FifoCount (fifo) == 500);
+    block_FifoEmpty (fifo);
+    assert (block_FifoCount (fifo) == 0);
+    assert (vlc_fifo_GetBytes (fifo) == 0);
+
+    /* One producer and one consumer thread */
+    vlc_thread_t th;
+    mtime_t start = mdate ();
+
+    assert (vlc_clone (&th, test_block_Fifo_Thread, fifo,
+                       VLC_THREAD_PRIORITY_LOW) == 0);
+    for (unsigned i = 0; i < FIFO_BLOCKS; i++)
+    {
+        block_t *block = block_FifoGet (fifo);
+        assert (block->i_dts == i);
+        block_Release (block);
+    }
+    vlc_join (th, NULL);
+    printf ("%.1f ns per block through the FIFO\n",
+            (double)(mdate () - start) * 1000. / FIFO_BLOCKS);
+
+    assert (block_FifoCount (fifo) == 0);
+    block_FifoRelease (fifo);
+}
+
 int main (void)
 {
     test_block_File ();
     test_block ();
+    test_block_Share ();
+    test_block_Pool ();
+    test_block_Fifo ();
     return 0;
 }
-
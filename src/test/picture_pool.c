@@ -23,10 +23,12 @@
 #endif
 
 #include <stdbool.h>
+#include <stdio.h>
 #undef NDEBUG
 #include <assert.h>
 
 #include <vlc_common.h>
+#include <vlc_atomic.h>
 #include <vlc_es.h>
 #include <vlc_picture_pool.h>
 
@@ -93,6 +95,88 @@ static void test(bool zombie)
             picture_Release(pics[i]);
 }
 
+#define THREADS 4
+#define ITERATIONS 100000
+
+static atomic_bool owned[PICTURES];
+static picture_t *table[PICTURES];
+static unsigned table_size;
+
+static void enum_cb(void *opaque, picture_t *pic)
+{
+    (void) opaque;
+    table[table_size++] = pic;
+}
+
+static unsigned lookup(picture_t *pic)
+{
+    for (unsigned i = 0; i < table_size; i++)
+        if (table[i] == pic)
+            return i;
+    abort();
+}
+
+static void *contend(void *data)
+{
+    picture_pool_t *p = data;
+
+    for (unsigned i = 0; i < ITERATIONS; i++) {
+        picture_t *pic[2];
+
+        /* Hold two pictures at once so that the pool runs dry sometimes */
+        for (unsigned j = 0; j < 2; j++) {
+            pic[j] = picture_pool_Get(p);
+            if (pic[j] != NULL)
+                assert(!atomic_exchange(&owned[lookup(pic[j])], true));
+        }
+
+        for (unsigned j = 0; j < 2; j++)
+            if (pic[j] != NULL) {
+                atomic_store(&owned[lookup(pic[j])], false);
+                picture_Release(pic[j]);
+            }
+    }
+    return NULL;
+}
+
+static void test_contention(void)
+{
+    vlc_thread_t th[THREADS];
+
+    pool = picture_pool_NewFromFormat(&fmt, PICTURES);
+    assert(pool != NULL);
+
+    table_size = 0;
+    picture_pool_Enum(pool, enum_cb, NULL);
+    assert(table_size == PICTURES);
+    for (unsigned i = 0; i < PICTURES; i++)
+        atomic_init(&owned[i], false);
+
+    mtime_t start = mdate();
+
+    for (unsigned i = 0; i < THREADS; i++)
+        assert(vlc_clone(&th[i], contend, pool,
+                         VLC_THREAD_PRIORITY_LOW) == 0);
+    for (unsigned i = 0; i < THREADS; i++)
+        vlc_join(th[i], NULL);
+
+    mtime_t duration = mdate() - start;
+
+    printf("%u threads: %.1f ns per get/release\n", THREADS,
+           duration * 1000. / (THREADS * ITERATIONS * 2));
+
+    /* Every picture must be available again */
+    for (unsigned i = 0; i < PICTURES; i++) {
+        table[i] = picture_pool_Get(pool);
+        assert(table[i] != NULL);
+    }
+    assert(picture_pool_Get(pool) == NULL);
+    for (unsigned i = 0; i < PICTURES; i++)
+        picture_Release(table[i]);
+
+    picture_pool_Release(pool);
+}
+
 int main(void)
 {
     video_format_Setup(&fmt, VLC_CODEC_I420, 320, 200, 320, 200, 1, 1);
@@ -109,6 +193,7 @@ int main(void)
 
     test(false);
     test(true);
+    test_contention();
 
     return 0;
 }
@@ -0,0 +1,168 @@
+/*****************************************************************************
+ * file.c: file access test
+ *****************************************************************************
+ * Copyright (C) 2015 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+/* Reads a file with stream_Block(), with and without memory mapping, checks
+ * the data including after seeking and after the blocks were modified in
+ * place, and compares the read throughput, also with stream_BlockShared(),
+ * which does not copy mapped data. */
+
+#include "../../libvlc/test.h"
+#include "../lib/libvlc_internal.h"
+
+#include <vlc_common.h>
+#include <vlc_block.h>
+#include <vlc_stream.h>
+#include <vlc_url.h>
+
+#define FILE_SIZE  (24 * 1024 * 1024 + 123)
+#define READ_SIZE  (7 * 188)
+
+static uint8_t Byte( uint64_t i_pos )
+{
+    return i_pos ^ (i_pos >> 11) ^ (i_pos >> 19);
+}
+
+static void CheckBlock( const block_t *p_block, uint64_t i_pos )
+{
+    for( size_t i = 0; i < p_block->i_buffer; i++ )
+        assert( p_block->p_buffer[i] == Byte( i_pos + i ) );
+}
+
+static void Run( vlc_object_t *obj, const char *psz_url, bool b_mmap )
+{
+    var_SetBool( obj, "file-mmap", b_mmap );
+
+    stream_t *s = stream_UrlNew( obj, psz_url );
+    assert( s != NULL );
+    assert( stream_Size( s ) == FILE_SIZE );
+
+    /* Sequential reading */
+    uint64_t i_pos = 0;
+    block_t *p_block;
+
+    mtime_t i_start = mdate();
+    while( (p_block = stream_Block( s, READ_SIZE )) != NULL )
+    {
+        assert( p_block->i_buffer == READ_SIZE ||
+                i_pos + p_block->i_buffer == FILE_SIZE );
+        CheckBlock( p_block, i_pos );
+        i_pos += p_block->i_buffer;
+        block_Release( p_block );
+    }
+    mtime_t i_duration = mdate() - i_start;
+    assert( i_pos == FILE_SIZE );
+
+    /* Seeking backward and forward, close to and far from the position */
+    static const uint64_t seeks[] = {
+        FILE_SIZE - 1000, 0, 4096, 4095, 3 * 1024 * 1024 - 7,
+        1024 * 1024, FILE_SIZE - 1, 17 * 1024 * 1024 + 1,
+    };
+
+    for( size_t i = 0; i < sizeof(seeks) / sizeof(*seeks); i++ )
+    {
+        assert( stream_Seek( s, seeks[i] ) == VLC_SUCCESS );
+        assert( (uint64_t)stream_Tell( s ) == seeks[i] );
+
+        /* keep a block across the next read, as a demuxer may do */
+        block_t *p_first = stream_Block( s, READ_SIZE );
+        assert( p_first != NULL );
+        p_block = stream_Block( s, 100 );
+
+        CheckBlock( p_first, seeks[i] );
+        if( p_block != NULL )
+        {
+            CheckBlock( p_block, seeks[i] + p_first->i_buffer );
+            block_Release( p_block );
+        }
+
+        /* blocks are writable, as when a demuxer reorders audio channels,
+         * and writing must not alter the data read again */
+        memset( p_first->p_buffer, 0xAA, p_first->i_buffer );
+        block_Release( p_first );
+
+        assert( stream_Seek( s, seeks[i] ) == VLC_SUCCESS );
+        p_first = stream_Block( s, READ_SIZE );
+        assert( p_first != NULL );
+        CheckBlock( p_first, seeks[i] );
+        block_Release( p_first );
+    }
+
+    /* Sequential reading again, without copying the mapped data */
+    unsigned i_shared = 0;
+
+    assert( stream_Seek( s, 0 ) == VLC_SUCCESS );
+    i_pos = 0;
+    mtime_t i_shared_start = mdate();
+    while( (p_block = stream_BlockShared( s, READ_SIZE )) != NULL )
+    {
+        CheckBlock( p_block, i_pos );
+        i_pos += p_block->i_buffer;
+        if( block_IsShareable( p_block ) )
+            i_shared++;
+        block_Release( p_block );
+    }
+    mtime_t i_shared_duration = mdate() - i_shared_start;
+    assert( i_pos == FILE_SIZE );
+    assert( b_mmap ? i_shared > 0 : i_shared == 0 );
+
+    stream_Delete( s );
+
+    printf( "%s: %.0f MiB/s, %.0f MiB/s shared (%u blocks not copied)\n",
+            b_mmap ? "memory mapping" : "read",
+            (double)FILE_SIZE * CLOCK_FREQ / (i_duration + 1) / 1048576,
+            (double)FILE_SIZE * CLOCK_FREQ / (i_shared_duration + 1) / 1048576,
+            i_shared );
+}
+
+int main( void )
+{
+    libvlc_instance_t *p_vlc;
+    vlc_object_t *obj;
+    char psz_path[] = "/tmp/vlc-test-file-XXXXXX";
+
+    test_init();
+
+    int fd = mkstemp( psz_path );
+    assert( fd != -1 );
+
+    uint8_t *p_buf = malloc( FILE_SIZE );
+    assert( p_buf != NULL );
+    for( uint64_t i = 0; i < FILE_SIZE; i++ )
+        p_buf[i] = Byte( i );
+    assert( write( fd, p_buf, FILE_SIZE ) == FILE_SIZE );
+    free( p_buf );
+    close( fd );
+
+    char *psz_url = vlc_path2uri( psz_path, "file" );
+    assert( psz_url != NULL );
+
+    p_vlc = libvlc_new( test_defaults_nargs, test_defaults_args );
+    assert( p_vlc != NULL );
+    obj = VLC_OBJECT(p_vlc->p_libvlc_int);
+    var_Create( obj, "file-mmap", VLC_VAR_BOOL );
+
+    Run( obj, psz_url, false );
+    Run( obj, psz_url, true );
+
+    libvlc_release( p_vlc );
+    free( psz_url );
+    unlink( psz_path );
+    return 0;
+}
@@ -0,0 +1,287 @@
+/*****************************************************************************
+ * http.c: HTTP access test
+ *****************************************************************************
+ * Copyright (C) 2015 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+/* Reads and seeks a file served by a local HTTP/1.1 server, and checks that
+ * connections are kept alive across seeks and across overlapping accesses. */
+
+#include "../../libvlc/test.h"
+#include "../lib/libvlc_internal.h"
+
+#include <vlc_common.h>
+#include <vlc_stream.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define FILE_SIZE   (16 * 1024 * 1024 + 321)
+#define MAX_CONNS   16
+
+static struct
+{
+    int fd;
+    unsigned port;
+    vlc_mutex_t lock;
+    unsigned connections;
+    unsigned requests;
+    unsigned count;
+    vlc_thread_t threads[MAX_CONNS];
+    int conns[MAX_CONNS];
+} server;
+
+static uint8_t Byte( uint64_t i_pos )
+{
+    return i_pos ^ (i_pos >> 11) ^ (i_pos >> 19);
+}
+
+static char *GetLine( int fd )
+{
+    char *psz = malloc( 1024 );
+    size_t i_len = 0;
+
+    assert( psz != NULL );
+    while( i_len < 1023 && recv( fd, &psz[i_len], 1, 0 ) == 1 )
+    {
+        if( psz[i_len] == '\n' )
+        {
+            if( i_len > 0 && psz[i_len - 1] == '\r' )
+                i_len--;
+            psz[i_len] = '\0';
+            return psz;
+        }
+        i_len++;
+    }
+    free( psz );
+    return NULL;
+}
+
+static bool Send( int fd, const void *p_data, size_t i_data )
+{
+    return send( fd, p_data, i_data, MSG_NOSIGNAL ) == (ssize_t)i_data;
+}
+
+/* Serves requests on one connection until the client closes it */
+static void *Serve( void *data )
+{
+    int fd = (intptr_t)data;
+    char *psz;
+
+    while( (psz = GetLine( fd )) != NULL )
+    {
+        uint64_t i_start = 0;
+        bool b_range = false;
+
+        assert( !strncmp( psz, "GET /file HTTP/1.1", 18 ) );
+        free( psz );
+        while( (psz = GetLine( fd )) != NULL && *psz )
+        {
+            if( sscanf( psz, "Range: bytes=%"SCNu64"-", &i_start ) == 1 )
+                b_range = true;
+            assert( strncasecmp( psz, "Connection: close", 17 ) );
+            free( psz );
+        }
+        if( psz == NULL )
+            break;
+        free( psz );
+
+        vlc_mutex_lock( &server.lock );
+        server.requests++;
+        vlc_mutex_unlock( &server.lock );
+
+        char *psz_header;
+        int i_header = asprintf( &psz_header, "HTTP/1.1 %s\r\n"
+            "Content-Length: %"PRIu64"\r\n"
+            "Content-Range: bytes %"PRIu64"-%u/%u\r\n"
+            "Accept-Ranges: bytes\r\n"
+            "Keep-Alive: timeout=60\r\n\r\n",
+            b_range ? "206 Partial Content" : "200 OK",
+            FILE_SIZE - i_start, i_start, FILE_SIZE - 1, FILE_SIZE );
+        assert( i_header >= 0 );
+        bool b_ok = Send( fd, psz_header, i_header );
+        free( psz_header );
+
+        uint8_t p_buf[8192];
+        for( uint64_t i_pos = i_start; b_ok && i_pos < FILE_SIZE; )
+        {
+            size_t i_len = __MIN( sizeof(p_buf), FILE_SIZE - i_pos );
+            for( size_t i = 0; i < i_len; i++ )
+                p_buf[i] = Byte( i_pos + i );
+            b_ok = Send( fd, p_buf, i_len );
+            i_pos += i_len;
+        }
+        if( !b_ok )
+            break; /* the client gave up on the response */
+    }
+    shutdown( fd, SHUT_RDWR );
+    return NULL;
+}
+
+static void *Listen( void *data )
+{
+    int fd;
+
+    (void) data;
+    while( (fd = accept( server.fd, NULL, NULL )) != -1 )
+    {
+        vlc_mutex_lock( &server.lock );
+        assert( server.count < MAX_CONNS );
+        server.conns[server.count] = fd;
+        assert( vlc_clone( &server.threads[server.count], Serve,
+                           (void *)(intptr_t)fd,
+                           VLC_THREAD_PRIORITY_LOW ) == 0 );
+        server.count++;
+        server.connections++;
+        vlc_mutex_unlock( &server.lock );
+    }
+    return NULL;
+}
+
+static void GetCounts( unsigned *pi_connections, unsigned *pi_requests )
+{
+    vlc_mutex_lock( &server.lock );
+    *pi_connections = server.connections;
+    *pi_requests = server.requests;
+    vlc_mutex_unlock( &server.lock );
+}
+
+static void CheckRead( stream_t *s, uint64_t i_pos, size_t i_size )
+{
+    uint8_t *p_buf = malloc( i_size );
+
+    assert( p_buf != NULL );
+    assert( (uint64_t)stream_Tell( s ) == i_pos );
+    assert( stream_Read( s, p_buf, i_size ) == (int)i_size );
+    for( size_t i = 0; i < i_size; i++ )
+        assert( p_buf[i] == Byte( i_pos + i ) );
+    free( p_buf );
+}
+
+static void ReadToEnd( stream_t *s )
+{
+    uint64_t i_pos = stream_Tell( s );
+
+    while( i_pos < FILE_SIZE )
+    {
+        size_t i_size = __MIN( 1024 * 1024, FILE_SIZE - i_pos );
+        CheckRead( s, i_pos, i_size );
+        i_pos += i_size;
+    }
+    assert( stream_Read( s, &(uint8_t){ 0 }, 1 ) == 0 );
+}
+
+int main( void )
+{
+    libvlc_instance_t *p_vlc;
+    vlc_object_t *obj;
+    vlc_thread_t listener;
+    unsigned i_connections, i_requests;
+    char psz_url[64];
+
+    test_init();
+
+    vlc_mutex_init( &server.lock );
+    server.fd = socket( AF_INET, SOCK_STREAM, 0 );
+    assert( server.fd != -1 );
+
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_addr.s_addr = htonl( INADDR_LOOPBACK ),
+    };
+    socklen_t addrlen = sizeof(addr);
+    assert( bind( server.fd, (struct sockaddr *)&addr, sizeof(addr) ) == 0 );
+    assert( listen( server.fd, 4 ) == 0 );
+    assert( getsockname( server.fd, (struct sockaddr *)&addr,
+                         &addrlen ) == 0 );
+    snprintf( psz_url, sizeof(psz_url), "http://127.0.0.1:%u/file",
+              ntohs( addr.sin_port ) );
+    assert( vlc_clone( &listener, Listen, NULL,
+                       VLC_THREAD_PRIORITY_LOW ) == 0 );
+
+    p_vlc = libvlc_new( test_defaults_nargs, test_defaults_args );
+    assert( p_vlc != NULL );
+    obj = VLC_OBJECT(p_vlc->p_libvlc_int);
+
+    stream_t *s = stream_UrlNew( obj, psz_url );
+    assert( s != NULL );
+    assert( stream_Size( s ) == FILE_SIZE );
+
+    /* Reading the whole response leaves the connection ready for the next
+     * request */
+    ReadToEnd( s );
+    assert( stream_Seek( s, 0 ) == VLC_SUCCESS );
+    CheckRead( s, 0, 100000 );
+    GetCounts( &i_connections, &i_requests );
+    assert( i_connections == 1 );
+    assert( i_requests == 2 );
+
+    /* Far seeks give up on the current response, close ones may not */
+    static const uint64_t seeks[] = {
+        FILE_SIZE - 5000, 1000, 4 * 1024 * 1024, 4 * 1024 * 1024 + 70000,
+        12 * 1024 * 1024 + 1, FILE_SIZE - 1,
+    };
+
+    for( size_t i = 0; i < sizeof(seeks) / sizeof(*seeks); i++ )
+    {
+        assert( stream_Seek( s, seeks[i] ) == VLC_SUCCESS );
+        CheckRead( s, seeks[i], __MIN( 3000, FILE_SIZE - seeks[i] ) );
+    }
+    ReadToEnd( s );
+
+    /* The idle connection is reused by the next access, as long as another
+     * access keeps the pool */
+    stream_t *p_hold = stream_UrlNew( obj, psz_url );
+    assert( p_hold != NULL );
+    stream_Delete( s );
+    GetCounts( &i_connections, &i_requests );
+    s = stream_UrlNew( obj, psz_url );
+    assert( s != NULL );
+    CheckRead( s, 0, 100000 );
+    stream_Delete( s );
+
+    unsigned i_connections2, i_requests2;
+    GetCounts( &i_connections2, &i_requests2 );
+    assert( i_connections2 == i_connections );
+    assert( i_requests2 == i_requests + 1 );
+
+    /* Without any access left, idle connections are closed */
+    stream_Delete( p_hold );
+    s = stream_UrlNew( obj, psz_url );
+    assert( s != NULL );
+    stream_Delete( s );
+    GetCounts( &i_connections2, &i_requests2 );
+    assert( i_connections2 == i_connections + 1 );
+    printf( "%u requests over %u connections\n", i_requests2,
+            i_connections2 );
+
+    libvlc_release( p_vlc );
+
+    shutdown( server.fd, SHUT_RDWR );
+    vlc_join( listener, NULL );
+    for( unsigned i = 0; i < server.count; i++ )
+    {
+        shutdown( server.conns[i], SHUT_RDWR );
+        vlc_join( server.threads[i], NULL );
+        close( server.conns[i] );
+    }
+    close( server.fd );
+    vlc_mutex_destroy( &server.lock );
+    return 0;
+}
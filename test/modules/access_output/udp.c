@@ -0,0 +1,163 @@
+/*****************************************************************************
+ * udp.c: UDP stream output test
+ *****************************************************************************
+ * Copyright (C) 2015 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+/* Sends a paced stream of TS-sized packets to a local socket, checks that
+ * they arrive in order and in time, and measures the sending cost. */
+
+#include "../../libvlc/test.h"
+#include "../lib/libvlc_internal.h"
+
+#include <vlc_common.h>
+#include <vlc_block.h>
+#include <vlc_sout.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <poll.h>
+
+#define PACKETS     40000
+#define PACKET_SIZE (7 * 188)
+#define PERIOD      20 /* microseconds between packets, about 500 Mbit/s */
+
+static struct
+{
+    int fd;
+    unsigned received;
+    unsigned reordered;
+    mtime_t i_last;
+} receiver;
+
+static void *Receive( void *data )
+{
+    uint8_t buf[2048];
+    uint32_t i_expected = 0;
+
+    (void) data;
+    for( ;; )
+    {
+        struct pollfd ufd = { .fd = receiver.fd, .events = POLLIN };
+
+        if( poll( &ufd, 1, 1000 ) <= 0 )
+            break;
+
+        ssize_t len = recv( receiver.fd, buf, sizeof (buf), 0 );
+        assert( len == PACKET_SIZE );
+        receiver.i_last = mdate();
+
+        uint32_t i_seq = GetDWBE( buf );
+        if( i_seq < i_expected )
+            receiver.reordered++;
+        i_expected = i_seq + 1;
+        if( ++receiver.received == PACKETS || i_seq == PACKETS - 1 )
+            break;
+    }
+    return NULL;
+}
+
+static mtime_t SystemTime( void )
+{
+    struct rusage ru;
+
+    assert( getrusage( RUSAGE_SELF, &ru ) == 0 );
+    return ru.ru_stime.tv_sec * CLOCK_FREQ + ru.ru_stime.tv_usec;
+}
+
+int main( void )
+{
+    const char *argv[test_defaults_nargs + 2];
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_addr.s_addr = htonl( INADDR_LOOPBACK ),
+    };
+    socklen_t addrlen = sizeof (addr);
+    char psz_dst[32];
+
+    test_init();
+
+    receiver.fd = socket( AF_INET, SOCK_DGRAM, 0 );
+    assert( receiver.fd != -1 );
+    int i_rcvbuf = 8 * 1024 * 1024;
+    setsockopt( receiver.fd, SOL_SOCKET, SO_RCVBUF, &i_rcvbuf,
+                sizeof (i_rcvbuf) );
+    assert( bind( receiver.fd, (struct sockaddr *)&addr, addrlen ) == 0 );
+    assert( getsockname( receiver.fd, (struct sockaddr *)&addr,
+                         &addrlen ) == 0 );
+    snprintf( psz_dst, sizeof (psz_dst), "127.0.0.1:%u",
+              ntohs( addr.sin_port ) );
+
+    for( int i = 0; i < test_defaults_nargs; i++ )
+        argv[i] = test_defaults_args[i];
+    argv[test_defaults_nargs] = "--sout-udp-caching=100";
+    /* one packet per datagram, flushed as soon as it is written */
+    argv[test_defaults_nargs + 1] = "--mtu=1316";
+
+    libvlc_instance_t *p_vlc = libvlc_new( test_defaults_nargs + 2, argv );
+    assert( p_vlc != NULL );
+
+    sout_access_out_t *p_access =
+        sout_AccessOutNew( p_vlc->p_libvlc_int, "udp", psz_dst );
+    assert( p_access != NULL );
+
+    vlc_thread_t thread;
+    assert( vlc_clone( &thread, Receive, NULL,
+                       VLC_THREAD_PRIORITY_LOW ) == 0 );
+
+    mtime_t i_stime = SystemTime();
+    mtime_t i_start = mdate();
+
+    for( uint32_t i = 0; i < PACKETS; i++ )
+    {
+        block_t *p_block = block_Alloc( PACKET_SIZE );
+        assert( p_block != NULL );
+
+        memset( p_block->p_buffer, 0x47, PACKET_SIZE );
+        SetDWBE( p_block->p_buffer, i );
+        p_block->i_dts = i_start + i * PERIOD;
+        if( (i % 256) == 0 )
+            p_block->i_flags |= BLOCK_FLAG_CLOCK;
+        assert( sout_AccessOutWrite( p_access, p_block ) == PACKET_SIZE );
+
+        /* Do not get too far ahead, as a muxer running in real time */
+        if( (i % 1024) == 1023 )
+            mwait( p_block->i_dts );
+    }
+
+    vlc_join( thread, NULL );
+    i_stime = SystemTime() - i_stime;
+    sout_AccessOutDelete( p_access );
+    libvlc_release( p_vlc );
+    close( receiver.fd );
+
+    /* The last packet is due after the caching delay plus the duration */
+    mtime_t i_late = receiver.i_last - (i_start + 100000
+                                        + (PACKETS - 1) * PERIOD);
+
+    printf( "received %u/%u packets, last one %"PRId64" ms late, "
+            "%"PRId64" ms of system time\n", receiver.received, PACKETS,
+            i_late / 1000, i_stime / 1000 );
+
+    assert( receiver.reordered == 0 );
+    assert( receiver.received > 0 );
+    assert( i_late < CLOCK_FREQ / 2 );
+    return 0;
+}
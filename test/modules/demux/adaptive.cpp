@@ -0,0 +1,352 @@
+/*****************************************************************************
+ * adaptive.cpp: adaptive streaming logic simulation
+ *****************************************************************************
+ * Copyright (C) 2015 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+/* Replays bandwidth traces against the adaptation logics, downloading the
+ * segments of a fixed representation ladder in simulated time the way the
+ * stream download thread does, and reports stalls and switches. */
+
+#define __STDC_CONSTANT_MACROS
+#define __STDC_FORMAT_MACROS
+#include <vlc_common.h>
+
+#include "../modules/demux/adaptative/Streams.cpp"
+#include "../modules/demux/adaptative/SegmentTracker.cpp"
+#include "../modules/demux/adaptative/http/Chunk.cpp"
+#include "../modules/demux/adaptative/http/HTTPConnection.cpp"
+#include "../modules/demux/adaptative/http/HTTPConnectionManager.cpp"
+#include "../modules/demux/adaptative/http/Sockets.cpp"
+#include "../modules/demux/adaptative/logic/AbstractAdaptationLogic.cpp"
+#include "../modules/demux/adaptative/logic/AlwaysBestAdaptationLogic.cpp"
+#include "../modules/demux/adaptative/logic/AlwaysLowestAdaptationLogic.cpp"
+#include "../modules/demux/adaptative/logic/BufferBasedAdaptationLogic.cpp"
+#include "../modules/demux/adaptative/logic/RateBasedAdaptationLogic.cpp"
+#include "../modules/demux/adaptative/logic/Representationselectors.cpp"
+#include "../modules/demux/adaptative/playlist/AbstractPlaylist.cpp"
+#include "../modules/demux/adaptative/playlist/BaseAdaptationSet.cpp"
+#include "../modules/demux/adaptative/playlist/BasePeriod.cpp"
+#include "../modules/demux/adaptative/playlist/BaseRepresentation.cpp"
+#include "../modules/demux/adaptative/playlist/CommonAttributesElements.cpp"
+#include "../modules/demux/adaptative/playlist/Inheritables.cpp"
+#include "../modules/demux/adaptative/playlist/Segment.cpp"
+#include "../modules/demux/adaptative/playlist/SegmentBase.cpp"
+#include "../modules/demux/adaptative/playlist/SegmentInfoCommon.cpp"
+#include "../modules/demux/adaptative/playlist/SegmentInformation.cpp"
+#include "../modules/demux/adaptative/playlist/SegmentList.cpp"
+#include "../modules/demux/adaptative/playlist/SegmentTemplate.cpp"
+#include "../modules/demux/adaptative/playlist/SegmentTimeline.cpp"
+#include "../modules/demux/adaptative/playlist/Url.cpp"
+#include "../modules/demux/adaptative/tools/Helper.cpp"
+
+/* after the C++ headers, which clash with its log() macro */
+#include "../../libvlc/test.h"
+#include "../lib/libvlc_internal.h"
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define SEGMENT_DURATION (2 * CLOCK_FREQ)
+#define SEGMENTS         150
+#define PREFETCH         3
+#define READ_SIZE        32768
+
+/* Bandwidths of the fixture representations, in bits per second */
+static const uint64_t ladder[] = {
+    300000, 750000, 1500000, 3000000, 6000000,
+};
+
+struct trace_step
+{
+    unsigned seconds;
+    unsigned kbps;
+};
+
+struct trace
+{
+    const char *name;
+    const trace_step *steps;
+    size_t count;
+};
+
+static const trace_step constant[] = { { 60, 4000 } };
+static const trace_step step_down[] = {
+    { 90, 5000 }, { 90, 1000 }, { 90, 5000 }, { 90, 2000 },
+};
+static const trace_step oscillating[] = { { 10, 7000 }, { 10, 900 } };
+static trace_step mobile[120]; /* filled pseudo-randomly */
+
+#define TRACE(t) { #t, t, sizeof(t) / sizeof(*t) }
+static const trace traces[] = {
+    TRACE(constant), TRACE(step_down), TRACE(oscillating), TRACE(mobile),
+};
+
+/* Bandwidth at a given simulated time, the traces loop */
+static unsigned GetRate(const trace *t, double time, double *remaining)
+{
+    unsigned total = 0;
+    for(size_t i = 0; i < t->count; i++)
+        total += t->steps[i].seconds;
+
+    double pos = fmod(time, total);
+    for(size_t i = 0; i < t->count; i++)
+    {
+        if(pos < t->steps[i].seconds)
+        {
+            *remaining = t->steps[i].seconds - pos;
+            return t->steps[i].kbps * 1000;
+        }
+        pos -= t->steps[i].seconds;
+    }
+    vlc_assert_unreachable();
+}
+
+/* Time taken to transfer a number of bytes, starting at a given time */
+static mtime_t Transfer(const trace *t, mtime_t now, size_t size)
+{
+    double time = (double) now / CLOCK_FREQ;
+    double bits = 8. * size;
+
+    for(;;)
+    {
+        double remaining;
+        unsigned rate = GetRate(t, time, &remaining);
+
+        if(bits <= rate * remaining)
+        {
+            time += bits / rate;
+            break;
+        }
+        bits -= rate * remaining;
+        time += remaining;
+    }
+    return time * CLOCK_FREQ - now;
+}
+
+class FixturePlaylist : public AbstractPlaylist
+{
+    public:
+        FixturePlaylist() : AbstractPlaylist(NULL) {}
+        virtual bool isLive() const { return false; }
+        virtual void debug() {}
+};
+
+struct result
+{
+    unsigned stalls;
+    mtime_t  stall_time;
+    unsigned switches;
+    uint64_t average;
+};
+
+static result Simulate(AbstractAdaptationLogic *logic, const trace *t,
+                       BasePeriod *period)
+{
+    result res = { 0, 0, 0, 0 };
+    mtime_t now = 0;
+    mtime_t buffer = 0; /* downloaded ahead of playback */
+    uint64_t previous = 0;
+    uint64_t sum = 0;
+
+    for(unsigned i = 0; i < SEGMENTS; i++)
+    {
+        /* the download thread waits for room in its buffer */
+        if(buffer > (PREFETCH - 1) * SEGMENT_DURATION)
+        {
+            now += buffer - (PREFETCH - 1) * SEGMENT_DURATION;
+            buffer = (PREFETCH - 1) * SEGMENT_DURATION;
+        }
+
+        logic->updateBufferLevel(buffer);
+        BaseRepresentation *rep =
+            logic->getCurrentRepresentation(StreamType::VIDEO, period);
+        assert(rep != NULL);
+
+        uint64_t bw = rep->getBandwidth();
+        if(i > 0 && bw != previous)
+            res.switches++;
+        previous = bw;
+        sum += bw;
+
+        size_t size = bw * SEGMENT_DURATION / CLOCK_FREQ / 8;
+        mtime_t start = now;
+        for(size_t done = 0; done < size; done += READ_SIZE)
+        {
+            size_t len = __MIN(READ_SIZE, size - done);
+            mtime_t time = Transfer(t, now, len);
+
+            logic->updateDownloadRate(len, time);
+            now += time;
+        }
+
+        /* playback starts with the first segment */
+        mtime_t elapsed = now - start;
+        if(i > 0 && elapsed > buffer)
+        {
+            res.stalls++;
+            res.stall_time += elapsed - buffer;
+            buffer = 0;
+        }
+        else if(i > 0)
+            buffer -= elapsed;
+        buffer += SEGMENT_DURATION;
+    }
+    res.average = sum / SEGMENTS;
+    return res;
+}
+
+static AbstractAdaptationLogic *CreateLogic(unsigned i, const char **name)
+{
+    switch(i)
+    {
+        case 0:
+            *name = "lowest";
+            return new AlwaysLowestAdaptationLogic();
+        case 1:
+            *name = "best";
+            return new AlwaysBestAdaptationLogic();
+        case 2:
+            *name = "rate";
+            return new RateBasedAdaptationLogic(0, 0);
+        case 3:
+            *name = "buffer";
+            return new BufferBasedAdaptationLogic(0, 0);
+    }
+    return NULL;
+}
+
+struct reader
+{
+    vlc_object_t *obj;
+    Socket *socket;
+    ssize_t ret;
+};
+
+static void *Read(void *data)
+{
+    reader *r = static_cast<reader *>(data);
+    char buf[16];
+
+    r->ret = r->socket->read(r->obj, buf, sizeof(buf));
+    return NULL;
+}
+
+/* A download blocked on a silent server must be woken up by interrupt() */
+static void TestInterrupt(void)
+{
+    libvlc_instance_t *vlc = libvlc_new(test_defaults_nargs,
+                                        test_defaults_args);
+    assert(vlc != NULL);
+
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    assert(fd != -1);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t addrlen = sizeof(addr);
+    assert(bind(fd, (struct sockaddr *)&addr, addrlen) == 0);
+    assert(getsockname(fd, (struct sockaddr *)&addr, &addrlen) == 0);
+    assert(listen(fd, 1) == 0);
+
+    reader r;
+    r.obj = VLC_OBJECT(vlc->p_libvlc_int);
+    r.socket = new Socket();
+    assert(r.socket->connect(r.obj, "127.0.0.1", ntohs(addr.sin_port)));
+    int peer = accept(fd, NULL, NULL);
+    assert(peer != -1);
+
+    vlc_thread_t thread;
+    assert(vlc_clone(&thread, Read, &r, VLC_THREAD_PRIORITY_LOW) == 0);
+    msleep(CLOCK_FREQ / 10);
+    r.socket->interrupt();
+    vlc_join(thread, NULL);
+    assert(r.ret <= 0);
+
+    /* and it must not be reconnected behind the caller's back */
+    r.socket->disconnect();
+    assert(!r.socket->connect(r.obj, "127.0.0.1", ntohs(addr.sin_port)));
+
+    delete r.socket;
+    close(peer);
+    close(fd);
+    libvlc_release(vlc);
+}
+
+int main(void)
+{
+    test_init();
+
+    TestInterrupt();
+
+    uint32_t seed = 42;
+    for(size_t i = 0; i < sizeof(mobile) / sizeof(*mobile); i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        mobile[i].seconds = 2;
+        mobile[i].kbps = 400 + (seed >> 16) % 6000;
+    }
+
+    FixturePlaylist playlist;
+    BasePeriod *period = new BasePeriod(&playlist);
+    BaseAdaptationSet *set = new BaseAdaptationSet(period);
+    set->setMimeType("video/mp4");
+    for(size_t i = 0; i < sizeof(ladder) / sizeof(*ladder); i++)
+    {
+        BaseRepresentation *rep = new BaseRepresentation(set, &playlist);
+        rep->setBandwidth(ladder[i]);
+        set->addRepresentation(rep);
+    }
+    period->addAdaptationSet(set);
+    playlist.addPeriod(period);
+
+    for(size_t i = 0; i < sizeof(traces) / sizeof(*traces); i++)
+    {
+        result res[4];
+
+        for(unsigned j = 0; j < 4; j++)
+        {
+            const char *name;
+            AbstractAdaptationLogic *logic = CreateLogic(j, &name);
+
+            res[j] = Simulate(logic, &traces[i], period);
+            delete logic;
+            printf("%-12s %-7s %3u stalls (%5.1f s) %3u switches "
+                   "%5" PRIu64 " kb/s\n", traces[i].name, name,
+                   res[j].stalls, (double) res[j].stall_time / CLOCK_FREQ,
+                   res[j].switches, res[j].average / 1000);
+        }
+
+        /* The buffer based logic stalls less than the rate based one, and
+         * never for more than 5% of the playback */
+        assert(res[0].stalls == 0);
+        assert(res[3].stall_time <= res[2].stall_time);
+        assert(res[3].stall_time * 20 <= SEGMENTS * SEGMENT_DURATION);
+    }
+
+    /* On a steady link, it settles at the best sustainable representation */
+    AbstractAdaptationLogic *logic = new BufferBasedAdaptationLogic(0, 0);
+    result res = Simulate(logic, &traces[0], period);
+    assert(res.stalls == 0);
+    assert(res.switches <= 2);
+    assert(res.average >= 2500000);
+    delete logic;
+
+    return 0;
+}
@@ -0,0 +1,384 @@
+/*****************************************************************************
+ * avi.c: AVI demuxer background index creation test
+ *****************************************************************************
+ * Copyright (C) 2015 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+/* Opens a synthetic file without index nor frame count, as left by an
+ * interrupted capture, and seeks around it while its index is created in the
+ * background. Then opens it again with the index stored the first time.
+ * Reports the opening and seeking times, and checks the seeks land on the
+ * right frame. */
+
+#include "../../libvlc/test.h"
+#include "../lib/libvlc_internal.h"
+
+#include <vlc_common.h>
+#include <vlc_demux.h>
+#include <vlc_es_out.h>
+#include <vlc_modules.h>
+#include <vlc_stream.h>
+#include <vlc_url.h>
+#include <vlc_md5.h>
+#include <vlc_configuration.h>
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#define FRAMES     200000
+#define DELTA      40        /* ms, 25 fps */
+#define SEEKS      100
+
+static uint32_t FrameSize( uint32_t i )
+{
+    return 16 + (i * 7) % 48;
+}
+
+/* Growable output buffer */
+static struct
+{
+    uint8_t *p;
+    size_t   i_size;
+    size_t   i_max;
+} file;
+
+static uint8_t *Reserve( size_t i_size )
+{
+    if( file.i_size + i_size > file.i_max )
+    {
+        file.i_max = (file.i_size + i_size) * 2;
+        file.p = realloc( file.p, file.i_max );
+        assert( file.p != NULL );
+    }
+    uint8_t *p = &file.p[file.i_size];
+    memset( p, 0, i_size );
+    file.i_size += i_size;
+    return p;
+}
+
+static void PutFourcc( const char *psz )
+{
+    memcpy( Reserve( 4 ), psz, 4 );
+}
+
+static void PutDWord( uint32_t i_value )
+{
+    SetDWLE( Reserve( 4 ), i_value );
+}
+
+/* Chunks, sized once complete */
+static size_t ChunkStart( const char *psz_fourcc, const char *psz_type )
+{
+    PutFourcc( psz_fourcc );
+    size_t i_start = file.i_size;
+    Reserve( 4 );
+    if( psz_type != NULL )
+        PutFourcc( psz_type );
+    return i_start;
+}
+
+static void ChunkEnd( size_t i_start )
+{
+    SetDWLE( &file.p[i_start], file.i_size - i_start - 4 );
+    if( file.i_size & 1 )
+        Reserve( 1 );
+}
+
+static void BuildFile( void )
+{
+    size_t riff = ChunkStart( "RIFF", "AVI " );
+
+    size_t hdrl = ChunkStart( "LIST", "hdrl" );
+    size_t avih = ChunkStart( "avih", NULL );
+    PutDWord( DELTA * 1000 ); /* microsecperframe */
+    PutDWord( 0 ); /* maxbytespersec */
+    PutDWord( 0 ); /* reserved */
+    PutDWord( 0 ); /* flags, no index */
+    PutDWord( 0 ); /* totalframes, never written */
+    PutDWord( 0 ); /* initialframes */
+    PutDWord( 1 ); /* streams */
+    PutDWord( 0 ); /* suggestedbuffersize */
+    PutDWord( 16 ); /* width */
+    PutDWord( 16 ); /* height */
+    Reserve( 16 ); /* reserved */
+    ChunkEnd( avih );
+
+    size_t strl = ChunkStart( "LIST", "strl" );
+    size_t strh = ChunkStart( "strh", NULL );
+    PutFourcc( "vids" );
+    PutFourcc( "MJPG" );
+    PutDWord( 0 ); /* flags */
+    PutDWord( 0 ); /* priority, language */
+    PutDWord( 0 ); /* initialframes */
+    PutDWord( 1 ); /* scale */
+    PutDWord( 1000 / DELTA ); /* rate */
+    PutDWord( 0 ); /* start */
+    PutDWord( 0 ); /* length, never written */
+    PutDWord( 0 ); /* suggestedbuffersize */
+    PutDWord( 0xffffffff ); /* quality */
+    PutDWord( 0 ); /* samplesize */
+    Reserve( 8 ); /* frame */
+    ChunkEnd( strh );
+
+    size_t strf = ChunkStart( "strf", NULL );
+    PutDWord( 40 ); /* biSize */
+    PutDWord( 16 ); /* biWidth */
+    PutDWord( 16 ); /* biHeight */
+    SetWLE( Reserve( 2 ), 1 ); /* biPlanes */
+    SetWLE( Reserve( 2 ), 24 ); /* biBitCount */
+    PutFourcc( "MJPG" );
+    Reserve( 20 );
+    ChunkEnd( strf );
+    ChunkEnd( strl );
+    ChunkEnd( hdrl );
+
+    size_t movi = ChunkStart( "LIST", "movi" );
+    for( uint32_t i = 0; i < FRAMES; i++ )
+    {
+        size_t frame = ChunkStart( "00dc", NULL );
+        SetDWLE( Reserve( FrameSize( i ) ), i );
+        ChunkEnd( frame );
+    }
+    ChunkEnd( movi );
+
+    /* no idx1 */
+    ChunkEnd( riff );
+}
+
+/* ES output checking the frames */
+static uint32_t i_received;
+static uint32_t i_first; /* first frame received after a seek */
+
+static es_out_id_t *EsOutAdd( es_out_t *out, const es_format_t *fmt )
+{
+    (void) out; (void) fmt;
+    return (es_out_id_t *)(uintptr_t)1;
+}
+
+static int EsOutSend( es_out_t *out, es_out_id_t *id, block_t *block )
+{
+    (void) out; (void) id;
+
+    assert( block->i_buffer >= 4 );
+    const uint32_t i = GetDWLE( block->p_buffer );
+    assert( block->i_buffer == FrameSize( i ) );
+
+    if( i_received++ == 0 )
+        i_first = i;
+    block_ChainRelease( block );
+    return VLC_SUCCESS;
+}
+
+static void EsOutDel( es_out_t *out, es_out_id_t *id )
+{
+    (void) out; (void) id;
+}
+
+static int EsOutControl( es_out_t *out, int i_query, va_list args )
+{
+    (void) out;
+
+    switch( i_query )
+    {
+        case ES_OUT_GET_ES_STATE:
+            (void) va_arg( args, es_out_id_t * );
+            *va_arg( args, bool * ) = true;
+            return VLC_SUCCESS;
+        default:
+            return VLC_EGENERIC;
+    }
+}
+
+static es_out_t es_out =
+{
+    .pf_add = EsOutAdd,
+    .pf_send = EsOutSend,
+    .pf_del = EsOutDel,
+    .pf_control = EsOutControl,
+};
+
+static int Control( demux_t *p_demux, int i_query, ... )
+{
+    va_list args;
+    int i_ret;
+
+    va_start( args, i_query );
+    i_ret = p_demux->pf_control( p_demux, i_query, args );
+    va_end( args );
+    return i_ret;
+}
+
+static demux_t *Open( libvlc_instance_t *p_vlc, char *psz_path )
+{
+    demux_t *p_demux = vlc_object_create( p_vlc->p_libvlc_int, sizeof(*p_demux) );
+    assert( p_demux != NULL );
+
+    char *psz_url = vlc_path2uri( psz_path, "file" );
+    assert( psz_url != NULL );
+
+    /* always fix, and keep the fixed index */
+    var_Create( p_demux, "avi-index", VLC_VAR_INTEGER );
+    var_SetInteger( p_demux, "avi-index", 1 );
+    var_Create( p_demux, "avi-index-file", VLC_VAR_BOOL );
+    var_SetBool( p_demux, "avi-index-file", true );
+
+    p_demux->psz_access = (char *)"file";
+    p_demux->psz_demux = (char *)"avi";
+    p_demux->psz_location = psz_path;
+    p_demux->psz_file = psz_path;
+    p_demux->out = &es_out;
+    p_demux->s = stream_UrlNew( p_vlc->p_libvlc_int, psz_url );
+    assert( p_demux->s != NULL );
+    free( psz_url );
+
+    const mtime_t i_start = mdate();
+    p_demux->p_module = module_need( p_demux, "demux", "avi", true );
+    if( p_demux->p_module == NULL )
+    {
+        stream_Delete( p_demux->s );
+        vlc_object_release( p_demux );
+        return NULL;
+    }
+    printf( "opened in %.1f ms\n", (double)(mdate() - i_start) / 1000 );
+    return p_demux;
+}
+
+static void Close( demux_t *p_demux )
+{
+    module_unneed( p_demux, p_demux->p_module );
+    stream_Delete( p_demux->s );
+    vlc_object_release( p_demux );
+}
+
+static void Seeks( demux_t *p_demux, const char *psz_name )
+{
+    const mtime_t i_start = mdate();
+
+    for( unsigned i = 0; i < SEEKS; i++ )
+    {
+        const uint32_t i_target = rand() % FRAMES;
+        const mtime_t i_time = (mtime_t)i_target * DELTA * 1000;
+
+        assert( Control( p_demux, DEMUX_SET_TIME, i_time, true ) == VLC_SUCCESS );
+        i_received = 0;
+        for( unsigned j = 0; j < 8 && i_received == 0; j++ )
+            assert( p_demux->pf_demux( p_demux ) == 1 );
+
+        /* every frame is a key frame */
+        assert( i_received > 0 );
+        assert( i_first == i_target );
+    }
+
+    printf( "%s: %.1f ms per seek\n", psz_name,
+            (double)(mdate() - i_start) / SEEKS / 1000 );
+}
+
+/* Path of the stored index of a file, as computed by the demuxer */
+static char *IndexPath( const char *psz_path )
+{
+    char *psz_cachedir = config_GetUserDir( VLC_CACHE_DIR );
+    char *psz_index;
+
+    assert( psz_cachedir != NULL );
+
+    struct md5_s md5;
+    InitMD5( &md5 );
+    AddMD5( &md5, psz_path, strlen( psz_path ) );
+    EndMD5( &md5 );
+    char *psz_hash = psz_md5_hash( &md5 );
+    assert( psz_hash != NULL );
+
+    assert( asprintf( &psz_index, "%s/aviindex/%s", psz_cachedir, psz_hash ) != -1 );
+    free( psz_hash );
+    free( psz_cachedir );
+    return psz_index;
+}
+
+int main( void )
+{
+    char psz_cachedir[] = "/tmp/vlc-test-avi-cache-XXXXXX";
+    char psz_path[] = "/tmp/vlc-test-avi-XXXXXX";
+    char *psz_index;
+    libvlc_instance_t *p_vlc;
+    demux_t *p_demux;
+
+    test_init();
+
+    /* keep the index away from the user cache */
+    assert( mkdtemp( psz_cachedir ) != NULL );
+    setenv( "XDG_CACHE_HOME", psz_cachedir, 1 );
+
+    BuildFile();
+    printf( "%u frames, %zu KiB\n", FRAMES, file.i_size / 1024 );
+
+    /* the indexer opens the file again */
+    int fd = mkstemp( psz_path );
+    assert( fd != -1 );
+    assert( write( fd, file.p, file.i_size ) == (ssize_t)file.i_size );
+    close( fd );
+    psz_index = IndexPath( psz_path );
+
+    p_vlc = libvlc_new( test_defaults_nargs, test_defaults_args );
+    assert( p_vlc != NULL );
+
+    int i_ret = 77;
+    p_demux = Open( p_vlc, psz_path );
+    if( p_demux == NULL )
+        goto end;
+
+    srand( 0 );
+    Seeks( p_demux, "while indexing" );
+
+    /* the length is taken from the partial index, the header has none */
+    int64_t i_length;
+    assert( Control( p_demux, DEMUX_GET_LENGTH, &i_length ) == VLC_SUCCESS );
+    assert( i_length > 0 && i_length <= (int64_t)FRAMES * DELTA * 1000 );
+
+    /* wait for the indexer to store the index */
+    mtime_t i_deadline = mdate() + 60 * CLOCK_FREQ;
+    while( access( psz_index, R_OK ) )
+    {
+        assert( mdate() < i_deadline );
+        msleep( 10000 );
+    }
+    Close( p_demux );
+
+    /* the length is only known from the index */
+    p_demux = Open( p_vlc, psz_path );
+    assert( p_demux != NULL );
+
+    assert( Control( p_demux, DEMUX_GET_LENGTH, &i_length ) == VLC_SUCCESS );
+    assert( i_length == (int64_t)FRAMES * DELTA * 1000 );
+
+    Seeks( p_demux, "stored index" );
+    Close( p_demux );
+    i_ret = 0;
+
+end:
+    libvlc_release( p_vlc );
+    free( file.p );
+    unlink( psz_index );
+    /* remove the index directories, empty unless a temporary file is left */
+    *strrchr( psz_index, '/' ) = '\0';
+    assert( rmdir( psz_index ) == 0 || i_ret != 0 );
+    *strrchr( psz_index, '/' ) = '\0';
+    rmdir( psz_index );
+    free( psz_index );
+    rmdir( psz_cachedir );
+    unlink( psz_path );
+    return i_ret;
+}
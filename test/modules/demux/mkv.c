@@ -0,0 +1,346 @@
+/*****************************************************************************
+ * mkv.c: Matroska demuxer background cluster indexing test
+ *****************************************************************************
+ * Copyright (C) 2015 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+/* Opens a synthetic file made of many clusters and without cues, and seeks
+ * around it while the clusters are indexed in the background, then once they
+ * all are. Reports the time and the bytes parsed per seek in both cases, and
+ * checks the seeks land on the key frame starting the right cluster. Then
+ * seeks again with the indexer disabled. */
+
+#include "../../libvlc/test.h"
+#include "../lib/libvlc_internal.h"
+
+#include <vlc_common.h>
+#include <vlc_demux.h>
+#include <vlc_es_out.h>
+#include <vlc_modules.h>
+#include <vlc_stream.h>
+#include <vlc_url.h>
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#define CLUSTERS   20000
+#define CLUSTER    25        /* frames per cluster, the first one is key */
+#define DELTA      40        /* ms, 25 fps */
+#define SEEKS      100
+
+static uint32_t FrameSize( uint32_t i )
+{
+    return 16 + (i * 7) % 48;
+}
+
+/* Growable output buffer */
+static struct
+{
+    uint8_t *p;
+    size_t   i_size;
+    size_t   i_max;
+} file;
+
+static uint8_t *Reserve( size_t i_size )
+{
+    if( file.i_size + i_size > file.i_max )
+    {
+        file.i_max = (file.i_size + i_size) * 2;
+        file.p = realloc( file.p, file.i_max );
+        assert( file.p != NULL );
+    }
+    uint8_t *p = &file.p[file.i_size];
+    memset( p, 0, i_size );
+    file.i_size += i_size;
+    return p;
+}
+
+static void PutID( uint32_t i_id )
+{
+    int i_len = i_id > 0xffffff ? 4 : i_id > 0xffff ? 3 : i_id > 0xff ? 2 : 1;
+    uint8_t *p = Reserve( i_len );
+    while( i_len-- > 0 )
+    {
+        p[i_len] = i_id & 0xff;
+        i_id >>= 8;
+    }
+}
+
+/* Master elements, sized on 8 bytes once complete */
+static size_t ElementStart( uint32_t i_id )
+{
+    PutID( i_id );
+    size_t i_start = file.i_size;
+    Reserve( 8 );
+    return i_start;
+}
+
+static void ElementEnd( size_t i_start )
+{
+    SetQWBE( &file.p[i_start], file.i_size - i_start - 8 );
+    file.p[i_start] = 0x01;
+}
+
+static void PutUInt( uint32_t i_id, uint64_t i_value )
+{
+    PutID( i_id );
+    *Reserve( 1 ) = 0x80 | 8;
+    SetQWBE( Reserve( 8 ), i_value );
+}
+
+static void PutFloat( uint32_t i_id, double f_value )
+{
+    union { double f; uint64_t i; } u = { .f = f_value };
+    PutUInt( i_id, u.i );
+}
+
+static void PutString( uint32_t i_id, const char *psz )
+{
+    PutID( i_id );
+    *Reserve( 1 ) = 0x80 | strlen( psz );
+    memcpy( Reserve( strlen( psz ) ), psz, strlen( psz ) );
+}
+
+static size_t i_segment;
+
+static void BuildHeader( void )
+{
+    size_t ebml = ElementStart( 0x1A45DFA3 );
+    PutUInt( 0x4286, 1 ); /* EBMLVersion */
+    PutUInt( 0x42F7, 1 ); /* EBMLReadVersion */
+    PutUInt( 0x42F2, 4 ); /* EBMLMaxIDLength */
+    PutUInt( 0x42F3, 8 ); /* EBMLMaxSizeLength */
+    PutString( 0x4282, "matroska" ); /* DocType */
+    PutUInt( 0x4287, 2 ); /* DocTypeVersion */
+    PutUInt( 0x4285, 2 ); /* DocTypeReadVersion */
+    ElementEnd( ebml );
+
+    i_segment = ElementStart( 0x18538067 );
+
+    size_t info = ElementStart( 0x1549A966 );
+    PutUInt( 0x2AD7B1, 1000000 ); /* TimecodeScale, 1 ms */
+    PutFloat( 0x4489, (double)CLUSTERS * CLUSTER * DELTA ); /* Duration */
+    PutString( 0x4D80, "test" ); /* MuxingApp */
+    PutString( 0x5741, "test" ); /* WritingApp */
+    ElementEnd( info );
+
+    size_t tracks = ElementStart( 0x1654AE6B );
+    size_t entry = ElementStart( 0xAE );
+    PutUInt( 0xD7, 1 ); /* TrackNumber */
+    PutUInt( 0x73C5, 1 ); /* TrackUID */
+    PutUInt( 0x83, 1 ); /* TrackType, video */
+    PutString( 0x86, "V_MPEG2" ); /* CodecID */
+    PutUInt( 0x23E383, DELTA * 1000000 ); /* DefaultDuration */
+    size_t video = ElementStart( 0xE0 );
+    PutUInt( 0xB0, 16 ); /* PixelWidth */
+    PutUInt( 0xBA, 16 ); /* PixelHeight */
+    ElementEnd( video );
+    ElementEnd( entry );
+    ElementEnd( tracks );
+}
+
+static void BuildCluster( uint32_t i_cluster )
+{
+    size_t cluster = ElementStart( 0x1F43B675 );
+    PutUInt( 0xE7, (uint64_t)i_cluster * CLUSTER * DELTA ); /* Timecode */
+
+    for( uint32_t j = 0; j < CLUSTER; j++ )
+    {
+        const uint32_t i = i_cluster * CLUSTER + j;
+        const uint32_t i_size = FrameSize( i );
+
+        PutID( 0xA3 ); /* SimpleBlock */
+        *Reserve( 1 ) = 0x80 | (4 + i_size);
+        *Reserve( 1 ) = 0x81; /* track 1 */
+        SetWBE( Reserve( 2 ), j * DELTA );
+        *Reserve( 1 ) = j == 0 ? 0x80 : 0x00;
+        SetDWBE( Reserve( i_size ), i );
+    }
+    ElementEnd( cluster );
+}
+
+/* ES output checking the frames */
+static uint32_t i_received;
+static uint32_t i_first; /* first frame received after a seek */
+
+static es_out_id_t *EsOutAdd( es_out_t *out, const es_format_t *fmt )
+{
+    (void) out; (void) fmt;
+    return (es_out_id_t *)(uintptr_t)1;
+}
+
+static int EsOutSend( es_out_t *out, es_out_id_t *id, block_t *block )
+{
+    (void) out; (void) id;
+
+    assert( block->i_buffer >= 4 );
+    const uint32_t i = GetDWBE( block->p_buffer );
+    assert( block->i_buffer == FrameSize( i ) );
+
+    if( i_received++ == 0 )
+        i_first = i;
+    block_ChainRelease( block );
+    return VLC_SUCCESS;
+}
+
+static void EsOutDel( es_out_t *out, es_out_id_t *id )
+{
+    (void) out; (void) id;
+}
+
+static int EsOutControl( es_out_t *out, int i_query, va_list args )
+{
+    (void) out;
+
+    switch( i_query )
+    {
+        case ES_OUT_GET_ES_STATE:
+            (void) va_arg( args, es_out_id_t * );
+            *va_arg( args, bool * ) = true;
+            return VLC_SUCCESS;
+        default:
+            return VLC_EGENERIC;
+    }
+}
+
+static es_out_t es_out =
+{
+    .pf_add = EsOutAdd,
+    .pf_send = EsOutSend,
+    .pf_del = EsOutDel,
+    .pf_control = EsOutControl,
+};
+
+static int Control( demux_t *p_demux, int i_query, ... )
+{
+    va_list args;
+    int i_ret;
+
+    va_start( args, i_query );
+    i_ret = p_demux->pf_control( p_demux, i_query, args );
+    va_end( args );
+    return i_ret;
+}
+
+/* Seeks around, and returns the bytes parsed to seek */
+static int64_t Seeks( demux_t *p_demux, const char *psz_name )
+{
+    const int64_t i_scanned = var_GetInteger( p_demux, "mkv-seek-scan-bytes" );
+    const mtime_t i_start = mdate();
+
+    for( unsigned i = 0; i < SEEKS; i++ )
+    {
+        const uint32_t i_target = rand() % (CLUSTERS * CLUSTER);
+        const mtime_t i_time = (mtime_t)i_target * DELTA * 1000;
+
+        assert( Control( p_demux, DEMUX_SET_TIME, i_time, true ) == VLC_SUCCESS );
+        i_received = 0;
+        for( unsigned j = 0; j < 8 && i_received == 0; j++ )
+            assert( p_demux->pf_demux( p_demux ) == VLC_DEMUXER_SUCCESS );
+
+        /* from the key frame starting the cluster holding the target */
+        assert( i_received > 0 );
+        assert( i_first % CLUSTER == 0 );
+        assert( i_first <= i_target && i_first + CLUSTER > i_target );
+    }
+
+    const int64_t i_bytes = var_GetInteger( p_demux, "mkv-seek-scan-bytes" ) - i_scanned;
+    printf( "%s: %.1f ms and %"PRId64" KiB parsed per seek\n", psz_name,
+            (double)(mdate() - i_start) / SEEKS / 1000, i_bytes / SEEKS / 1024 );
+    return i_bytes;
+}
+
+int main( void )
+{
+    char psz_path[] = "/tmp/vlc-test-mkv-XXXXXX";
+    libvlc_instance_t *p_vlc;
+
+    test_init();
+
+    BuildHeader();
+    for( uint32_t i = 0; i < CLUSTERS; i++ )
+        BuildCluster( i );
+    ElementEnd( i_segment );
+    printf( "%u clusters, %zu KiB\n", CLUSTERS, file.i_size / 1024 );
+
+    /* the indexer opens the file again */
+    int fd = mkstemp( psz_path );
+    assert( fd != -1 );
+    assert( write( fd, file.p, file.i_size ) == (ssize_t)file.i_size );
+    close( fd );
+
+    p_vlc = libvlc_new( test_defaults_nargs, test_defaults_args );
+    assert( p_vlc != NULL );
+
+    demux_t *p_demux = vlc_object_create( p_vlc->p_libvlc_int, sizeof(*p_demux) );
+    assert( p_demux != NULL );
+
+    char *psz_url = vlc_path2uri( psz_path, "file" );
+    assert( psz_url != NULL );
+
+    p_demux->psz_access = (char *)"file";
+    p_demux->psz_demux = (char *)"mkv";
+    p_demux->psz_location = psz_path;
+    p_demux->psz_file = psz_path;
+    p_demux->out = &es_out;
+    p_demux->s = stream_UrlNew( p_vlc->p_libvlc_int, psz_url );
+    assert( p_demux->s != NULL );
+
+    int i_ret = 77;
+    p_demux->p_module = module_need( p_demux, "demux", "mkv", true );
+    if( p_demux->p_module == NULL )
+        goto end;
+
+    srand( 0 );
+    Seeks( p_demux, "while indexing" );
+
+    /* wait for the indexer to reach the end */
+    mtime_t i_deadline = mdate() + 60 * CLOCK_FREQ;
+    while( var_GetFloat( p_demux, "mkv-index-progress" ) < 1.f )
+    {
+        assert( mdate() < i_deadline );
+        msleep( 10000 );
+    }
+
+    /* at most the cluster holding the target, and its key frame again */
+    const int64_t i_bytes = Seeks( p_demux, "indexed" );
+    assert( i_bytes <= SEEKS * 2 * (22 + CLUSTER * (6 + 63)) );
+    module_unneed( p_demux, p_demux->p_module );
+
+    /* the indexer can be disabled */
+    var_Create( p_demux, "mkv-index-clusters", VLC_VAR_BOOL );
+    var_SetBool( p_demux, "mkv-index-clusters", false );
+    var_SetFloat( p_demux, "mkv-index-progress", 0.f );
+    assert( stream_Seek( p_demux->s, 0 ) == VLC_SUCCESS );
+    p_demux->p_module = module_need( p_demux, "demux", "mkv", true );
+    assert( p_demux->p_module != NULL );
+
+    srand( 0 );
+    assert( Seeks( p_demux, "not indexed" ) > i_bytes );
+    assert( var_GetFloat( p_demux, "mkv-index-progress" ) == 0.f );
+    i_ret = 0;
+
+    module_unneed( p_demux, p_demux->p_module );
+end:
+    stream_Delete( p_demux->s );
+    vlc_object_release( p_demux );
+    free( psz_url );
+    libvlc_release( p_vlc );
+    free( file.p );
+    unlink( psz_path );
+    return i_ret;
+}
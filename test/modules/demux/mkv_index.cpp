@@ -0,0 +1,277 @@
+/*****************************************************************************
+ * mkv_index.cpp: Matroska cluster indexer test
+ *****************************************************************************
+ * Copyright (C) 2015 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+/* Indexes a synthetic segment without cues, made of clusters of known and
+ * unknown sizes, and checks the positions and timecodes found, where the
+ * indexing stops, and that it can be aborted. Unlike mkv.c, this does not
+ * need the demuxer, hence libebml. */
+
+#define __STDC_CONSTANT_MACROS
+#define __STDC_FORMAT_MACROS
+#include <vlc_common.h>
+
+#include "../modules/demux/mkv/cluster_indexer.cpp"
+
+/* after the C++ headers, which clash with its log() macro */
+#include "../../libvlc/test.h"
+#include "../lib/libvlc_internal.h"
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#define CLUSTERS   3000
+#define CLUSTER    25        /* frames per cluster */
+#define DELTA      40        /* ms, 25 fps */
+
+/* Growable output buffer */
+static struct
+{
+    uint8_t *p;
+    size_t   i_size;
+    size_t   i_max;
+} file;
+
+static uint8_t *Reserve( size_t i_size )
+{
+    if( file.i_size + i_size > file.i_max )
+    {
+        file.i_max = (file.i_size + i_size) * 2;
+        file.p = (uint8_t *)realloc( file.p, file.i_max );
+        assert( file.p != NULL );
+    }
+    uint8_t *p = &file.p[file.i_size];
+    memset( p, 0, i_size );
+    file.i_size += i_size;
+    return p;
+}
+
+static void PutID( uint32_t i_id )
+{
+    int i_len = i_id > 0xffffff ? 4 : i_id > 0xffff ? 3 : i_id > 0xff ? 2 : 1;
+    uint8_t *p = Reserve( i_len );
+    while( i_len-- > 0 )
+    {
+        p[i_len] = i_id & 0xff;
+        i_id >>= 8;
+    }
+}
+
+/* Master elements, sized on 8 bytes once complete, or of unknown size */
+static size_t ElementStart( uint32_t i_id )
+{
+    PutID( i_id );
+    size_t i_start = file.i_size;
+    memset( Reserve( 8 ), 0xff, 8 );
+    file.p[i_start] = 0x01;
+    return i_start;
+}
+
+static void ElementEnd( size_t i_start )
+{
+    SetQWBE( &file.p[i_start], file.i_size - i_start - 8 );
+    file.p[i_start] = 0x01;
+}
+
+/* Unsigned integers on as few bytes as possible */
+static void PutUInt( uint32_t i_id, uint64_t i_value )
+{
+    int i_len = 1;
+    while( i_len < 8 && ( i_value >> (8 * i_len) ) != 0 )
+        i_len++;
+
+    PutID( i_id );
+    *Reserve( 1 ) = 0x80 | i_len;
+    uint8_t *p = Reserve( i_len );
+    while( i_len-- > 0 )
+    {
+        p[i_len] = i_value & 0xff;
+        i_value >>= 8;
+    }
+}
+
+static void PutString( uint32_t i_id, const char *psz )
+{
+    PutID( i_id );
+    *Reserve( 1 ) = 0x80 | strlen( psz );
+    memcpy( Reserve( strlen( psz ) ), psz, strlen( psz ) );
+}
+
+static void BuildEBML( void )
+{
+    size_t ebml = ElementStart( 0x1A45DFA3 );
+    PutString( 0x4282, "matroska" ); /* DocType */
+    ElementEnd( ebml );
+}
+
+/* Every third cluster is of unknown size, some have a void element
+ * before their timecode */
+static int64_t BuildCluster( uint32_t i_cluster )
+{
+    const int64_t i_position = file.i_size;
+    size_t cluster = ElementStart( 0x1F43B675 );
+    if( i_cluster % 5 == 0 )
+    {
+        PutID( 0xEC ); /* Void */
+        *Reserve( 1 ) = 0x80 | 3;
+        Reserve( 3 );
+    }
+    PutUInt( 0xE7, (uint64_t)i_cluster * CLUSTER * DELTA ); /* Timecode */
+
+    for( uint32_t j = 0; j < CLUSTER; j++ )
+    {
+        PutID( 0xA3 ); /* SimpleBlock */
+        *Reserve( 1 ) = 0x80 | 12;
+        *Reserve( 1 ) = 0x81; /* track 1 */
+        SetWBE( Reserve( 2 ), j * DELTA );
+        *Reserve( 1 ) = j == 0 ? 0x80 : 0x00;
+        SetDWBE( Reserve( 8 ), i_cluster * CLUSTER + j );
+    }
+    if( i_cluster % 3 != 2 )
+        ElementEnd( cluster );
+    return i_position;
+}
+
+static int64_t positions[CLUSTERS];
+static int64_t i_clusters_start;
+static int64_t i_segment_end;
+
+static void BuildFile( void )
+{
+    BuildEBML();
+    size_t segment = ElementStart( 0x18538067 );
+
+    size_t info = ElementStart( 0x1549A966 );
+    PutUInt( 0x2AD7B1, 1000000 ); /* TimecodeScale, 1 ms */
+    ElementEnd( info );
+
+    i_clusters_start = file.i_size;
+    for( uint32_t i = 0; i < CLUSTERS; i++ )
+        positions[i] = BuildCluster( i );
+
+    size_t tags = ElementStart( 0x1254C367 ); /* Tags */
+    ElementEnd( tags );
+    ElementEnd( segment );
+    i_segment_end = file.i_size;
+
+    /* a chained segment, not to be indexed */
+    BuildEBML();
+    segment = ElementStart( 0x18538067 );
+    BuildCluster( 0 );
+    ElementEnd( segment );
+}
+
+/* Posted on each progress of the indexer */
+static vlc_sem_t progress;
+
+static int ProgressCallback( vlc_object_t *obj, const char *var,
+                             vlc_value_t oldval, vlc_value_t newval,
+                             void *data )
+{
+    (void) obj; (void) var; (void) oldval; (void) newval; (void) data;
+    vlc_sem_post( &progress );
+    return VLC_SUCCESS;
+}
+
+/* Indexes until the end and checks every cluster was found */
+static void TestIndex( demux_t *p_demux, int64_t i_end, const char *psz_name )
+{
+    cluster_indexer_c *p_indexer = new cluster_indexer_c( p_demux, 1000000, i_end );
+    std::vector<cluster_point_t> points;
+    const mtime_t i_start = mdate();
+
+    vlc_sem_init( &progress, 0 );
+    assert( p_indexer->Start( i_clusters_start ) );
+    while( !p_indexer->Fetch( -1, points ) )
+    {
+        points.clear();
+        vlc_sem_wait( &progress );
+    }
+
+    printf( "%s: %zu clusters indexed in %.1f ms\n", psz_name, points.size(),
+            (double)(mdate() - i_start) / 1000 );
+    assert( points.size() == CLUSTERS );
+    for( uint32_t i = 0; i < CLUSTERS; i++ )
+    {
+        assert( points[i].i_position == positions[i] );
+        assert( points[i].i_mk_time == (mtime_t)i * CLUSTER * DELTA * 1000 );
+    }
+    assert( var_GetFloat( p_demux, "mkv-index-progress" ) == 1.f );
+
+    /* only the clusters past the given position */
+    points.clear();
+    assert( p_indexer->Fetch( positions[CLUSTERS / 2], points ) );
+    assert( points.size() == CLUSTERS - CLUSTERS / 2 - 1 );
+    assert( points[0].i_position == positions[CLUSTERS / 2 + 1] );
+
+    delete p_indexer;
+    vlc_sem_destroy( &progress );
+}
+
+int main( void )
+{
+    char psz_path[] = "/tmp/vlc-test-mkv-index-XXXXXX";
+
+    test_init();
+
+    BuildFile();
+
+    int fd = mkstemp( psz_path );
+    assert( fd != -1 );
+    assert( write( fd, file.p, file.i_size ) == (ssize_t)file.i_size );
+    close( fd );
+
+    libvlc_instance_t *p_vlc = libvlc_new( test_defaults_nargs,
+                                           test_defaults_args );
+    assert( p_vlc != NULL );
+
+    demux_t *p_demux = (demux_t *)vlc_object_create( p_vlc->p_libvlc_int,
+                                                     sizeof(*p_demux) );
+    assert( p_demux != NULL );
+    p_demux->psz_access = (char *)"file";
+    p_demux->psz_location = psz_path;
+    var_Create( p_demux, "mkv-index-progress", VLC_VAR_FLOAT );
+    var_AddCallback( p_demux, "mkv-index-progress", ProgressCallback, NULL );
+
+    /* stops at the end of the segment, or at the next one */
+    TestIndex( p_demux, i_segment_end, "known segment size" );
+    TestIndex( p_demux, -1, "unknown segment size" );
+
+    /* aborts at various points while indexing */
+    for( unsigned i = 0; i < 100; i += 10 )
+    {
+        cluster_indexer_c *p_indexer =
+            new cluster_indexer_c( p_demux, 1000000, i_segment_end );
+
+        vlc_sem_init( &progress, 0 );
+        assert( p_indexer->Start( i_clusters_start ) );
+        for( unsigned j = 0; j < i; j++ )
+            vlc_sem_wait( &progress );
+        delete p_indexer;
+        vlc_sem_destroy( &progress );
+    }
+
+    var_DelCallback( p_demux, "mkv-index-progress", ProgressCallback, NULL );
+    var_Destroy( p_demux, "mkv-index-progress" );
+    vlc_object_release( p_demux );
+    libvlc_release( p_vlc );
+    free( file.p );
+    unlink( psz_path );
+    return 0;
+}
@@ -0,0 +1,409 @@
+/*****************************************************************************
+ * mp4.c: MP4 demuxer sample tables test
+ *****************************************************************************
+ * Copyright (C) 2015 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+/* Demuxes a synthetic file with a large moov box: a million samples of
+ * varying sizes in large chunks, with one ctts entry per sample. Reports
+ * the time and memory taken to open it, the samples demuxed per second and
+ * the time per seek, and checks the position and timestamps of every
+ * sample. */
+
+#include "../../libvlc/test.h"
+#include "../lib/libvlc_internal.h"
+
+#include <vlc_common.h>
+#include <vlc_demux.h>
+#include <vlc_es_out.h>
+#include <vlc_modules.h>
+#include <vlc_stream.h>
+
+#ifndef _WIN32
+# include <sys/resource.h>
+#endif
+
+#define SAMPLES    (1 << 20)
+#define CHUNK      4096      /* samples per chunk */
+#define SYNC       32        /* samples between sync samples */
+#define TIMESCALE  25000
+#define DELTA      1000      /* 25 fps */
+#define SEEKS      1000
+
+static uint32_t SampleSize( uint32_t i )
+{
+    return 16 + (i * 7) % 48;
+}
+
+static int32_t SampleOffset( uint32_t i )
+{
+    return (i % 3) * DELTA;
+}
+
+/* Peak resident memory in KiB, 0 if unknown */
+static long PeakMemory( void )
+{
+#ifndef _WIN32
+    struct rusage usage;
+
+    if( getrusage( RUSAGE_SELF, &usage ) == 0 )
+        return usage.ru_maxrss;
+#endif
+    return 0;
+}
+
+/* Growable output buffer */
+static struct
+{
+    uint8_t *p;
+    size_t   i_size;
+    size_t   i_max;
+} file;
+
+static uint8_t *Reserve( size_t i_size )
+{
+    if( file.i_size + i_size > file.i_max )
+    {
+        file.i_max = (file.i_size + i_size) * 2;
+        file.p = realloc( file.p, file.i_max );
+        assert( file.p != NULL );
+    }
+    uint8_t *p = &file.p[file.i_size];
+    memset( p, 0, i_size );
+    file.i_size += i_size;
+    return p;
+}
+
+static void Put32( uint32_t i )
+{
+    SetDWBE( Reserve( 4 ), i );
+}
+
+static void PutFourCC( const char *psz )
+{
+    memcpy( Reserve( 4 ), psz, 4 );
+}
+
+static size_t BoxStart( const char *psz_type )
+{
+    size_t i_start = file.i_size;
+    Put32( 0 );
+    PutFourCC( psz_type );
+    return i_start;
+}
+
+static void BoxEnd( size_t i_start )
+{
+    SetDWBE( &file.p[i_start], file.i_size - i_start );
+}
+
+static size_t FullBoxStart( const char *psz_type, uint32_t i_flags )
+{
+    size_t i_start = BoxStart( psz_type );
+    Put32( i_flags ); /* version 0 */
+    return i_start;
+}
+
+static uint8_t *BuildFile( size_t *pi_size )
+{
+    size_t ftyp = BoxStart( "ftyp" );
+    PutFourCC( "isom" );
+    Put32( 0 );
+    PutFourCC( "isom" );
+    BoxEnd( ftyp );
+
+    size_t moov = BoxStart( "moov" );
+
+    size_t mvhd = FullBoxStart( "mvhd", 0 );
+    Reserve( 8 );
+    Put32( TIMESCALE );
+    Put32( SAMPLES * DELTA );
+    Put32( 0x00010000 ); /* rate */
+    SetWBE( Reserve( 2 ), 0x0100 ); /* volume */
+    Reserve( 10 + 36 + 24 );
+    Put32( 2 ); /* next track ID */
+    BoxEnd( mvhd );
+
+    size_t trak = BoxStart( "trak" );
+    size_t tkhd = FullBoxStart( "tkhd", 3 ); /* enabled, in movie */
+    Reserve( 8 );
+    Put32( 1 ); /* track ID */
+    Reserve( 4 );
+    Put32( SAMPLES * DELTA );
+    Reserve( 8 + 8 + 36 );
+    Put32( 640 << 16 );
+    Put32( 360 << 16 );
+    BoxEnd( tkhd );
+
+    size_t mdia = BoxStart( "mdia" );
+    size_t mdhd = FullBoxStart( "mdhd", 0 );
+    Reserve( 8 );
+    Put32( TIMESCALE );
+    Put32( SAMPLES * DELTA );
+    SetWBE( Reserve( 2 ), 0x55c4 ); /* und */
+    Reserve( 2 );
+    BoxEnd( mdhd );
+
+    size_t hdlr = FullBoxStart( "hdlr", 0 );
+    Reserve( 4 );
+    PutFourCC( "vide" );
+    Reserve( 12 + 1 );
+    BoxEnd( hdlr );
+
+    size_t minf = BoxStart( "minf" );
+    size_t vmhd = FullBoxStart( "vmhd", 1 );
+    Reserve( 8 );
+    BoxEnd( vmhd );
+
+    size_t stbl = BoxStart( "stbl" );
+    size_t stsd = FullBoxStart( "stsd", 0 );
+    Put32( 1 );
+    size_t jpeg = BoxStart( "jpeg" );
+    Reserve( 6 );
+    SetWBE( Reserve( 2 ), 1 ); /* data reference index */
+    Reserve( 16 );
+    SetWBE( Reserve( 2 ), 640 );
+    SetWBE( Reserve( 2 ), 360 );
+    Put32( 0x00480000 );
+    Put32( 0x00480000 );
+    Reserve( 4 );
+    SetWBE( Reserve( 2 ), 1 ); /* frame count */
+    Reserve( 32 );
+    SetWBE( Reserve( 2 ), 24 ); /* depth */
+    SetWBE( Reserve( 2 ), 0xffff );
+    BoxEnd( jpeg );
+    BoxEnd( stsd );
+
+    size_t stts = FullBoxStart( "stts", 0 );
+    Put32( 1 );
+    Put32( SAMPLES );
+    Put32( DELTA );
+    BoxEnd( stts );
+
+    size_t ctts = FullBoxStart( "ctts", 0 );
+    Put32( SAMPLES );
+    for( uint32_t i = 0; i < SAMPLES; i++ )
+    {
+        Put32( 1 );
+        Put32( SampleOffset( i ) );
+    }
+    BoxEnd( ctts );
+
+    size_t stss = FullBoxStart( "stss", 0 );
+    Put32( SAMPLES / SYNC );
+    for( uint32_t i = 0; i < SAMPLES; i += SYNC )
+        Put32( i + 1 );
+    BoxEnd( stss );
+
+    size_t stsc = FullBoxStart( "stsc", 0 );
+    Put32( 1 );
+    Put32( 1 );
+    Put32( CHUNK );
+    Put32( 1 );
+    BoxEnd( stsc );
+
+    size_t stsz = FullBoxStart( "stsz", 0 );
+    Put32( 0 );
+    Put32( SAMPLES );
+    for( uint32_t i = 0; i < SAMPLES; i++ )
+        Put32( SampleSize( i ) );
+    BoxEnd( stsz );
+
+    size_t stco = FullBoxStart( "stco", 0 );
+    Put32( SAMPLES / CHUNK );
+    size_t i_offsets = file.i_size;
+    Reserve( 4 * SAMPLES / CHUNK );
+    BoxEnd( stco );
+
+    BoxEnd( stbl );
+    BoxEnd( minf );
+    BoxEnd( mdia );
+    BoxEnd( trak );
+    BoxEnd( moov );
+
+    printf( "moov box of %zu KiB\n", (file.i_size - moov) / 1024 );
+
+    /* Samples start with their number */
+    size_t mdat = BoxStart( "mdat" );
+    for( uint32_t i = 0; i < SAMPLES; i++ )
+    {
+        if( i % CHUNK == 0 )
+            SetDWBE( &file.p[i_offsets + 4 * (i / CHUNK)], file.i_size );
+
+        uint8_t *p = Reserve( SampleSize( i ) );
+        memset( p, i & 0xff, SampleSize( i ) );
+        SetDWBE( p, i );
+    }
+    BoxEnd( mdat );
+
+    *pi_size = file.i_size;
+    return file.p;
+}
+
+/* ES output checking every sample */
+static uint32_t i_received;
+static uint32_t i_next; /* next sample expected, UINT32_MAX after a seek */
+static uint32_t i_first; /* first sample received after a seek */
+
+static es_out_id_t *EsOutAdd( es_out_t *out, const es_format_t *fmt )
+{
+    (void) out; (void) fmt;
+    return (es_out_id_t *)(uintptr_t)1;
+}
+
+static int EsOutSend( es_out_t *out, es_out_id_t *id, block_t *block )
+{
+    (void) out; (void) id;
+
+    assert( block->i_buffer >= 4 );
+    const uint32_t i = GetDWBE( block->p_buffer );
+    assert( i < SAMPLES );
+    assert( i_next == UINT32_MAX || i == i_next );
+    if( i_next == UINT32_MAX )
+        i_first = i;
+    assert( block->i_buffer == SampleSize( i ) );
+    assert( block->i_dts == VLC_TS_0 + (mtime_t)i * DELTA * CLOCK_FREQ / TIMESCALE );
+    assert( block->i_pts == block->i_dts + SampleOffset( i ) * CLOCK_FREQ / TIMESCALE );
+
+    i_next = i + 1;
+    i_received++;
+    block_ChainRelease( block );
+    return VLC_SUCCESS;
+}
+
+static void EsOutDel( es_out_t *out, es_out_id_t *id )
+{
+    (void) out; (void) id;
+}
+
+static int EsOutControl( es_out_t *out, int i_query, va_list args )
+{
+    (void) out;
+
+    switch( i_query )
+    {
+        case ES_OUT_GET_ES_STATE:
+            (void) va_arg( args, es_out_id_t * );
+            *va_arg( args, bool * ) = true;
+            return VLC_SUCCESS;
+        default:
+            return VLC_EGENERIC;
+    }
+}
+
+static es_out_t es_out =
+{
+    .pf_add = EsOutAdd,
+    .pf_send = EsOutSend,
+    .pf_del = EsOutDel,
+    .pf_control = EsOutControl,
+};
+
+static int Control( demux_t *p_demux, int i_query, ... )
+{
+    va_list args;
+    int i_ret;
+
+    va_start( args, i_query );
+    i_ret = p_demux->pf_control( p_demux, i_query, args );
+    va_end( args );
+    return i_ret;
+}
+
+int main( void )
+{
+    libvlc_instance_t *p_vlc;
+    uint8_t *p_buf;
+    size_t i_size;
+
+    test_init();
+
+    p_vlc = libvlc_new( test_defaults_nargs, test_defaults_args );
+    assert( p_vlc != NULL );
+
+    p_buf = BuildFile( &i_size );
+
+    demux_t *p_demux = vlc_object_create( p_vlc->p_libvlc_int, sizeof(*p_demux) );
+    assert( p_demux != NULL );
+
+    p_demux->psz_access = (char *)"file";
+    p_demux->psz_demux = (char *)"mp4";
+    p_demux->psz_location = (char *)"";
+    p_demux->psz_file = (char *)"";
+    p_demux->out = &es_out;
+    p_demux->s = stream_MemoryNew( p_vlc->p_libvlc_int, p_buf, i_size, true );
+    assert( p_demux->s != NULL );
+
+    long i_memory = PeakMemory();
+    mtime_t i_start = mdate();
+    p_demux->p_module = module_need( p_demux, "demux", "mp4", true );
+    if( p_demux->p_module == NULL )
+    {
+        stream_Delete( p_demux->s );
+        vlc_object_release( p_demux );
+        free( p_buf );
+        libvlc_release( p_vlc );
+        return 77;
+    }
+    /* The file is resident already, so the growth is the demuxer's */
+    i_memory = PeakMemory() - i_memory;
+    printf( "opened in %"PRId64" ms, %ld KiB of memory (%.1f bytes per sample)\n",
+            (mdate() - i_start) / 1000, i_memory, i_memory * 1024. / SAMPLES );
+
+    /* Read everything, in order */
+    i_next = 0;
+    i_start = mdate();
+    while( i_received < SAMPLES &&
+           p_demux->pf_demux( p_demux ) == VLC_DEMUXER_SUCCESS );
+    mtime_t i_duration = mdate() - i_start;
+    printf( "%u samples demuxed, %.0f samples/s\n", i_received,
+            (double)i_received * CLOCK_FREQ / (i_duration + 1) );
+    assert( i_received == SAMPLES );
+
+    /* Seek around, and read a few samples after each seek */
+    srand( 0 );
+    i_start = mdate();
+    for( unsigned i = 0; i < SEEKS; i++ )
+    {
+        const uint32_t i_target = rand() % (SAMPLES - 2 * SYNC);
+        const mtime_t i_time = (mtime_t)i_target * DELTA * CLOCK_FREQ / TIMESCALE;
+
+        assert( Control( p_demux, DEMUX_SET_TIME, i_time, true ) == VLC_SUCCESS );
+        i_next = UINT32_MAX;
+        i_received = 0;
+        for( unsigned j = 0; j < 4; j++ )
+            assert( p_demux->pf_demux( p_demux ) == VLC_DEMUXER_SUCCESS );
+
+        /* from the sync sample before the target */
+        assert( i_received > 0 );
+        assert( i_first % SYNC == 0 );
+        assert( i_first <= i_target && i_first + SYNC > i_target );
+    }
+    i_duration = mdate() - i_start;
+    printf( "%u seeks, %.1f us per seek\n", SEEKS, (double)i_duration / SEEKS );
+
+    module_unneed( p_demux, p_demux->p_module );
+    printf( "%"PRId64" reads and %"PRId64" seeks issued\n",
+            var_GetInteger( p_demux, "mp4-reads" ),
+            var_GetInteger( p_demux, "mp4-seeks" ) );
+    assert( var_GetInteger( p_demux, "mp4-reads" ) > 0 );
+    stream_Delete( p_demux->s );
+    vlc_object_release( p_demux );
+    free( p_buf );
+    libvlc_release( p_vlc );
+    return 0;
+}
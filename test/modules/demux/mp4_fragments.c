@@ -0,0 +1,446 @@
+/*****************************************************************************
+ * mp4_fragments.c: MP4 demuxer fragments index cache test
+ *****************************************************************************
+ * Copyright (C) 2015 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+/* Opens and seeks a synthetic fragmented file made of many small moof/mdat
+ * pairs, without the fragments index cache, then with it (creating it, then
+ * reusing it), and finally after fragments were appended to the file.
+ * Reports the time to open and seek in each case, and checks the seeks land
+ * at the start of the right fragment. */
+
+#include "../../libvlc/test.h"
+#include "../lib/libvlc_internal.h"
+
+#include <vlc_common.h>
+#include <vlc_demux.h>
+#include <vlc_es_out.h>
+#include <vlc_modules.h>
+#include <vlc_stream.h>
+
+#include <vlc_fs.h>
+
+#include <dirent.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define FRAGMENTS  20000
+#define FRAGMENT   25        /* samples per fragment */
+#define TIMESCALE  25000
+#define DELTA      1000      /* 25 fps */
+#define SEEKS      100
+
+static uint32_t SampleSize( uint32_t i )
+{
+    return 16 + (i * 7) % 48;
+}
+
+/* Growable output buffer */
+static struct
+{
+    uint8_t *p;
+    size_t   i_size;
+    size_t   i_max;
+} file;
+
+static uint8_t *Reserve( size_t i_size )
+{
+    if( file.i_size + i_size > file.i_max )
+    {
+        file.i_max = (file.i_size + i_size) * 2;
+        file.p = realloc( file.p, file.i_max );
+        assert( file.p != NULL );
+    }
+    uint8_t *p = &file.p[file.i_size];
+    memset( p, 0, i_size );
+    file.i_size += i_size;
+    return p;
+}
+
+static void Put32( uint32_t i )
+{
+    SetDWBE( Reserve( 4 ), i );
+}
+
+static void PutFourCC( const char *psz )
+{
+    memcpy( Reserve( 4 ), psz, 4 );
+}
+
+static size_t BoxStart( const char *psz_type )
+{
+    size_t i_start = file.i_size;
+    Put32( 0 );
+    PutFourCC( psz_type );
+    return i_start;
+}
+
+static void BoxEnd( size_t i_start )
+{
+    SetDWBE( &file.p[i_start], file.i_size - i_start );
+}
+
+static size_t FullBoxStart( const char *psz_type, uint32_t i_flags )
+{
+    size_t i_start = BoxStart( psz_type );
+    Put32( i_flags ); /* version 0 */
+    return i_start;
+}
+
+static void EmptyTable( const char *psz_type )
+{
+    size_t box = FullBoxStart( psz_type, 0 );
+    Put32( 0 );
+    BoxEnd( box );
+}
+
+static void BuildHeader( void )
+{
+    size_t ftyp = BoxStart( "ftyp" );
+    PutFourCC( "iso6" );
+    Put32( 0 );
+    PutFourCC( "isom" );
+    PutFourCC( "iso6" );
+    BoxEnd( ftyp );
+
+    size_t moov = BoxStart( "moov" );
+
+    size_t mvhd = FullBoxStart( "mvhd", 0 );
+    Reserve( 8 );
+    Put32( TIMESCALE );
+    Put32( 0 );
+    Put32( 0x00010000 ); /* rate */
+    SetWBE( Reserve( 2 ), 0x0100 ); /* volume */
+    Reserve( 10 + 36 + 24 );
+    Put32( 2 ); /* next track ID */
+    BoxEnd( mvhd );
+
+    size_t trak = BoxStart( "trak" );
+    size_t tkhd = FullBoxStart( "tkhd", 3 ); /* enabled, in movie */
+    Reserve( 8 );
+    Put32( 1 ); /* track ID */
+    Reserve( 4 + 4 + 8 + 8 + 36 );
+    Put32( 640 << 16 );
+    Put32( 360 << 16 );
+    BoxEnd( tkhd );
+
+    size_t mdia = BoxStart( "mdia" );
+    size_t mdhd = FullBoxStart( "mdhd", 0 );
+    Reserve( 8 );
+    Put32( TIMESCALE );
+    Put32( 0 );
+    SetWBE( Reserve( 2 ), 0x55c4 ); /* und */
+    Reserve( 2 );
+    BoxEnd( mdhd );
+
+    size_t hdlr = FullBoxStart( "hdlr", 0 );
+    Reserve( 4 );
+    PutFourCC( "vide" );
+    Reserve( 12 + 1 );
+    BoxEnd( hdlr );
+
+    size_t minf = BoxStart( "minf" );
+    size_t vmhd = FullBoxStart( "vmhd", 1 );
+    Reserve( 8 );
+    BoxEnd( vmhd );
+
+    size_t stbl = BoxStart( "stbl" );
+    size_t stsd = FullBoxStart( "stsd", 0 );
+    Put32( 1 );
+    size_t jpeg = BoxStart( "jpeg" );
+    Reserve( 6 );
+    SetWBE( Reserve( 2 ), 1 ); /* data reference index */
+    Reserve( 16 );
+    SetWBE( Reserve( 2 ), 640 );
+    SetWBE( Reserve( 2 ), 360 );
+    Put32( 0x00480000 );
+    Put32( 0x00480000 );
+    Reserve( 4 );
+    SetWBE( Reserve( 2 ), 1 ); /* frame count */
+    Reserve( 32 );
+    SetWBE( Reserve( 2 ), 24 ); /* depth */
+    SetWBE( Reserve( 2 ), 0xffff );
+    BoxEnd( jpeg );
+    BoxEnd( stsd );
+
+    /* samples are all in fragments */
+    EmptyTable( "stts" );
+    EmptyTable( "stsc" );
+    size_t stsz = FullBoxStart( "stsz", 0 );
+    Put32( 0 );
+    Put32( 0 );
+    BoxEnd( stsz );
+    EmptyTable( "stco" );
+
+    BoxEnd( stbl );
+    BoxEnd( minf );
+    BoxEnd( mdia );
+    BoxEnd( trak );
+
+    /* duration of the initial fragments only: like a recorder, this one
+     * does not update it when appending fragments */
+    size_t mvex = BoxStart( "mvex" );
+    size_t mehd = FullBoxStart( "mehd", 0 );
+    Put32( FRAGMENTS * FRAGMENT * DELTA );
+    BoxEnd( mehd );
+    size_t trex = FullBoxStart( "trex", 0 );
+    Put32( 1 ); /* track ID */
+    Put32( 1 ); /* sample description index */
+    Put32( DELTA );
+    Put32( 0 );
+    Put32( 0 );
+    BoxEnd( trex );
+    BoxEnd( mvex );
+
+    BoxEnd( moov );
+}
+
+/* Samples start with their number */
+static void BuildFragment( uint32_t i_fragment )
+{
+    const uint32_t i_start = i_fragment * FRAGMENT;
+
+    size_t moof = BoxStart( "moof" );
+    size_t mfhd = FullBoxStart( "mfhd", 0 );
+    Put32( i_fragment + 1 );
+    BoxEnd( mfhd );
+
+    size_t traf = BoxStart( "traf" );
+    size_t tfhd = FullBoxStart( "tfhd", 0x020008 ); /* base is moof, duration */
+    Put32( 1 );
+    Put32( DELTA );
+    BoxEnd( tfhd );
+
+    size_t tfdt = FullBoxStart( "tfdt", 0x01000000 ); /* version 1 */
+    Put32( 0 );
+    Put32( i_start * DELTA );
+    BoxEnd( tfdt );
+
+    size_t trun = FullBoxStart( "trun", 0x000201 ); /* data offset, sizes */
+    Put32( FRAGMENT );
+    size_t i_data_offset = file.i_size;
+    Put32( 0 );
+    for( uint32_t i = i_start; i < i_start + FRAGMENT; i++ )
+        Put32( SampleSize( i ) );
+    BoxEnd( trun );
+    BoxEnd( traf );
+    BoxEnd( moof );
+
+    SetDWBE( &file.p[i_data_offset], file.i_size - moof + 8 );
+
+    size_t mdat = BoxStart( "mdat" );
+    for( uint32_t i = i_start; i < i_start + FRAGMENT; i++ )
+    {
+        uint8_t *p = Reserve( SampleSize( i ) );
+        memset( p, i & 0xff, SampleSize( i ) );
+        SetDWBE( p, i );
+    }
+    BoxEnd( mdat );
+}
+
+/* ES output checking the samples */
+static uint32_t i_received;
+static uint32_t i_first; /* first sample received after a seek */
+
+static es_out_id_t *EsOutAdd( es_out_t *out, const es_format_t *fmt )
+{
+    (void) out; (void) fmt;
+    return (es_out_id_t *)(uintptr_t)1;
+}
+
+static int EsOutSend( es_out_t *out, es_out_id_t *id, block_t *block )
+{
+    (void) out; (void) id;
+
+    assert( block->i_buffer >= 4 );
+    const uint32_t i = GetDWBE( block->p_buffer );
+    assert( block->i_buffer == SampleSize( i ) );
+    assert( block->i_dts == VLC_TS_0 + (mtime_t)i * DELTA * CLOCK_FREQ / TIMESCALE );
+
+    if( i_received++ == 0 )
+        i_first = i;
+    block_ChainRelease( block );
+    return VLC_SUCCESS;
+}
+
+static void EsOutDel( es_out_t *out, es_out_id_t *id )
+{
+    (void) out; (void) id;
+}
+
+static int EsOutControl( es_out_t *out, int i_query, va_list args )
+{
+    (void) out;
+
+    switch( i_query )
+    {
+        case ES_OUT_GET_ES_STATE:
+            (void) va_arg( args, es_out_id_t * );
+            *va_arg( args, bool * ) = true;
+            return VLC_SUCCESS;
+        default:
+            return VLC_EGENERIC;
+    }
+}
+
+static es_out_t es_out =
+{
+    .pf_add = EsOutAdd,
+    .pf_send = EsOutSend,
+    .pf_del = EsOutDel,
+    .pf_control = EsOutControl,
+};
+
+static int Control( demux_t *p_demux, int i_query, ... )
+{
+    va_list args;
+    int i_ret;
+
+    va_start( args, i_query );
+    i_ret = p_demux->pf_control( p_demux, i_query, args );
+    va_end( args );
+    return i_ret;
+}
+
+/* Opens the file, and seeks around its i_fragments fragments.
+ * Returns false if the mp4 module is not available. */
+static bool Run( libvlc_instance_t *p_vlc, const char *psz_name,
+                 bool b_cache, uint32_t i_fragments )
+{
+    demux_t *p_demux = vlc_object_create( p_vlc->p_libvlc_int, sizeof(*p_demux) );
+    assert( p_demux != NULL );
+
+    var_Create( p_demux, "mp4-fragment-index-cache", VLC_VAR_BOOL );
+    var_SetBool( p_demux, "mp4-fragment-index-cache", b_cache );
+
+    p_demux->psz_access = (char *)"file";
+    p_demux->psz_demux = (char *)"mp4";
+    p_demux->psz_location = (char *)"/test/mp4_fragments.mp4";
+    p_demux->psz_file = (char *)"";
+    p_demux->out = &es_out;
+    p_demux->s = stream_MemoryNew( p_vlc->p_libvlc_int, file.p, file.i_size, true );
+    assert( p_demux->s != NULL );
+
+    mtime_t i_start = mdate();
+    p_demux->p_module = module_need( p_demux, "demux", "mp4", true );
+    if( p_demux->p_module == NULL )
+    {
+        stream_Delete( p_demux->s );
+        vlc_object_release( p_demux );
+        return false;
+    }
+    const mtime_t i_open = mdate() - i_start;
+
+    int64_t i_length;
+    assert( Control( p_demux, DEMUX_GET_LENGTH, &i_length ) == VLC_SUCCESS );
+    assert( i_length == (mtime_t)FRAGMENTS * FRAGMENT * DELTA * CLOCK_FREQ / TIMESCALE );
+
+    /* Seek around, and read until samples come out */
+    srand( 0 );
+    i_start = mdate();
+    for( unsigned i = 0; i < SEEKS; i++ )
+    {
+        const uint32_t i_target = rand() % (i_fragments * FRAGMENT);
+        const mtime_t i_time = (mtime_t)i_target * DELTA * CLOCK_FREQ / TIMESCALE;
+
+        assert( Control( p_demux, DEMUX_SET_TIME, i_time, true ) == VLC_SUCCESS );
+        i_received = 0;
+        for( unsigned j = 0; j < 8 && i_received == 0; j++ )
+            assert( p_demux->pf_demux( p_demux ) == VLC_DEMUXER_SUCCESS );
+
+        /* from the start of the fragment holding the target */
+        assert( i_received > 0 );
+        assert( i_first % FRAGMENT == 0 );
+        assert( i_first <= i_target && i_first + FRAGMENT > i_target );
+    }
+    const mtime_t i_seeks = mdate() - i_start;
+
+    printf( "%s: opened in %"PRId64" ms, %.1f ms per seek, first seek included\n",
+            psz_name, i_open / 1000, (double)i_seeks / SEEKS / 1000 );
+
+    module_unneed( p_demux, p_demux->p_module );
+    stream_Delete( p_demux->s );
+    vlc_object_release( p_demux );
+    return true;
+}
+
+int main( void )
+{
+    char psz_cachedir[] = "/tmp/vlc-test-mp4-XXXXXX";
+    libvlc_instance_t *p_vlc;
+
+    test_init();
+
+    /* keep the index away from the user cache */
+    assert( mkdtemp( psz_cachedir ) != NULL );
+    setenv( "XDG_CACHE_HOME", psz_cachedir, 1 );
+
+    p_vlc = libvlc_new( test_defaults_nargs, test_defaults_args );
+    assert( p_vlc != NULL );
+
+    BuildHeader();
+    for( uint32_t i = 0; i < FRAGMENTS; i++ )
+        BuildFragment( i );
+    printf( "%u fragments, %zu KiB\n", FRAGMENTS, file.i_size / 1024 );
+
+    int i_ret = 77;
+    if( !Run( p_vlc, "without index", false, FRAGMENTS ) )
+        goto end;
+    Run( p_vlc, "creating index", true, FRAGMENTS );
+    Run( p_vlc, "with index", true, FRAGMENTS );
+
+    /* as a recording going on */
+    for( uint32_t i = FRAGMENTS; i < 2 * FRAGMENTS; i++ )
+        BuildFragment( i );
+    Run( p_vlc, "completing index", true, 2 * FRAGMENTS );
+    Run( p_vlc, "with completed index", true, 2 * FRAGMENTS );
+    i_ret = 0;
+
+end:
+    libvlc_release( p_vlc );
+    free( file.p );
+
+    /* remove the index */
+    char *psz_dir;
+    if( asprintf( &psz_dir, "%s/vlc/mp4index", psz_cachedir ) != -1 )
+    {
+        DIR *p_dir = vlc_opendir( psz_dir );
+        const char *psz_entry;
+        unsigned i_files = 0;
+        while( p_dir && (psz_entry = vlc_readdir( p_dir )) != NULL )
+        {
+            char *psz_path;
+            if( asprintf( &psz_path, "%s/%s", psz_dir, psz_entry ) != -1 )
+            {
+                if( unlink( psz_path ) == 0 ) /* fails on . and .. */
+                    i_files++;
+                free( psz_path );
+            }
+        }
+        /* no temporary file left behind */
+        assert( i_ret != 0 || i_files == 1 );
+        if( p_dir )
+            closedir( p_dir );
+        rmdir( psz_dir );
+        *strrchr( psz_dir, '/' ) = '\0';
+        rmdir( psz_dir );
+        free( psz_dir );
+    }
+    rmdir( psz_cachedir );
+    return i_ret;
+}
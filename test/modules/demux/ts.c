@@ -0,0 +1,307 @@
+/*****************************************************************************
+ * ts.c: MPEG-TS demuxer throughput test
+ *****************************************************************************
+ * Copyright (C) 2015 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+/* Demuxes a synthetic multiplex with many programs and PIDs, as found on
+ * DVB-T2 or cable, and reports the number of TS packets demuxed per second,
+ * first with all programs selected, then with a single one. */
+
+#include "../../libvlc/test.h"
+#include "../lib/libvlc_internal.h"
+
+#include <vlc_common.h>
+#include <vlc_demux.h>
+#include <vlc_es_out.h>
+#include <vlc_modules.h>
+#include <vlc_stream.h>
+
+#define PROGRAMS       32
+#define ES_PER_PROGRAM 4
+#define PACKETS        100000
+#define PES_PACKETS    4 /* TS packets per PES packet */
+#define PSI_INTERVAL   2000
+
+#define PMT_PID(p)   (0x20 + (p))
+#define ES_PID(p, e) (0x100 + (p) * ES_PER_PROGRAM + (e))
+
+static uint32_t crc32_mpeg( const uint8_t *p, size_t i_len )
+{
+    uint32_t i_crc = 0xffffffff;
+
+    while( i_len-- > 0 )
+    {
+        i_crc ^= (uint32_t)*(p++) << 24;
+        for( int i = 0; i < 8; i++ )
+            i_crc = (i_crc << 1) ^ ((i_crc & 0x80000000) ? 0x04c11db7 : 0);
+    }
+    return i_crc;
+}
+
+static uint8_t cc[8192];
+
+static uint8_t *WriteHeader( uint8_t *p, uint16_t i_pid, bool b_start )
+{
+    p[0] = 0x47;
+    p[1] = (b_start ? 0x40 : 0x00) | (i_pid >> 8);
+    p[2] = i_pid & 0xff;
+    p[3] = 0x10 | (cc[i_pid]++ & 0x0f);
+    return p + 4;
+}
+
+/* Writes a single packet PSI section, table header and CRC included */
+static void WriteSection( uint8_t *p, uint16_t i_pid, uint8_t i_table,
+                          uint16_t i_ext, const uint8_t *p_data, size_t i_data )
+{
+    uint8_t *p_section = WriteHeader( p, i_pid, true ) + 1;
+    size_t i_length = 5 + i_data + 4;
+
+    memset( p + 4, 0xff, 184 );
+    p[4] = 0; /* pointer field */
+    p_section[0] = i_table;
+    p_section[1] = 0xb0 | (i_length >> 8);
+    p_section[2] = i_length & 0xff;
+    p_section[3] = i_ext >> 8;
+    p_section[4] = i_ext & 0xff;
+    p_section[5] = 0xc1; /* version 0, current */
+    p_section[6] = 0;
+    p_section[7] = 0;
+    memcpy( p_section + 8, p_data, i_data );
+    SetDWBE( p_section + 8 + i_data, crc32_mpeg( p_section, 8 + i_data ) );
+}
+
+static void WritePAT( uint8_t *p )
+{
+    uint8_t data[4 * PROGRAMS];
+
+    for( unsigned i = 0; i < PROGRAMS; i++ )
+    {
+        SetWBE( &data[4 * i], i + 1 );
+        SetWBE( &data[4 * i + 2], 0xe000 | PMT_PID(i) );
+    }
+    WriteSection( p, 0, 0x00, 1, data, sizeof(data) );
+}
+
+static void WritePMT( uint8_t *p, unsigned i_program )
+{
+    uint8_t data[4 + 5 * ES_PER_PROGRAM];
+
+    SetWBE( &data[0], 0xe000 | ES_PID(i_program, 0) ); /* PCR PID */
+    SetWBE( &data[2], 0xf000 );
+    for( unsigned i = 0; i < ES_PER_PROGRAM; i++ )
+    {
+        data[4 + 5 * i] = 0x03; /* MPEG audio */
+        SetWBE( &data[4 + 5 * i + 1], 0xe000 | ES_PID(i_program, i) );
+        SetWBE( &data[4 + 5 * i + 3], 0xf000 );
+    }
+    WriteSection( p, PMT_PID(i_program), 0x02, i_program + 1,
+                  data, sizeof(data) );
+}
+
+static void WritePES( uint8_t *p, uint16_t i_pid, unsigned i_count,
+                      bool b_pcr )
+{
+    const bool b_start = (i_count % PES_PACKETS) == 0;
+    const uint64_t i_ts = 90000 + i_count * 90; /* 1ms per PES packet */
+    uint8_t *p_payload = WriteHeader( p, i_pid, b_start );
+
+    if( b_start && b_pcr )
+    {
+        const uint64_t i_pcr = i_ts - 9000;
+
+        p[3] |= 0x20; /* adaptation field */
+        p_payload[0] = 7;
+        p_payload[1] = 0x10; /* PCR flag */
+        p_payload[2] = i_pcr >> 25;
+        p_payload[3] = i_pcr >> 17;
+        p_payload[4] = i_pcr >> 9;
+        p_payload[5] = i_pcr >> 1;
+        p_payload[6] = (i_pcr << 7) | 0x7e;
+        p_payload[7] = 0;
+        p_payload += 8;
+    }
+
+    memset( p_payload, i_count & 0xff, p + 188 - p_payload );
+    if( b_start )
+    {
+        p_payload[0] = 0x00;
+        p_payload[1] = 0x00;
+        p_payload[2] = 0x01;
+        p_payload[3] = 0xc0;
+        SetWBE( &p_payload[4], 0 ); /* unbounded */
+        p_payload[6] = 0x80;
+        p_payload[7] = 0x80; /* PTS only */
+        p_payload[8] = 5;
+        p_payload[9] = 0x21 | ((i_ts >> 29) & 0x0e);
+        SetWBE( &p_payload[10], ((i_ts >> 14) & 0xfffe) | 1 );
+        SetWBE( &p_payload[12], ((i_ts << 1) & 0xfffe) | 1 );
+    }
+}
+
+static uint8_t *BuildStream( size_t *pi_size )
+{
+    uint8_t *p_buf = malloc( PACKETS * 188 );
+    unsigned i_es = 0;
+
+    assert( p_buf != NULL );
+    for( unsigned i = 0; i < PACKETS; )
+    {
+        if( i % PSI_INTERVAL == 0 )
+        {
+            WritePAT( p_buf + 188 * i++ );
+            for( unsigned j = 0; j < PROGRAMS && i < PACKETS; j++ )
+                WritePMT( p_buf + 188 * i++, j );
+            continue;
+        }
+
+        /* Interleave all the elementary streams */
+        const unsigned i_program = i_es % PROGRAMS;
+        const unsigned i_stream = (i_es / PROGRAMS) % ES_PER_PROGRAM;
+
+        WritePES( p_buf + 188 * i++, ES_PID(i_program, i_stream),
+                  i_es / (PROGRAMS * ES_PER_PROGRAM), i_stream == 0 );
+        i_es++;
+    }
+    *pi_size = PACKETS * 188;
+    return p_buf;
+}
+
+/* ES output discarding everything */
+static unsigned i_es_count;
+static uint64_t i_sent;
+
+static es_out_id_t *EsOutAdd( es_out_t *out, const es_format_t *fmt )
+{
+    (void) out; (void) fmt;
+    return (es_out_id_t *)(uintptr_t)++i_es_count;
+}
+
+static int EsOutSend( es_out_t *out, es_out_id_t *id, block_t *block )
+{
+    (void) out; (void) id;
+    i_sent += block->i_buffer;
+    block_ChainRelease( block );
+    return VLC_SUCCESS;
+}
+
+static void EsOutDel( es_out_t *out, es_out_id_t *id )
+{
+    (void) out; (void) id;
+}
+
+static int EsOutControl( es_out_t *out, int i_query, va_list args )
+{
+    (void) out;
+
+    switch( i_query )
+    {
+        case ES_OUT_GET_ES_STATE:
+            (void) va_arg( args, es_out_id_t * );
+            *va_arg( args, bool * ) = true;
+            return VLC_SUCCESS;
+        default:
+            return VLC_EGENERIC;
+    }
+}
+
+static es_out_t es_out =
+{
+    .pf_add = EsOutAdd,
+    .pf_send = EsOutSend,
+    .pf_del = EsOutDel,
+    .pf_control = EsOutControl,
+};
+
+static int Control( demux_t *p_demux, int i_query, ... )
+{
+    va_list args;
+    int i_ret;
+
+    va_start( args, i_query );
+    i_ret = p_demux->pf_control( p_demux, i_query, args );
+    va_end( args );
+    return i_ret;
+}
+
+static int Run( libvlc_int_t *p_libvlc, uint8_t *p_buf, size_t i_size,
+                int i_program )
+{
+    demux_t *p_demux = vlc_object_create( p_libvlc, sizeof(*p_demux) );
+    assert( p_demux != NULL );
+
+    p_demux->psz_access = (char *)"file";
+    p_demux->psz_demux = (char *)"ts";
+    p_demux->psz_location = (char *)"";
+    p_demux->psz_file = (char *)"";
+    p_demux->out = &es_out;
+    p_demux->s = stream_MemoryNew( p_libvlc, p_buf, i_size, true );
+    assert( p_demux->s != NULL );
+
+    p_demux->p_module = module_need( p_demux, "demux", "ts", true );
+    if( p_demux->p_module == NULL )
+    {
+        stream_Delete( p_demux->s );
+        vlc_object_release( p_demux );
+        return 77;
+    }
+
+    if( i_program > 0 )
+    {
+        int i_ret = Control( p_demux, DEMUX_SET_GROUP, i_program, NULL );
+        assert( i_ret == VLC_SUCCESS );
+    }
+
+    i_sent = 0;
+    mtime_t i_start = mdate();
+    while( p_demux->pf_demux( p_demux ) == VLC_DEMUXER_SUCCESS );
+    mtime_t i_duration = mdate() - i_start;
+
+    printf( "%s: %u ES, %"PRIu64" bytes out, %.0f packets/s\n",
+            i_program > 0 ? "one program" : "all programs", i_es_count,
+            i_sent, (double)PACKETS * CLOCK_FREQ / (i_duration + 1) );
+    assert( i_sent > 0 );
+
+    module_unneed( p_demux, p_demux->p_module );
+    stream_Delete( p_demux->s );
+    vlc_object_release( p_demux );
+    i_es_count = 0;
+    return 0;
+}
+
+int main( void )
+{
+    libvlc_instance_t *p_vlc;
+    uint8_t *p_buf;
+    size_t i_size;
+    int i_ret;
+
+    test_init();
+
+    p_vlc = libvlc_new( test_defaults_nargs, test_defaults_args );
+    assert( p_vlc != NULL );
+
+    p_buf = BuildStream( &i_size );
+
+    i_ret = Run( p_vlc->p_libvlc_int, p_buf, i_size, 0 );
+    if( i_ret == 0 )
+        i_ret = Run( p_vlc->p_libvlc_int, p_buf, i_size, 1 );
+
+    free( p_buf );
+    libvlc_release( p_vlc );
+    return i_ret;
+}
@@ -0,0 +1,158 @@
+/*****************************************************************************
+ * tls.c: TLS session resumption test
+ *****************************************************************************
+ * Copyright (C) 2015 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+/* Connects to a local HTTPS server again and again, with and without TLS
+ * session resumption, and compares the handshake rates. */
+
+#include "../../libvlc/test.h"
+#include "../lib/libvlc_internal.h"
+
+#include <vlc_common.h>
+#include <vlc_dialog.h>
+#include <vlc_httpd.h>
+#include <vlc_network.h>
+#include <vlc_tls.h>
+
+#define HANDSHAKES 30
+
+/* Accepts the self-signed test certificate */
+static int Question( vlc_object_t *obj, const char *var, vlc_value_t old,
+                     vlc_value_t cur, void *data )
+{
+    dialog_question_t *p_dialog = cur.p_address;
+
+    /* "View certificate", then "Accept 24 hours" */
+    p_dialog->answer = 2;
+    (void) obj; (void) var; (void) old; (void) data;
+    return VLC_SUCCESS;
+}
+
+static int Fill( httpd_file_sys_t *sys, httpd_file_t *file,
+                 uint8_t *psz_request, uint8_t **pp_data, int *pi_data )
+{
+    *pp_data = (uint8_t *)strdup( "ok" );
+    *pi_data = 2;
+    (void) sys; (void) file; (void) psz_request;
+    return VLC_SUCCESS;
+}
+
+/* Returns the duration of the handshake */
+static mtime_t Connect( vlc_object_t *obj, vlc_tls_creds_t *creds,
+                        int i_port )
+{
+    int fd = net_ConnectTCP( obj, "localhost", i_port );
+    assert( fd != -1 );
+
+    mtime_t i_start = mdate();
+    vlc_tls_t *tls = vlc_tls_ClientSessionCreate( creds, fd, "localhost",
+                                                  "https", NULL, NULL );
+    mtime_t i_duration = mdate() - i_start;
+    assert( tls != NULL );
+
+    vlc_tls_SessionDelete( tls );
+    net_Close( fd );
+    return i_duration;
+}
+
+static double Run( vlc_object_t *obj, vlc_tls_creds_t *creds, int i_port,
+                   bool b_resume )
+{
+    var_SetBool( obj, "gnutls-resumption", b_resume );
+    /* the first session is never resumed */
+    Connect( obj, creds, i_port );
+
+    mtime_t i_duration = 0;
+    for( unsigned i = 0; i < HANDSHAKES; i++ )
+        i_duration += Connect( obj, creds, i_port );
+    return (double)HANDSHAKES * CLOCK_FREQ / (i_duration + 1);
+}
+
+int main( void )
+{
+    libvlc_instance_t *p_vlc;
+    vlc_object_t *obj;
+    char psz_home[] = "/tmp/vlc-test-tls-XXXXXX";
+    int i_ret = 0;
+
+    test_init();
+
+    /* accepted certificates are stored in the home directory */
+    assert( mkdtemp( psz_home ) != NULL );
+    setenv( "HOME", psz_home, 1 );
+
+    p_vlc = libvlc_new( test_defaults_nargs, test_defaults_args );
+    assert( p_vlc != NULL );
+    obj = VLC_OBJECT(p_vlc->p_libvlc_int);
+
+    var_Create( obj, "dialog-question", VLC_VAR_ADDRESS );
+    var_AddCallback( obj, "dialog-question", Question, NULL );
+    assert( dialog_Register( obj ) == VLC_SUCCESS );
+
+    int i_port = 20000 + getpid() % 20000;
+    var_Create( obj, "http-host", VLC_VAR_STRING );
+    var_SetString( obj, "http-host", "localhost" );
+    var_Create( obj, "https-port", VLC_VAR_INTEGER );
+    var_SetInteger( obj, "https-port", i_port );
+    var_Create( obj, "http-cert", VLC_VAR_STRING );
+    var_SetString( obj, "http-cert", SRCDIR"/modules/misc/certkey.pem" );
+    var_Create( obj, "gnutls-resumption", VLC_VAR_BOOL );
+    /* TLS 1.3 tickets only come after the handshake, with application data,
+     * and this only measures handshakes */
+    var_Create( obj, "gnutls-priorities", VLC_VAR_STRING );
+    var_SetString( obj, "gnutls-priorities",
+                   "NORMAL:-VERS-TLS-ALL:+VERS-TLS1.2" );
+
+    httpd_host_t *host = vlc_https_HostNew( obj );
+    vlc_tls_creds_t *creds = vlc_tls_ClientCreate( obj );
+    httpd_file_t *file = NULL;
+    if( host == NULL || creds == NULL )
+    {
+        i_ret = 77; /* no TLS or HTTP server support */
+        goto out;
+    }
+
+    /* the server only accepts connections once it has something to serve */
+    file = httpd_FileNew( host, "/", "text/plain", NULL, NULL, Fill, NULL );
+    assert( file != NULL );
+
+    double f_full = Run( obj, creds, i_port, false );
+    double f_resumed = Run( obj, creds, i_port, true );
+    printf( "%.0f full handshakes/s, %.0f resumed handshakes/s\n",
+            f_full, f_resumed );
+
+out:
+    if( file != NULL )
+        httpd_FileDelete( file );
+    vlc_tls_Delete( creds );
+    if( host != NULL )
+        httpd_HostDelete( host );
+    dialog_Unregister( obj );
+    var_DelCallback( obj, "dialog-question", Question, NULL );
+    libvlc_release( p_vlc );
+
+    char psz_path[sizeof( psz_home ) + 32];
+    snprintf( psz_path, sizeof( psz_path ), "%s/.gnutls/known_hosts",
+              psz_home );
+    unlink( psz_path );
+    snprintf( psz_path, sizeof( psz_path ), "%s/.gnutls", psz_home );
+    rmdir( psz_path );
+    rmdir( psz_home );
+    return i_ret;
+}
@@ -0,0 +1,213 @@
+/*****************************************************************************
+ * csa.c: Common Scrambling Algorithm test
+ *****************************************************************************
+ * Copyright (C) 2015 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+/* Checks that batch (de)scrambling gives the same results as scrambling
+ * packets one at a time, and compares their speed. */
+
+#include "../../libvlc/test.h"
+#include "../lib/libvlc_internal.h"
+
+#include <vlc_common.h>
+#include "../modules/mux/mpeg/csa.c"
+
+/* The CSA code includes config.h again, which defines NDEBUG */
+#undef NDEBUG
+#include <assert.h>
+
+#define PACKETS 1000
+#define ROUNDS  20
+
+/* first payload bytes of a packet of 0x00..0xb7, scrambled with the even
+ * key 0x0123456789abcdef */
+static const uint8_t vector[16] =
+{
+    0x12, 0x7d, 0xeb, 0x94, 0xac, 0x72, 0xa4, 0x53,
+    0x85, 0x44, 0x40, 0x3f, 0x37, 0x0a, 0x8c, 0x79,
+};
+
+static uint8_t *BuildPackets( void )
+{
+    uint8_t *p_buf = malloc( PACKETS * 188 );
+
+    assert( p_buf != NULL );
+    srand( 42 );
+    for( unsigned i = 0; i < PACKETS; i++ )
+    {
+        uint8_t *p = &p_buf[188 * i];
+
+        for( unsigned j = 4; j < 188; j++ )
+            p[j] = rand();
+        p[0] = 0x47;
+        p[1] = 0x01;
+        p[2] = 0x00;
+        p[3] = 0x10 | (i & 0x0f);
+
+        /* adaptation fields of all sizes, leaving from 0 to 183 bytes
+         * of payload */
+        if( i % 3 == 0 )
+        {
+            p[3] |= 0x20;
+            p[4] = (i / 3) % 184;
+        }
+    }
+    return p_buf;
+}
+
+static void ScrambleOneByOne( csa_t *c, uint8_t *p_buf, bool b_encrypt )
+{
+    for( unsigned i = 0; i < PACKETS; i++ )
+    {
+        if( b_encrypt )
+        {
+            c->use_odd = i & 1;
+            csa_Encrypt( c, &p_buf[188 * i], 188 );
+        }
+        else
+            csa_Decrypt( c, &p_buf[188 * i], 188 );
+    }
+}
+
+static void ScrambleBatch( csa_t *c, uint8_t *p_buf, bool b_encrypt )
+{
+    uint8_t *pkts[PACKETS];
+
+    if( b_encrypt )
+    {
+        /* same key alternation as ScrambleOneByOne() */
+        for( unsigned i = 0; i < 2; i++ )
+        {
+            unsigned n = 0;
+
+            for( unsigned j = i; j < PACKETS; j += 2 )
+                pkts[n++] = &p_buf[188 * j];
+            c->use_odd = i;
+            csa_EncryptBatch( c, pkts, n, 188 );
+        }
+    }
+    else
+    {
+        for( unsigned i = 0; i < PACKETS; i++ )
+            pkts[i] = &p_buf[188 * i];
+        csa_DecryptBatch( c, pkts, PACKETS, 188 );
+    }
+}
+
+static void test_vector( csa_t *c )
+{
+    uint8_t pkt[188];
+
+    pkt[0] = 0x47;
+    pkt[1] = 0x01;
+    pkt[2] = 0x00;
+    pkt[3] = 0x10;
+    for( unsigned i = 4; i < 188; i++ )
+        pkt[i] = i - 4;
+
+    uint8_t *pkts[1] = { pkt };
+
+    c->use_odd = false;
+    csa_EncryptBatch( c, pkts, 1, 188 );
+    assert( pkt[3] == 0x90 );
+    assert( !memcmp( &pkt[4], vector, sizeof(vector) ) );
+
+    csa_DecryptBatch( c, pkts, 1, 188 );
+    assert( pkt[3] == 0x10 );
+    for( unsigned i = 4; i < 188; i++ )
+        assert( pkt[i] == i - 4 );
+}
+
+static void test_batch( csa_t *c )
+{
+    uint8_t *p_orig = BuildPackets();
+    uint8_t *p_ref = malloc( PACKETS * 188 );
+    uint8_t *p_buf = malloc( PACKETS * 188 );
+
+    assert( p_ref != NULL && p_buf != NULL );
+
+    memcpy( p_ref, p_orig, PACKETS * 188 );
+    memcpy( p_buf, p_orig, PACKETS * 188 );
+    ScrambleOneByOne( c, p_ref, true );
+    ScrambleBatch( c, p_buf, true );
+    assert( !memcmp( p_ref, p_buf, PACKETS * 188 ) );
+
+    ScrambleBatch( c, p_buf, false );
+    assert( !memcmp( p_orig, p_buf, PACKETS * 188 ) );
+
+    /* descrambling scrambled packets in a single batch, parities mixed */
+    ScrambleOneByOne( c, p_ref, false );
+    assert( !memcmp( p_orig, p_ref, PACKETS * 188 ) );
+
+    free( p_buf );
+    free( p_ref );
+    free( p_orig );
+}
+
+static void test_speed( csa_t *c )
+{
+    uint8_t *p_buf = BuildPackets();
+    mtime_t i_one = 0, i_batch = 0;
+
+    for( unsigned i = 0; i < ROUNDS; i++ )
+    {
+        ScrambleOneByOne( c, p_buf, true );
+
+        mtime_t i_start = mdate();
+        ScrambleOneByOne( c, p_buf, false );
+        i_one += mdate() - i_start;
+
+        ScrambleOneByOne( c, p_buf, true );
+
+        i_start = mdate();
+        ScrambleBatch( c, p_buf, false );
+        i_batch += mdate() - i_start;
+    }
+
+    printf( "descrambling: %.0f packets/s one by one, %.0f packets/s "
+            "in batches\n",
+            (double)PACKETS * ROUNDS * CLOCK_FREQ / (i_one + 1),
+            (double)PACKETS * ROUNDS * CLOCK_FREQ / (i_batch + 1) );
+    free( p_buf );
+}
+
+int main( void )
+{
+    libvlc_instance_t *p_vlc;
+    vlc_object_t *obj;
+    csa_t *c;
+
+    test_init();
+
+    p_vlc = libvlc_new( test_defaults_nargs, test_defaults_args );
+    assert( p_vlc != NULL );
+    obj = VLC_OBJECT(p_vlc->p_libvlc_int);
+
+    c = csa_New();
+    assert( c != NULL );
+    assert( csa_SetCW( obj, c, (char *)"0x0123456789abcdef", false ) == 0 );
+    assert( csa_SetCW( obj, c, (char *)"fedcba9876543210", true ) == 0 );
+
+    test_vector( c );
+    test_batch( c );
+    test_speed( c );
+
+    csa_Delete( c );
+    libvlc_release( p_vlc );
+    return 0;
+}
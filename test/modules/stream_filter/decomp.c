@@ -0,0 +1,332 @@
+/*****************************************************************************
+ * decomp.c: decompression stream filter test
+ *****************************************************************************
+ * Copyright (C) 2015 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+/* Compresses synthetic data made of two concatenated streams, then reads it
+ * back through the filter, sequentially, with seeks both ways, and
+ * truncated. Also closes the filter while its source blocks. */
+
+#include "../../libvlc/test.h"
+#include "../lib/libvlc_internal.h"
+
+#include <vlc_common.h>
+#include <vlc_stream.h>
+
+#include <unistd.h>
+
+#ifdef HAVE_ZLIB_H
+# include <zlib.h>
+#endif
+#ifdef HAVE_LIBBZ2
+# include <bzlib.h>
+#endif
+#ifdef HAVE_LIBLZMA
+# include <lzma.h>
+#endif
+
+#define LINE 16
+
+/* Decimal line numbers: compressible, and easy to check at any offset */
+static void Generate( uint8_t *p_buf, uint64_t i_pos, size_t i_len )
+{
+    while( i_len > 0 )
+    {
+        char psz_line[24];
+        size_t i_off = i_pos % LINE;
+        size_t i_copy = __MIN( LINE - i_off, i_len );
+
+        snprintf( psz_line, sizeof(psz_line), "%015"PRIu64"\n", i_pos / LINE );
+        memcpy( p_buf, psz_line + i_off, i_copy );
+        p_buf += i_copy;
+        i_pos += i_copy;
+        i_len -= i_copy;
+    }
+}
+
+static void Check( const uint8_t *p_buf, uint64_t i_pos, size_t i_len )
+{
+    uint8_t *p_ref = malloc( i_len );
+
+    assert( p_ref != NULL );
+    Generate( p_ref, i_pos, i_len );
+    assert( !memcmp( p_buf, p_ref, i_len ) );
+    free( p_ref );
+}
+
+typedef size_t (*compress_cb)( uint8_t *, size_t, const uint8_t *, size_t );
+
+#ifdef HAVE_ZLIB_H
+static size_t CompressGzip( uint8_t *p_out, size_t i_out,
+                            const uint8_t *p_in, size_t i_in )
+{
+    z_stream z = { .next_in = (Bytef *)p_in, .avail_in = i_in,
+                   .next_out = p_out, .avail_out = i_out };
+
+    assert( deflateInit2( &z, 6, Z_DEFLATED, MAX_WBITS + 16, 8,
+                          Z_DEFAULT_STRATEGY ) == Z_OK );
+    assert( deflate( &z, Z_FINISH ) == Z_STREAM_END );
+    deflateEnd( &z );
+    return i_out - z.avail_out;
+}
+#endif
+
+#ifdef HAVE_LIBBZ2
+static size_t CompressBzip2( uint8_t *p_out, size_t i_out,
+                             const uint8_t *p_in, size_t i_in )
+{
+    unsigned i_len = i_out;
+
+    assert( BZ2_bzBuffToBuffCompress( (char *)p_out, &i_len, (char *)p_in,
+                                      i_in, 1, 0, 0 ) == BZ_OK );
+    return i_len;
+}
+#endif
+
+#ifdef HAVE_LIBLZMA
+/* in blocks of 1 MiB, as multi-threaded xz does, so that seeks can resume
+ * within a stream */
+#define XZ_BLOCK (1 << 20)
+
+static size_t CompressXZ( uint8_t *p_out, size_t i_out,
+                          const uint8_t *p_in, size_t i_in )
+{
+    lzma_stream xz = LZMA_STREAM_INIT;
+
+    assert( lzma_easy_encoder( &xz, 0, LZMA_CHECK_CRC32 ) == LZMA_OK );
+    xz.next_out = p_out;
+    xz.avail_out = i_out;
+    for( size_t i_pos = 0; i_pos < i_in; i_pos += XZ_BLOCK )
+    {
+        xz.next_in = p_in + i_pos;
+        xz.avail_in = __MIN( XZ_BLOCK, i_in - i_pos );
+        assert( lzma_code( &xz, LZMA_FULL_FLUSH ) == LZMA_STREAM_END );
+    }
+    assert( lzma_code( &xz, LZMA_FINISH ) == LZMA_STREAM_END );
+    lzma_end( &xz );
+
+    size_t i_len = i_out - xz.avail_out;
+    /* stream padding */
+    memset( p_out + i_len, 0, 4 );
+    return i_len + 4;
+}
+#endif
+
+static stream_t *Open( vlc_object_t *obj, uint8_t *p_data, size_t i_size )
+{
+    char psz_url[] = "file:///tmp/vlc-test-decomp-XXXXXX";
+    char *psz_path = psz_url + 7;
+    int fd = mkstemp( psz_path );
+
+    assert( fd != -1 );
+    assert( write( fd, p_data, i_size ) == (ssize_t)i_size );
+    close( fd );
+
+    stream_t *p_source = stream_UrlNew( obj, psz_url );
+    assert( p_source != NULL );
+    unlink( psz_path );
+
+    stream_t *s = stream_FilterNew( p_source, "decomp" );
+    assert( s != NULL );
+    return s;
+}
+
+static void Test( vlc_object_t *obj, const char *psz_name,
+                  compress_cb pf_compress, uint64_t i_size )
+{
+    uint8_t *p_data = malloc( i_size );
+    uint8_t *p_comp = malloc( i_size + 65536 );
+    size_t i_comp;
+
+    assert( p_data != NULL && p_comp != NULL );
+    Generate( p_data, 0, i_size );
+    /* two concatenated streams */
+    i_comp = pf_compress( p_comp, i_size + 65536, p_data, i_size / 3 );
+    i_comp += pf_compress( p_comp + i_comp, i_size + 65536 - i_comp,
+                           p_data + i_size / 3, i_size - i_size / 3 );
+    free( p_data );
+
+    /* sequential read */
+    stream_t *s = Open( obj, p_comp, i_comp );
+    uint8_t *p_buf = malloc( 1 << 20 );
+    uint64_t i_pos = 0;
+    int i_read;
+
+    assert( p_buf != NULL );
+    mtime_t i_start, i_time = 0;
+    for( ;; )
+    {
+        i_start = mdate();
+        i_read = stream_Read( s, p_buf, 100000 );
+        i_time += mdate() - i_start;
+        if( i_read <= 0 )
+            break;
+        Check( p_buf, i_pos, i_read );
+        i_pos += i_read;
+    }
+    assert( i_pos == i_size );
+    assert( (uint64_t)stream_Size( s ) == i_size );
+
+    /* seeks, mostly backward */
+    static const double seeks[] = { .99, .5, .01, .75, .34, .33, .0, .9, };
+    mtime_t i_seek_time = 0;
+    for( size_t i = 0; i < sizeof(seeks) / sizeof(*seeks); i++ )
+    {
+        uint64_t i_offset = i_size * seeks[i];
+
+        i_start = mdate();
+        assert( stream_Seek( s, i_offset ) == VLC_SUCCESS );
+        assert( (uint64_t)stream_Tell( s ) == i_offset );
+        i_read = stream_Read( s, p_buf, 10000 );
+        i_seek_time += mdate() - i_start;
+        assert( i_read == (int)__MIN( 10000, i_size - i_offset ) );
+        Check( p_buf, i_offset, i_read );
+
+        /* peek across blocks, then skip within the peeked data */
+        const uint8_t *p_peek;
+        int i_peek = stream_Peek( s, &p_peek, 300000 );
+        assert( i_peek == (int)__MIN( 300000, i_size - i_offset - i_read ) );
+        Check( p_peek, i_offset + i_read, i_peek );
+        uint64_t i_skip = i_offset + i_read + i_peek / 2;
+        assert( stream_Seek( s, i_skip ) == VLC_SUCCESS );
+        i_read = stream_Read( s, p_buf, 1000 );
+        Check( p_buf, i_skip, i_read );
+    }
+    assert( stream_Seek( s, i_size ) == VLC_SUCCESS );
+    assert( stream_Read( s, p_buf, 1000 ) == 0 );
+    stream_Delete( s ); /* and its source */
+
+    printf( "%-5s %3"PRIu64" MiB from %5zu KiB: read in %4"PRId64" ms "
+            "(%4"PRIu64" MiB/s), %zu seeks in %4"PRId64" ms\n", psz_name,
+            i_size >> 20, i_comp >> 10, i_time / 1000,
+            (i_size * CLOCK_FREQ / __MAX(i_time, 1)) >> 20,
+            sizeof(seeks) / sizeof(*seeks), i_seek_time / 1000 );
+
+    /* truncated, and with trailing garbage */
+    s = Open( obj, p_comp, i_comp / 2 );
+    i_pos = 0;
+    while( (i_read = stream_Read( s, p_buf, 100000 )) > 0 )
+    {
+        Check( p_buf, i_pos, i_read );
+        i_pos += i_read;
+    }
+    assert( i_pos < i_size );
+    stream_Delete( s );
+
+    memset( p_comp + i_comp, 'x', 100 );
+    s = Open( obj, p_comp, i_comp + 100 );
+    assert( stream_Read( s, NULL, i_size ) == (int)i_size );
+    assert( stream_Read( s, p_buf, 1000 ) == 0 );
+    stream_Delete( s );
+
+    free( p_buf );
+    free( p_comp );
+}
+
+#ifdef HAVE_ZLIB_H
+struct writer
+{
+    int fd;
+    const uint8_t *p_data;
+    size_t i_size;
+};
+
+static void *Write( void *data )
+{
+    struct writer *w = data;
+
+    assert( write( w->fd, w->p_data, w->i_size ) == (ssize_t)w->i_size );
+    return NULL;
+}
+
+/* The decoder thread waits for more data from a pipe, as from a stalled
+ * network source: closing must not wait for it (test_init() sets an alarm) */
+static void TestBlocked( vlc_object_t *obj )
+{
+    const size_t i_size = 2 << 20;
+    uint8_t *p_data = malloc( i_size );
+    uint8_t *p_comp = malloc( i_size );
+    int fds[2];
+    char psz_url[16];
+
+    assert( p_data != NULL && p_comp != NULL );
+    Generate( p_data, 0, i_size );
+    size_t i_comp = CompressGzip( p_comp, i_size, p_data, i_size );
+
+    /* more than the filter reads at once, but less than its queue once
+     * inflated; the pipe then stays open and empty */
+    struct writer w = { .p_data = p_comp, .i_size = __MIN( i_comp, 131072 ) };
+    vlc_thread_t thread;
+
+    assert( pipe( fds ) == 0 );
+    w.fd = fds[1];
+    assert( vlc_clone( &thread, Write, &w, VLC_THREAD_PRIORITY_LOW ) == 0 );
+
+    snprintf( psz_url, sizeof(psz_url), "fd://%d", fds[0] );
+    stream_t *p_source = stream_UrlNew( obj, psz_url );
+    assert( p_source != NULL );
+    stream_t *s = stream_FilterNew( p_source, "decomp" );
+    assert( s != NULL );
+
+    uint8_t buf[LINE * 64];
+    assert( stream_Read( s, buf, sizeof(buf) ) == sizeof(buf) );
+    Check( buf, 0, sizeof(buf) );
+    vlc_join( thread, NULL );
+    msleep( CLOCK_FREQ / 10 ); /* let it reach the end of the pipe */
+
+    mtime_t i_start = mdate();
+    stream_Delete( s );
+    printf( "closed a blocked decoder in %"PRId64" ms\n",
+            (mdate() - i_start) / 1000 );
+
+    close( fds[1] );
+    close( fds[0] );
+    free( p_comp );
+    free( p_data );
+}
+#endif
+
+int main( void )
+{
+    libvlc_instance_t *p_vlc;
+    int i_ret = 77;
+
+    test_init();
+
+    p_vlc = libvlc_new( test_defaults_nargs, test_defaults_args );
+    assert( p_vlc != NULL );
+
+    vlc_object_t *obj = VLC_OBJECT(p_vlc->p_libvlc_int);
+    (void) obj;
+#ifdef HAVE_ZLIB_H
+    Test( obj, "gzip", CompressGzip, 24 << 20 );
+    TestBlocked( obj );
+    i_ret = 0;
+#endif
+#ifdef HAVE_LIBBZ2
+    Test( obj, "bzip2", CompressBzip2, 4 << 20 );
+    i_ret = 0;
+#endif
+#ifdef HAVE_LIBLZMA
+    Test( obj, "xz", CompressXZ, 24 << 20 );
+    i_ret = 0;
+#endif
+
+    libvlc_release( p_vlc );
+    return i_ret;
+}
@@ -0,0 +1,297 @@
+/*****************************************************************************
+ * httplive.c: HTTP Live Streaming stream filter test
+ *****************************************************************************
+ * Copyright (C) 2015 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+/* Plays a playlist served by a local HTTP/1.1 server which delays every
+ * response, and checks that the segments are downloaded in parallel,
+ * delivered in order, and over reused connections. */
+
+#include "../../libvlc/test.h"
+#include "../lib/libvlc_internal.h"
+
+#include <vlc_common.h>
+#include <vlc_stream.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define SEGMENTS        24
+#define SEGMENT_SIZE    (100 * 1000 + 17)
+#define LATENCY         (CLOCK_FREQ / 10)
+#define MAX_CONNS       32
+
+static struct
+{
+    int fd;
+    vlc_mutex_t lock;
+    unsigned connections;
+    unsigned requests;
+    unsigned active;
+    unsigned max_active;
+    unsigned count;
+    vlc_thread_t threads[MAX_CONNS];
+    int conns[MAX_CONNS];
+} server;
+
+static uint8_t Byte( unsigned i_segment, uint64_t i_pos )
+{
+    return i_pos ^ (i_pos >> 11) ^ (i_segment * 31);
+}
+
+static char *GetLine( int fd )
+{
+    char *psz = malloc( 1024 );
+    size_t i_len = 0;
+
+    assert( psz != NULL );
+    while( i_len < 1023 && recv( fd, &psz[i_len], 1, 0 ) == 1 )
+    {
+        if( psz[i_len] == '\n' )
+        {
+            if( i_len > 0 && psz[i_len - 1] == '\r' )
+                i_len--;
+            psz[i_len] = '\0';
+            return psz;
+        }
+        i_len++;
+    }
+    free( psz );
+    return NULL;
+}
+
+static bool Send( int fd, const void *p_data, size_t i_data )
+{
+    return send( fd, p_data, i_data, MSG_NOSIGNAL ) == (ssize_t)i_data;
+}
+
+static char *Playlist( void )
+{
+    char *psz;
+    size_t i_size;
+    FILE *stream = open_memstream( &psz, &i_size );
+
+    assert( stream != NULL );
+    fputs( "#EXTM3U\n#EXT-X-TARGETDURATION:2\n#EXT-X-MEDIA-SEQUENCE:0\n",
+           stream );
+    for( unsigned i = 0; i < SEGMENTS; i++ )
+        fprintf( stream, "#EXTINF:2,\nsegment%u.ts\n", i );
+    fputs( "#EXT-X-ENDLIST\n", stream );
+    fclose( stream );
+    return psz;
+}
+
+/* Serves requests on one connection until the client closes it */
+static void *Serve( void *data )
+{
+    int fd = (intptr_t)data;
+    char *psz;
+
+    while( (psz = GetLine( fd )) != NULL )
+    {
+        unsigned i_segment;
+        uint64_t i_start = 0;
+        bool b_playlist = !strncmp( psz, "GET /index.m3u8 ", 16 );
+
+        bool b_segment = !b_playlist &&
+                         sscanf( psz, "GET /segment%u.ts ", &i_segment ) == 1;
+        assert( b_playlist || b_segment );
+        free( psz );
+        while( (psz = GetLine( fd )) != NULL && *psz )
+        {
+            sscanf( psz, "Range: bytes=%"SCNu64"-", &i_start );
+            free( psz );
+        }
+        if( psz == NULL )
+            break;
+        free( psz );
+
+        vlc_mutex_lock( &server.lock );
+        server.requests++;
+        if( ++server.active > server.max_active )
+            server.max_active = server.active;
+        vlc_mutex_unlock( &server.lock );
+
+        /* a far away server */
+        mwait( mdate() + LATENCY );
+
+        char *psz_body = b_playlist ? Playlist() : NULL;
+        uint64_t i_size = b_playlist ? strlen( psz_body ) : SEGMENT_SIZE;
+        char *psz_header;
+        int i_header = asprintf( &psz_header, "HTTP/1.1 %s\r\n"
+            "Content-Length: %"PRIu64"\r\n"
+            "Content-Range: bytes %"PRIu64"-%"PRIu64"/%"PRIu64"\r\n"
+            "Accept-Ranges: bytes\r\n\r\n",
+            i_start ? "206 Partial Content" : "200 OK",
+            i_size - i_start, i_start, i_size - 1, i_size );
+        assert( i_header >= 0 );
+        bool b_ok = Send( fd, psz_header, i_header );
+        free( psz_header );
+
+        if( b_playlist )
+        {
+            b_ok = b_ok && Send( fd, psz_body + i_start, i_size - i_start );
+            free( psz_body );
+        }
+
+        uint8_t p_buf[8192];
+        for( uint64_t i_pos = i_start; b_ok && !b_playlist && i_pos < i_size; )
+        {
+            size_t i_len = __MIN( sizeof(p_buf), i_size - i_pos );
+            for( size_t i = 0; i < i_len; i++ )
+                p_buf[i] = Byte( i_segment, i_pos + i );
+            b_ok = Send( fd, p_buf, i_len );
+            i_pos += i_len;
+        }
+
+        vlc_mutex_lock( &server.lock );
+        server.active--;
+        vlc_mutex_unlock( &server.lock );
+        if( !b_ok )
+            break; /* the client gave up on the response */
+    }
+    shutdown( fd, SHUT_RDWR );
+    return NULL;
+}
+
+static void *Listen( void *data )
+{
+    int fd;
+
+    (void) data;
+    while( (fd = accept( server.fd, NULL, NULL )) != -1 )
+    {
+        vlc_mutex_lock( &server.lock );
+        assert( server.count < MAX_CONNS );
+        server.conns[server.count] = fd;
+        assert( vlc_clone( &server.threads[server.count], Serve,
+                           (void *)(intptr_t)fd,
+                           VLC_THREAD_PRIORITY_LOW ) == 0 );
+        server.count++;
+        server.connections++;
+        vlc_mutex_unlock( &server.lock );
+    }
+    return NULL;
+}
+
+/* Reads the whole stream, checks it and returns the maximum number of
+ * requests served at the same time */
+static int Play( vlc_object_t *obj, const char *psz_url, unsigned i_parallel )
+{
+    var_SetInteger( obj, "hls-parallel", i_parallel );
+
+    vlc_mutex_lock( &server.lock );
+    server.connections = server.requests = server.max_active = 0;
+    vlc_mutex_unlock( &server.lock );
+
+    stream_t *p_source = stream_UrlNew( obj, psz_url );
+    assert( p_source != NULL );
+
+    mtime_t i_start = mdate();
+    stream_t *s = stream_FilterNew( p_source, "httplive" );
+    if( s == NULL )
+    {
+        stream_Delete( p_source );
+        return -1;
+    }
+
+    uint8_t *p_buf = malloc( SEGMENT_SIZE );
+    uint64_t i_pos = 0;
+    int i_read;
+
+    assert( p_buf != NULL );
+    while( (i_read = stream_Read( s, p_buf, SEGMENT_SIZE )) > 0 )
+    {
+        for( int i = 0; i < i_read; i++, i_pos++ )
+            assert( p_buf[i] == Byte( i_pos / SEGMENT_SIZE,
+                                      i_pos % SEGMENT_SIZE ) );
+    }
+    assert( i_pos == (uint64_t)SEGMENTS * SEGMENT_SIZE );
+    free( p_buf );
+
+    stream_Delete( s ); /* and its source */
+
+    vlc_mutex_lock( &server.lock );
+    printf( "%u parallel: %"PRId64" ms, %u requests over %u connections, "
+            "%u at most at once\n", i_parallel, (mdate() - i_start) / 1000,
+            server.requests, server.connections, server.max_active );
+    assert( server.connections < server.requests );
+    int i_max = server.max_active;
+    vlc_mutex_unlock( &server.lock );
+    return i_max;
+}
+
+int main( void )
+{
+    libvlc_instance_t *p_vlc;
+    vlc_object_t *obj;
+    vlc_thread_t listener;
+    char psz_url[64];
+
+    test_init();
+
+    vlc_mutex_init( &server.lock );
+    server.fd = socket( AF_INET, SOCK_STREAM, 0 );
+    assert( server.fd != -1 );
+
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_addr.s_addr = htonl( INADDR_LOOPBACK ),
+    };
+    socklen_t addrlen = sizeof(addr);
+    assert( bind( server.fd, (struct sockaddr *)&addr, sizeof(addr) ) == 0 );
+    assert( listen( server.fd, 8 ) == 0 );
+    assert( getsockname( server.fd, (struct sockaddr *)&addr,
+                         &addrlen ) == 0 );
+    snprintf( psz_url, sizeof(psz_url), "http://127.0.0.1:%u/index.m3u8",
+              ntohs( addr.sin_port ) );
+    assert( vlc_clone( &listener, Listen, NULL,
+                       VLC_THREAD_PRIORITY_LOW ) == 0 );
+
+    p_vlc = libvlc_new( test_defaults_nargs, test_defaults_args );
+    assert( p_vlc != NULL );
+    obj = VLC_OBJECT(p_vlc->p_libvlc_int);
+    var_Create( obj, "hls-parallel", VLC_VAR_INTEGER );
+
+    int i_ret = 0;
+    int i_max = Play( obj, psz_url, 1 );
+    if( i_max < 0 )
+        i_ret = 77; /* no HLS support */
+    else
+    {
+        assert( i_max == 1 );
+        i_max = Play( obj, psz_url, 3 );
+        assert( i_max >= 2 && i_max <= 3 );
+    }
+
+    libvlc_release( p_vlc );
+
+    shutdown( server.fd, SHUT_RDWR );
+    vlc_join( listener, NULL );
+    for( unsigned i = 0; i < server.count; i++ )
+    {
+        shutdown( server.conns[i], SHUT_RDWR );
+        vlc_join( server.threads[i], NULL );
+        close( server.conns[i] );
+    }
+    close( server.fd );
+    vlc_mutex_destroy( &server.lock );
+    return i_ret;
+}
@@ -0,0 +1,249 @@
+/*****************************************************************************
+ * timeshift.c: es_out timeshift test
+ *****************************************************************************
+ * Copyright (C) 2015 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+/* Pauses a live input to record blocks in the timeshift buffer, reports the
+ * write throughput, then checks the blocks played back, with and without a
+ * size limit, with blocks bigger than the files and after a seek in the
+ * buffer. */
+
+#include "../../libvlc/test.h"
+#include "../lib/libvlc_internal.h"
+
+#include "../../../src/input/es_out_timeshift.c"
+
+/* The timeshift code includes config.h again, which defines NDEBUG */
+#undef NDEBUG
+#include <assert.h>
+
+#define BLOCK_SIZE 32768
+#define PCR_PERIOD 64
+#define INPUT_TIME (10 * CLOCK_FREQ)
+
+/* Only called on rate changes */
+void input_ControlPush( input_thread_t *p_input, int i_type, vlc_value_t *p_val )
+{
+    (void) p_input; (void) i_type; (void) p_val;
+}
+
+/* Output receiving the blocks played back */
+static struct
+{
+    vlc_mutex_t lock;
+    size_t      i_size;     /* Size of the blocks */
+    uint64_t    i_next;     /* Sequence number of the next block expected */
+    unsigned    i_blocks;
+    unsigned    i_gaps;
+    unsigned    i_resets;
+} sink;
+
+static es_out_id_t *SinkAdd( es_out_t *out, const es_format_t *fmt )
+{
+    (void) fmt;
+    return (es_out_id_t *)out;
+}
+
+static int SinkSend( es_out_t *out, es_out_id_t *id, block_t *p_block )
+{
+    uint64_t i_seq;
+
+    (void) out; (void) id;
+    assert( p_block->i_buffer == sink.i_size );
+    memcpy( &i_seq, p_block->p_buffer, sizeof(i_seq) );
+    assert( p_block->i_dts == (mtime_t)i_seq && p_block->i_pts == (mtime_t)i_seq );
+    for( size_t i = sizeof(i_seq); i < p_block->i_buffer; i++ )
+        assert( p_block->p_buffer[i] == (uint8_t)(i_seq + i) );
+    block_Release( p_block );
+
+    vlc_mutex_lock( &sink.lock );
+    assert( i_seq >= sink.i_next );
+    if( i_seq > sink.i_next )
+        sink.i_gaps++;
+    sink.i_next = i_seq + 1;
+    sink.i_blocks++;
+    vlc_mutex_unlock( &sink.lock );
+    return VLC_SUCCESS;
+}
+
+static void SinkDel( es_out_t *out, es_out_id_t *id )
+{
+    (void) out; (void) id;
+}
+
+static int SinkControl( es_out_t *out, int i_query, va_list args )
+{
+    (void) out;
+    switch( i_query )
+    {
+        case ES_OUT_GET_BUFFERING:
+            *va_arg( args, bool * ) = false;
+            return VLC_SUCCESS;
+        case ES_OUT_SET_TIME:
+            vlc_mutex_lock( &sink.lock );
+            sink.i_resets++;
+            vlc_mutex_unlock( &sink.lock );
+            return VLC_SUCCESS;
+        case ES_OUT_SET_PAUSE_STATE:
+        case ES_OUT_SET_PCR:
+            return VLC_SUCCESS;
+    }
+    return VLC_EGENERIC;
+}
+
+static es_out_t sink_out = {
+    .pf_add = SinkAdd,
+    .pf_send = SinkSend,
+    .pf_del = SinkDel,
+    .pf_control = SinkControl,
+};
+
+static void Record( es_out_t *out, es_out_id_t *es, unsigned i_count,
+                    size_t i_size )
+{
+    for( uint64_t i_seq = 0; i_seq < i_count; i_seq++ )
+    {
+        block_t *p_block = block_Alloc( i_size );
+
+        assert( p_block != NULL );
+        memcpy( p_block->p_buffer, &i_seq, sizeof(i_seq) );
+        for( size_t i = sizeof(i_seq); i < i_size; i++ )
+            p_block->p_buffer[i] = i_seq + i;
+        p_block->i_dts = p_block->i_pts = i_seq;
+        assert( es_out_Send( out, es, p_block ) == VLC_SUCCESS );
+        if( i_seq % PCR_PERIOD == 0 )
+            es_out_Control( out, ES_OUT_SET_PCR, (int64_t)i_seq );
+    }
+}
+
+/* Records while paused, then plays back everything left, i_seek ahead if
+ * not negative */
+static void Test( vlc_object_t *obj, const char *psz_name,
+                  int64_t i_granularity, int64_t i_size, unsigned i_count,
+                  size_t i_block, int64_t i_seek )
+{
+    input_thread_t *p_input = vlc_object_create( obj, sizeof(*p_input) );
+    assert( p_input != NULL );
+    p_input->p = calloc( 1, sizeof(*p_input->p) );
+    assert( p_input->p != NULL );
+    p_input->p->b_can_pace_control = false; /* live */
+
+    var_Create( p_input, "input-timeshift-granularity", VLC_VAR_INTEGER );
+    var_SetInteger( p_input, "input-timeshift-granularity", i_granularity );
+    var_Create( p_input, "input-timeshift-size", VLC_VAR_INTEGER );
+    var_SetInteger( p_input, "input-timeshift-size", i_size );
+    /* Seeks are relative to the time being played */
+    var_Create( p_input, "time", VLC_VAR_TIME );
+    var_SetTime( p_input, "time", INPUT_TIME );
+
+    vlc_mutex_lock( &sink.lock );
+    sink.i_size = i_block;
+    sink.i_next = 0;
+    sink.i_blocks = sink.i_gaps = sink.i_resets = 0;
+    vlc_mutex_unlock( &sink.lock );
+
+    es_out_t *out = input_EsOutTimeshiftNew( p_input, &sink_out,
+                                             INPUT_RATE_DEFAULT );
+    assert( out != NULL );
+
+    es_format_t fmt;
+    es_format_Init( &fmt, VIDEO_ES, VLC_CODEC_H264 );
+    es_out_id_t *es = es_out_Add( out, &fmt );
+    assert( es != NULL );
+
+    assert( es_out_SetPauseState( out, false, true, mdate() ) == VLC_SUCCESS );
+    mtime_t i_start = mdate();
+    Record( out, es, i_count, i_block );
+    mtime_t i_time = mdate() - i_start;
+
+    printf( "%-9s %4u MiB recorded in %4"PRId64" ms (%5"PRId64" MiB/s)\n",
+            psz_name, (unsigned)((uint64_t)i_count * i_block >> 20),
+            i_time / 1000, ((int64_t)i_count * i_block * CLOCK_FREQ /
+                            __MAX(i_time, 1)) >> 20 );
+
+    if( i_seek >= 0 )
+    {
+        i_start = mdate();
+        assert( es_out_SetTime( out, INPUT_TIME + i_seek ) == VLC_SUCCESS );
+        printf( "%-9s seeked in %"PRId64" us\n", psz_name, mdate() - i_start );
+
+        /* The data skipped or played is not kept */
+        assert( es_out_SetTime( out, INPUT_TIME - 1 ) == VLC_EGENERIC );
+    }
+
+    assert( es_out_SetPauseState( out, false, false, mdate() ) == VLC_SUCCESS );
+    for( ;; )
+    {
+        vlc_mutex_lock( &sink.lock );
+        bool b_done = sink.i_next == i_count;
+        vlc_mutex_unlock( &sink.lock );
+        if( b_done )
+            break;
+        msleep( CLOCK_FREQ / 100 );
+    }
+
+    es_out_Del( out, es );
+    es_out_Delete( out );
+
+    vlc_mutex_lock( &sink.lock );
+    printf( "%-9s %4u blocks played back, %u gaps, %u resets\n",
+            psz_name, sink.i_blocks, sink.i_gaps, sink.i_resets );
+    if( i_seek >= 0 )
+    {
+        /* The reference follows the block of the same time */
+        assert( sink.i_blocks == i_count - i_seek - 1 );
+        assert( sink.i_resets == 1 && sink.i_gaps == 1 );
+    }
+    else if( i_size <= 0 )
+    {
+        assert( sink.i_blocks == i_count );
+        assert( sink.i_resets == 0 );
+    }
+    else
+    {
+        /* Only about the last i_size bytes are kept */
+        assert( sink.i_resets > 0 && sink.i_gaps > 0 );
+        assert( (int64_t)sink.i_blocks * (int64_t)i_block <= i_size );
+        assert( (int64_t)sink.i_blocks * (int64_t)i_block >= i_size / 2 );
+    }
+    vlc_mutex_unlock( &sink.lock );
+
+    free( p_input->p );
+    vlc_object_release( p_input );
+}
+
+int main( void )
+{
+    libvlc_instance_t *p_vlc;
+
+    test_init();
+
+    p_vlc = libvlc_new( test_defaults_nargs, test_defaults_args );
+    assert( p_vlc != NULL );
+    vlc_mutex_init( &sink.lock );
+
+    vlc_object_t *obj = VLC_OBJECT(p_vlc->p_libvlc_int);
+    Test( obj, "unlimited", 16 << 20, 0, 4096, BLOCK_SIZE, -1 );
+    Test( obj, "limited", 1 << 20, 4 << 20, 1024, BLOCK_SIZE, -1 );
+    Test( obj, "oversized", 1 << 20, 0, 64, 3 << 19, -1 );
+    Test( obj, "seek", 1 << 20, 0, 1024, BLOCK_SIZE, 8 * PCR_PERIOD );
+
+    vlc_mutex_destroy( &sink.lock );
+    libvlc_release( p_vlc );
+    return 0;
+}